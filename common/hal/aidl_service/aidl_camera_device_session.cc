@@ -463,6 +463,11 @@ void AidlCameraDeviceSession::SetSessionCallbacks() {
       .unregister_thermal_changed_callback =
           google_camera_hal::UnregisterThermalChangedCallbackFunc(
               [this]() { UnregisterThermalChangedCallback(); }),
+      .get_current_temperatures = google_camera_hal::GetCurrentTemperaturesFunc(
+          [this](bool filter_type, google_camera_hal::TemperatureType type,
+                 std::vector<google_camera_hal::Temperature>* temperatures) {
+            return GetCurrentTemperatures(filter_type, type, temperatures);
+          }),
   };
 
   device_session_->SetSessionCallback(session_callback, thermal_callback);
@@ -535,6 +540,58 @@ void AidlCameraDeviceSession::UnregisterThermalChangedCallback() {
   thermal_changed_callback_ = nullptr;
 }
 
+status_t AidlCameraDeviceSession::GetCurrentTemperatures(
+    bool filter_type, google_camera_hal::TemperatureType type,
+    std::vector<google_camera_hal::Temperature>* temperatures) {
+  if (temperatures == nullptr) {
+    ALOGE("%s: temperatures is nullptr", __FUNCTION__);
+    return BAD_VALUE;
+  }
+
+  std::lock_guard<std::mutex> lock(aidl_thermal_mutex_);
+  if (thermal_ == nullptr) {
+    ALOGE("%s: thermal was not initialized.", __FUNCTION__);
+    return NO_INIT;
+  }
+
+  std::vector<Temperature> aidl_temperatures;
+  ndk::ScopedAStatus status;
+  if (filter_type) {
+    TemperatureType aidl_type = TemperatureType::UNKNOWN;
+    status_t res =
+        aidl_thermal_utils::ConvertToAidlTemperatureType(type, &aidl_type);
+    if (res != OK) {
+      ALOGE("%s: Converting to AIDL type failed: %s(%d)", __FUNCTION__,
+            strerror(-res), res);
+      return res;
+    }
+    status = thermal_->getTemperaturesWithType(aidl_type, &aidl_temperatures);
+  } else {
+    status = thermal_->getTemperatures(&aidl_temperatures);
+  }
+  if (!status.isOk()) {
+    ALOGE("%s: Getting temperatures failed: %s", __FUNCTION__,
+          status.getMessage());
+    return UNKNOWN_ERROR;
+  }
+
+  temperatures->clear();
+  for (auto& aidl_temperature : aidl_temperatures) {
+    google_camera_hal::Temperature temperature;
+    status_t res =
+        aidl_thermal_utils::ConvertToHalTemperature(aidl_temperature,
+                                                    &temperature);
+    if (res != OK) {
+      ALOGW("%s: Skipping temperature %s: %s(%d)", __FUNCTION__,
+            aidl_temperature.name.c_str(), strerror(-res), res);
+      continue;
+    }
+    temperatures->push_back(std::move(temperature));
+  }
+
+  return OK;
+}
+
 status_t AidlCameraDeviceSession::CreateMetadataQueue(
     std::unique_ptr<MetadataQueue>* metadata_queue, uint32_t default_size_bytes,
     const char* override_size_property) {
@@ -193,6 +193,14 @@ class AidlCameraDeviceSession
   // Unregister thermal changed callback.
   void UnregisterThermalChangedCallback();
 
+  // Get the current temperatures.
+  // If filter_type is false, type will be ignored and all types will be
+  // returned.
+  // If filter_type is true, only temperatures of type will be returned.
+  status_t GetCurrentTemperatures(
+      bool filter_type, google_camera_hal::TemperatureType type,
+      std::vector<google_camera_hal::Temperature>* temperatures);
+
   // Log when the first frame buffers are all received.
   void TryLogFirstFrameDone(const google_camera_hal::CaptureResult& result,
                             const char* caller_func_name);
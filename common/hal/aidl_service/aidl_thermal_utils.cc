@@ -87,7 +87,7 @@ status_t ConvertToAidlTemperatureType(
   return OK;
 }
 
-status_t ThermalChangedCallback::ConvertToHalTemperatureType(
+status_t ConvertToHalTemperatureType(
     const TemperatureType& aidl_temperature_type,
     google_camera_hal::TemperatureType* hal_temperature_type) {
   if (hal_temperature_type == nullptr) {
@@ -139,7 +139,7 @@ status_t ThermalChangedCallback::ConvertToHalTemperatureType(
   return OK;
 }
 
-status_t ThermalChangedCallback::ConvertToHalThrottlingSeverity(
+status_t ConvertToHalThrottlingSeverity(
     const ThrottlingSeverity& aidl_throttling_severity,
     google_camera_hal::ThrottlingSeverity* hal_throttling_severity) {
   if (hal_throttling_severity == nullptr) {
@@ -182,7 +182,7 @@ status_t ThermalChangedCallback::ConvertToHalThrottlingSeverity(
   return OK;
 }
 
-status_t ThermalChangedCallback::ConvertToHalTemperature(
+status_t ConvertToHalTemperature(
     const Temperature& aidl_temperature,
     google_camera_hal::Temperature* hal_temperature) {
   if (hal_temperature == nullptr) {
@@ -43,26 +43,26 @@ class ThermalChangedCallback
 
  private:
   const google_camera_hal::NotifyThrottlingFunc notify_throttling_;
-
-  status_t ConvertToHalTemperatureType(
-      const aidl::android::hardware::thermal::TemperatureType&
-          aidl_temperature_type,
-      google_camera_hal::TemperatureType* hal_temperature_type);
-
-  status_t ConvertToHalThrottlingSeverity(
-      const aidl::android::hardware::thermal::ThrottlingSeverity&
-          aidl_throttling_severity,
-      google_camera_hal::ThrottlingSeverity* hal_throttling_severity);
-
-  status_t ConvertToHalTemperature(
-      const aidl::android::hardware::thermal::Temperature& aidl_temperature,
-      google_camera_hal::Temperature* hal_temperature);
 };
 
 status_t ConvertToAidlTemperatureType(
     const google_camera_hal::TemperatureType& hal_temperature_type,
     aidl::android::hardware::thermal::TemperatureType* aidl_temperature_type);
 
+status_t ConvertToHalTemperatureType(
+    const aidl::android::hardware::thermal::TemperatureType&
+        aidl_temperature_type,
+    google_camera_hal::TemperatureType* hal_temperature_type);
+
+status_t ConvertToHalThrottlingSeverity(
+    const aidl::android::hardware::thermal::ThrottlingSeverity&
+        aidl_throttling_severity,
+    google_camera_hal::ThrottlingSeverity* hal_throttling_severity);
+
+status_t ConvertToHalTemperature(
+    const aidl::android::hardware::thermal::Temperature& aidl_temperature,
+    google_camera_hal::Temperature* hal_temperature);
+
 }  // namespace aidl_thermal_utils
 }  // namespace hardware
 }  // namespace android
@@ -22,6 +22,7 @@
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <vector>
 
 namespace android {
 namespace google_camera_hal {
@@ -77,6 +78,13 @@ using RegisterThermalChangedCallbackFunc =
 // Unregister the thermal callback.
 using UnregisterThermalChangedCallbackFunc = std::function<void()>;
 
+// Get the current temperatures.
+// If filter_type is true, only temperatures of type will be returned. If
+// filter_type is false, type will be ignored and all types will be returned.
+using GetCurrentTemperaturesFunc = std::function<status_t(
+    bool /*filter_type*/, TemperatureType /*type*/,
+    std::vector<Temperature>* /*temperatures*/)>;
+
 }  // namespace google_camera_hal
 }  // namespace android
 
@@ -50,6 +50,7 @@ enum VendorTagIds : uint32_t {
   kVideoSwDenoiseEnabled,
   kVideo60to30FPSThermalThrottle,
   kVideoFpsThrottle,
+  kThermalThrottlingLevel,
   // This should not be used as a vendor tag ID on its own, but as a placeholder
   // to indicate the end of currently defined vendor tag IDs
   kEndMarker
@@ -257,6 +258,17 @@ static const std::vector<VendorTag> kInternalVendorTags = {
     {.tag_id = VendorTagIds::kVideoFpsThrottle,
      .tag_name = "VideoFpsThrottle",
      .tag_type = CameraMetadataType::kByte},
+    // Thermal throttling level
+    //
+    // Indicates the graduated thermal mitigation level of the session, from
+    // 0 (none) to 3 (severe). Unlike thermal_throttling, it goes back down
+    // when the device cools down.
+    //
+    // Present in: request
+    // Payload: 1 byte ThermalLevel
+    {.tag_id = VendorTagIds::kThermalThrottlingLevel,
+     .tag_name = "thermal_throttling_level",
+     .tag_type = CameraMetadataType::kByte},
 };
 
 // Google Camera HAL vendor tag sections
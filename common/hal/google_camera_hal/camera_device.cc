@@ -122,6 +122,8 @@ constexpr char kExternalCaptureSessionDir[] =
 #endif
 #endif
 
+std::atomic<uint32_t> CameraDevice::device_state_generation_ = 0;
+
 std::unique_ptr<CameraDevice> CameraDevice::Create(
     std::unique_ptr<CameraDeviceHwl> camera_device_hwl,
     CameraBufferAllocatorHwl* camera_allocator_hwl,
@@ -203,17 +205,54 @@ status_t CameraDevice::GetResourceCost(CameraResourceCost* cost) {
   return camera_device_hwl_->GetResourceCost(cost);
 }
 
+void CameraDevice::NotifyDeviceStateChange() {
+  device_state_generation_++;
+}
+
+void CameraDevice::InvalidateStaleCharacteristicsLocked() {
+  uint32_t generation = device_state_generation_.load();
+  if (characteristics_generation_ != generation) {
+    characteristics_.reset();
+    physical_characteristics_.clear();
+    characteristics_generation_ = generation;
+  }
+}
+
 status_t CameraDevice::GetCameraCharacteristics(
     std::unique_ptr<HalCameraMetadata>* characteristics) {
   ATRACE_CALL();
-  status_t res = camera_device_hwl_->GetCameraCharacteristics(characteristics);
-  if (res != OK) {
-    ALOGE("%s: GetCameraCharacteristics() failed: %s (%d).", __FUNCTION__,
-          strerror(-res), res);
-    return res;
+  if (characteristics == nullptr) {
+    ALOGE("%s: characteristics is nullptr", __FUNCTION__);
+    return BAD_VALUE;
   }
 
-  return hal_vendor_tag_utils::ModifyCharacteristicsKeys(characteristics->get());
+  std::lock_guard<std::mutex> lock(characteristics_lock_);
+  InvalidateStaleCharacteristicsLocked();
+  if (characteristics_ == nullptr) {
+    std::unique_ptr<HalCameraMetadata> finalized;
+    status_t res = camera_device_hwl_->GetCameraCharacteristics(&finalized);
+    if (res != OK) {
+      ALOGE("%s: GetCameraCharacteristics() failed: %s (%d).", __FUNCTION__,
+            strerror(-res), res);
+      return res;
+    }
+
+    res = hal_vendor_tag_utils::ModifyCharacteristicsKeys(finalized.get());
+    if (res != OK) {
+      ALOGE("%s: Modifying characteristics keys failed: %s (%d).",
+            __FUNCTION__, strerror(-res), res);
+      return res;
+    }
+    characteristics_ = std::move(finalized);
+  }
+
+  *characteristics = HalCameraMetadata::Clone(characteristics_.get());
+  if (*characteristics == nullptr) {
+    ALOGE("%s: Cloning characteristics failed.", __FUNCTION__);
+    return NO_MEMORY;
+  }
+
+  return OK;
 }
 
 // Populates the required session characteristics keys from a camera
@@ -289,15 +328,38 @@ status_t CameraDevice::GetPhysicalCameraCharacteristics(
     uint32_t physical_camera_id,
     std::unique_ptr<HalCameraMetadata>* characteristics) {
   ATRACE_CALL();
-  status_t res = camera_device_hwl_->GetPhysicalCameraCharacteristics(
-      physical_camera_id, characteristics);
-  if (res != OK) {
-    ALOGE("%s: GetPhysicalCameraCharacteristics() failed: %s (%d).",
-          __FUNCTION__, strerror(-res), res);
-    return res;
+  if (characteristics == nullptr) {
+    ALOGE("%s: characteristics is nullptr", __FUNCTION__);
+    return BAD_VALUE;
   }
 
-  return hal_vendor_tag_utils::ModifyCharacteristicsKeys(characteristics->get());
+  std::lock_guard<std::mutex> lock(characteristics_lock_);
+  InvalidateStaleCharacteristicsLocked();
+  auto& cached = physical_characteristics_[physical_camera_id];
+  if (cached == nullptr) {
+    std::unique_ptr<HalCameraMetadata> finalized;
+    status_t res = camera_device_hwl_->GetPhysicalCameraCharacteristics(
+        physical_camera_id, &finalized);
+    if (res == OK) {
+      res = hal_vendor_tag_utils::ModifyCharacteristicsKeys(finalized.get());
+    }
+    if (res != OK) {
+      ALOGE("%s: GetPhysicalCameraCharacteristics() failed: %s (%d).",
+            __FUNCTION__, strerror(-res), res);
+      physical_characteristics_.erase(physical_camera_id);
+      return res;
+    }
+    cached = std::move(finalized);
+  }
+
+  *characteristics = HalCameraMetadata::Clone(cached.get());
+  if (*characteristics == nullptr) {
+    ALOGE("%s: Cloning physical camera %u characteristics failed.",
+          __FUNCTION__, physical_camera_id);
+    return NO_MEMORY;
+  }
+
+  return OK;
 }
 
 status_t CameraDevice::SetTorchMode(TorchMode mode) {
@@ -17,7 +17,9 @@
 #ifndef HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_CAMERA_DEVICE_H_
 #define HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_CAMERA_DEVICE_H_
 
+#include <atomic>
 #include <map>
+#include <mutex>
 
 #include "camera_buffer_allocator_hwl.h"
 #include "camera_device_hwl.h"
@@ -49,6 +51,9 @@ class CameraDevice {
 
   // Get the characteristics of this camera device.
   // characteristics will be filled with this camera device's characteristics.
+  // The characteristics are queried from the HWL and finalized once, and
+  // copies of the finalized snapshot are returned until the device state
+  // changes.
   status_t GetCameraCharacteristics(
       std::unique_ptr<HalCameraMetadata>* characteristics);
 
@@ -70,7 +75,8 @@ class CameraDevice {
   // Get the characteristics of this camera device's physical camera if the
   // physical_camera_id belongs to this camera device.
   // characteristics will be filled with the physical camera ID's
-  // characteristics.
+  // characteristics. Like GetCameraCharacteristics(), the finalized
+  // characteristics of each physical camera are cached.
   status_t GetPhysicalCameraCharacteristics(
       uint32_t physical_camera_id,
       std::unique_ptr<HalCameraMetadata>* characteristics);
@@ -121,6 +127,11 @@ class CameraDevice {
   std::unique_ptr<google::camera_common::Profiler> GetProfiler(uint32_t camere_id,
                                                                int option);
 
+  // Invalidate the cached characteristics of all camera devices. Must be
+  // called when the device state changes because the HWL may report different
+  // characteristics for a different device state.
+  static void NotifyDeviceStateChange();
+
  protected:
   CameraDevice() = default;
 
@@ -128,6 +139,10 @@ class CameraDevice {
   status_t Initialize(std::unique_ptr<CameraDeviceHwl> camera_device_hwl,
                       CameraBufferAllocatorHwl* camera_allocator_hwl);
 
+  // Drop the cached characteristics if the device state changed since they
+  // were cached. characteristics_lock_ must be held.
+  void InvalidateStaleCharacteristicsLocked();
+
   uint32_t public_camera_id_ = 0;
 
   std::unique_ptr<CameraDeviceHwl> camera_device_hwl_;
@@ -142,6 +157,23 @@ class CameraDevice {
   std::map<uint32_t, std::set<int64_t>> camera_id_to_stream_use_cases_;
 
   const std::vector<std::string>* configure_streams_libs_ = nullptr;
+
+  // Incremented when the device state changes.
+  static std::atomic<uint32_t> device_state_generation_;
+
+  std::mutex characteristics_lock_;
+
+  // Finalized camera characteristics. Protected by characteristics_lock_.
+  std::unique_ptr<HalCameraMetadata> characteristics_;
+
+  // Map from a physical camera ID to its finalized characteristics.
+  // Protected by characteristics_lock_.
+  std::map<uint32_t, std::unique_ptr<HalCameraMetadata>>
+      physical_characteristics_;
+
+  // device_state_generation_ when the characteristics were cached. Protected
+  // by characteristics_lock_.
+  uint32_t characteristics_generation_ = 0;
 };
 
 }  // namespace google_camera_hal
@@ -23,6 +23,9 @@
 #include <log/log.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
+#include <chrono>
+
 #include "basic_capture_session.h"
 #include "capture_session_utils.h"
 #include "dual_ir_capture_session.h"
@@ -40,6 +43,15 @@
 namespace android {
 namespace google_camera_hal {
 
+namespace {
+// Return the monotonic time in nanoseconds.
+int64_t GetSteadyClockTimeNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
 constexpr char kMeasureBufferAllocationProp[] =
     "persist.vendor.camera.measure_buffer_allocation";
 
@@ -271,6 +283,7 @@ void CameraDeviceSession::Notify(const NotifyMessage& result) {
     if (result.type == MessageType::kError &&
         result.message.error.error_code == ErrorCode::kErrorResult) {
       pending_results_.erase(frame_number);
+      thermal_capped_fps_ranges_.erase(frame_number);
 
       if (ignore_shutters_.find(frame_number) == ignore_shutters_.end()) {
         ignore_shutters_.insert(frame_number);
@@ -395,6 +408,12 @@ status_t CameraDeviceSession::Initialize(
   ALOGI("%s: measure buffer allocation time: %d ", __FUNCTION__,
         measure_buffer_allocation_time_);
 
+  thermal_governor_ = ThermalGovernor::Create();
+  if (thermal_governor_ == nullptr) {
+    ALOGE("%s: Creating thermal governor failed.", __FUNCTION__);
+    return UNKNOWN_ERROR;
+  }
+
   camera_id_ = device_session_hwl->GetCameraId();
   device_session_hwl_ = std::move(device_session_hwl);
   camera_allocator_hwl_ = camera_allocator_hwl;
@@ -578,6 +597,15 @@ status_t CameraDeviceSession::LoadExternalCaptureSession(
 }
 
 CameraDeviceSession::~CameraDeviceSession() {
+  {
+    std::lock_guard<std::mutex> lock(thermal_poll_lock_);
+    thermal_poll_exiting_ = true;
+  }
+  thermal_poll_cv_.notify_one();
+  if (thermal_poll_thread_.joinable()) {
+    thermal_poll_thread_.join();
+  }
+
   UnregisterThermalCallback();
 
   capture_session_ = nullptr;
@@ -616,9 +644,66 @@ void CameraDeviceSession::SetSessionCallback(
     ALOGW("%s: Registering thermal callback failed: %s(%d)", __FUNCTION__,
           strerror(-res), res);
   }
+
+  if (thermal_callback_.get_current_temperatures != nullptr &&
+      thermal_governor_ != nullptr && !thermal_poll_thread_.joinable()) {
+    thermal_poll_thread_ = std::thread([this] { ThermalPollThreadLoop(); });
+  }
+}
+
+void CameraDeviceSession::NotifyThermalPollThread() {
+  std::lock_guard<std::mutex> lock(thermal_poll_lock_);
+  thermal_poll_cv_.notify_one();
+}
+
+void CameraDeviceSession::ThermalPollThreadLoop() {
+  std::unique_lock<std::mutex> lock(thermal_poll_lock_);
+  while (!thermal_poll_exiting_) {
+    if (thermal_governor_->GetLevel() == ThermalLevel::kNone) {
+      // Thermal callbacks and requests wake up the thread once the level
+      // goes up.
+      thermal_poll_cv_.wait(lock);
+      continue;
+    }
+
+    thermal_poll_cv_.wait_for(
+        lock, std::chrono::milliseconds(kThermalPollIntervalMs),
+        [this] { return thermal_poll_exiting_; });
+    if (thermal_poll_exiting_) {
+      break;
+    }
+
+    lock.unlock();
+    std::vector<Temperature> temperatures;
+    status_t res = NO_INIT;
+    {
+      std::shared_lock callback_lock(session_callback_lock_);
+      res = thermal_callback_.get_current_temperatures(
+          /*filter_type=*/false, TemperatureType::kUnknown, &temperatures);
+    }
+    if (res != OK) {
+      ALOGW("%s: Getting current temperatures failed: %s(%d)", __FUNCTION__,
+            strerror(-res), res);
+    } else {
+      int64_t timestamp_ns = GetSteadyClockTimeNs();
+      for (auto& temperature : temperatures) {
+        thermal_governor_->OnTemperature(temperature, timestamp_ns);
+      }
+      ALOGV("%s: Polled %zu temperatures, thermal level %u", __FUNCTION__,
+            temperatures.size(),
+            static_cast<uint32_t>(thermal_governor_->GetLevel()));
+    }
+    lock.lock();
+  }
 }
 
 void CameraDeviceSession::NotifyThrottling(const Temperature& temperature) {
+  if (thermal_governor_ != nullptr &&
+      thermal_governor_->OnTemperature(temperature, GetSteadyClockTimeNs()) !=
+          ThermalLevel::kNone) {
+    NotifyThermalPollThread();
+  }
+
   switch (temperature.throttling_status) {
     case ThrottlingSeverity::kNone:
     case ThrottlingSeverity::kLight:
@@ -726,13 +811,20 @@ status_t CameraDeviceSession::ConfigureStreams(
       break;
     }
   }
+  int64_t create_session_start_ns = GetSteadyClockTimeNs();
   capture_session_ = CreateCaptureSession(
       stream_config, kWrapperCaptureSessionEntries,
       external_capture_session_entries_, kCaptureSessionEntries,
       hwl_session_callback_, camera_allocator_hwl_, device_session_hwl_.get(),
       &hal_config, camera_device_session_callback_.process_capture_result,
       camera_device_session_callback_.notify,
-      camera_device_session_callback_.process_batch_capture_result);
+      camera_device_session_callback_.process_batch_capture_result,
+      &capture_session_selection_cache_);
+  ALOGI("%s: Creating capture session took %" PRId64
+        " us (selection cache hits %zu, misses %zu)",
+        __FUNCTION__, (GetSteadyClockTimeNs() - create_session_start_ns) / 1000,
+        capture_session_selection_cache_.GetHitCount(),
+        capture_session_selection_cache_.GetMissCount());
 
   if (capture_session_ == nullptr) {
     ALOGE("%s: Cannot find a capture session compatible with stream config",
@@ -826,11 +918,13 @@ status_t CameraDeviceSession::ConfigureStreams(
     dummy_buffer_observed_.clear();
     pending_results_.clear();
     ignore_shutters_.clear();
+    thermal_capped_fps_ranges_.clear();
   }
 
   has_valid_settings_ = false;
   thermal_throttling_ = false;
   thermal_throttling_notified_ = false;
+  notified_thermal_level_ = ThermalLevel::kNone;
   last_request_settings_ = nullptr;
   last_timestamp_ns_for_trace_ = 0;
 
@@ -874,6 +968,101 @@ status_t CameraDeviceSession::UpdateBufferHandlesLocked(
   return OK;
 }
 
+status_t CameraDeviceSession::ApplyThermalLevelLocked(
+    CaptureRequest* updated_request) {
+  // Returns -1 if kThermalThrottlingLevel is not defined.
+  if (thermal_governor_ == nullptr ||
+      get_camera_metadata_tag_type(VendorTagIds::kThermalThrottlingLevel) ==
+          -1) {
+    return OK;
+  }
+
+  ThermalLevel level = thermal_governor_->Update(GetSteadyClockTimeNs());
+  if (level != ThermalLevel::kNone &&
+      notified_thermal_level_ == ThermalLevel::kNone) {
+    // The predicted temperature can raise the level without a callback.
+    NotifyThermalPollThread();
+  }
+  // Send a changed level right away, even if the request has no settings.
+  if (level != notified_thermal_level_ &&
+      updated_request->settings == nullptr) {
+    updated_request->settings =
+        HalCameraMetadata::Clone(last_request_settings_.get());
+  }
+  if (updated_request->settings == nullptr) {
+    return OK;
+  }
+
+  HalCameraMetadata* settings = updated_request->settings.get();
+  uint8_t level_value = static_cast<uint8_t>(level);
+  status_t res = settings->Set(VendorTagIds::kThermalThrottlingLevel,
+                               &level_value, /*data_count=*/1);
+  if (res != OK) {
+    ALOGE("%s: Setting thermal throttling level failed: %s(%d)", __FUNCTION__,
+          strerror(-res), res);
+    return res;
+  }
+  notified_thermal_level_ = level;
+
+  // Cap the frame rate of preview requests. The cap is lifted by the settings
+  // cloned from the last request settings once the level drops.
+  int32_t max_fps = thermal_governor_->GetMitigation(level).max_preview_fps;
+  camera_metadata_ro_entry entry = {};
+  if (max_fps <= 0 ||
+      settings->Get(ANDROID_CONTROL_CAPTURE_INTENT, &entry) != OK ||
+      entry.count != 1 ||
+      entry.data.u8[0] != ANDROID_CONTROL_CAPTURE_INTENT_PREVIEW) {
+    return OK;
+  }
+  if (settings->Get(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, &entry) != OK ||
+      entry.count != 2 || entry.data.i32[1] <= max_fps) {
+    return OK;
+  }
+
+  // Only lower the upper bound, and not below the app's lower bound, so the
+  // capped range stays within the app's range.
+  std::array<int32_t, 2> fps_range = {
+      entry.data.i32[0], std::max(entry.data.i32[0], max_fps)};
+  if (fps_range[1] >= entry.data.i32[1]) {
+    return OK;
+  }
+  res = settings->Set(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, fps_range.data(),
+                      fps_range.size());
+  if (res != OK) {
+    ALOGE("%s: Capping the preview frame rate failed: %s(%d)", __FUNCTION__,
+          strerror(-res), res);
+    return res;
+  }
+
+  std::lock_guard<std::mutex> lock(request_record_lock_);
+  thermal_capped_fps_ranges_[updated_request->frame_number] = fps_range;
+  return OK;
+}
+
+void CameraDeviceSession::ReportThermalCappedFpsRange(CaptureResult* result) {
+  if (result->result_metadata == nullptr) {
+    return;
+  }
+
+  std::array<int32_t, 2> fps_range;
+  {
+    std::lock_guard<std::mutex> lock(request_record_lock_);
+    auto fps_range_it = thermal_capped_fps_ranges_.find(result->frame_number);
+    if (fps_range_it == thermal_capped_fps_ranges_.end()) {
+      return;
+    }
+    fps_range = fps_range_it->second;
+    thermal_capped_fps_ranges_.erase(fps_range_it);
+  }
+
+  status_t res = result->result_metadata->Set(
+      ANDROID_CONTROL_AE_TARGET_FPS_RANGE, fps_range.data(), fps_range.size());
+  if (res != OK) {
+    ALOGW("%s: Reporting the capped FPS range of frame %u failed: %s(%d)",
+          __FUNCTION__, result->frame_number, strerror(-res), res);
+  }
+}
+
 status_t CameraDeviceSession::CreateCaptureRequestLocked(
     const CaptureRequest& request, CaptureRequest* updated_request) {
   ATRACE_CALL();
@@ -927,6 +1116,11 @@ status_t CameraDeviceSession::CreateCaptureRequestLocked(
     }
   }
 
+  status_t res = ApplyThermalLevelLocked(updated_request);
+  if (res != OK) {
+    return res;
+  }
+
   AppendOutputIntentToSettingsLocked(request, updated_request);
 
   {
@@ -1412,6 +1606,7 @@ status_t CameraDeviceSession::ProcessCaptureRequest(
           std::lock_guard<std::mutex> request_lock(request_record_lock_);
           pending_request_streams_.erase(updated_request.frame_number);
           pending_results_.erase(updated_request.frame_number);
+          thermal_capped_fps_ranges_.erase(updated_request.frame_number);
         }
         NotifyErrorMessage(updated_request.frame_number, kInvalidStreamId,
                            ErrorCode::kErrorRequest);
@@ -1955,6 +2150,7 @@ bool CameraDeviceSession::TryHandleCaptureResult(
     return true;
   }
   zoom_ratio_mapper_.UpdateCaptureResult(result.get());
+  ReportThermalCappedFpsRange(result.get());
 
   status_t res = UpdatePendingRequest(result.get());
   if (res != OK) {
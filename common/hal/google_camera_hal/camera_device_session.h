@@ -17,9 +17,13 @@
 #ifndef HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_CAMERA_DEVICE__SESSION_H_
 #define HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_CAMERA_DEVICE__SESSION_H_
 
+#include <array>
+#include <condition_variable>
 #include <memory>
 #include <set>
 #include <shared_mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <map>
 
@@ -32,6 +36,7 @@
 #include "hwl_types.h"
 #include "pending_requests_tracker.h"
 #include "stream_buffer_cache_manager.h"
+#include "thermal_governor.h"
 #include "thermal_types.h"
 #include "zoom_ratio_mapper.h"
 
@@ -63,6 +68,10 @@ struct ThermalCallback {
 
   // Unregister the thermal changed callback.
   UnregisterThermalChangedCallbackFunc unregister_thermal_changed_callback;
+
+  // Get the current temperatures. Optional; it's used to follow the
+  // temperature while thermal mitigation is active.
+  GetCurrentTemperaturesFunc get_current_temperatures;
 };
 
 // Entry point for getting an external capture session.
@@ -275,6 +284,22 @@ class CameraDeviceSession {
   // Invoked when thermal status changes.
   void NotifyThrottling(const Temperature& temperature);
 
+  // Send the current thermal level to the HWL and capture session in
+  // updated_request, and apply its preview frame rate cap. Must be
+  // exclusively protected by session_lock_.
+  status_t ApplyThermalLevelLocked(CaptureRequest* updated_request);
+
+  // Report the AE target FPS range a preview request was capped to in the
+  // first result metadata of its frame.
+  void ReportThermalCappedFpsRange(CaptureResult* result);
+
+  // Poll the current temperatures while the thermal level is above kNone,
+  // because thermal callbacks only arrive on status changes.
+  void ThermalPollThreadLoop();
+
+  // Wake up the thermal poll thread to check the thermal level.
+  void NotifyThermalPollThread();
+
   // Unregister thermal callback.
   void UnregisterThermalCallback();
 
@@ -355,6 +380,31 @@ class CameraDeviceSession {
   // Must be protected by session_lock_.
   bool thermal_throttling_notified_ = false;
 
+  // Capture sessions selected for recent stream configurations.
+  // Must be protected by session_lock_.
+  CaptureSessionSelectionCache capture_session_selection_cache_;
+
+  // Turns thermal callbacks into graduated thermal levels.
+  std::unique_ptr<ThermalGovernor> thermal_governor_;
+
+  // Thermal level last sent in request settings.
+  // Must be protected by session_lock_.
+  ThermalLevel notified_thermal_level_ = ThermalLevel::kNone;
+
+  // Interval of polling the temperatures while throttling.
+  static constexpr int64_t kThermalPollIntervalMs = 1000;
+
+  // Thread polling the temperatures. Started if thermal_callback_ can get the
+  // current temperatures.
+  std::thread thermal_poll_thread_;
+
+  // thermal_poll_lock_ protects the following variables as noted.
+  std::mutex thermal_poll_lock_;
+  std::condition_variable thermal_poll_cv_;
+
+  // If the thermal poll thread should exit. Protected by thermal_poll_lock_.
+  bool thermal_poll_exiting_ = false;
+
   // Predefined wrapper capture session entry points
   static std::vector<WrapperCaptureSessionEntryFuncs> kWrapperCaptureSessionEntries;
 
@@ -436,6 +486,12 @@ class CameraDeviceSession {
   // Protected by request_record_lock_;
   std::set<uint32_t> ignore_shutters_;
 
+  // Map from a frame number to the AE target FPS range its preview request
+  // was capped to for thermal mitigation, until its result metadata arrives.
+  // Protected by request_record_lock_;
+  std::unordered_map<uint32_t, std::array<int32_t, 2>>
+      thermal_capped_fps_ranges_;
+
   // Stream use cases supported by this camera device
   std::map<uint32_t, std::set<int64_t>> camera_id_to_stream_use_cases_;
 
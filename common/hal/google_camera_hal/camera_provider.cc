@@ -343,6 +343,7 @@ status_t CameraProvider::NotifyDeviceStateChange(
     return NO_INIT;
   }
   camera_provider_hwl_->NotifyDeviceStateChange(device_state);
+  CameraDevice::NotifyDeviceStateChange();
   return OK;
 }
 }  // namespace google_camera_hal
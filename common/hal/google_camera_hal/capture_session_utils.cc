@@ -16,11 +16,174 @@
 
 #include "capture_session_utils.h"
 
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+
 #include "zsl_snapshot_capture_session.h"
 
 namespace android {
 namespace google_camera_hal {
 
+namespace {
+
+using SessionList = CaptureSessionSelectionCache::SessionList;
+using Selection = CaptureSessionSelectionCache::Selection;
+
+// Properties that capture sessions check in IsStreamConfigurationSupported().
+constexpr const char* kSessionSelectionProperties[] = {
+    "persist.vendor.camera.hdrplus.disable",
+    "persist.vendor.camera.fatp.enable",
+    "persist.vendor.camera.rgbird.forceinternal",
+};
+
+template <typename T>
+void AppendValue(std::string* fingerprint, const T& value) {
+  fingerprint->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendStream(std::string* fingerprint, const Stream& stream) {
+  // Stream ids change across reconfigurations and don't affect the selection.
+  AppendValue(fingerprint, stream.stream_type);
+  AppendValue(fingerprint, stream.width);
+  AppendValue(fingerprint, stream.height);
+  AppendValue(fingerprint, stream.format);
+  AppendValue(fingerprint, stream.usage);
+  AppendValue(fingerprint, stream.data_space);
+  AppendValue(fingerprint, stream.rotation);
+  AppendValue(fingerprint, stream.is_physical_camera_stream);
+  AppendValue(fingerprint, stream.physical_camera_id);
+  AppendValue(fingerprint, stream.buffer_size);
+  AppendValue(fingerprint, stream.group_id);
+  AppendValue(fingerprint, stream.intended_for_max_resolution_mode);
+  AppendValue(fingerprint, stream.intended_for_default_resolution_mode);
+  AppendValue(fingerprint, stream.dynamic_profile);
+  AppendValue(fingerprint, stream.use_case);
+  AppendValue(fingerprint, stream.color_space);
+}
+
+void AppendMetadata(std::string* fingerprint,
+                    const HalCameraMetadata* metadata) {
+  size_t entry_count = metadata == nullptr ? 0 : metadata->GetEntryCount();
+  AppendValue(fingerprint, entry_count);
+  for (size_t i = 0; i < entry_count; i++) {
+    camera_metadata_ro_entry entry = {};
+    if (metadata->GetByIndex(&entry, i) != OK) {
+      continue;
+    }
+    AppendValue(fingerprint, entry.tag);
+    AppendValue(fingerprint, entry.type);
+    AppendValue(fingerprint, entry.count);
+    fingerprint->append(reinterpret_cast<const char*>(entry.data.u8),
+                        entry.count * camera_metadata_type_size[entry.type]);
+  }
+}
+
+// Return the first capture session that supports stream_config.
+Selection SelectCaptureSession(
+    const StreamConfiguration& stream_config,
+    const std::vector<WrapperCaptureSessionEntryFuncs>&
+        wrapper_capture_session_entries,
+    const std::vector<ExternalCaptureSessionFactory*>&
+        external_capture_session_entries,
+    const std::vector<CaptureSessionEntryFuncs>& capture_session_entries,
+    CameraDeviceSessionHwl* camera_device_session_hwl) {
+  // first pass: check predefined wrapper capture session
+  for (size_t i = 0; i < wrapper_capture_session_entries.size(); i++) {
+    if (wrapper_capture_session_entries[i].IsStreamConfigurationSupported(
+            camera_device_session_hwl, stream_config)) {
+      return {.session_list = SessionList::kWrapper, .index = i};
+    }
+  }
+
+  // second pass: check loaded external capture sessions
+  for (size_t i = 0; i < external_capture_session_entries.size(); i++) {
+    if (external_capture_session_entries[i]->IsStreamConfigurationSupported(
+            camera_device_session_hwl, stream_config)) {
+      return {.session_list = SessionList::kExternal, .index = i};
+    }
+  }
+
+  // third pass: check predefined capture sessions
+  for (size_t i = 0; i < capture_session_entries.size(); i++) {
+    if (capture_session_entries[i].IsStreamConfigurationSupported(
+            camera_device_session_hwl, stream_config)) {
+      return {.session_list = SessionList::kPredefined, .index = i};
+    }
+  }
+  return {};
+}
+
+}  // namespace
+
+CaptureSessionSelectionCache::CaptureSessionSelectionCache(size_t capacity)
+    : capacity_(std::max(capacity, size_t(1))) {
+}
+
+std::string CaptureSessionSelectionCache::GetFingerprint(
+    const StreamConfiguration& stream_config) {
+  std::string fingerprint;
+  AppendValue(&fingerprint, stream_config.operation_mode);
+  AppendValue(&fingerprint, stream_config.multi_resolution_input_image);
+  for (const char* property : kSessionSelectionProperties) {
+    AppendValue(&fingerprint, property_get_bool(property, false));
+  }
+
+  AppendValue(&fingerprint, stream_config.streams.size());
+  for (const auto& stream : stream_config.streams) {
+    AppendStream(&fingerprint, stream);
+  }
+  AppendMetadata(&fingerprint, stream_config.session_params.get());
+  return fingerprint;
+}
+
+bool CaptureSessionSelectionCache::Get(const std::string& fingerprint,
+                                       Selection* selection) {
+  if (selection == nullptr) {
+    ALOGE("%s: selection is nullptr", __FUNCTION__);
+    return false;
+  }
+
+  auto it = std::find_if(
+      selections_.begin(), selections_.end(),
+      [&fingerprint](const auto& entry) { return entry.first == fingerprint; });
+  if (it == selections_.end()) {
+    miss_count_++;
+    return false;
+  }
+
+  *selection = it->second;
+  std::rotate(selections_.begin(), it, it + 1);
+  hit_count_++;
+  return true;
+}
+
+void CaptureSessionSelectionCache::Put(const std::string& fingerprint,
+                                       const Selection& selection) {
+  Remove(fingerprint);
+  if (selections_.size() >= capacity_) {
+    selections_.pop_back();
+  }
+  selections_.emplace(selections_.begin(), fingerprint, selection);
+}
+
+void CaptureSessionSelectionCache::Remove(const std::string& fingerprint) {
+  selections_.erase(
+      std::remove_if(selections_.begin(), selections_.end(),
+                     [&fingerprint](const auto& entry) {
+                       return entry.first == fingerprint;
+                     }),
+      selections_.end());
+}
+
+void CaptureSessionSelectionCache::Clear() {
+  selections_.clear();
+  hit_count_ = 0;
+  miss_count_ = 0;
+}
+
 std::unique_ptr<CaptureSession> CreateCaptureSession(
     const StreamConfiguration& stream_config,
     const std::vector<WrapperCaptureSessionEntryFuncs>&
@@ -33,41 +196,79 @@ std::unique_ptr<CaptureSession> CreateCaptureSession(
     CameraDeviceSessionHwl* camera_device_session_hwl,
     std::vector<HalStream>* hal_config,
     ProcessCaptureResultFunc process_capture_result, NotifyFunc notify,
-    ProcessBatchCaptureResultFunc process_batch_capture_result) {
-  // first pass: check predefined wrapper capture session
-  for (auto sessionEntry : wrapper_capture_session_entries) {
-    if (sessionEntry.IsStreamConfigurationSupported(camera_device_session_hwl,
-                                                    stream_config)) {
-      return sessionEntry.CreateSession(
-          stream_config, external_capture_session_entries,
-          capture_session_entries, hwl_session_callback,
-          camera_buffer_allocator_hwl, camera_device_session_hwl, hal_config,
-          process_capture_result, notify);
+    ProcessBatchCaptureResultFunc process_batch_capture_result,
+    CaptureSessionSelectionCache* selection_cache) {
+  ATRACE_CALL();
+  std::string fingerprint;
+  Selection selection;
+  bool cached = false;
+  if (selection_cache != nullptr) {
+    fingerprint = CaptureSessionSelectionCache::GetFingerprint(stream_config);
+    cached = selection_cache->Get(fingerprint, &selection);
+  }
+  if (!cached) {
+    selection = SelectCaptureSession(
+        stream_config, wrapper_capture_session_entries,
+        external_capture_session_entries, capture_session_entries,
+        camera_device_session_hwl);
+  } else if (selection.session_list != SessionList::kWrapper) {
+    // External capture sessions are never cached, so probe them again before
+    // a cached selection that comes after them.
+    for (size_t i = 0; i < external_capture_session_entries.size(); i++) {
+      if (external_capture_session_entries[i]->IsStreamConfigurationSupported(
+              camera_device_session_hwl, stream_config)) {
+        selection = {.session_list = SessionList::kExternal, .index = i};
+        break;
+      }
     }
   }
 
-  // second pass: check loaded external capture sessions
-  for (auto externalSession : external_capture_session_entries) {
-    if (externalSession->IsStreamConfigurationSupported(
-            camera_device_session_hwl, stream_config)) {
-      return externalSession->CreateSession(
-          camera_device_session_hwl, stream_config, process_capture_result,
-          notify, hwl_session_callback, hal_config, camera_buffer_allocator_hwl);
-    }
+  std::unique_ptr<CaptureSession> session;
+  switch (selection.session_list) {
+    case SessionList::kWrapper:
+      if (selection.index < wrapper_capture_session_entries.size()) {
+        const auto& entry = wrapper_capture_session_entries[selection.index];
+        session = entry.CreateSession(
+            stream_config, external_capture_session_entries,
+            capture_session_entries, hwl_session_callback,
+            camera_buffer_allocator_hwl, camera_device_session_hwl, hal_config,
+            process_capture_result, notify);
+      }
+      break;
+    case SessionList::kExternal:
+      if (selection.index < external_capture_session_entries.size()) {
+        auto entry = external_capture_session_entries[selection.index];
+        session = entry->CreateSession(
+            camera_device_session_hwl, stream_config, process_capture_result,
+            notify, hwl_session_callback, hal_config,
+            camera_buffer_allocator_hwl);
+      }
+      break;
+    case SessionList::kPredefined:
+      if (selection.index < capture_session_entries.size()) {
+        session = capture_session_entries[selection.index].CreateSession(
+            camera_device_session_hwl, stream_config, process_capture_result,
+            process_batch_capture_result, notify, hwl_session_callback,
+            hal_config, camera_buffer_allocator_hwl);
+      }
+      break;
+    case SessionList::kNone:
+      break;
   }
 
-  // third pass: check predefined capture sessions
-  for (auto sessionEntry : capture_session_entries) {
-    if (sessionEntry.IsStreamConfigurationSupported(camera_device_session_hwl,
-                                                    stream_config)) {
-      return sessionEntry.CreateSession(
-          camera_device_session_hwl, stream_config, process_capture_result,
-          process_batch_capture_result, notify, hwl_session_callback,
-          hal_config, camera_buffer_allocator_hwl);
+  // External capture sessions may depend on state that the fingerprint
+  // doesn't cover, so their selections are not cached.
+  if (selection_cache != nullptr &&
+      selection.session_list != SessionList::kExternal) {
+    // Probe again next time if the selected session failed to be created.
+    if (session != nullptr || selection.session_list == SessionList::kNone) {
+      selection_cache->Put(fingerprint, selection);
+    } else {
+      selection_cache->Remove(fingerprint);
     }
   }
-  return nullptr;
+  return session;
 }
 
 }  // namespace google_camera_hal
-}  // namespace android
\ No newline at end of file
+}  // namespace android
@@ -19,6 +19,9 @@
 
 #include <utils/Errors.h>
 
+#include <string>
+#include <vector>
+
 #include "camera_buffer_allocator_hwl.h"
 #include "camera_device_session_hwl.h"
 #include "capture_session.h"
@@ -68,10 +71,75 @@ struct WrapperCaptureSessionEntryFuncs {
   WrapperCaptureSessionCreateFunc CreateSession;
 };
 
+// CaptureSessionSelectionCache remembers which capture session
+// CreateCaptureSession() selected for a stream configuration, so that
+// reconfiguring the same streams, e.g. when toggling between preview and
+// video, creates that session without probing IsStreamConfigurationSupported()
+// of every session again.
+// Selections are keyed by a fingerprint of everything the session checks can
+// see: the streams except their ids, the operation mode, the session
+// parameters and the properties that change the sessions' checks. Selections
+// of external capture sessions are not cached, because their checks may
+// depend on anything; they are probed again before any cached selection that
+// comes after them. A cache is only valid for one camera device session and
+// one set of capture session entries.
+// CaptureSessionSelectionCache is not thread-safe.
+class CaptureSessionSelectionCache {
+ public:
+  static constexpr size_t kDefaultCapacity = 8;
+
+  // Capture session lists probed by CreateCaptureSession(), in order.
+  enum class SessionList : uint32_t {
+    kWrapper = 0,
+    kExternal,
+    kPredefined,
+    // No capture session supports the stream configuration.
+    kNone,
+  };
+
+  struct Selection {
+    SessionList session_list = SessionList::kNone;
+    // Index of the capture session in session_list.
+    size_t index = 0;
+  };
+
+  explicit CaptureSessionSelectionCache(size_t capacity = kDefaultCapacity);
+
+  static std::string GetFingerprint(const StreamConfiguration& stream_config);
+
+  // Return true and the cached selection if fingerprint is cached.
+  bool Get(const std::string& fingerprint, Selection* selection);
+
+  void Put(const std::string& fingerprint, const Selection& selection);
+
+  void Remove(const std::string& fingerprint);
+
+  void Clear();
+
+  size_t GetHitCount() const {
+    return hit_count_;
+  }
+
+  size_t GetMissCount() const {
+    return miss_count_;
+  }
+
+ private:
+  const size_t capacity_;
+
+  // Cached selections, most recently used first.
+  std::vector<std::pair<std::string, Selection>> selections_;
+
+  size_t hit_count_ = 0;
+  size_t miss_count_ = 0;
+};
+
 // Select and create capture session.
 // When consider_zsl_capture_session is enabled, we will first consider using
 // ZslCaptureSession as a wrapper capture session when it supports the given
 // configurations.
+// If selection_cache is not nullptr, a capture session selected before for an
+// identical stream configuration is created without probing the others.
 std::unique_ptr<CaptureSession> CreateCaptureSession(
     const StreamConfiguration& stream_config,
     const std::vector<WrapperCaptureSessionEntryFuncs>&
@@ -84,7 +152,8 @@ std::unique_ptr<CaptureSession> CreateCaptureSession(
     CameraDeviceSessionHwl* camera_device_session_hwl,
     std::vector<HalStream>* hal_config,
     ProcessCaptureResultFunc process_capture_result, NotifyFunc notify,
-    ProcessBatchCaptureResultFunc process_batch_capture_result = nullptr);
+    ProcessBatchCaptureResultFunc process_batch_capture_result = nullptr,
+    CaptureSessionSelectionCache* selection_cache = nullptr);
 
 }  // namespace google_camera_hal
 }  // namespace android
@@ -20,11 +20,12 @@
 #include <cutils/properties.h>
 #include <hardware/gralloc1.h>
 #include <log/log.h>
-#include <sys/mman.h>
 #include <utils/Trace.h>
 
 #include <dlfcn.h>
 
+#include <algorithm>
+
 #include "depth_process_block.h"
 #include "hal_types.h"
 #include "hal_utils.h"
@@ -35,6 +36,8 @@ namespace google_camera_hal {
 
 #if GCH_HWL_USE_DLOPEN
 static std::string kDepthGeneratorLib = "/vendor/lib64/libdepthgenerator.so";
+static std::string kReferenceDepthGeneratorLib =
+    "/vendor/lib64/libdepthgenerator_reference.so";
 using android::depth_generator::CreateDepthGenerator_t;
 #endif
 const float kSmallOffset = 0.01f;
@@ -43,6 +46,15 @@ std::unique_ptr<DepthProcessBlock> DepthProcessBlock::Create(
     CameraDeviceSessionHwl* device_session_hwl,
     HwlRequestBuffersFunc request_stream_buffers,
     const DepthProcessBlockCreateData& create_data) {
+  return Create(device_session_hwl, request_stream_buffers, create_data,
+                /*depth_generator=*/nullptr);
+}
+
+std::unique_ptr<DepthProcessBlock> DepthProcessBlock::Create(
+    CameraDeviceSessionHwl* device_session_hwl,
+    HwlRequestBuffersFunc request_stream_buffers,
+    const DepthProcessBlockCreateData& create_data,
+    std::unique_ptr<DepthGenerator> depth_generator) {
   ATRACE_CALL();
   if (device_session_hwl == nullptr) {
     ALOGE("%s: device_session_hwl is nullptr", __FUNCTION__);
@@ -56,6 +68,12 @@ std::unique_ptr<DepthProcessBlock> DepthProcessBlock::Create(
     return nullptr;
   }
 
+  block->buffer_mapping_cache_ = BufferMappingCache::Create();
+  if (block->buffer_mapping_cache_ == nullptr) {
+    ALOGE("%s: Creating BufferMappingCache failed.", __FUNCTION__);
+    return nullptr;
+  }
+
   status_t res = block->InitializeBufferManagementStatus(device_session_hwl);
   if (res != OK) {
     ALOGE("%s: Failed to initialize HAL Buffer Management status.",
@@ -88,6 +106,7 @@ std::unique_ptr<DepthProcessBlock> DepthProcessBlock::Create(
   block->rgb_ir_auto_cal_enabled_ =
       property_get_bool("vendor.camera.frontdepth.enableautocal", true);
   block->device_session_hwl_ = device_session_hwl;
+  block->depth_generator_ = std::move(depth_generator);
   return block;
 }
 
@@ -123,7 +142,11 @@ DepthProcessBlock::DepthProcessBlock(
     : request_stream_buffers_(request_stream_buffers),
       rgb_internal_yuv_stream_id_(create_data.rgb_internal_yuv_stream_id),
       ir1_internal_raw_stream_id_(create_data.ir1_internal_raw_stream_id),
-      ir2_internal_raw_stream_id_(create_data.ir2_internal_raw_stream_id) {
+      ir2_internal_raw_stream_id_(create_data.ir2_internal_raw_stream_id),
+      max_buffers_per_input_stream_(create_data.max_buffers_per_input_stream) {
+  // Each in-flight request holds a depth stream buffer.
+  max_inflight_requests_ = std::clamp(create_data.max_inflight_requests, 1u,
+                                      kDepthStreamMaxBuffers);
 }
 
 DepthProcessBlock::~DepthProcessBlock() {
@@ -187,6 +210,19 @@ status_t DepthProcessBlock::ConfigureStreams(
     return ALREADY_EXISTS;
   }
 
+  // Buffers mapped for a previous configuration will not be used again. Only
+  // the mappings of input buffers are kept, so at most the buffers of the
+  // input streams are idle.
+  buffer_mapping_cache_->Invalidate();
+  size_t num_input_streams = 0;
+  for (auto& stream : stream_config.streams) {
+    if (!utils::IsDepthStream(stream)) {
+      num_input_streams++;
+    }
+  }
+  buffer_mapping_cache_->SetMaxCachedMappings(num_input_streams *
+                                              max_buffers_per_input_stream_);
+
   // TODO(b/128633958): remove this after FLL syncing is verified
   if (force_internal_stream_) {
     // Nothing to configure if this is force internal mode
@@ -235,23 +271,23 @@ status_t DepthProcessBlock::ConfigureStreams(
       ALOGE("%s: Creating DepthGenerator failed.", __FUNCTION__);
       return NO_INIT;
     }
+  }
 
-    if (pipelined_depth_engine_enabled_ == true) {
-      auto depth_result_callback =
-          android::depth_generator::DepthResultCallbackFunction(
-              [this](DepthResultStatus result_status, uint32_t frame_number) {
-                status_t res = ProcessDepthResult(result_status, frame_number);
-                if (res != OK) {
-                  ALOGE("%s: Failed to process the depth result for frame %d.",
-                        __FUNCTION__, frame_number);
-                }
-              });
-      ALOGI("%s: Async depth api is used. Callback func is set.", __FUNCTION__);
-      depth_generator_->SetResultCallback(depth_result_callback);
-    } else {
-      ALOGI("%s: Blocking depth api is used.", __FUNCTION__);
-      depth_generator_->SetResultCallback(nullptr);
-    }
+  if (pipelined_depth_engine_enabled_ == true) {
+    auto depth_result_callback =
+        android::depth_generator::DepthResultCallbackFunction(
+            [this](DepthResultStatus result_status, uint32_t frame_number) {
+              status_t res = ProcessDepthResult(result_status, frame_number);
+              if (res != OK) {
+                ALOGE("%s: Failed to process the depth result for frame %d.",
+                      __FUNCTION__, frame_number);
+              }
+            });
+    ALOGI("%s: Async depth api is used. Callback func is set.", __FUNCTION__);
+    depth_generator_->SetResultCallback(depth_result_callback);
+  } else {
+    ALOGI("%s: Blocking depth api is used.", __FUNCTION__);
+    depth_generator_->SetResultCallback(nullptr);
   }
   if (session_buffer_management_supported_ &&
       device_session_hwl_->configure_streams_v2()) {
@@ -290,82 +326,153 @@ status_t DepthProcessBlock::SubmitBlockingDepthRequest(
   if (res != OK) {
     ALOGE("%s: Depth generator fails to process frame %d.", __FUNCTION__,
           request_info.frame_number);
-    return res;
   }
 
-  res = ProcessDepthResult(DepthResultStatus::kOk, request_info.frame_number);
+  // Return the result even if processing failed so that the results of later
+  // requests are not blocked.
+  res = ProcessDepthResult(
+      res == OK ? DepthResultStatus::kOk : DepthResultStatus::kError,
+      request_info.frame_number);
   if (res != OK) {
     ALOGE("%s: Failed to process depth result.", __FUNCTION__);
-    return res;
   }
 
-  return OK;
+  return res;
 }
 
-status_t DepthProcessBlock::SubmitAsyncDepthRequest(
-    const DepthRequestInfo& request_info) {
-  std::unique_lock<std::mutex> lock(depth_generator_api_lock_);
-  ALOGV("%s: [ud] ExecuteProcessRequest for frame %d", __FUNCTION__,
-        request_info.frame_number);
-  status_t res = depth_generator_->EnqueueProcessRequest(request_info);
-  if (res != OK) {
-    ALOGE("%s: Failed to enqueue depth request.", __FUNCTION__);
-    return res;
-  }
+void DepthProcessBlock::SubmitQueuedDepthRequests() {
+  {
+    std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+    if (submitting_queued_requests_) {
+      // The thread that is submitting will also submit the requests queued
+      // since, keeping them in frame number order.
+      return;
+    }
+    submitting_queued_requests_ = true;
+  }
+
+  while (true) {
+    DepthRequestInfo request_info;
+    {
+      std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+      auto queued_it = pending_depth_requests_.end();
+      if (num_inflight_requests_ < max_inflight_requests_) {
+        queued_it = std::find_if(
+            pending_depth_requests_.begin(), pending_depth_requests_.end(),
+            [](const auto& pending) { return !pending.second.submitted; });
+      }
+      if (queued_it == pending_depth_requests_.end()) {
+        submitting_queued_requests_ = false;
+        return;
+      }
 
-  return OK;
+      queued_it->second.submitted = true;
+      num_inflight_requests_++;
+      request_info = queued_it->second.depth_request;
+    }
+
+    // No lock is held while the depth generator has the request, so a depth
+    // generator can return results from within EnqueueProcessRequest() or
+    // block in it until an earlier result is processed.
+    ALOGV("%s: [ud] EnqueueProcessRequest for frame %d", __FUNCTION__,
+          request_info.frame_number);
+    status_t res = depth_generator_->EnqueueProcessRequest(request_info);
+    if (res != OK) {
+      ALOGE("%s: Failed to enqueue depth request for frame %u.", __FUNCTION__,
+            request_info.frame_number);
+      // Return the depth buffer in error state so that the results of later
+      // requests are not blocked.
+      std::lock_guard<std::mutex> lock(depth_generator_api_lock_);
+      CompleteDepthRequestLocked(DepthResultStatus::kError,
+                                 request_info.frame_number);
+    }
+  }
 }
 
 status_t DepthProcessBlock::ProcessDepthResult(DepthResultStatus result_status,
                                                uint32_t frame_number) {
-  std::unique_lock<std::mutex> lock(depth_generator_api_lock_);
   ALOGV("%s: [ud] Depth result for frame %u notified.", __FUNCTION__,
         frame_number);
-
-  status_t res = UnmapDepthRequestBuffers(frame_number);
-  if (res != OK) {
-    ALOGE("%s: Failed to clean up the depth request info.", __FUNCTION__);
-    return res;
+  status_t res;
+  {
+    std::lock_guard<std::mutex> lock(depth_generator_api_lock_);
+    res = CompleteDepthRequestLocked(result_status, frame_number);
   }
 
-  auto capture_result = std::make_unique<CaptureResult>();
-  if (capture_result == nullptr) {
-    ALOGE("%s: Creating capture_result failed.", __FUNCTION__);
-    return NO_MEMORY;
+  if (pipelined_depth_engine_enabled_ == true) {
+    // The returned request left room in the in-flight window.
+    SubmitQueuedDepthRequests();
   }
 
-  CaptureRequest request;
+  return res;
+}
+
+status_t DepthProcessBlock::CompleteDepthRequestLocked(
+    DepthResultStatus result_status, uint32_t frame_number) {
+  // Results are returned in frame number order. Collect this request and the
+  // completed requests after it if all requests before it have completed.
+  std::vector<PendingDepthRequestInfo> completed_requests;
   {
     std::lock_guard<std::mutex> pending_request_lock(pending_requests_mutex_);
-    if (pending_depth_requests_.find(frame_number) ==
-        pending_depth_requests_.end()) {
+    auto pending_it = pending_depth_requests_.find(frame_number);
+    if (pending_it == pending_depth_requests_.end()) {
       ALOGE("%s: Frame %u does not exist in pending requests list.",
             __FUNCTION__, frame_number);
-    } else {
-      auto& request = pending_depth_requests_[frame_number].request;
-      capture_result->frame_number = frame_number;
-      capture_result->output_buffers = request.output_buffers;
-
-      // In case the depth engine fails to process a depth request, mark the
-      // buffer as in error state.
-      if (result_status != DepthResultStatus::kOk) {
-        for (auto& stream_buffer : capture_result->output_buffers) {
-          if (stream_buffer.stream_id == depth_stream_.id) {
-            stream_buffer.status = BufferStatus::kError;
-          }
-        }
-      }
+      return BAD_VALUE;
+    }
+
+    if (pending_it->second.completed) {
+      ALOGE("%s: Frame %u was already completed.", __FUNCTION__, frame_number);
+      return BAD_VALUE;
+    }
 
-      capture_result->input_buffers = request.input_buffers;
-      pending_depth_requests_.erase(frame_number);
+    pending_it->second.completed = true;
+    pending_it->second.result_status = result_status;
+    if (pending_it->second.submitted) {
+      num_inflight_requests_--;
+    }
+    while (!pending_depth_requests_.empty() &&
+           pending_depth_requests_.begin()->second.completed) {
+      completed_requests.push_back(
+          std::move(pending_depth_requests_.begin()->second));
+      pending_depth_requests_.erase(pending_depth_requests_.begin());
     }
   }
 
-  ProcessBlockResult block_result = {.request_id = 0,
-                                     .result = std::move(capture_result)};
-  {
-    std::lock_guard<std::mutex> lock(result_processor_lock_);
-    result_processor_->ProcessResult(std::move(block_result));
+  for (auto& pending_request : completed_requests) {
+    status_t res = UnmapDepthRequestBuffers(pending_request);
+    if (res != OK) {
+      ALOGE("%s: Failed to clean up the depth request info.", __FUNCTION__);
+    }
+
+    auto capture_result = std::make_unique<CaptureResult>();
+    if (capture_result == nullptr) {
+      ALOGE("%s: Creating capture_result failed.", __FUNCTION__);
+      return NO_MEMORY;
+    }
+
+    auto& request = pending_request.request;
+    capture_result->frame_number = request.frame_number;
+    capture_result->output_buffers = request.output_buffers;
+
+    // In case the depth engine fails to process a depth request, mark the
+    // buffer as in error state.
+    if (pending_request.result_status != DepthResultStatus::kOk) {
+      for (auto& stream_buffer : capture_result->output_buffers) {
+        if (stream_buffer.stream_id == depth_stream_.id) {
+          stream_buffer.status = BufferStatus::kError;
+        }
+      }
+    }
+
+    capture_result->input_buffers = request.input_buffers;
+
+    ProcessBlockResult block_result = {.request_id = 0,
+                                       .result = std::move(capture_result)};
+    {
+      std::lock_guard<std::mutex> lock(result_processor_lock_);
+      result_processor_->ProcessResult(std::move(block_result));
+    }
   }
 
   return OK;
@@ -383,15 +490,16 @@ status_t DepthProcessBlock::ProcessRequests(
     return UNKNOWN_ERROR;
   }
 
-  std::lock_guard<std::mutex> lock(configure_lock_);
-  if (!is_configured_) {
-    ALOGE("%s: block is not configured.", __FUNCTION__);
-    return NO_INIT;
+  {
+    std::lock_guard<std::mutex> lock(configure_lock_);
+    if (!is_configured_) {
+      ALOGE("%s: block is not configured.", __FUNCTION__);
+      return NO_INIT;
+    }
   }
 
-  if (process_block_requests.size() != 1) {
-    ALOGE("%s: Only a single request is supported but there are %zu",
-          __FUNCTION__, process_block_requests.size());
+  if (process_block_requests.empty()) {
+    ALOGE("%s: No requests.", __FUNCTION__);
     return BAD_VALUE;
   }
 
@@ -411,38 +519,79 @@ status_t DepthProcessBlock::ProcessRequests(
     }
   }
 
-  auto& request = process_block_requests[0].request;
-  DepthRequestInfo request_info;
+  for (auto& block_request : process_block_requests) {
+    status_t res = ProcessDepthRequest(block_request.request);
+    if (res != OK) {
+      ALOGE("%s: Failed to process depth request for frame %u.", __FUNCTION__,
+            block_request.request.frame_number);
+      return res;
+    }
+  }
+
+  return OK;
+}
+
+status_t DepthProcessBlock::ProcessDepthRequest(const CaptureRequest& request) {
+  ATRACE_CALL();
+  PendingDepthRequestInfo pending_request;
+  DepthRequestInfo& request_info = pending_request.depth_request;
   request_info.frame_number = request.frame_number;
-  std::unique_ptr<HalCameraMetadata> metadata = nullptr;
   if (request.settings != nullptr) {
-    metadata = HalCameraMetadata::Clone(request.settings.get());
+    pending_request.settings = HalCameraMetadata::Clone(request.settings.get());
   }
 
-  std::unique_ptr<HalCameraMetadata> color_metadata = nullptr;
   for (auto& metadata : request.input_buffer_metadata) {
     if (metadata != nullptr) {
-      color_metadata = HalCameraMetadata::Clone(metadata.get());
+      pending_request.color_metadata = HalCameraMetadata::Clone(metadata.get());
     }
   }
 
   ALOGV("%s: [ud] Prepare depth request info for frame %u .", __FUNCTION__,
         request.frame_number);
 
-  status_t res = PrepareDepthRequestInfo(request, &request_info, metadata.get(),
-                                         color_metadata.get());
+  status_t res = PrepareDepthRequestInfo(request, &request_info,
+                                         pending_request.settings.get(),
+                                         pending_request.color_metadata.get());
   if (res != OK) {
     ALOGE("%s: Failed to perpare the depth request info.", __FUNCTION__);
     return res;
   }
 
-  if (pipelined_depth_engine_enabled_ == true) {
-    res = SubmitAsyncDepthRequest(request_info);
-    if (res != OK) {
-      ALOGE("%s: Failed to submit asynchronized depth request.", __FUNCTION__);
+  pending_request.request.frame_number = request.frame_number;
+  pending_request.request.input_buffers = request.input_buffers;
+  pending_request.request.output_buffers = request.output_buffers;
+  DepthRequestInfo submitted_request_info = request_info;
+  // Requests to the blocking depth generator API are executed right away.
+  const bool submit_now = pipelined_depth_engine_enabled_ != true;
+  {
+    std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+    if (pending_depth_requests_.find(request.frame_number) !=
+        pending_depth_requests_.end()) {
+      ALOGE("%s: Frame %u already exists in pending requests.", __FUNCTION__,
+            request.frame_number);
+      UnmapDepthRequestBuffers(pending_request);
+      return UNKNOWN_ERROR;
     }
+
+    if (submit_now) {
+      pending_request.submitted = true;
+      num_inflight_requests_++;
+    }
+
+    // The metadata that request_info points to is owned by the pending
+    // request and stays at the same address after the move.
+    pending_depth_requests_.emplace(request.frame_number,
+                                    std::move(pending_request));
+  }
+
+  if (!submit_now) {
+    // Submit the request if the in-flight window has room for it. Otherwise
+    // it stays queued and is submitted when an earlier request returns, so
+    // the caller, usually the HWL result thread, never waits for the depth
+    // generator.
+    SubmitQueuedDepthRequests();
   } else {
-    res = SubmitBlockingDepthRequest(request_info);
+    res = SubmitBlockingDepthRequest(submitted_request_info);
     if (res != OK) {
       ALOGE("%s: Failed to submit blocking depth request.", __FUNCTION__);
     }
@@ -458,6 +607,10 @@ status_t DepthProcessBlock::Flush() {
     return OK;
   }
 
+  // Buffers may be freed after a flush. Mappings of pending requests are
+  // dropped when the requests complete.
+  buffer_mapping_cache_->Invalidate();
+
   // TODO(b/127322570): Implement this method.
   return OK;
 }
@@ -468,18 +621,24 @@ status_t DepthProcessBlock::LoadDepthGenerator(
 #if GCH_HWL_USE_DLOPEN
   CreateDepthGenerator_t create_depth_generator;
 
-  ALOGI("%s: Loading library: %s", __FUNCTION__, kDepthGeneratorLib.c_str());
+  // The in-tree reference depth generator can be used on devices without a
+  // vendor depth generator.
+  const std::string& depth_generator_lib =
+      property_get_bool("vendor.camera.frontdepth.usereference", false)
+          ? kReferenceDepthGeneratorLib
+          : kDepthGeneratorLib;
+  ALOGI("%s: Loading library: %s", __FUNCTION__, depth_generator_lib.c_str());
   depth_generator_lib_handle_ =
-      dlopen(kDepthGeneratorLib.c_str(), RTLD_NOW | RTLD_NODELETE);
+      dlopen(depth_generator_lib.c_str(), RTLD_NOW | RTLD_NODELETE);
   if (depth_generator_lib_handle_ == nullptr) {
-    ALOGE("Depth generator loading %s failed.", kDepthGeneratorLib.c_str());
+    ALOGE("Depth generator loading %s failed.", depth_generator_lib.c_str());
     return NO_INIT;
   }
 
   create_depth_generator = (CreateDepthGenerator_t)dlsym(
       depth_generator_lib_handle_, "CreateDepthGenerator");
   if (create_depth_generator == nullptr) {
-    ALOGE("%s: dlsym failed (%s).", __FUNCTION__, kDepthGeneratorLib.c_str());
+    ALOGE("%s: dlsym failed (%s).", __FUNCTION__, depth_generator_lib.c_str());
     dlclose(depth_generator_lib_handle_);
     depth_generator_lib_handle_ = nullptr;
     return NO_INIT;
@@ -512,11 +671,10 @@ status_t DepthProcessBlock::MapBuffersForDepthGenerator(
     return UNKNOWN_ERROR;
   }
 
-  void* virtual_addr =
-      mmap(NULL, stream_buffer_sizes_[stream_id], (PROT_READ | PROT_WRITE),
-           MAP_SHARED, buffer_handle->data[0], 0);
-
-  if (virtual_addr == nullptr || virtual_addr == reinterpret_cast<void*>(-1)) {
+  uint8_t* virtual_addr = nullptr;
+  status_t res = buffer_mapping_cache_->Map(
+      buffer_handle->data[0], stream_buffer_sizes_[stream_id], &virtual_addr);
+  if (res != OK) {
     ALOGE("%s: Failed to map the stream buffer to virtual addr.", __FUNCTION__);
     return UNKNOWN_ERROR;
   }
@@ -526,7 +684,7 @@ status_t DepthProcessBlock::MapBuffersForDepthGenerator(
   buffer->width = stream.width;
   buffer->height = stream.height;
   depth_generator::BufferPlane buffer_plane = {};
-  buffer_plane.addr = reinterpret_cast<uint8_t*>(virtual_addr);
+  buffer_plane.addr = virtual_addr;
   // TODO(b/130764929): Use actual gralloc buffer stride instead of stream dim
   buffer_plane.stride = stream.width;
   buffer_plane.scanline = stream.height;
@@ -550,8 +708,9 @@ status_t DepthProcessBlock::UnmapBuffersForDepthGenerator(
     return UNKNOWN_ERROR;
   }
 
-  munmap(addr, stream_buffer_sizes_[stream_id]);
-  return OK;
+  // Output buffers are returned to the framework, which may free them.
+  bool is_input = stream_id != depth_stream_.id;
+  return buffer_mapping_cache_->Unmap(addr, /*keep_mapping=*/is_input);
 }
 
 status_t DepthProcessBlock::RequestDepthStreamBuffer(
@@ -713,42 +872,15 @@ status_t DepthProcessBlock::PrepareDepthRequestInfo(
     return UNKNOWN_ERROR;
   }
 
-  {
-    uint32_t frame_number = request.frame_number;
-    std::lock_guard<std::mutex> lock(pending_requests_mutex_);
-    if (pending_depth_requests_.find(frame_number) !=
-        pending_depth_requests_.end()) {
-      ALOGE("%s: Frame %u already exists in pending requests.", __FUNCTION__,
-            request.frame_number);
-      return UNKNOWN_ERROR;
-    } else {
-      pending_depth_requests_[frame_number] = {};
-      auto& pending_request = pending_depth_requests_[frame_number].request;
-      pending_request.frame_number = frame_number;
-      pending_request.input_buffers = request.input_buffers;
-      pending_request.output_buffers = request.output_buffers;
-      auto& pending_depth_request =
-          pending_depth_requests_[frame_number].depth_request;
-      pending_depth_request = *depth_request_info;
-    }
-  }
-
   return OK;
 }
 
-status_t DepthProcessBlock::UnmapDepthRequestBuffers(uint32_t frame_number) {
-  std::lock_guard<std::mutex> lock(pending_requests_mutex_);
-  if (pending_depth_requests_.find(frame_number) ==
-      pending_depth_requests_.end()) {
-    ALOGE("%s: Can not find frame %u in pending requests list.", __FUNCTION__,
-          frame_number);
-    return BAD_VALUE;
-  }
-
-  auto& request = pending_depth_requests_[frame_number].request;
-  auto& depth_request_info = pending_depth_requests_[frame_number].depth_request;
-
+status_t DepthProcessBlock::UnmapDepthRequestBuffers(
+    const PendingDepthRequestInfo& pending_request) {
   ATRACE_CALL();
+  auto& request = pending_request.request;
+  auto& depth_request_info = pending_request.depth_request;
+
   if (request.input_buffers.size() < 2 || request.input_buffers.size() > 3 ||
       request.output_buffers.size() != 1) {
     ALOGE(
@@ -765,7 +897,7 @@ status_t DepthProcessBlock::UnmapDepthRequestBuffers(uint32_t frame_number) {
     int32_t stream_id = input_buffer.stream_id;
     if (stream_id == kInvalidStreamId) {
       ALOGV("%s: input buffer place holder found for frame %u", __FUNCTION__,
-            frame_number);
+            request.frame_number);
       continue;
     }
 
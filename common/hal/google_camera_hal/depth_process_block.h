@@ -19,6 +19,7 @@
 
 #include <map>
 
+#include "buffer_mapping_cache.h"
 #include "depth_generator.h"
 #include "hwl_types.h"
 #include "process_block.h"
@@ -41,6 +42,14 @@ class DepthProcessBlock : public ProcessBlock {
     int32_t ir1_internal_raw_stream_id = -1;
     // stream id of the internal raw stream from IR 2
     int32_t ir2_internal_raw_stream_id = -1;
+    // Maximum number of depth requests submitted to the depth generator whose
+    // results have not been returned. Preparing a request overlaps with the
+    // depth generator processing previous ones within this window. Requests
+    // beyond the window are queued and submitted as earlier requests return.
+    uint32_t max_inflight_requests = 3;
+    // Maximum number of buffers of each internal input stream. Mappings of
+    // up to this many idle buffers per input stream are kept for reuse.
+    uint32_t max_buffers_per_input_stream = 8;
   };
   // Create a DepthProcessBlock.
   static std::unique_ptr<DepthProcessBlock> Create(
@@ -48,6 +57,14 @@ class DepthProcessBlock : public ProcessBlock {
       HwlRequestBuffersFunc request_stream_buffers,
       const DepthProcessBlockCreateData& create_data);
 
+  // Create a DepthProcessBlock that uses depth_generator instead of loading
+  // the depth generator library when streams are configured.
+  static std::unique_ptr<DepthProcessBlock> Create(
+      CameraDeviceSessionHwl* device_session_hwl,
+      HwlRequestBuffersFunc request_stream_buffers,
+      const DepthProcessBlockCreateData& create_data,
+      std::unique_ptr<DepthGenerator> depth_generator);
+
   virtual ~DepthProcessBlock();
 
   // Override functions of ProcessBlock start.
@@ -75,10 +92,19 @@ class DepthProcessBlock : public ProcessBlock {
   struct PendingDepthRequestInfo {
     CaptureRequest request;
     DepthRequestInfo depth_request;
+    // Settings and color buffer metadata that depth_request points to. They
+    // must stay valid until the depth generator returns the request.
+    std::unique_ptr<HalCameraMetadata> settings;
+    std::unique_ptr<HalCameraMetadata> color_metadata;
+    // Whether the request has been submitted to the depth generator.
+    bool submitted = false;
+    // Whether the depth generator has returned the request and its status.
+    bool completed = false;
+    DepthResultStatus result_status = DepthResultStatus::kOk;
   };
 
   static constexpr int32_t kInvalidStreamId = -1;
-  const uint32_t kDepthStreamMaxBuffers = 8;
+  static constexpr uint32_t kDepthStreamMaxBuffers = 8;
 
   // Callback function to request stream buffer from camera device session
   const HwlRequestBuffersFunc request_stream_buffers_;
@@ -93,7 +119,9 @@ class DepthProcessBlock : public ProcessBlock {
   // Get the gralloc buffer size of a stream
   status_t GetStreamBufferSize(const Stream& stream, int32_t* buffer_size);
 
-  // Ummap the input and output buffers
+  // Release the mapping of an input or output buffer. Mappings of internal
+  // input buffers stay in buffer_mapping_cache_ so the buffer is not mapped
+  // again next time. Output buffers belong to the framework and are unmapped.
   status_t UnmapBuffersForDepthGenerator(const StreamBuffer& stream_buffer,
                                          uint8_t* addr);
 
@@ -104,7 +132,13 @@ class DepthProcessBlock : public ProcessBlock {
                                    const HalCameraMetadata* color_metadata);
 
   // Clean up a depth request info by unmapping the buffers
-  status_t UnmapDepthRequestBuffers(uint32_t frame_number);
+  status_t UnmapDepthRequestBuffers(
+      const PendingDepthRequestInfo& pending_request);
+
+  // Prepare a depth request, add it to pending_depth_requests_ and submit it
+  // to the depth generator once the in-flight window has room for it. It
+  // does not wait for the window; a request that doesn't fit stays queued.
+  status_t ProcessDepthRequest(const CaptureRequest& request);
 
   // Caclculate the ratio of logical camera active array size comparing to the
   // IR camera active array size
@@ -130,13 +164,22 @@ class DepthProcessBlock : public ProcessBlock {
   // Submit a depth request through the blocking depth generator API
   status_t SubmitBlockingDepthRequest(const DepthRequestInfo& request_info);
 
-  // Submit a detph request through the asynchronized depth generator API
-  status_t SubmitAsyncDepthRequest(const DepthRequestInfo& request_info);
+  // Submit queued depth requests in frame number order through the
+  // asynchronized depth generator API until the in-flight window is full.
+  // Must be called without depth_generator_api_lock_ locked, as the depth
+  // generator may return results from within EnqueueProcessRequest().
+  void SubmitQueuedDepthRequests();
 
   // Process the depth result of frame frame_number
   status_t ProcessDepthResult(DepthResultStatus result_status,
                               uint32_t frame_number);
 
+  // Mark frame frame_number completed and return the results of the completed
+  // requests that are no longer behind an earlier pending request. Must be
+  // called with depth_generator_api_lock_ locked.
+  status_t CompleteDepthRequestLocked(DepthResultStatus result_status,
+                                      uint32_t frame_number);
+
   // Map all buffers needed by a depth request from request
   status_t MapDepthRequestBuffers(const CaptureRequest& request,
                                   DepthRequestInfo* depth_request_info);
@@ -169,6 +212,11 @@ class DepthProcessBlock : public ProcessBlock {
   // Map from stream id to the stream
   std::map<int32_t, Stream> depth_io_streams_;
 
+  // CPU mappings of the input buffers passed to the depth generator, kept
+  // across requests. Holds up to max_buffers_per_input_stream_ idle mappings
+  // per input stream. Invalidated when streams are configured or flushed.
+  std::unique_ptr<BufferMappingCache> buffer_mapping_cache_;
+
   // Ratio of logical camera active array size comparing to IR camera active
   // array size.
   float logical_to_ir_ratio_ = 1.0;
@@ -189,10 +237,23 @@ class DepthProcessBlock : public ProcessBlock {
   // Whether the pipelined depth engine is enabled
   bool pipelined_depth_engine_enabled_ = false;
 
+  // Maximum number of depth requests submitted to the depth generator.
+  uint32_t max_inflight_requests_ = 1;
+
   std::mutex pending_requests_mutex_;
-  // Pending depth request indexed by the frame_number
-  // Must be protected by pending_requests_mutex_
-  std::unordered_map<uint32_t, PendingDepthRequestInfo> pending_depth_requests_;
+  // Pending depth request indexed by the frame_number. Results are returned in
+  // frame number order, so completed requests stay here until all earlier
+  // requests complete. Must be protected by pending_requests_mutex_
+  std::map<uint32_t, PendingDepthRequestInfo> pending_depth_requests_;
+
+  // Number of requests in pending_depth_requests_ that have been submitted
+  // and not completed. Must be protected by pending_requests_mutex_
+  uint32_t num_inflight_requests_ = 0;
+
+  // Whether a thread is submitting the queued requests. Only one thread
+  // submits at a time so requests reach the depth generator in order. Must be
+  // protected by pending_requests_mutex_
+  bool submitting_queued_requests_ = false;
 
   // Whether RGB-IR auto-calibration is enabled. This affects how the internal
   // YUV stream results are handled.
@@ -205,7 +266,12 @@ class DepthProcessBlock : public ProcessBlock {
   // stream id of the internal raw stream from IR 2
   int32_t ir2_internal_raw_stream_id_ = kInvalidStreamId;
 
-  // Guarding async depth generator API calls and the result processing calls
+  // Maximum number of buffers of each internal input stream.
+  const uint32_t max_buffers_per_input_stream_ = 0;
+
+  // Guarding the result processing calls. It keeps results returned in order
+  // when the depth generator notifies results from multiple threads. It is
+  // not held while calling into the depth generator.
   std::mutex depth_generator_api_lock_;
 };
 
@@ -148,7 +148,8 @@ status_t DualIrRequestProcessor::ProcessRequest(const CaptureRequest& request) {
     block_requests.push_back(std::move(block_request));
   }
 
-  return process_block_->ProcessRequests(block_requests, request);
+  return process_block_->ProcessOwnedRequests(std::move(block_requests),
+                                              request);
 }
 
 status_t DualIrRequestProcessor::Flush() {
@@ -47,6 +47,25 @@ DualIrResultRequestProcessor::Create(CameraDeviceSessionHwl* device_session_hwl,
     return nullptr;
   }
 
+  DualIrResultRequestProcessor* processor = result_processor.get();
+  result_processor->pending_result_metadata_ =
+      MultiCameraFrameAssembler<PendingResultMetadata>::Create(
+          [processor](uint32_t frame_number,
+                      PendingResultMetadata pending_result_metadata) {
+            processor->SendResultMetadata(frame_number,
+                                          std::move(pending_result_metadata));
+          },
+          [](uint32_t frame_number, uint32_t arrived_parts,
+             PendingResultMetadata /*pending_result_metadata*/) {
+            ALOGW("%s: Dropping result metadata of frame %u (parts 0x%x)",
+                  __FUNCTION__, frame_number, arrived_parts);
+          });
+  if (result_processor->pending_result_metadata_ == nullptr) {
+    ALOGE("%s: Creating pending result metadata assembler failed.",
+          __FUNCTION__);
+    return nullptr;
+  }
+
   return result_processor;
 }
 
@@ -60,6 +79,10 @@ DualIrResultRequestProcessor::DualIrResultRequestProcessor(
   for (auto& stream : stream_config.streams) {
     if (stream.is_physical_camera_stream) {
       stream_camera_ids_[stream.id] = stream.physical_camera_id;
+      uint32_t index;
+      if (!GetPhysicalMetadataIndex(stream.physical_camera_id, &index)) {
+        physical_camera_ids_.push_back(stream.physical_camera_id);
+      }
     } else {
       stream_camera_ids_[stream.id] = kLogicalCameraId;
     }
@@ -70,7 +93,7 @@ void DualIrResultRequestProcessor::SetResultCallback(
     ProcessCaptureResultFunc process_capture_result, NotifyFunc notify,
     ProcessBatchCaptureResultFunc /*process_batch_capture_result*/) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(callback_lock_);
+  std::unique_lock<std::shared_mutex> lock(callback_lock_);
   process_capture_result_ = process_capture_result;
   notify_ = notify;
 }
@@ -96,30 +119,44 @@ bool DualIrResultRequestProcessor::IsFrameworkPhyiscalStream(
   return true;
 }
 
-status_t DualIrResultRequestProcessor::AddPendingPhysicalCameraMetadata(
-    const ProcessBlockRequest& block_request,
-    std::map<uint32_t, std::unique_ptr<HalCameraMetadata>>* physical_metadata) {
-  ATRACE_CALL();
-  if (physical_metadata == nullptr) {
-    ALOGE("%s: physical_metadata is nullptr.", __FUNCTION__);
-    return BAD_VALUE;
+bool DualIrResultRequestProcessor::GetPhysicalMetadataIndex(
+    uint32_t physical_camera_id, uint32_t* index) const {
+  for (uint32_t i = 0; i < physical_camera_ids_.size(); i++) {
+    if (physical_camera_ids_[i] == physical_camera_id) {
+      *index = i;
+      return true;
+    }
   }
 
+  return false;
+}
+
+uint32_t DualIrResultRequestProcessor::GetPhysicalMetadataPart(
+    uint32_t index) const {
+  return kLogicalMetadataPart << (index + 1);
+}
+
+uint32_t DualIrResultRequestProcessor::GetPhysicalMetadataParts(
+    const ProcessBlockRequest& block_request) const {
+  ATRACE_CALL();
+  uint32_t parts = 0;
   for (auto& buffer : block_request.request.output_buffers) {
     uint32_t physical_camera_id;
-    if (IsFrameworkPhyiscalStream(buffer.stream_id, &physical_camera_id)) {
-      // Add physical_camera_id to physical_metadata.
-      (*physical_metadata)[physical_camera_id] = nullptr;
+    uint32_t index;
+    if (IsFrameworkPhyiscalStream(buffer.stream_id, &physical_camera_id) &&
+        GetPhysicalMetadataIndex(physical_camera_id, &index)) {
+      parts |= GetPhysicalMetadataPart(index);
     }
   }
 
-  return OK;
+  return parts;
 }
 
 status_t DualIrResultRequestProcessor::AddPendingRequests(
     const std::vector<ProcessBlockRequest>& process_block_requests,
     const CaptureRequest& remaining_session_request) {
   ATRACE_CALL();
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
   // This is the last result processor. Sanity check if requests contains
   // all remaining output buffers.
   if (!hal_utils::AreAllRemainingBuffersRequested(process_block_requests,
@@ -128,60 +165,39 @@ status_t DualIrResultRequestProcessor::AddPendingRequests(
     return BAD_VALUE;
   }
 
-  // Create new pending result metadata.
-  PendingResultMetadata pending_result_metadata;
+  // Create new pending result metadata expecting the logical camera's and
+  // the requested physical cameras' result metadata.
+  uint32_t expected_parts = kLogicalMetadataPart;
   for (auto& block_request : process_block_requests) {
-    status_t res = AddPendingPhysicalCameraMetadata(
-        block_request, &pending_result_metadata.physical_metadata);
-    if (res != OK) {
-      ALOGE("%s: Failed to fill pending physical camera metadata: %s(%d)",
-            __FUNCTION__, strerror(-res), res);
-      return res;
-    }
+    expected_parts |= GetPhysicalMetadataParts(block_request);
   }
 
-  uint32_t frame_number = process_block_requests[0].request.frame_number;
-
-  std::lock_guard<std::mutex> lock(pending_result_metadata_mutex_);
-  pending_result_metadata_[frame_number] = std::move(pending_result_metadata);
+  PendingResultMetadata pending_result_metadata;
+  pending_result_metadata.physical_metadata.resize(physical_camera_ids_.size());
 
-  return OK;
+  uint32_t frame_number = process_block_requests[0].request.frame_number;
+  return pending_result_metadata_->AddFrame(frame_number, expected_parts,
+                                            std::move(pending_result_metadata));
 }
 
-void DualIrResultRequestProcessor::TrySendingResultMetadataLocked(
-    uint32_t frame_number) {
+void DualIrResultRequestProcessor::SendResultMetadata(
+    uint32_t frame_number, PendingResultMetadata pending_result_metadata) {
   ATRACE_CALL();
-  auto pending_result_metadata_iter =
-      pending_result_metadata_.find(frame_number);
-  if (pending_result_metadata_iter == pending_result_metadata_.end()) {
-    ALOGE("%s: Can't find pending result for frame number %u", __FUNCTION__,
-          frame_number);
-    return;
-  }
-
-  // Check if we got result metadata from all cameras for this frame.
-  auto& pending_result_metadata = pending_result_metadata_iter->second;
-  if (pending_result_metadata.metadata == nullptr) {
-    // No metadata for logical camera yet.
-    return;
-  }
-
-  for (auto& [camera_id, metadata] : pending_result_metadata.physical_metadata) {
-    if (metadata == nullptr) {
-      // No metadata for this physical camera yet.
-      return;
-    }
-  }
-
   // Prepare the result.
   auto result = std::make_unique<CaptureResult>();
   result->frame_number = frame_number;
   result->partial_result = 1;
   result->result_metadata = std::move(pending_result_metadata.metadata);
 
-  for (auto& [camera_id, metadata] : pending_result_metadata.physical_metadata) {
+  for (uint32_t i = 0; i < physical_camera_ids_.size(); i++) {
+    auto& metadata = pending_result_metadata.physical_metadata[i];
+    if (metadata == nullptr) {
+      // This physical camera's result metadata is not requested.
+      continue;
+    }
+
     PhysicalCameraMetadata physical_metadata = {
-        .physical_camera_id = camera_id,
+        .physical_camera_id = physical_camera_ids_[i],
         .metadata = std::move(metadata),
     };
 
@@ -189,30 +205,19 @@ void DualIrResultRequestProcessor::TrySendingResultMetadataLocked(
   }
 
   process_capture_result_(std::move(result));
-  pending_result_metadata_.erase(pending_result_metadata_iter);
 }
 
 status_t DualIrResultRequestProcessor::ProcessResultMetadata(
     uint32_t frame_number, uint32_t physical_camera_id,
     std::unique_ptr<HalCameraMetadata> result_metadata) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(pending_result_metadata_mutex_);
-  auto pending_result_metadata_iter =
-      pending_result_metadata_.find(frame_number);
-  if (pending_result_metadata_iter == pending_result_metadata_.end()) {
-    ALOGE("%s: frame number %u is not expected.", __FUNCTION__, frame_number);
-    return BAD_VALUE;
+  uint32_t physical_metadata_index = 0;
+  uint32_t physical_metadata_part = 0;
+  if (GetPhysicalMetadataIndex(physical_camera_id, &physical_metadata_index)) {
+    physical_metadata_part = GetPhysicalMetadataPart(physical_metadata_index);
   }
 
-  auto& pending_result_metadata = pending_result_metadata_iter->second;
-
   if (physical_camera_id == kLeadCameraId) {
-    if (pending_result_metadata.metadata != nullptr) {
-      ALOGE("%s: Already received metadata from camera %u for frame %u",
-            __FUNCTION__, physical_camera_id, frame_number);
-      return UNKNOWN_ERROR;
-    }
-
     // Set lead camera id to multi camera metadata
     std::string activePhysicalId = std::to_string(kLeadCameraId);
     if (OK != result_metadata->Set(
@@ -221,41 +226,61 @@ status_t DualIrResultRequestProcessor::ProcessResultMetadata(
                   static_cast<uint32_t>(activePhysicalId.size() + 1))) {
       ALOGE("Failure in setting active physical camera");
     }
-
-    // Logical camera's result metadata is a clone of the lead camera's
-    // result metadata.
-    pending_result_metadata.metadata = std::move(result_metadata);
   }
 
-  // Add the physical result metadata to pending result metadata if needed.
-  auto physical_metadata_iter =
-      pending_result_metadata.physical_metadata.find(physical_camera_id);
-  if (physical_metadata_iter != pending_result_metadata.physical_metadata.end()) {
-    // If the pending result metadata have physical metadata for a physical
-    // camera ID, the physical result metadata is needed.
-    if (physical_metadata_iter->second != nullptr) {
-      ALOGE("%s: Already received result metadata for camera %u for frame %u",
-            __FUNCTION__, physical_camera_id, frame_number);
-      return UNKNOWN_ERROR;
+  // Logical camera's result metadata is the lead camera's result metadata. If
+  // the lead camera's physical result metadata is also requested, it's a clone
+  // of the logical camera's result metadata.
+  status_t res = NAME_NOT_FOUND;
+  if (physical_camera_id == kLeadCameraId) {
+    res = pending_result_metadata_->AddParts(
+        frame_number, kLogicalMetadataPart | physical_metadata_part,
+        [&](PendingResultMetadata* pending) {
+          if (physical_metadata_part != 0) {
+            pending->physical_metadata[physical_metadata_index] =
+                HalCameraMetadata::Clone(result_metadata.get());
+          }
+          pending->metadata = std::move(result_metadata);
+        });
+    if (res == ALREADY_EXISTS && physical_metadata_part != 0) {
+      res = pending_result_metadata_->AddParts(
+          frame_number, kLogicalMetadataPart,
+          [&](PendingResultMetadata* pending) {
+            pending->metadata = std::move(result_metadata);
+          });
     }
+  } else if (physical_metadata_part != 0) {
+    res = pending_result_metadata_->AddParts(
+        frame_number, physical_metadata_part,
+        [&](PendingResultMetadata* pending) {
+          pending->physical_metadata[physical_metadata_index] =
+              std::move(result_metadata);
+        });
+  } else {
+    // The result metadata of this camera is not needed.
+    return OK;
+  }
 
-    if (physical_camera_id == kLeadCameraId) {
-      // If this physical camera is the lead camera, clone the result metadata
-      // from the logical camera's result metadata.
-      physical_metadata_iter->second =
-          HalCameraMetadata::Clone(pending_result_metadata.metadata.get());
-    } else {
-      physical_metadata_iter->second = std::move(result_metadata);
+  if (res == NAME_NOT_FOUND) {
+    ALOGE("%s: frame number %u is not expected.", __FUNCTION__, frame_number);
+    return BAD_VALUE;
+  } else if (res == ALREADY_EXISTS) {
+    // The physical result metadata of a camera may not be requested for this
+    // frame.
+    if (physical_camera_id != kLeadCameraId) {
+      return OK;
     }
+    ALOGE("%s: Already received metadata from camera %u for frame %u",
+          __FUNCTION__, physical_camera_id, frame_number);
+    return UNKNOWN_ERROR;
   }
 
-  TrySendingResultMetadataLocked(frame_number);
-  return OK;
+  return res;
 }
 
 void DualIrResultRequestProcessor::ProcessResult(ProcessBlockResult block_result) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(callback_lock_);
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
   if (block_result.result == nullptr) {
     ALOGW("%s: Received a nullptr result.", __FUNCTION__);
     return;
@@ -271,7 +296,8 @@ void DualIrResultRequestProcessor::ProcessResult(ProcessBlockResult block_result
   uint32_t camera_id = block_result.request_id;
 
   // Process result metadata separately because there could be two result
-  // metadata (one from each camera).
+  // metadata (one from each camera). Results from both cameras are processed
+  // concurrently.
   auto result = std::move(block_result.result);
   if (result->result_metadata != nullptr) {
     status_t res = ProcessResultMetadata(result->frame_number, camera_id,
@@ -294,7 +320,7 @@ void DualIrResultRequestProcessor::ProcessResult(ProcessBlockResult block_result
 void DualIrResultRequestProcessor::Notify(
     const ProcessBlockNotifyMessage& block_message) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(callback_lock_);
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
   if (notify_ == nullptr) {
     ALOGE("%s: notify_ is nullptr. Dropping a message.", __FUNCTION__);
     return;
@@ -349,6 +375,11 @@ status_t DualIrResultRequestProcessor::Flush() {
 
 status_t DualIrResultRequestProcessor::FlushPendingRequests() {
   ATRACE_CALL();
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
+  // Drop the result metadata of frames whose results from all cameras have
+  // not arrived. Late result metadata of the dropped frames is ignored.
+  pending_result_metadata_->Flush();
+  ALOGI("%s: Flushing pending result metadata done.", __FUNCTION__);
   return OK;
 }
 
@@ -18,7 +18,10 @@
 #define HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_DUAL_IR_RESULT_PROCESSOR_H_
 
 #include <map>
+#include <shared_mutex>
+#include <vector>
 
+#include "multicam_frame_assembler.h"
 #include "request_processor.h"
 #include "result_processor.h"
 
@@ -81,12 +84,16 @@ class DualIrResultRequestProcessor : public ResultProcessor,
   const uint32_t kLogicalCameraId;
   const uint32_t kLeadCameraId;
 
+  // Part of a frame's result metadata for the logical camera.
+  static constexpr uint32_t kLogicalMetadataPart = 1;
+
   // Define a pending result metadata
   struct PendingResultMetadata {
     // Result metadata for the logical camera.
     std::unique_ptr<HalCameraMetadata> metadata;
-    // Map from a physical camera ID to the physical camera's result metadata.
-    std::map<uint32_t, std::unique_ptr<HalCameraMetadata>> physical_metadata;
+    // Physical cameras' result metadata, indexed by the part index of the
+    // physical camera.
+    std::vector<std::unique_ptr<HalCameraMetadata>> physical_metadata;
   };
 
   // If a stream is a physical stream configured by the framework.
@@ -96,19 +103,27 @@ class DualIrResultRequestProcessor : public ResultProcessor,
   bool IsFrameworkPhyiscalStream(int32_t stream_id,
                                  uint32_t* physical_camera_id) const;
 
-  // Add pending physical camera's result metadata to the map.
-  // block_request is a block request used figure out pending results.
-  // physical_metadata is the map to add the pending physical camera's result
-  // metadata to.
-  status_t AddPendingPhysicalCameraMetadata(
-      const ProcessBlockRequest& block_request,
-      std::map<uint32_t, std::unique_ptr<HalCameraMetadata>>* physical_metadata);
+  // Get the mask of the result metadata parts expected for a block request.
+  uint32_t GetPhysicalMetadataParts(
+      const ProcessBlockRequest& block_request) const;
+
+  // Get the index of a physical camera in physical_camera_ids_. Returns false
+  // if the camera is not a physical camera of the framework's stream
+  // configuration.
+  bool GetPhysicalMetadataIndex(uint32_t physical_camera_id,
+                                uint32_t* index) const;
+
+  // Get the result metadata part of the physical camera at index in
+  // physical_camera_ids_.
+  uint32_t GetPhysicalMetadataPart(uint32_t index) const;
 
-  // Try to send result metadata for a frame number if all of it's result
-  // metadata are ready. Must have pending_result_metadata_mutex_ locked.
-  void TrySendingResultMetadataLocked(uint32_t frame_number);
+  // Send the result metadata of a frame whose result metadata from all
+  // cameras have arrived.
+  void SendResultMetadata(uint32_t frame_number,
+                          PendingResultMetadata pending_result_metadata);
 
-  // Process a result metadata and update the pending result metadata map.
+  // Process a result metadata and add it to the frame's pending result
+  // metadata.
   status_t ProcessResultMetadata(
       uint32_t frame_number, uint32_t physical_camera_id,
       std::unique_ptr<HalCameraMetadata> result_metadata);
@@ -116,13 +131,19 @@ class DualIrResultRequestProcessor : public ResultProcessor,
   // Map from a stream ID to a camera ID based on framework stream configuration.
   std::map<int32_t, uint32_t> stream_camera_ids_;
 
-  std::mutex pending_result_metadata_mutex_;
+  // Physical camera IDs of the framework's stream configuration. The result
+  // metadata part of a physical camera is 1 << (index + 1).
+  std::vector<uint32_t> physical_camera_ids_;
 
-  // Map from a frame number to the pending result metadata. Must be protected
-  // by pending_result_metadata_mutex_.
-  std::map<uint32_t, PendingResultMetadata> pending_result_metadata_;
+  // Assembles the result metadata of each frame from the logical and physical
+  // cameras.
+  std::unique_ptr<MultiCameraFrameAssembler<PendingResultMetadata>>
+      pending_result_metadata_;
 
-  std::mutex callback_lock_;
+  // Locked exclusively to set the callbacks and shared while requests,
+  // results and messages use them, so results and messages are delivered
+  // concurrently but never while the callbacks change.
+  std::shared_mutex callback_lock_;
 
   // The following callbacks must be protected by callback_lock_.
   ProcessCaptureResultFunc process_capture_result_;
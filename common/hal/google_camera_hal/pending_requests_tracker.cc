@@ -52,98 +52,154 @@ status_t PendingRequestsTracker::Initialize(
     const std::vector<HalStream>& hal_configured_streams,
     const std::unordered_map<int32_t, int32_t>& grouped_stream_id_map,
     const std::set<int32_t>& hal_buffer_managed_stream_ids) {
-  hal_buffer_managed_stream_ids_ = hal_buffer_managed_stream_ids;
-  grouped_stream_id_map_ = grouped_stream_id_map;
+  // If the stream is part of a stream group, return the single stream id
+  // representing the group. Otherwise, return the id that's passed in.
+  auto override_stream_id_for_group =
+      [&grouped_stream_id_map](int32_t stream_id) {
+        auto group_it = grouped_stream_id_map.find(stream_id);
+        return group_it == grouped_stream_id_map.end() ? stream_id
+                                                       : group_it->second;
+      };
+
+  std::unordered_map<int32_t, StreamQuota*> quotas;
   for (auto& hal_stream : hal_configured_streams) {
-    int hal_stream_id = OverrideStreamIdForGroup(hal_stream.id);
+    int32_t hal_stream_id = override_stream_id_for_group(hal_stream.id);
     // For grouped hal streams, only use one stream to represent the whole group
-    if (hal_stream_id == hal_stream.id) {
-      auto [max_buffer_it, max_buffer_inserted] =
-          stream_max_buffers_.emplace(hal_stream_id, hal_stream.max_buffers);
-      if (!max_buffer_inserted) {
-        ALOGE("%s: There are duplicated stream id %d", __FUNCTION__,
-              hal_stream_id);
-        return BAD_VALUE;
+    if (hal_stream_id != hal_stream.id) {
+      continue;
+    }
+
+    auto quota = std::make_unique<StreamQuota>();
+    quota->stream_id = hal_stream_id;
+    quota->max_buffers = hal_stream.max_buffers;
+    quota->hal_buffer_managed =
+        hal_buffer_managed_stream_ids.find(hal_stream_id) !=
+        hal_buffer_managed_stream_ids.end();
+
+    // Include all stream IDs in the same group in first requested stream IDs.
+    quota->first_requested_stream_ids.push_back(hal_stream_id);
+    for (auto& [id_in_group, group_stream_id] : grouped_stream_id_map) {
+      if (group_stream_id == hal_stream_id) {
+        quota->first_requested_stream_ids.push_back(id_in_group);
       }
+    }
+
+    auto [quota_it, quota_inserted] = quotas.emplace(hal_stream_id, quota.get());
+    if (!quota_inserted) {
+      ALOGE("%s: There are duplicated stream id %d", __FUNCTION__,
+            hal_stream_id);
+      return BAD_VALUE;
+    }
+    stream_quotas_.push_back(std::move(quota));
+  }
 
-      stream_pending_buffers_.emplace(hal_stream_id, /*pending_buffers=*/0);
-      stream_acquired_buffers_.emplace(hal_stream_id, /*pending_buffers=*/0);
+  // Precompute the quota of every stream ID, including the stream IDs within
+  // a stream group.
+  auto add_stream_entry = [&](int32_t stream_id) {
+    auto quota_it = quotas.find(override_stream_id_for_group(stream_id));
+    if (quota_it == quotas.end()) {
+      return;
     }
+
+    StreamEntry entry = {
+        .quota = quota_it->second,
+        .hal_buffer_managed = hal_buffer_managed_stream_ids.find(stream_id) !=
+                              hal_buffer_managed_stream_ids.end(),
+    };
+    stream_entries_.emplace(stream_id, entry);
+  };
+
+  for (auto& hal_stream : hal_configured_streams) {
+    add_stream_entry(hal_stream.id);
+  }
+  for (auto& [id_in_group, group_stream_id] : grouped_stream_id_map) {
+    add_stream_entry(id_in_group);
   }
 
   return OK;
 }
 
-bool PendingRequestsTracker::IsStreamConfigured(int32_t stream_id) const {
-  return stream_max_buffers_.find(stream_id) != stream_max_buffers_.end();
+const PendingRequestsTracker::StreamEntry* PendingRequestsTracker::GetStreamEntry(
+    int32_t stream_id) const {
+  auto entry_it = stream_entries_.find(stream_id);
+  if (entry_it == stream_entries_.end()) {
+    return nullptr;
+  }
+
+  return &entry_it->second;
+}
+
+bool PendingRequestsTracker::TryReserve(std::atomic<uint32_t>* counter,
+                                        uint32_t num_buffers,
+                                        uint32_t max_buffers) {
+  uint32_t current = counter->load();
+  do {
+    if (current + num_buffers > max_buffers) {
+      return false;
+    }
+  } while (!counter->compare_exchange_weak(current, current + num_buffers));
+
+  return true;
+}
+
+bool PendingRequestsTracker::Release(std::atomic<uint32_t>* counter,
+                                     uint32_t num_buffers) {
+  uint32_t current = counter->load();
+  do {
+    if (current < num_buffers) {
+      return false;
+    }
+  } while (!counter->compare_exchange_weak(current, current - num_buffers));
+
+  return true;
 }
 
-int32_t PendingRequestsTracker::OverrideStreamIdForGroup(int32_t stream_id) const {
-  if (grouped_stream_id_map_.count(stream_id) == 1) {
-    return grouped_stream_id_map_.at(stream_id);
-  } else {
-    return stream_id;
+void PendingRequestsTracker::NotifyWaiters(
+    const std::atomic<uint32_t>& num_waiters, std::mutex* mutex,
+    std::condition_variable* cond) {
+  // The counters are released before num_waiters is read. A waiter increases
+  // num_waiters before checking the counters under the mutex, so it either
+  // sees the released buffers or is counted here.
+  if (num_waiters.load() == 0) {
+    return;
   }
+
+  {
+    // Synchronize with a waiter that is between checking the counters and
+    // starting to wait.
+    std::lock_guard<std::mutex> lock(*mutex);
+  }
+  cond->notify_all();
 }
 
-void PendingRequestsTracker::TrackRequestBuffersLocked(
-    const std::vector<StreamBuffer>& requested_buffers) {
+status_t PendingRequestsTracker::TrackReturnedResultBuffers(
+    const std::vector<StreamBuffer>& returned_buffers) {
   ATRACE_CALL();
 
-  for (auto& buffer : requested_buffers) {
-    int32_t stream_id = OverrideStreamIdForGroup(buffer.stream_id);
-    if (!IsStreamConfigured(stream_id)) {
-      ALOGW("%s: stream %d was not configured.", __FUNCTION__, stream_id);
+  for (auto& buffer : returned_buffers) {
+    const StreamEntry* entry = GetStreamEntry(buffer.stream_id);
+    if (entry == nullptr) {
+      ALOGW("%s: stream %d was not configured.", __FUNCTION__,
+            buffer.stream_id);
       // Continue to track other buffers.
       continue;
     }
-    if (hal_buffer_managed_stream_ids_.find(stream_id) ==
-        hal_buffer_managed_stream_ids_.end()) {
+    if (!entry->quota->hal_buffer_managed) {
       // Pending requests tracker doesn't track stream ids which aren't HAL
       // buffer managed
       continue;
     }
 
-    stream_pending_buffers_[stream_id]++;
-  }
-}
-
-status_t PendingRequestsTracker::TrackReturnedResultBuffers(
-    const std::vector<StreamBuffer>& returned_buffers) {
-  ATRACE_CALL();
-
-  {
-    std::lock_guard<std::mutex> lock(pending_requests_mutex_);
-    for (auto& buffer : returned_buffers) {
-      int32_t stream_id = OverrideStreamIdForGroup(buffer.stream_id);
-      if (hal_buffer_managed_stream_ids_.find(stream_id) ==
-          hal_buffer_managed_stream_ids_.end()) {
-        // Pending requests tracker doesn't track stream ids which aren't HAL
-        // buffer managed
-        continue;
-      }
-      if (!IsStreamConfigured(stream_id)) {
-        ALOGW("%s: stream %d was not configured.", __FUNCTION__, stream_id);
-        // Continue to track other buffers.
-        continue;
-      }
-
-      if (stream_pending_buffers_[stream_id] == 0) {
-        ALOGE("%s: stream %d should not have any pending quota buffers.",
-              __FUNCTION__, stream_id);
-        // Continue to track other buffers.
-        continue;
-      }
-
-      stream_pending_buffers_[stream_id]--;
-      if (stream_pending_buffers_[stream_id] == 0) {
-        ALOGV("%s: stream %d all pending buffers have been returned.",
-              __FUNCTION__, stream_id);
-      }
+    if (!Release(&entry->quota->pending_buffers, /*num_buffers=*/1)) {
+      ALOGE("%s: stream %d should not have any pending quota buffers.",
+            __FUNCTION__, entry->quota->stream_id);
+      // Continue to track other buffers.
+      continue;
     }
   }
 
-  tracker_request_condition_.notify_one();
+  NotifyWaiters(num_request_waiters_, &pending_requests_mutex_,
+                &tracker_request_condition_);
   return OK;
 }
 
@@ -151,96 +207,91 @@ status_t PendingRequestsTracker::TrackReturnedAcquiredBuffers(
     const std::vector<StreamBuffer>& returned_buffers) {
   ATRACE_CALL();
 
-  {
-    std::lock_guard<std::mutex> lock(pending_acquisition_mutex_);
-    for (auto& buffer : returned_buffers) {
-      int32_t stream_id = OverrideStreamIdForGroup(buffer.stream_id);
-      if (!IsStreamConfigured(stream_id)) {
-        ALOGW("%s: stream %d was not configured.", __FUNCTION__, stream_id);
-        // Continue to track other buffers.
-        continue;
-      }
-      if (hal_buffer_managed_stream_ids_.find(stream_id) ==
-          hal_buffer_managed_stream_ids_.end()) {
-        // Pending requests tracker doesn't track stream ids which aren't HAL
-        // buffer managed
-        continue;
-      }
-      if (stream_acquired_buffers_[stream_id] == 0) {
-        if (buffer.status == BufferStatus::kOk) {
-          ALOGE("%s: stream %d should not have any pending acquired buffers.",
-                __FUNCTION__, stream_id);
-        } else {
-          // This may indicate that HAL doesn't intend to process a certain
-          // buffer, so the buffer isn't sent to pipeline and it's not
-          // explicitly allocated and recorded in buffer cache manager.
-          // The buffer still needs to return to framework with an error status
-          // if HAL doesn't process it.
-          ALOGV(
-              "%s: stream %d isn't acquired but returned with buffer status %u",
-              __FUNCTION__, stream_id, buffer.status);
-        }
-        // Continue to track other buffers.
-        continue;
-      }
+  for (auto& buffer : returned_buffers) {
+    const StreamEntry* entry = GetStreamEntry(buffer.stream_id);
+    if (entry == nullptr) {
+      ALOGW("%s: stream %d was not configured.", __FUNCTION__,
+            buffer.stream_id);
+      // Continue to track other buffers.
+      continue;
+    }
+    if (!entry->quota->hal_buffer_managed) {
+      // Pending requests tracker doesn't track stream ids which aren't HAL
+      // buffer managed
+      continue;
+    }
 
-      stream_acquired_buffers_[stream_id]--;
+    if (!Release(&entry->quota->acquired_buffers, /*num_buffers=*/1)) {
+      if (buffer.status == BufferStatus::kOk) {
+        ALOGE("%s: stream %d should not have any pending acquired buffers.",
+              __FUNCTION__, entry->quota->stream_id);
+      } else {
+        // This may indicate that HAL doesn't intend to process a certain
+        // buffer, so the buffer isn't sent to pipeline and it's not
+        // explicitly allocated and recorded in buffer cache manager.
+        // The buffer still needs to return to framework with an error status
+        // if HAL doesn't process it.
+        ALOGV("%s: stream %d isn't acquired but returned with buffer status %u",
+              __FUNCTION__, entry->quota->stream_id, buffer.status);
+      }
+      // Continue to track other buffers.
+      continue;
     }
   }
 
-  tracker_acquisition_condition_.notify_one();
+  NotifyWaiters(num_acquisition_waiters_, &pending_acquisition_mutex_,
+                &tracker_acquisition_condition_);
   return OK;
 }
 
 void PendingRequestsTracker::OnBufferCacheFlushed() {
-  std::unique_lock<std::mutex> lock(pending_requests_mutex_);
-  requested_stream_ids_.clear();
+  for (auto& quota : stream_quotas_) {
+    quota->requested = false;
+  }
 }
 
-bool PendingRequestsTracker::DoStreamsHaveEnoughBuffersLocked(
-    const std::vector<StreamBuffer>& buffers) const {
-  for (auto& buffer : buffers) {
-    int32_t stream_id = OverrideStreamIdForGroup(buffer.stream_id);
-    if (!IsStreamConfigured(stream_id)) {
-      ALOGE("%s: stream %d was not configured.", __FUNCTION__, stream_id);
-      return false;
+status_t PendingRequestsTracker::TryTrackRequestBuffers(
+    const std::vector<StreamBuffer>& buffers, bool* rolled_back) {
+  *rolled_back = false;
+
+  // Release the buffers reserved before buffers[num_reserved].
+  auto rollback = [this, &buffers, rolled_back](uint32_t num_reserved) {
+    for (uint32_t i = 0; i < num_reserved; i++) {
+      const StreamEntry* entry = GetStreamEntry(buffers[i].stream_id);
+      if (entry->quota->hal_buffer_managed) {
+        Release(&entry->quota->pending_buffers, /*num_buffers=*/1);
+        *rolled_back = true;
+      }
     }
-    if (hal_buffer_managed_stream_ids_.find(stream_id) ==
-        hal_buffer_managed_stream_ids_.end()) {
+  };
+
+  for (uint32_t i = 0; i < buffers.size(); i++) {
+    const StreamEntry* entry = GetStreamEntry(buffers[i].stream_id);
+    if (entry == nullptr) {
+      ALOGE("%s: stream %d was not configured.", __FUNCTION__,
+            buffers[i].stream_id);
+      rollback(i);
+      return BAD_VALUE;
+    }
+    if (!entry->quota->hal_buffer_managed) {
       // Pending requests tracker doesn't track stream ids which aren't HAL
       // buffer managed
       continue;
     }
 
-    if (stream_pending_buffers_.at(stream_id) >=
-        stream_max_buffers_.at(stream_id)) {
+    if (!TryReserve(&entry->quota->pending_buffers, /*num_buffers=*/1,
+                    entry->quota->max_buffers)) {
       ALOGV("%s: stream %d is not ready. max_buffers=%u", __FUNCTION__,
-            stream_id, stream_max_buffers_.at(stream_id));
-      return false;
+            entry->quota->stream_id, entry->quota->max_buffers);
+      rollback(i);
+      return NOT_ENOUGH_DATA;
     }
   }
 
-  return true;
-}
-
-bool PendingRequestsTracker::DoesStreamHaveEnoughBuffersToAcquireLocked(
-    int32_t stream_id, uint32_t num_buffers) const {
-  if (!IsStreamConfigured(stream_id)) {
-    ALOGE("%s: stream %d was not configured.", __FUNCTION__, stream_id);
-    return false;
-  }
-
-  if (stream_acquired_buffers_.at(stream_id) + num_buffers >
-      stream_max_buffers_.at(stream_id)) {
-    ALOGV("%s: stream %d is not ready. max_buffers=%u", __FUNCTION__, stream_id,
-          stream_max_buffers_.at(stream_id));
-    return false;
-  }
-
-  return true;
+  return OK;
 }
 
-status_t PendingRequestsTracker::UpdateRequestedStreamIdsLocked(
+status_t PendingRequestsTracker::UpdateRequestedStreamIds(
     const std::vector<StreamBuffer>& requested_buffers,
     std::vector<int32_t>* first_requested_stream_ids) {
   if (first_requested_stream_ids == nullptr) {
@@ -249,24 +300,18 @@ status_t PendingRequestsTracker::UpdateRequestedStreamIdsLocked(
   }
 
   for (auto& buffer : requested_buffers) {
-    int32_t stream_id = OverrideStreamIdForGroup(buffer.stream_id);
-    if (hal_buffer_managed_stream_ids_.find(stream_id) ==
-        hal_buffer_managed_stream_ids_.end()) {
+    const StreamEntry* entry = GetStreamEntry(buffer.stream_id);
+    if (entry == nullptr || !entry->quota->hal_buffer_managed) {
       // Pending requests tracker doesn't track stream ids which aren't HAL
       // buffer managed
       continue;
     }
-    auto stream_id_iter = requested_stream_ids_.find(stream_id);
-    if (stream_id_iter == requested_stream_ids_.end()) {
-      first_requested_stream_ids->push_back(stream_id);
-
-      // Include all stream IDs in the same group in first_requested_stream_ids
-      for (auto& [id_in_group, group_stream_id] : grouped_stream_id_map_) {
-        if (group_stream_id == stream_id) {
-          first_requested_stream_ids->push_back(id_in_group);
-        }
-      }
-      requested_stream_ids_.emplace(stream_id);
+
+    if (!entry->quota->requested.exchange(true)) {
+      first_requested_stream_ids->insert(
+          first_requested_stream_ids->end(),
+          entry->quota->first_requested_stream_ids.begin(),
+          entry->quota->first_requested_stream_ids.end());
     }
   }
 
@@ -283,22 +328,44 @@ status_t PendingRequestsTracker::WaitAndTrackRequestBuffers(
     return BAD_VALUE;
   }
 
-  std::unique_lock<std::mutex> lock(pending_requests_mutex_);
-  if (!tracker_request_condition_.wait_for(
-          lock, std::chrono::milliseconds(kTrackerTimeoutMs), [this, &request] {
-            return DoStreamsHaveEnoughBuffersLocked(request.output_buffers);
-          })) {
-    ALOGE("%s: Waiting for buffer ready timed out.", __FUNCTION__);
-    return TIMED_OUT;
+  bool rolled_back = false;
+  status_t res = TryTrackRequestBuffers(request.output_buffers, &rolled_back);
+  if (rolled_back) {
+    // A waiter may have found its streams exhausted by the buffers reserved
+    // and released here.
+    NotifyWaiters(num_request_waiters_, &pending_requests_mutex_,
+                  &tracker_request_condition_);
   }
 
-  ALOGV("%s: all streams are ready", __FUNCTION__);
+  if (res == NOT_ENOUGH_DATA) {
+    // Slow path: wait until other requests return buffers. Waiters reserve
+    // and roll back under pending_requests_mutex_, so other waiters never see
+    // their reservations and don't need to be notified.
+    std::unique_lock<std::mutex> lock(pending_requests_mutex_);
+    num_request_waiters_++;
+    bool ready = tracker_request_condition_.wait_for(
+        lock, std::chrono::milliseconds(kTrackerTimeoutMs), [&] {
+          res = TryTrackRequestBuffers(request.output_buffers, &rolled_back);
+          return res != NOT_ENOUGH_DATA;
+        });
+    num_request_waiters_--;
+    if (!ready) {
+      ALOGE("%s: Waiting for buffer ready timed out.", __FUNCTION__);
+      return TIMED_OUT;
+    }
+  }
 
-  TrackRequestBuffersLocked(request.output_buffers);
+  if (res != OK) {
+    ALOGE("%s: Tracking request buffers failed: %s(%d)", __FUNCTION__,
+          strerror(-res), res);
+    return res;
+  }
+
+  ALOGV("%s: all streams are ready", __FUNCTION__);
 
   first_requested_stream_ids->clear();
-  status_t res = UpdateRequestedStreamIdsLocked(request.output_buffers,
-                                                first_requested_stream_ids);
+  res = UpdateRequestedStreamIds(request.output_buffers,
+                                 first_requested_stream_ids);
   if (res != OK) {
     ALOGE("%s: Updating requested stream ID for output buffers failed: %s(%d)",
           __FUNCTION__, strerror(-res), res);
@@ -312,72 +379,76 @@ status_t PendingRequestsTracker::WaitAndTrackAcquiredBuffers(
     int32_t stream_id, uint32_t num_buffers) {
   ATRACE_CALL();
 
-  int32_t overridden_stream_id = OverrideStreamIdForGroup(stream_id);
-  if (hal_buffer_managed_stream_ids_.find(stream_id) ==
-      hal_buffer_managed_stream_ids_.end()) {
+  const StreamEntry* entry = GetStreamEntry(stream_id);
+  if (entry == nullptr) {
+    ALOGW("%s: stream %d was not configured.", __FUNCTION__, stream_id);
+    return BAD_VALUE;
+  }
+  if (!entry->hal_buffer_managed) {
     // Pending requests tracker doesn't track stream ids which aren't HAL buffer managed
     return OK;
   }
-  if (!IsStreamConfigured(overridden_stream_id)) {
-    ALOGW("%s: stream %d was not configured.", __FUNCTION__,
-          overridden_stream_id);
-    // Continue to track other buffers.
-    return BAD_VALUE;
+
+  StreamQuota* quota = entry->quota;
+  if (TryReserve(&quota->acquired_buffers, num_buffers, quota->max_buffers)) {
+    return OK;
   }
 
+  // Slow path: wait until acquired buffers are returned.
+  ALOGV("%s: stream %d is not ready. max_buffers=%u", __FUNCTION__,
+        quota->stream_id, quota->max_buffers);
   std::unique_lock<std::mutex> lock(pending_acquisition_mutex_);
-  if (!tracker_acquisition_condition_.wait_for(
-          lock, std::chrono::milliseconds(kAcquireBufferTimeoutMs),
-          [this, overridden_stream_id, num_buffers] {
-            return DoesStreamHaveEnoughBuffersToAcquireLocked(
-                overridden_stream_id, num_buffers);
-          })) {
+  num_acquisition_waiters_++;
+  bool ready = tracker_acquisition_condition_.wait_for(
+      lock, std::chrono::milliseconds(kAcquireBufferTimeoutMs),
+      [quota, num_buffers] {
+        return TryReserve(&quota->acquired_buffers, num_buffers,
+                          quota->max_buffers);
+      });
+  num_acquisition_waiters_--;
+  if (!ready) {
     ALOGW("%s: Waiting to acquire buffer timed out.", __FUNCTION__);
     return TIMED_OUT;
   }
 
-  stream_acquired_buffers_[overridden_stream_id] += num_buffers;
-
   return OK;
 }
 
 void PendingRequestsTracker::TrackBufferAcquisitionFailure(int32_t stream_id,
                                                            uint32_t num_buffers) {
-  int32_t overridden_stream_id = OverrideStreamIdForGroup(stream_id);
-  if (!IsStreamConfigured(overridden_stream_id)) {
-    ALOGW("%s: stream %d was not configured.", __FUNCTION__,
-          overridden_stream_id);
+  const StreamEntry* entry = GetStreamEntry(stream_id);
+  if (entry == nullptr) {
+    ALOGW("%s: stream %d was not configured.", __FUNCTION__, stream_id);
     // Continue to track other buffers.
     return;
   }
-  if (hal_buffer_managed_stream_ids_.find(stream_id) ==
-      hal_buffer_managed_stream_ids_.end()) {
+  if (!entry->hal_buffer_managed) {
     // Pending requests tracker doesn't track stream ids which aren't HAL buffer managed
     return;
   }
-  std::unique_lock<std::mutex> lock(pending_acquisition_mutex_);
-  stream_acquired_buffers_[overridden_stream_id] -= num_buffers;
+
+  if (!Release(&entry->quota->acquired_buffers, num_buffers)) {
+    ALOGE("%s: stream %d has fewer than %u acquired buffers.", __FUNCTION__,
+          entry->quota->stream_id, num_buffers);
+    return;
+  }
+
+  NotifyWaiters(num_acquisition_waiters_, &pending_acquisition_mutex_,
+                &tracker_acquisition_condition_);
 }
 
 void PendingRequestsTracker::DumpStatus() {
   std::string pending_requests_string = "{";
-  {
-    std::lock_guard<std::mutex> lock(pending_requests_mutex_);
-    for (auto& [stream_id, num_pending_buffers] : stream_pending_buffers_) {
-      pending_requests_string += "{" + std::to_string(stream_id) + ": " +
-                                 std::to_string(num_pending_buffers) + "},";
-    }
-  }
-  pending_requests_string += "}";
-
   std::string pending_acquisition_string = "{";
-  {
-    std::lock_guard<std::mutex> lock(pending_acquisition_mutex_);
-    for (auto& [stream_id, num_acquired_buffers] : stream_acquired_buffers_) {
-      pending_acquisition_string += "{" + std::to_string(stream_id) + ": " +
-                                    std::to_string(num_acquired_buffers) + "},";
-    }
+  for (auto& quota : stream_quotas_) {
+    pending_requests_string += "{" + std::to_string(quota->stream_id) + ": " +
+                               std::to_string(quota->pending_buffers.load()) + "},";
+    pending_acquisition_string += "{" + std::to_string(quota->stream_id) +
+                                  ": " +
+                                  std::to_string(quota->acquired_buffers.load()) +
+                                  "},";
   }
+  pending_requests_string += "}";
   pending_acquisition_string += "}";
 
   ALOGI(
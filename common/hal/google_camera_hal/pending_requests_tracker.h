@@ -17,10 +17,14 @@
 #ifndef HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_PENDING_REQUESTS_TRACKER_H_
 #define HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_PENDING_REQUESTS_TRACKER_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <string>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 #include "hal_types.h"
 
@@ -29,7 +33,9 @@ namespace google_camera_hal {
 
 // PendingRequestsTracker tracks pending requests and can be used to throttle
 // capture requests so the number of stream buffers won't exceed its stream's
-// max number of buffers.
+// max number of buffers. Buffer counts are tracked with per-stream atomic
+// counters; callers only block on a condition when a stream's quota is
+// exhausted.
 class PendingRequestsTracker {
  public:
   static std::unique_ptr<PendingRequestsTracker> Create(
@@ -80,75 +86,95 @@ class PendingRequestsTracker {
   // Duration to wait for when requesting buffer
   static constexpr uint32_t kAcquireBufferTimeoutMs = 50;
 
+  // Buffer quota of a stream or a stream group. The counters are updated with
+  // atomic operations so the uncontended path never takes a lock.
+  struct StreamQuota {
+    // Stream ID representing the stream or the stream group.
+    int32_t stream_id = -1;
+    // Max number of buffers of the stream.
+    uint32_t max_buffers = 0;
+    // If the stream is HAL buffer managed. Only HAL buffer managed streams
+    // are tracked.
+    bool hal_buffer_managed = false;
+    // Stream IDs to report when the stream is requested for the first time.
+    // Includes stream_id and all stream IDs in the same group.
+    std::vector<int32_t> first_requested_stream_ids;
+    // Number of buffers pending return from HWL.
+    std::atomic<uint32_t> pending_buffers{0};
+    // Number of buffers actually acquired from the framework.
+    std::atomic<uint32_t> acquired_buffers{0};
+    // If the stream has been requested since the last buffer cache flush.
+    std::atomic<bool> requested{false};
+  };
+
+  // Precomputed lookup entry for a stream ID. Stream IDs within a stream
+  // group point to the quota of the stream representing the group.
+  struct StreamEntry {
+    StreamQuota* quota = nullptr;
+    // If the stream ID itself (not the group) is HAL buffer managed.
+    bool hal_buffer_managed = false;
+  };
+
   // Initialize the tracker.
   status_t Initialize(
       const std::vector<HalStream>& hal_configured_streams,
       const std::unordered_map<int32_t, int32_t>& grouped_stream_id_map,
       const std::set<int32_t>& hal_buffer_managed_stream_ids);
 
-  // Return if all the buffers' streams have enough buffers to be requested.
-  // Must be protected with pending_requests_mutex_.
-  bool DoStreamsHaveEnoughBuffersLocked(
-      const std::vector<StreamBuffer>& buffers) const;
+  // Return the entry of stream_id, or nullptr if the stream was not
+  // configured when Create() was called.
+  const StreamEntry* GetStreamEntry(int32_t stream_id) const;
+
+  // Try to increase counter by num_buffers if the result does not exceed
+  // max_buffers. Return false if the quota is exhausted.
+  static bool TryReserve(std::atomic<uint32_t>* counter, uint32_t num_buffers,
+                         uint32_t max_buffers);
 
-  // Return if the stream with stream_id have enough buffers to be requested.
-  // Must be protected with pending_acquisition_mutex_.
-  bool DoesStreamHaveEnoughBuffersToAcquireLocked(int32_t stream_id,
-                                                  uint32_t num_buffers) const;
+  // Decrease counter by num_buffers. Return false and leave counter unchanged
+  // if it is smaller than num_buffers.
+  static bool Release(std::atomic<uint32_t>* counter, uint32_t num_buffers);
 
-  // Update requested stream ID and return the stream IDs that have not been
+  // Try to reserve one pending buffer for each of the buffers' streams.
+  // Either all buffers are reserved or none. Return BAD_VALUE if a stream
+  // was not configured, NOT_ENOUGH_DATA if a stream's quota is exhausted.
+  // rolled_back is set to true if buffers reserved by this call were
+  // released again.
+  status_t TryTrackRequestBuffers(const std::vector<StreamBuffer>& buffers,
+                                  bool* rolled_back);
+
+  // Update requested streams and return the stream IDs that have not been
   // requested previously in first_requested_stream_ids.
-  // Must be protected with pending_requests_mutex_.
-  status_t UpdateRequestedStreamIdsLocked(
+  status_t UpdateRequestedStreamIds(
       const std::vector<StreamBuffer>& requested_buffers,
       std::vector<int32_t>* first_requested_stream_ids);
 
-  // Track buffers in capture requests.
-  // Must be protected with pending_requests_mutex_.
-  void TrackRequestBuffersLocked(
-      const std::vector<StreamBuffer>& requested_buffers);
-
-  // Return if a stream ID is configured when Create() was called.
-  bool IsStreamConfigured(int32_t stream_id) const;
+  // Wake up threads waiting in cond if there is any waiter.
+  static void NotifyWaiters(const std::atomic<uint32_t>& num_waiters,
+                            std::mutex* mutex, std::condition_variable* cond);
 
-  // If the stream is part of a stream group, return the single stream id
-  // representing the group. Otherwise, return the id that's passed in.
-  int32_t OverrideStreamIdForGroup(int32_t stream_id) const;
+  // Quotas of configured streams. Each stream group has one quota. The quotas
+  // are created in Initialize() and never reallocated.
+  std::vector<std::unique_ptr<StreamQuota>> stream_quotas_;
 
-  // Map from stream ID to the stream's max number of buffers.
-  std::unordered_map<int32_t, uint32_t> stream_max_buffers_;
-
-  // Condition to signal when a buffer is returned to the client.
-  std::condition_variable tracker_request_condition_;
+  // Map from a configured stream ID to its entry. Not modified after
+  // Initialize().
+  std::unordered_map<int32_t, StreamEntry> stream_entries_;
 
+  // Mutex and condition to wait on when a stream's pending buffer quota is
+  // exhausted. Only used on the slow path.
   std::mutex pending_requests_mutex_;
+  std::condition_variable tracker_request_condition_;
 
-  // Map from stream ID to the stream's number of pending buffers.
-  // It must have an entry for keys present in stream_max_buffers_.
-  // Must be protected with pending_requests_mutex_.
-  std::unordered_map<int32_t, uint32_t> stream_pending_buffers_;
-
-  // Condition to signal when a buffer is returned to the client through process
-  // capture result or return stream buffer api.
-  std::condition_variable tracker_acquisition_condition_;
+  // Number of threads waiting on tracker_request_condition_.
+  std::atomic<uint32_t> num_request_waiters_{0};
 
+  // Mutex and condition to wait on when a stream's acquired buffer quota is
+  // exhausted. Only used on the slow path.
   std::mutex pending_acquisition_mutex_;
+  std::condition_variable tracker_acquisition_condition_;
 
-  // Map from stream ID to the stream's number of actually acquired buffers.
-  // It must have an entry for keys present in stream_max_buffers_.
-  // Must be protected with pending_acquisition_mutex_.
-  std::unordered_map<int32_t, uint32_t> stream_acquired_buffers_;
-
-  // Contains the stream IDs that have been requested previously.
-  // Must be protected with pending_requests_mutex_.
-  std::unordered_set<int32_t> requested_stream_ids_;
-
-  // Map from stream IDs within a stream group to one stream ID for tracking
-  // purposes. For multi-resolution output, the HWL gets to decide which stream
-  // within a stream group outputs images.
-  std::unordered_map<int32_t, int32_t> grouped_stream_id_map_;
-
-  std::set<int32_t> hal_buffer_managed_stream_ids_;
+  // Number of threads waiting on tracker_acquisition_condition_.
+  std::atomic<uint32_t> num_acquisition_waiters_{0};
 };
 
 }  // namespace google_camera_hal
@@ -273,6 +273,33 @@ status_t RealtimeZslRequestProcessor::SetProcessBlock(
   return OK;
 }
 
+void RealtimeZslRequestProcessor::UpdateHdrplusZslForThermal(
+    const HalCameraMetadata& settings) {
+  ThermalMitigation mitigation;
+  if (hal_utils::GetThermalMitigation(&settings, &mitigation) == OK) {
+    if (mitigation.hdrplus_zsl_enabled != is_hdrplus_zsl_enabled_) {
+      is_hdrplus_zsl_enabled_ = mitigation.hdrplus_zsl_enabled;
+      ALOGI("%s: HDR+ ZSL %s by thermal level", __FUNCTION__,
+            is_hdrplus_zsl_enabled_ ? "re-enabled" : "disabled");
+    }
+    return;
+  }
+
+  // Without a thermal level, disable HDR+ ZSL once thermal throttles.
+  if (!is_hdrplus_zsl_enabled_) {
+    return;
+  }
+  camera_metadata_ro_entry entry = {};
+  status_t res = settings.Get(VendorTagIds::kThermalThrottling, &entry);
+  if (res != OK || entry.count != 1) {
+    ALOGW("%s: Getting thermal throttling entry failed: %s(%d)", __FUNCTION__,
+          strerror(-res), res);
+  } else if (entry.data.u8[0] == true) {
+    is_hdrplus_zsl_enabled_ = false;
+    ALOGI("%s: HDR+ ZSL disabled due to thermal throttling", __FUNCTION__);
+  }
+}
+
 status_t RealtimeZslRequestProcessor::ProcessRequest(
     const CaptureRequest& request) {
   ATRACE_CALL();
@@ -282,18 +309,8 @@ status_t RealtimeZslRequestProcessor::ProcessRequest(
     return NO_INIT;
   }
 
-  if (is_hdrplus_zsl_enabled_ && request.settings != nullptr) {
-    camera_metadata_ro_entry entry = {};
-    status_t res =
-        request.settings->Get(VendorTagIds::kThermalThrottling, &entry);
-    if (res != OK || entry.count != 1) {
-      ALOGW("%s: Getting thermal throttling entry failed: %s(%d)", __FUNCTION__,
-            strerror(-res), res);
-    } else if (entry.data.u8[0] == true) {
-      // Disable HDR+ ZSL once thermal throttles.
-      is_hdrplus_zsl_enabled_ = false;
-      ALOGI("%s: HDR+ ZSL disabled due to thermal throttling", __FUNCTION__);
-    }
+  if (is_hdrplus_zsl_supported_ && request.settings != nullptr) {
+    UpdateHdrplusZslForThermal(*request.settings);
   }
 
   // Update if preview intent has been requested.
@@ -307,6 +324,9 @@ status_t RealtimeZslRequestProcessor::ProcessRequest(
     }
   }
 
+  // The block request needs its own settings. The HWL takes ownership of
+  // them, they may be modified for HDR+ below, and the result processor still
+  // reads the session request's settings to save face and lens shading info.
   CaptureRequest block_request;
 
   block_request.frame_number = request.frame_number;
@@ -366,7 +386,8 @@ status_t RealtimeZslRequestProcessor::ProcessRequest(
 
   std::vector<ProcessBlockRequest> block_requests(1);
   block_requests[0].request = std::move(block_request);
-  return process_block_->ProcessRequests(block_requests, request);
+  return process_block_->ProcessOwnedRequests(std::move(block_requests),
+                                              request);
 }
 
 status_t RealtimeZslRequestProcessor::Flush() {
@@ -60,10 +60,15 @@ class RealtimeZslRequestProcessor : public RequestProcessor {
                               CameraDeviceSessionHwl* device_session_hwl)
       : pixel_format_(pixel_format),
         device_session_hwl_(device_session_hwl),
-        is_hdrplus_zsl_enabled_(pixel_format == HAL_PIXEL_FORMAT_RAW10){};
+        is_hdrplus_zsl_supported_(pixel_format == HAL_PIXEL_FORMAT_RAW10),
+        is_hdrplus_zsl_enabled_(is_hdrplus_zsl_supported_){};
 
  private:
   status_t Initialize(CameraDeviceSessionHwl* device_session_hwl);
+
+  // Enable or disable HDR+ ZSL according to the thermal state in settings.
+  void UpdateHdrplusZslForThermal(const HalCameraMetadata& settings);
+
   std::shared_mutex process_block_lock_;
 
   // Protected by process_block_lock_.
@@ -79,7 +84,11 @@ class RealtimeZslRequestProcessor : public RequestProcessor {
 
   HdrMode hdr_mode_ = HdrMode::kHdrplusMode;
 
-  // If HDR+ ZSL is enabled.
+  // If HDR+ ZSL is supported by the internal stream format.
+  const bool is_hdrplus_zsl_supported_ = false;
+
+  // If HDR+ ZSL is enabled. It's disabled while the thermal level calls for
+  // it.
   bool is_hdrplus_zsl_enabled_ = false;
 };
 
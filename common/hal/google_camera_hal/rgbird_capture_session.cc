@@ -287,6 +287,9 @@ status_t RgbirdCaptureSession::AllocateInternalBuffers(
     framework_stream_id_set.insert(stream.id);
   }
 
+  // The internal YUV and IR RAW streams are requested in every frame, so
+  // their buffers are in flight together and sharing a pool between them
+  // would not lower the peak buffer usage. Each gets dedicated buffers.
   for (uint32_t i = 0; i < hal_configured_streams->size(); i++) {
     HalStream& hal_stream = hal_configured_streams->at(i);
 
@@ -375,7 +378,8 @@ status_t RgbirdCaptureSession::CreateDepthChainSegment(
   DepthProcessBlock::DepthProcessBlockCreateData data = {
       .rgb_internal_yuv_stream_id = rgb_internal_yuv_stream_id_,
       .ir1_internal_raw_stream_id = ir1_internal_raw_stream_id_,
-      .ir2_internal_raw_stream_id = ir2_internal_raw_stream_id_};
+      .ir2_internal_raw_stream_id = ir2_internal_raw_stream_id_,
+      .max_buffers_per_input_stream = kDefaultInternalBufferCount};
   auto process_block = DepthProcessBlock::Create(device_session_hwl_,
                                                  request_stream_buffers_, data);
   if (process_block == nullptr) {
@@ -56,6 +56,23 @@ std::unique_ptr<RgbirdResultRequestProcessor> RgbirdResultRequestProcessor::Crea
     ALOGI("%s: autocal is enabled.", __FUNCTION__);
   }
 
+  RgbirdResultRequestProcessor* processor = result_processor.get();
+  result_processor->depth_requests_ =
+      MultiCameraFrameAssembler<PendingDepthRequest>::Create(
+          [processor](uint32_t frame_number,
+                      PendingDepthRequest pending_request) {
+            processor->SubmitDepthRequest(frame_number,
+                                          std::move(pending_request));
+          },
+          [processor](uint32_t frame_number, uint32_t /*arrived_parts*/,
+                      PendingDepthRequest pending_request) {
+            processor->FailDepthRequest(frame_number, pending_request);
+          });
+  if (result_processor->depth_requests_ == nullptr) {
+    ALOGE("%s: Creating depth request assembler failed.", __FUNCTION__);
+    return nullptr;
+  }
+
   return result_processor;
 }
 
@@ -72,7 +89,7 @@ RgbirdResultRequestProcessor::RgbirdResultRequestProcessor(
 void RgbirdResultRequestProcessor::SetResultCallback(
     ProcessCaptureResultFunc process_capture_result, NotifyFunc notify,
     ProcessBatchCaptureResultFunc /*process_batch_capture_result*/) {
-  std::lock_guard<std::mutex> lock(callback_lock_);
+  std::unique_lock<std::shared_mutex> lock(callback_lock_);
   process_capture_result_ = process_capture_result;
   notify_ = notify;
 }
@@ -217,8 +234,14 @@ status_t RgbirdResultRequestProcessor::AddPendingRequests(
     const std::vector<ProcessBlockRequest>& /*process_block_requests*/,
     const CaptureRequest& remaining_session_request) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(depth_requests_mutex_);
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
   for (auto stream_buffer : remaining_session_request.output_buffers) {
+    if (depth_stream_id_ != stream_buffer.stream_id) {
+      continue;
+    }
+
+    ALOGV("%s: request %d has a depth buffer", __FUNCTION__,
+          remaining_session_request.frame_number);
     if (stream_buffer.acquire_fence != nullptr) {
       stream_buffer.acquire_fence =
           native_handle_clone(stream_buffer.acquire_fence);
@@ -227,21 +250,29 @@ status_t RgbirdResultRequestProcessor::AddPendingRequests(
         return UNKNOWN_ERROR;
       }
     }
-    if (depth_stream_id_ == stream_buffer.stream_id) {
-      ALOGV("%s: request %d has a depth buffer", __FUNCTION__,
-            remaining_session_request.frame_number);
-      auto capture_request = std::make_unique<CaptureRequest>();
-      capture_request->frame_number = remaining_session_request.frame_number;
-      if (remaining_session_request.settings != nullptr) {
-        capture_request->settings =
-            HalCameraMetadata::Clone(remaining_session_request.settings.get());
-      }
-      capture_request->input_buffers.clear();
-      capture_request->output_buffers.push_back(stream_buffer);
-      depth_requests_.emplace(remaining_session_request.frame_number,
-                              std::move(capture_request));
-      break;
+
+    PendingDepthRequest pending_request;
+    if (remaining_session_request.settings != nullptr) {
+      pending_request.settings =
+          HalCameraMetadata::Clone(remaining_session_request.settings.get());
+    }
+    pending_request.depth_buffer = stream_buffer;
+
+    uint32_t expected_parts =
+        kIr1BufferPart | kIr2BufferPart | kRgbMetadataPart;
+    if (IsAutocalRequest(remaining_session_request.frame_number)) {
+      expected_parts |= kRgbYuvBufferPart;
+    }
+
+    status_t res = depth_requests_->AddFrame(
+        remaining_session_request.frame_number, expected_parts,
+        std::move(pending_request));
+    if (res != OK) {
+      ALOGE("%s: Adding depth request %u failed: %s(%d)", __FUNCTION__,
+            remaining_session_request.frame_number, strerror(-res), res);
+      return res;
     }
+    break;
   }
 
   if (is_hdrplus_supported_) {
@@ -364,7 +395,7 @@ status_t RgbirdResultRequestProcessor::CheckFenceStatus(CaptureRequest* request)
   return OK;
 }
 
-bool RgbirdResultRequestProcessor::IsAutocalMetadataReadyLocked(
+bool RgbirdResultRequestProcessor::IsAutocalMetadataReady(
     const HalCameraMetadata& metadata) {
   camera_metadata_ro_entry entry = {};
   if (metadata.Get(VendorTagIds::kNonWarpedCropRegion, &entry) != OK) {
@@ -395,80 +426,86 @@ bool RgbirdResultRequestProcessor::IsAutocalMetadataReadyLocked(
   return true;
 }
 
-status_t RgbirdResultRequestProcessor::VerifyAndSubmitDepthRequest(
-    uint32_t frame_number) {
-  std::lock_guard<std::mutex> lock(depth_requests_mutex_);
-  if (depth_requests_.find(frame_number) == depth_requests_.end()) {
-    ALOGW("%s: Can not find depth request with frame number %u", __FUNCTION__,
+void RgbirdResultRequestProcessor::SubmitDepthRequest(
+    uint32_t frame_number, PendingDepthRequest pending_request) {
+  ATRACE_CALL();
+  if (pending_request.rgb_metadata == nullptr) {
+    ALOGE("%s: RGB result metadata not found for frame %u", __FUNCTION__,
           frame_number);
-    return NAME_NOT_FOUND;
-  }
-
-  uint32_t valid_input_buffer_num = 0;
-  auto& depth_request = depth_requests_[frame_number];
-  for (auto& input_buffer : depth_request->input_buffers) {
-    if (input_buffer.stream_id != kInvalidStreamId) {
-      valid_input_buffer_num++;
-    }
-  }
-
-  if (IsAutocalRequest(frame_number)) {
-    if (valid_input_buffer_num != /*rgb+ir1+ir2*/ 3) {
-      // not all input buffers are ready, early return properly
-      ALOGV("%s: Not all input buffers are ready for frame %u", __FUNCTION__,
-            frame_number);
-      return OK;
-    }
-  } else {
-    // The input buffer for RGB pipeline could be a place holder to be
-    // consistent with the input buffer metadata.
-    if (valid_input_buffer_num != /*ir1+ir2*/ 2) {
-      // not all input buffers are ready, early return properly
-      ALOGV("%s: Not all input buffers are ready for frame %u", __FUNCTION__,
-            frame_number);
-      return OK;
-    }
+    FailDepthRequest(frame_number, pending_request);
+    return;
   }
 
-  if (depth_request->input_buffer_metadata.empty()) {
-    // input buffer metadata is not ready(cloned) yet, early return properly
-    ALOGV("%s: Input buffer metadata is not ready for frame %u", __FUNCTION__,
-          frame_number);
-    return OK;
-  }
+  CaptureRequest depth_request;
+  depth_request.frame_number = frame_number;
+  depth_request.settings = std::move(pending_request.settings);
+  depth_request.output_buffers.push_back(pending_request.depth_buffer);
 
-  // Check against all metadata needed before move on e.g. check against
-  // cropping info, FD result for internal YUV stream
-  status_t res = OK;
-  if (IsAutocalRequest(frame_number)) {
-    bool is_ready = false;
-    for (auto& metadata : depth_request->input_buffer_metadata) {
-      if (metadata != nullptr) {
-        is_ready = IsAutocalMetadataReadyLocked(*(metadata.get()));
-      }
-    }
-    if (!is_ready) {
-      ALOGV("%s: Not all AutoCal Metadata is ready for frame %u.", __FUNCTION__,
-            frame_number);
-      return OK;
-    }
-  }
+  // The RGB pipeline result metadata must be at the same index as the
+  // internal YUV buffer. If this is not an AutoCal request, the YUV buffer is
+  // a place holder with an invalid stream ID.
+  depth_request.input_buffers = {pending_request.rgb_yuv_buffer,
+                                 pending_request.ir1_buffer,
+                                 pending_request.ir2_buffer};
+  depth_request.input_buffer_metadata.resize(kNumOfAutoCalInputBuffers);
+  depth_request.input_buffer_metadata[0] =
+      std::move(pending_request.rgb_metadata);
 
-  res = CheckFenceStatus(depth_request.get());
+  status_t res = CheckFenceStatus(&depth_request);
   if (res != OK) {
     ALOGE("%s:Fence status wait failed.", __FUNCTION__);
-    return UNKNOWN_ERROR;
+    FailDepthRequest(frame_number, pending_request);
+    return;
   }
 
-  res = ProcessRequest(*depth_request.get());
+  res = ProcessRequest(depth_request);
   if (res != OK) {
     ALOGE("%s: Failed to submit process request to depth process block.",
           __FUNCTION__);
-    return UNKNOWN_ERROR;
+    FailDepthRequest(frame_number, pending_request);
   }
+}
 
-  depth_requests_.erase(frame_number);
-  return OK;
+void RgbirdResultRequestProcessor::FailDepthRequest(
+    uint32_t frame_number, const PendingDepthRequest& pending_request) {
+  ATRACE_CALL();
+  if (notify_ == nullptr || process_capture_result_ == nullptr) {
+    ALOGE("%s: notify_ or process_capture_result_ is nullptr. Dropping depth "
+          "request %u.",
+          __FUNCTION__, frame_number);
+    return;
+  }
+
+  // Returns all internal stream buffers
+  for (auto& input_buffer :
+       {pending_request.ir1_buffer, pending_request.ir2_buffer,
+        pending_request.rgb_yuv_buffer}) {
+    if (input_buffer.stream_id != kInvalidStreamId) {
+      status_t res = internal_stream_manager_->ReturnStreamBuffer(input_buffer);
+      if (res != OK) {
+        ALOGW("%s: Failed to return internal buffer for depth request %d",
+              __FUNCTION__, frame_number);
+      }
+    }
+  }
+
+  // Notify buffer error for the depth stream output buffer
+  const NotifyMessage message = {
+      .type = MessageType::kError,
+      .message.error = {.frame_number = frame_number,
+                        .error_stream_id = depth_stream_id_,
+                        .error_code = ErrorCode::kErrorBuffer}};
+  notify_(message);
+
+  // Return output buffer for the depth stream
+  auto result = std::make_unique<CaptureResult>();
+  result->frame_number = frame_number;
+  result->output_buffers.push_back(pending_request.depth_buffer);
+  auto& buffer = result->output_buffers.back();
+  buffer.status = BufferStatus::kError;
+  buffer.acquire_fence = nullptr;
+  buffer.release_fence = nullptr;
+  process_capture_result_(std::move(result));
 }
 
 status_t RgbirdResultRequestProcessor::TrySubmitDepthProcessBlockRequest(
@@ -478,130 +515,62 @@ status_t RgbirdResultRequestProcessor::TrySubmitDepthProcessBlockRequest(
   CaptureResult* result = block_result.result.get();
   uint32_t frame_number = result->frame_number;
 
-  bool pending_request_updated = false;
   for (auto& output_buffer : result->output_buffers) {
-    if (request_id == kIr1CameraId || request_id == kIr2CameraId ||
-        (request_id == kRgbCameraId &&
-         rgb_internal_yuv_stream_id_ == output_buffer.stream_id &&
-         IsAutocalRequest(frame_number))) {
-      std::lock_guard<std::mutex> lock(depth_requests_mutex_);
-
-      // In case depth request is flushed
-      if (depth_requests_.find(frame_number) == depth_requests_.end()) {
-        ALOGV("%s: Can not find depth request with frame number %u",
-              __FUNCTION__, frame_number);
-        status_t res =
-            internal_stream_manager_->ReturnStreamBuffer(output_buffer);
-        if (res != OK) {
-          ALOGW(
-              "%s: Failed to return internal buffer for flushed depth request"
-              " %u",
-              __FUNCTION__, frame_number);
-        }
-        continue;
-      }
+    uint32_t part = 0;
+    if (request_id == kIr1CameraId) {
+      part = kIr1BufferPart;
+    } else if (request_id == kIr2CameraId) {
+      part = kIr2BufferPart;
+    } else if (request_id == kRgbCameraId &&
+               rgb_internal_yuv_stream_id_ == output_buffer.stream_id &&
+               IsAutocalRequest(frame_number)) {
+      part = kRgbYuvBufferPart;
+    } else {
+      continue;
+    }
 
-      // If input_buffer_metadata is not empty, the RGB pipeline result metadata
-      // must have been cloned(other entries for IRs set to nullptr). The
-      // yuv_internal_stream buffer has to be inserted into the corresponding
-      // entry in input_buffers. Or if this is not a AutoCal request, the stream
-      // id for the place holder of the RGB input buffer must be invalid. Refer
-      // the logic below for result metadata handling.
-      const auto& metadata_list =
-          depth_requests_[frame_number]->input_buffer_metadata;
-      auto& input_buffers = depth_requests_[frame_number]->input_buffers;
-      if (!metadata_list.empty()) {
-        uint32_t rgb_metadata_index = 0;
-        for (; rgb_metadata_index < metadata_list.size(); rgb_metadata_index++) {
-          // Only the RGB pipeline result metadata is needed and cloned
-          if (metadata_list[rgb_metadata_index] != nullptr) {
-            break;
-          }
-        }
-
-        if (rgb_metadata_index == metadata_list.size()) {
-          ALOGE("%s: RGB result metadata not found. rgb_metadata_index %u",
-                __FUNCTION__, rgb_metadata_index);
-          return UNKNOWN_ERROR;
-        }
-
-        if (input_buffers.size() < kNumOfAutoCalInputBuffers) {
-          input_buffers.resize(kNumOfAutoCalInputBuffers);
-        }
-
-        if (request_id == kRgbCameraId) {
-          if (input_buffers[rgb_metadata_index].stream_id != kInvalidStreamId) {
-            ALOGE("%s: YUV buffer already exists.", __FUNCTION__);
-            return UNKNOWN_ERROR;
+    status_t res = depth_requests_->AddParts(
+        frame_number, part, [&](PendingDepthRequest* pending_request) {
+          if (part == kIr1BufferPart) {
+            pending_request->ir1_buffer = output_buffer;
+          } else if (part == kIr2BufferPart) {
+            pending_request->ir2_buffer = output_buffer;
+          } else {
+            pending_request->rgb_yuv_buffer = output_buffer;
           }
-          input_buffers[rgb_metadata_index] = output_buffer;
-        } else {
-          for (uint32_t i_buffer = 0; i_buffer < input_buffers.size();
-               i_buffer++) {
-            if (input_buffers[i_buffer].stream_id == kInvalidStreamId &&
-                rgb_metadata_index != i_buffer) {
-              input_buffers[i_buffer] = output_buffer;
-              break;
-            }
-          }
-        }
-      } else {
-        input_buffers.push_back(output_buffer);
+        });
+    if (res != OK) {
+      // In case depth request is flushed
+      ALOGV("%s: Can not add buffer to depth request with frame number %u: "
+            "%s(%d)",
+            __FUNCTION__, frame_number, strerror(-res), res);
+      res = internal_stream_manager_->ReturnStreamBuffer(output_buffer);
+      if (res != OK) {
+        ALOGW(
+            "%s: Failed to return internal buffer for flushed depth request"
+            " %u",
+            __FUNCTION__, frame_number);
       }
-      pending_request_updated = true;
     }
   }
 
   if (result->result_metadata != nullptr && request_id == kRgbCameraId) {
-    std::lock_guard<std::mutex> lock(depth_requests_mutex_);
-
-    // In case a depth request is flushed
-    if (depth_requests_.find(frame_number) == depth_requests_.end()) {
-      ALOGV("%s No depth request for Autocal", __FUNCTION__);
+    // AutoCal needs metadata that may only be in a later partial result.
+    if (IsAutocalRequest(frame_number) &&
+        !IsAutocalMetadataReady(*result->result_metadata)) {
+      ALOGV("%s: Not all AutoCal Metadata is ready for frame %u.", __FUNCTION__,
+            frame_number);
       return OK;
     }
 
-    // If YUV buffer exists in the input_buffers, the RGB pipeline metadata
-    // needs to be inserted into the corresponding entry in
-    // input_buffer_metadata. Otherwise, insert the RGB pipeline metadata into
-    // the entry that is not reserved for any existing IR input buffer. Refer
-    // above logic for input buffer preparation.
-    auto& input_buffers = depth_requests_[frame_number]->input_buffers;
-    auto& metadata_list = depth_requests_[frame_number]->input_buffer_metadata;
-    metadata_list.resize(kNumOfAutoCalInputBuffers);
-    uint32_t yuv_buffer_index = 0;
-    for (; yuv_buffer_index < input_buffers.size(); yuv_buffer_index++) {
-      if (input_buffers[yuv_buffer_index].stream_id ==
-          rgb_internal_yuv_stream_id_) {
-        break;
-      }
-    }
-
-    if (yuv_buffer_index >= kNumOfAutoCalInputBuffers) {
-      ALOGE("%s: input_buffers is full and YUV buffer not found.", __FUNCTION__);
-      return UNKNOWN_ERROR;
-    }
-
-    metadata_list[yuv_buffer_index] =
-        HalCameraMetadata::Clone(result->result_metadata.get());
-    if (metadata_list[yuv_buffer_index] == nullptr) {
-      ALOGE("%s: clone RGB pipeline result metadata failed.", __FUNCTION__);
-      return UNKNOWN_ERROR;
-    }
-    pending_request_updated = true;
-
-    // If metadata arrives after all IR buffers and there is not RGB buffer
-    if (input_buffers.size() < kNumOfAutoCalInputBuffers) {
-      input_buffers.resize(kNumOfAutoCalInputBuffers);
-    }
-  }
-
-  if (pending_request_updated) {
-    status_t res = VerifyAndSubmitDepthRequest(frame_number);
-    if (res != OK) {
-      ALOGE("%s: Failed to verify and submit depth request.", __FUNCTION__);
-      return res;
-    }
+    // The metadata is ignored if the depth request is flushed or already has
+    // the RGB pipeline metadata from an earlier partial result.
+    depth_requests_->AddParts(
+        frame_number, kRgbMetadataPart,
+        [&](PendingDepthRequest* pending_request) {
+          pending_request->rgb_metadata =
+              HalCameraMetadata::Clone(result->result_metadata.get());
+        });
   }
 
   return OK;
@@ -609,7 +578,7 @@ status_t RgbirdResultRequestProcessor::TrySubmitDepthProcessBlockRequest(
 
 void RgbirdResultRequestProcessor::ProcessResult(ProcessBlockResult block_result) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(callback_lock_);
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
   if (block_result.result == nullptr) {
     ALOGW("%s: Received a nullptr result.", __FUNCTION__);
     return;
@@ -646,20 +615,18 @@ void RgbirdResultRequestProcessor::ProcessResult(ProcessBlockResult block_result
   }
 
   // TODO(b/128633958): remove the following once FLL syncing is verified
-  {
-    std::lock_guard<std::mutex> lock(depth_requests_mutex_);
-    if (((force_internal_stream_) ||
-         (depth_requests_.find(result->frame_number) == depth_requests_.end())) &&
-        (depth_stream_id_ != -1)) {
-      res = ReturnInternalStreams(result);
-      if (res != OK) {
-        ALOGE("%s: Failed to return internal buffers.", __FUNCTION__);
-        return;
-      }
+  if (((force_internal_stream_) ||
+       (!depth_requests_->IsFramePending(result->frame_number))) &&
+      (depth_stream_id_ != -1)) {
+    res = ReturnInternalStreams(result);
+    if (res != OK) {
+      ALOGE("%s: Failed to return internal buffers.", __FUNCTION__);
+      return;
     }
   }
 
-  // Save necessary data for depth process block request
+  // Save necessary data for depth process block request. The result completing
+  // a depth request submits it to the depth process block on this thread.
   res = TrySubmitDepthProcessBlockRequest(block_result);
   if (res != OK) {
     ALOGE("%s: Failed to submit depth process block request.", __FUNCTION__);
@@ -690,7 +657,7 @@ void RgbirdResultRequestProcessor::ProcessResult(ProcessBlockResult block_result
 void RgbirdResultRequestProcessor::Notify(
     const ProcessBlockNotifyMessage& block_message) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(callback_lock_);
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
   if (notify_ == nullptr) {
     ALOGE("%s: notify_ is nullptr. Dropping a message.", __FUNCTION__);
     return;
@@ -818,8 +785,8 @@ status_t RgbirdResultRequestProcessor::Flush() {
 
 status_t RgbirdResultRequestProcessor::FlushPendingRequests() {
   ATRACE_CALL();
+  std::shared_lock<std::shared_mutex> callback_lock(callback_lock_);
 
-  std::lock_guard<std::mutex> lock(callback_lock_);
   if (notify_ == nullptr) {
     ALOGE("%s: notify_ is nullptr. Dropping a message.", __FUNCTION__);
     return OK;
@@ -831,44 +798,7 @@ status_t RgbirdResultRequestProcessor::FlushPendingRequests() {
     return OK;
   }
 
-  std::lock_guard<std::mutex> requests_lock(depth_requests_mutex_);
-  for (auto& [frame_number, capture_request] : depth_requests_) {
-    // Returns all internal stream buffers
-    for (auto& input_buffer : capture_request->input_buffers) {
-      if (input_buffer.stream_id != kInvalidStreamId) {
-        status_t res =
-            internal_stream_manager_->ReturnStreamBuffer(input_buffer);
-        if (res != OK) {
-          ALOGW("%s: Failed to return internal buffer for depth request %d",
-                __FUNCTION__, frame_number);
-        }
-      }
-    }
-
-    // Notify buffer error for the depth stream output buffer
-    const NotifyMessage message = {
-        .type = MessageType::kError,
-        .message.error = {.frame_number = frame_number,
-                          .error_stream_id = depth_stream_id_,
-                          .error_code = ErrorCode::kErrorBuffer}};
-    notify_(message);
-
-    // Return output buffer for the depth stream
-    auto result = std::make_unique<CaptureResult>();
-    result->frame_number = frame_number;
-    for (auto& output_buffer : capture_request->output_buffers) {
-      if (output_buffer.stream_id == depth_stream_id_) {
-        result->output_buffers.push_back(output_buffer);
-        auto& buffer = result->output_buffers.back();
-        buffer.status = BufferStatus::kError;
-        buffer.acquire_fence = nullptr;
-        buffer.release_fence = nullptr;
-        break;
-      }
-    }
-    process_capture_result_(std::move(result));
-  }
-  depth_requests_.clear();
+  depth_requests_->Flush();
   ALOGI("%s: Flushing depth requests done. ", __FUNCTION__);
   return OK;
 }
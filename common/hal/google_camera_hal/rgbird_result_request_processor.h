@@ -18,7 +18,9 @@
 #define HARDWARE_GOOGLE_CAMERA_HAL_GOOGLE_CAMERA_HAL_RGBIRD_RESULT_REQUEST_PROCESSOR_H_
 
 #include <set>
+#include <shared_mutex>
 
+#include "multicam_frame_assembler.h"
 #include "request_processor.h"
 #include "result_processor.h"
 #include "vendor_tag_defs.h"
@@ -94,6 +96,27 @@ class RgbirdResultRequestProcessor : public ResultProcessor,
   const uint32_t kIr2CameraId;
   const int32_t kSyncWaitTime = 5000;  // milliseconds
 
+  // Parts of a depth request that arrive from the RGB and IR pipelines.
+  static constexpr uint32_t kIr1BufferPart = 1 << 0;
+  static constexpr uint32_t kIr2BufferPart = 1 << 1;
+  static constexpr uint32_t kRgbMetadataPart = 1 << 2;
+  static constexpr uint32_t kRgbYuvBufferPart = 1 << 3;
+
+  // A depth request waiting for its input buffers and metadata.
+  struct PendingDepthRequest {
+    // Settings and depth stream buffer of the framework request.
+    std::unique_ptr<HalCameraMetadata> settings;
+    StreamBuffer depth_buffer;
+    // Internal stream buffers of the IR pipelines.
+    StreamBuffer ir1_buffer;
+    StreamBuffer ir2_buffer;
+    // Result metadata of the RGB pipeline.
+    std::unique_ptr<HalCameraMetadata> rgb_metadata;
+    // Internal YUV stream buffer of the RGB pipeline. Only needed for AutoCal
+    // requests.
+    StreamBuffer rgb_yuv_buffer;
+  };
+
   void ProcessResultForHdrplus(CaptureResult* result, bool* rgb_raw_output);
   // Return the RGB internal YUV stream buffer if there is any and depth is
   // configured
@@ -118,10 +141,10 @@ class RgbirdResultRequestProcessor : public ResultProcessor,
   status_t CheckFenceStatus(CaptureRequest* request);
 
   // Check all metadata exist for Autocal
-  // Protected by depth_requests_mutex_
-  bool IsAutocalMetadataReadyLocked(const HalCameraMetadata& metadata);
+  bool IsAutocalMetadataReady(const HalCameraMetadata& metadata);
 
-  // Prepare Depth Process Block request and try to submit that
+  // Add the parts of depth process block requests in a result. A request is
+  // submitted once all of its parts are added.
   status_t TrySubmitDepthProcessBlockRequest(
       const ProcessBlockResult& block_result);
 
@@ -129,11 +152,19 @@ class RgbirdResultRequestProcessor : public ResultProcessor,
   // process block.
   bool IsAutocalRequest(uint32_t frame_number) const;
 
-  // Verify if all information is ready for a depth request for frame_number and
-  // submit the request to the process block if so.
-  status_t VerifyAndSubmitDepthRequest(uint32_t frame_number);
+  // Submit a depth request whose parts have all arrived to the process block.
+  void SubmitDepthRequest(uint32_t frame_number,
+                          PendingDepthRequest pending_request);
 
-  std::mutex callback_lock_;
+  // Return the internal stream buffers of a depth request that can't be
+  // submitted, and return its depth buffer with an error.
+  void FailDepthRequest(uint32_t frame_number,
+                        const PendingDepthRequest& pending_request);
+
+  // Locked exclusively to set the callbacks and shared while requests,
+  // results and messages use them, so results and messages are delivered
+  // concurrently but never while the callbacks change.
+  std::shared_mutex callback_lock_;
 
   // The following callbacks must be protected by callback_lock_.
   ProcessCaptureResultFunc process_capture_result_;
@@ -175,12 +206,11 @@ class RgbirdResultRequestProcessor : public ResultProcessor,
   // Set of framework stream id
   std::set<int32_t> framework_stream_id_set_;
 
-  std::mutex depth_requests_mutex_;
-
-  // Map from framework number to capture request for depth process block. If a
-  // request does not contain any depth buffer, it is not recorded in the map.
-  // Protected by depth_requests_mutex_
-  std::unordered_map<uint32_t, std::unique_ptr<CaptureRequest>> depth_requests_;
+  // Assembles depth process block requests from the results of the RGB and IR
+  // pipelines. If a request does not contain any depth buffer, it is not
+  // added. Dropped requests are returned with an error.
+  std::unique_ptr<MultiCameraFrameAssembler<PendingDepthRequest>>
+      depth_requests_;
 
   // Depth stream id if it is configured for the current session
   int32_t depth_stream_id_ = -1;
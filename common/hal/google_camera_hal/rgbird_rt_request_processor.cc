@@ -509,6 +509,8 @@ status_t RgbirdRtRequestProcessor::AddIrRawProcessBlockRequestLocked(
     return INVALID_OPERATION;
   }
 
+  // Each pipeline gets its own copy of the settings, which the HWL takes
+  // ownership of.
   ProcessBlockRequest block_request = {.request_id = camera_id};
   CaptureRequest& physical_request = block_request.request;
   physical_request.frame_number = request.frame_number;
@@ -725,7 +727,8 @@ status_t RgbirdRtRequestProcessor::ProcessRequest(const CaptureRequest& request)
       }
     }
 
-    return process_block_->ProcessRequests(block_requests, request);
+    return process_block_->ProcessOwnedRequests(std::move(block_requests),
+                                                request);
   }
 }
 
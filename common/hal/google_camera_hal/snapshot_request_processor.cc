@@ -166,6 +166,8 @@ status_t SnapshotRequestProcessor::ProcessRequest(const CaptureRequest& request)
     return BAD_VALUE;
   }
 
+  // Settings are cloned since the session sends the same request to the
+  // realtime request processor if this one fails.
   CaptureRequest block_request;
   block_request.frame_number = request.frame_number;
   block_request.settings = HalCameraMetadata::Clone(request.settings.get());
@@ -198,10 +200,14 @@ status_t SnapshotRequestProcessor::ProcessRequest(const CaptureRequest& request)
   ALOGD("%s: frame number %u is a snapshot request.", __FUNCTION__,
         request.frame_number);
 
-  result = process_block_->ProcessRequests(block_requests, request);
+  // The process block takes ownership of the request, so keep the output
+  // buffers around to return them if the request fails.
+  std::vector<StreamBuffer> output_buffers =
+      block_requests[0].request.output_buffers;
+  result = process_block_->ProcessOwnedRequests(std::move(block_requests),
+                                                request);
   if (result != OK) {
-    session_callback_.return_stream_buffers(
-        block_requests[0].request.output_buffers);
+    session_callback_.return_stream_buffers(output_buffers);
   }
 
   return result;
@@ -99,6 +99,8 @@ status_t ModifyCharacteristicsKeys(HalCameraMetadata* metadata) {
   request_keys.push_back(VendorTagIds::kProcessingMode);
   // VendorTagIds::kThermalThrottling
   request_keys.push_back(VendorTagIds::kThermalThrottling);
+  // VendorTagIds::kThermalThrottlingLevel
+  request_keys.push_back(VendorTagIds::kThermalThrottlingLevel);
   // VendorTagIds::kOutputIntent
   request_keys.push_back(VendorTagIds::kOutputIntent);
   // VendorTagIds::kSensorModeFullFov
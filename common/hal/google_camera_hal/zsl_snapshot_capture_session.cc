@@ -21,6 +21,7 @@
 
 #include "zsl_snapshot_capture_session.h"
 
+#include <atomic>
 #include <dlfcn.h>
 #include <log/log.h>
 #include <sys/stat.h>
@@ -50,6 +51,10 @@ constexpr char kExternalProcessBlockDir[] =
 #endif
 #endif  // GCH_HWL_USE_DLOPEN
 
+// Set by SetSnapshotProcessBlockFactoryOverride().
+std::atomic<ZslSnapshotCaptureSession::GetProcessBlockFactoryFunc>
+    snapshot_process_block_factory_override = nullptr;
+
 bool IsSwDenoiseSnapshotCompatible(const CaptureRequest& request) {
   if (request.settings == nullptr) {
     return false;
@@ -90,9 +95,22 @@ bool IsSwDenoiseSnapshotCompatible(const CaptureRequest& request) {
 }
 }  // namespace
 
+void ZslSnapshotCaptureSession::SetSnapshotProcessBlockFactoryOverride(
+    GetProcessBlockFactoryFunc get_factory) {
+  snapshot_process_block_factory_override = get_factory;
+}
+
 std::unique_ptr<ProcessBlock>
 ZslSnapshotCaptureSession::CreateSnapshotProcessBlock() {
   ATRACE_CALL();
+  GetProcessBlockFactoryFunc factory_override =
+      snapshot_process_block_factory_override;
+  if (factory_override != nullptr) {
+    ALOGI("%s: Using the overridden snapshot process block.", __FUNCTION__);
+    snapshot_process_block_factory_ = factory_override;
+    return factory_override()->CreateProcessBlock(camera_device_session_hwl_);
+  }
+
 #if GCH_HWL_USE_DLOPEN
   bool found_process_block = false;
   for (const auto& lib_path :
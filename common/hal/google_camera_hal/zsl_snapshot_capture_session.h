@@ -78,6 +78,14 @@ class ZslSnapshotCaptureSession : public CaptureSession {
 
   virtual ~ZslSnapshotCaptureSession();
 
+  using GetProcessBlockFactoryFunc = ExternalProcessBlockFactory* (*)();
+
+  // Create the snapshot process blocks of sessions created after this call
+  // with get_factory instead of the vendor library, so that tests and
+  // benchmarks can run without one. nullptr restores the vendor library.
+  static void SetSnapshotProcessBlockFactoryOverride(
+      GetProcessBlockFactoryFunc get_factory);
+
   // Override functions in CaptureSession start.
   status_t ProcessRequest(const CaptureRequest& request) override;
 
@@ -180,7 +188,6 @@ class ZslSnapshotCaptureSession : public CaptureSession {
 
   std::vector<HalStream>* hal_config_ = nullptr;
 
-  using GetProcessBlockFactoryFunc = ExternalProcessBlockFactory* (*)();
   GetProcessBlockFactoryFunc snapshot_process_block_factory_;
   // Opened library handles that should be closed on destruction
   void* snapshot_process_block_lib_handle_ = nullptr;
@@ -92,6 +92,16 @@ class ProcessBlock {
       const std::vector<ProcessBlockRequest>& process_block_requests,
       const CaptureRequest& remaining_session_request) = 0;
 
+  // Same as ProcessRequests() except that process_block_requests are moved into
+  // the process block, which may take ownership of the requests' settings and
+  // metadata instead of cloning them. The default implementation calls
+  // ProcessRequests().
+  virtual status_t ProcessOwnedRequests(
+      std::vector<ProcessBlockRequest> process_block_requests,
+      const CaptureRequest& remaining_session_request) {
+    return ProcessRequests(process_block_requests, remaining_session_request);
+  }
+
   // Flush pending requests.
   virtual status_t Flush() = 0;
 };
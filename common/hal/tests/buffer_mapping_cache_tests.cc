@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferMappingCacheTests"
+#include <log/log.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <buffer_mapping_cache.h>
+#include <gtest/gtest.h>
+
+#include <cinttypes>
+#include <vector>
+
+namespace android {
+namespace google_camera_hal {
+
+static constexpr size_t kBufferSize = 4096;
+
+// Buffer fds backed by memfds, closed when the test ends.
+class TestBuffers {
+ public:
+  explicit TestBuffers(uint32_t num_buffers) {
+    for (uint32_t i = 0; i < num_buffers; i++) {
+      int fd = memfd_create("buffer_mapping_cache_test", /*flags=*/0);
+      if (fd < 0 || ftruncate(fd, kBufferSize) != 0) {
+        ALOGE("%s: Failed to create a memfd.", __FUNCTION__);
+        continue;
+      }
+      fds_.push_back(fd);
+    }
+  }
+
+  ~TestBuffers() {
+    for (int fd : fds_) {
+      close(fd);
+    }
+  }
+
+  const std::vector<int>& fds() const {
+    return fds_;
+  }
+
+ private:
+  std::vector<int> fds_;
+};
+
+TEST(BufferMappingCacheTests, MapSameBuffer) {
+  auto cache = BufferMappingCache::Create();
+  ASSERT_NE(cache, nullptr);
+  TestBuffers buffers(/*num_buffers=*/1);
+  ASSERT_EQ(buffers.fds().size(), 1u);
+
+  uint8_t* addr = nullptr;
+  ASSERT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &addr), OK);
+  addr[0] = 0xAB;
+
+  // A duplicated fd refers to the same buffer and reuses the mapping.
+  int dup_fd = dup(buffers.fds()[0]);
+  ASSERT_GE(dup_fd, 0);
+  uint8_t* dup_addr = nullptr;
+  ASSERT_EQ(cache->Map(dup_fd, kBufferSize, &dup_addr), OK);
+  EXPECT_EQ(dup_addr, addr);
+  EXPECT_EQ(dup_addr[0], 0xAB);
+  EXPECT_EQ(cache->GetMapCount(), 1u);
+  close(dup_fd);
+
+  EXPECT_EQ(cache->Unmap(addr), OK);
+  EXPECT_EQ(cache->Unmap(dup_addr), OK);
+  EXPECT_NE(cache->Unmap(addr), OK) << "Releasing an idle mapping should fail";
+  EXPECT_EQ(cache->GetMappingCount(), 1u);
+
+  EXPECT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &addr), OK);
+  EXPECT_EQ(cache->GetMapCount(), 1u);
+  EXPECT_EQ(cache->Unmap(addr), OK);
+}
+
+TEST(BufferMappingCacheTests, EvictLeastRecentlyUsed) {
+  static constexpr size_t kMaxCachedMappings = 2;
+  auto cache = BufferMappingCache::Create(kMaxCachedMappings);
+  ASSERT_NE(cache, nullptr);
+  TestBuffers buffers(/*num_buffers=*/3);
+  ASSERT_EQ(buffers.fds().size(), 3u);
+
+  std::vector<uint8_t*> addrs(buffers.fds().size(), nullptr);
+  for (size_t i = 0; i < buffers.fds().size(); i++) {
+    ASSERT_EQ(cache->Map(buffers.fds()[i], kBufferSize, &addrs[i]), OK);
+  }
+
+  // Mappings in use are never evicted.
+  EXPECT_EQ(cache->GetMappingCount(), 3u);
+  for (auto addr : addrs) {
+    EXPECT_EQ(cache->Unmap(addr), OK);
+  }
+  EXPECT_EQ(cache->GetMappingCount(), kMaxCachedMappings);
+
+  // Buffer 0 was released first and is evicted.
+  uint8_t* addr = nullptr;
+  ASSERT_EQ(cache->Map(buffers.fds()[2], kBufferSize, &addr), OK);
+  EXPECT_EQ(cache->Unmap(addr), OK);
+  EXPECT_EQ(cache->GetMapCount(), 3u);
+  ASSERT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &addr), OK);
+  EXPECT_EQ(cache->Unmap(addr), OK);
+  EXPECT_EQ(cache->GetMapCount(), 4u);
+}
+
+TEST(BufferMappingCacheTests, Invalidate) {
+  auto cache = BufferMappingCache::Create();
+  ASSERT_NE(cache, nullptr);
+  TestBuffers buffers(/*num_buffers=*/2);
+  ASSERT_EQ(buffers.fds().size(), 2u);
+
+  uint8_t* idle_addr = nullptr;
+  uint8_t* used_addr = nullptr;
+  ASSERT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &idle_addr), OK);
+  ASSERT_EQ(cache->Unmap(idle_addr), OK);
+  ASSERT_EQ(cache->Map(buffers.fds()[1], kBufferSize, &used_addr), OK);
+
+  cache->Invalidate();
+  EXPECT_EQ(cache->GetMappingCount(), 1u);
+
+  // The mapping in use stays valid until it is released.
+  used_addr[0] = 1;
+  EXPECT_EQ(cache->Unmap(used_addr), OK);
+  EXPECT_EQ(cache->GetMappingCount(), 0u);
+
+  uint8_t* addr = nullptr;
+  ASSERT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &addr), OK);
+  EXPECT_EQ(cache->Unmap(addr), OK);
+  EXPECT_EQ(cache->GetMapCount(), 3u);
+}
+
+TEST(BufferMappingCacheTests, UnmapWithoutKeepingMapping) {
+  auto cache = BufferMappingCache::Create();
+  ASSERT_NE(cache, nullptr);
+  TestBuffers buffers(/*num_buffers=*/1);
+  ASSERT_EQ(buffers.fds().size(), 1u);
+
+  // The mapping is shared while in use and unmapped when the last user
+  // releases it.
+  uint8_t* addr = nullptr;
+  uint8_t* shared_addr = nullptr;
+  ASSERT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &addr), OK);
+  ASSERT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &shared_addr), OK);
+  EXPECT_EQ(cache->Unmap(addr, /*keep_mapping=*/false), OK);
+  EXPECT_EQ(cache->GetMappingCount(), 1u);
+  shared_addr[0] = 1;
+  EXPECT_EQ(cache->Unmap(shared_addr, /*keep_mapping=*/false), OK);
+  EXPECT_EQ(cache->GetMappingCount(), 0u);
+  EXPECT_EQ(cache->GetIdleMappingCount(), 0u);
+
+  ASSERT_EQ(cache->Map(buffers.fds()[0], kBufferSize, &addr), OK);
+  EXPECT_EQ(cache->Unmap(addr), OK);
+  EXPECT_EQ(cache->GetMapCount(), 2u);
+}
+
+TEST(BufferMappingCacheTests, IdleMappingsStayBounded) {
+  static constexpr size_t kMaxCachedMappings = 4;
+  static constexpr uint32_t kNumBuffers = 16;
+  static constexpr uint32_t kNumIterations = 100;
+
+  auto cache = BufferMappingCache::Create();
+  ASSERT_NE(cache, nullptr);
+  TestBuffers buffers(kNumBuffers);
+  ASSERT_EQ(buffers.fds().size(), kNumBuffers);
+
+  // Cycle through more buffers than the cache keeps, with two in use.
+  std::vector<uint8_t*> addrs;
+  for (uint32_t i = 0; i < kNumIterations; i++) {
+    if (i == kNumBuffers) {
+      // Lowering the limit evicts idle mappings right away.
+      cache->SetMaxCachedMappings(kMaxCachedMappings);
+      EXPECT_LE(cache->GetIdleMappingCount(), kMaxCachedMappings);
+    }
+
+    uint8_t* addr = nullptr;
+    ASSERT_EQ(cache->Map(buffers.fds()[i % kNumBuffers], kBufferSize, &addr),
+              OK);
+    addrs.push_back(addr);
+    if (addrs.size() > 2) {
+      ASSERT_EQ(cache->Unmap(addrs.front()), OK);
+      addrs.erase(addrs.begin());
+    }
+
+    if (i >= kNumBuffers) {
+      EXPECT_LE(cache->GetIdleMappingCount(), kMaxCachedMappings);
+      EXPECT_LE(cache->GetMappingCount(), kMaxCachedMappings + addrs.size());
+    }
+  }
+
+  for (auto addr : addrs) {
+    ASSERT_EQ(cache->Unmap(addr), OK);
+  }
+  EXPECT_LE(cache->GetIdleMappingCount(), kMaxCachedMappings);
+}
+
+// Simulate the buffer mappings of a long RGBIRD session as DepthProcessBlock
+// makes them. Each depth request maps an RGB YUV buffer and two IR RAW
+// buffers, each internal stream cycling through its own buffers, and a depth
+// buffer from the framework. Input mappings are kept and depth buffer
+// mappings are dropped when released. The same session is run with and
+// without caching input mappings, and the mmap calls of both are counted.
+TEST(BufferMappingCacheTests, RgbirdSessionMapCount) {
+  static constexpr uint32_t kNumInputStreams = 3;
+  static constexpr uint32_t kBuffersPerStream = 8;
+  static constexpr uint32_t kNumFrames = 900;
+  static constexpr uint32_t kMaxInflightRequests = 3;
+
+  std::vector<std::unique_ptr<TestBuffers>> input_streams;
+  for (uint32_t i = 0; i < kNumInputStreams; i++) {
+    input_streams.push_back(std::make_unique<TestBuffers>(kBuffersPerStream));
+    ASSERT_EQ(input_streams.back()->fds().size(), kBuffersPerStream);
+  }
+  TestBuffers depth_stream(kBuffersPerStream);
+  ASSERT_EQ(depth_stream.fds().size(), kBuffersPerStream);
+
+  auto run_session = [&](size_t max_cached_mappings) -> uint64_t {
+    auto cache = BufferMappingCache::Create();
+    if (cache == nullptr) {
+      ADD_FAILURE() << "Creating BufferMappingCache failed";
+      return 0;
+    }
+    cache->SetMaxCachedMappings(max_cached_mappings);
+
+    // The last mapping of each request is the depth buffer.
+    std::vector<std::vector<uint8_t*>> inflight_requests;
+    auto release_request = [&](const std::vector<uint8_t*>& addrs) {
+      for (size_t i = 0; i < addrs.size(); i++) {
+        bool is_input = i + 1 < addrs.size();
+        EXPECT_EQ(cache->Unmap(addrs[i], /*keep_mapping=*/is_input), OK);
+      }
+      EXPECT_LE(cache->GetIdleMappingCount(), max_cached_mappings);
+    };
+
+    for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+      std::vector<uint8_t*> addrs;
+      std::vector<int> fds;
+      for (auto& stream : input_streams) {
+        fds.push_back(stream->fds()[frame % kBuffersPerStream]);
+      }
+      fds.push_back(depth_stream.fds()[frame % kBuffersPerStream]);
+      for (int fd : fds) {
+        uint8_t* addr = nullptr;
+        EXPECT_EQ(cache->Map(fd, kBufferSize, &addr), OK);
+        addrs.push_back(addr);
+      }
+      inflight_requests.push_back(addrs);
+
+      if (inflight_requests.size() > kMaxInflightRequests) {
+        release_request(inflight_requests.front());
+        inflight_requests.erase(inflight_requests.begin());
+      }
+    }
+
+    for (auto& addrs : inflight_requests) {
+      release_request(addrs);
+    }
+    return cache->GetMapCount();
+  };
+
+  uint64_t cached_map_count =
+      run_session(/*max_cached_mappings=*/kNumInputStreams * kBuffersPerStream);
+  uint64_t uncached_map_count = run_session(/*max_cached_mappings=*/0);
+
+  // Each input buffer is mapped once, and depth buffers in every frame.
+  EXPECT_EQ(cached_map_count,
+            kNumInputStreams * kBuffersPerStream + kNumFrames);
+  EXPECT_EQ(uncached_map_count, (kNumInputStreams + 1) * kNumFrames);
+  ALOGI("%s: %u frames, %" PRIu64 " mmap calls without caching input "
+        "mappings, %" PRIu64 " with caching",
+        __FUNCTION__, kNumFrames, uncached_map_count, cached_map_count);
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
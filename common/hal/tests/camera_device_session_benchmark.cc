@@ -0,0 +1,924 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Drives CameraDeviceSession on top of MockDeviceSessionHwl and measures the
+// cost of the HAL layer per frame, without a camera HWL.
+//
+// Each benchmark configures the streams of a capture session type, then sends
+// one request per iteration at the given frame rate (0 sends requests as fast
+// as the session accepts them). The following counters are reported:
+//   cpu_us:         CPU time of all threads per frame.
+//   allocs:         Heap allocations per frame made by the threads running
+//                   the session: the thread sending requests and the threads
+//                   delivering results and messages.
+//   submit_blocked: Time ProcessCaptureRequest() spends off CPU, which is
+//                   mostly waiting for locks held by the result threads.
+//   submit/shutter/result_p50/p99: Latency from sending a request to
+//                   ProcessCaptureRequest() returning, the shutter and the
+//                   complete result, in microseconds.
+//
+// Frame rates and stream counts can be set with --fps=<list> and
+// --streams=<list>, e.g. --fps=30,60 --streams=1,3.
+//
+// ZslSnapshotCaptureSession loads its snapshot process block from a vendor
+// library. The benchmark overrides it with a fake one, which completes
+// snapshots right away, so the ZSL configurations run on any device.
+
+#define LOG_TAG "CameraDeviceSessionBenchmark"
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+#include <log/log.h>
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera_device_session.h"
+#include "gralloc_buffer_allocator.h"
+#include "mock_device_session_hwl.h"
+#include "process_block.h"
+#include "result_processor.h"
+#include "test_utils.h"
+#include "vendor_tag_defs.h"
+#include "vendor_tag_utils.h"
+#include "zsl_snapshot_capture_session.h"
+
+namespace {
+
+std::atomic<uint64_t> num_allocations(0);
+
+// Allocations are only counted while the frames of a benchmark run are in
+// flight.
+std::atomic<bool> count_allocations(false);
+
+// Set on the thread sending requests and on the threads delivering results and
+// messages. Allocations of other threads, e.g. the ones of the benchmark
+// library or the binder thread pool, are not counted.
+thread_local bool is_session_thread = false;
+
+// Allocations made by the benchmark itself to build requests are not counted.
+thread_local bool ignore_allocations = false;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  if (is_session_thread && !ignore_allocations &&
+      count_allocations.load(std::memory_order_relaxed)) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    abort();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+  free(ptr);
+}
+
+namespace android {
+namespace google_camera_hal {
+namespace {
+
+using ::testing::_;
+using ::testing::NiceMock;
+
+enum class SessionType {
+  // A preview stream and YUV streams, handled by BasicCaptureSession.
+  kBasic,
+  // A preview stream, a JPEG stream and YUV streams on a camera that enables
+  // software denoise, handled by ZslSnapshotCaptureSession.
+  kZslSnapshot,
+  // A preview stream, a JPEG stream and YUV streams on a Bayer camera that
+  // supports HDR+, handled by HdrplusCaptureSession.
+  kHdrplus,
+};
+
+static constexpr uint32_t kPreviewWidth = 1920;
+static constexpr uint32_t kPreviewHeight = 1080;
+static constexpr uint32_t kYuvWidth = 640;
+static constexpr uint32_t kYuvHeight = 480;
+static constexpr uint32_t kJpegWidth = 4032;
+static constexpr uint32_t kJpegHeight = 3024;
+static constexpr uint32_t kNumBuffersPerStream = 4;
+// A snapshot is requested once every kSnapshotInterval frames.
+static constexpr uint32_t kSnapshotInterval = 30;
+static constexpr uint32_t kResultTimeoutMs = 3000;
+// Frames sent before each benchmark run, so that lazy initialization isn't
+// measured and the threads delivering results are known.
+static constexpr uint32_t kNumWarmUpFrames = kNumBuffersPerStream;
+// Latencies of at most this many frames are recorded per benchmark run.
+static constexpr size_t kMaxRecordedFrames = 1 << 16;
+
+class ScopedIgnoreAllocations {
+ public:
+  ScopedIgnoreAllocations() {
+    ignore_allocations = true;
+  }
+  ~ScopedIgnoreAllocations() {
+    ignore_allocations = false;
+  }
+};
+
+// Latencies of one stage of the pipeline.
+class LatencyRecorder {
+ public:
+  LatencyRecorder() {
+    latencies_ns_.reserve(kMaxRecordedFrames);
+  }
+
+  void Record(nsecs_t latency_ns) {
+    if (latencies_ns_.size() < kMaxRecordedFrames) {
+      latencies_ns_.push_back(latency_ns);
+    }
+  }
+
+  void Clear() {
+    latencies_ns_.clear();
+  }
+
+  // Returns the latency at percentile p (0 to 100) in microseconds.
+  double GetPercentileUs(uint32_t p) {
+    if (latencies_ns_.empty()) {
+      return 0;
+    }
+    size_t index = (latencies_ns_.size() - 1) * p / 100;
+    std::nth_element(latencies_ns_.begin(), latencies_ns_.begin() + index,
+                     latencies_ns_.end());
+    return latencies_ns_[index] / 1000.0;
+  }
+
+ private:
+  std::vector<nsecs_t> latencies_ns_;
+};
+
+// Stands in for the snapshot process block of ZslSnapshotCaptureSession. It
+// completes each snapshot as soon as it's requested, returning the ZSL input
+// buffers and the output buffers unchanged.
+class FakeSnapshotProcessBlock : public ProcessBlock {
+ public:
+  status_t ConfigureStreams(
+      const StreamConfiguration& stream_config,
+      const StreamConfiguration& /*overall_config*/) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (const auto& stream : stream_config.streams) {
+      HalStream hal_stream = {
+          .id = stream.id,
+          .override_format = stream.format,
+          .producer_usage = stream.usage,
+          .consumer_usage = GRALLOC_USAGE_SW_READ_OFTEN,
+          .max_buffers = 1,
+          .override_data_space = stream.data_space,
+      };
+      hal_streams_.push_back(hal_stream);
+    }
+    return OK;
+  }
+
+  status_t SetResultProcessor(
+      std::unique_ptr<ResultProcessor> result_processor) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    result_processor_ = std::move(result_processor);
+    return OK;
+  }
+
+  status_t GetConfiguredHalStreams(
+      std::vector<HalStream>* hal_streams) const override {
+    std::lock_guard<std::mutex> lock(lock_);
+    *hal_streams = hal_streams_;
+    return OK;
+  }
+
+  status_t ProcessRequests(
+      const std::vector<ProcessBlockRequest>& process_block_requests,
+      const CaptureRequest& remaining_session_request) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (result_processor_ == nullptr) {
+      return NO_INIT;
+    }
+
+    // ZslSnapshotCaptureSession requests the output buffers of a snapshot
+    // with HAL buffer management, which the benchmark doesn't use. The
+    // buffers of the session request are completed instead.
+    std::vector<ProcessBlockRequest> block_requests(
+        process_block_requests.size());
+    for (size_t i = 0; i < process_block_requests.size(); i++) {
+      block_requests[i].request_id = process_block_requests[i].request_id;
+      block_requests[i].request.frame_number =
+          process_block_requests[i].request.frame_number;
+      block_requests[i].request.output_buffers =
+          remaining_session_request.output_buffers;
+    }
+    status_t res = result_processor_->AddPendingRequests(
+        block_requests, remaining_session_request);
+    if (res != OK) {
+      return res;
+    }
+
+    for (size_t i = 0; i < process_block_requests.size(); i++) {
+      const CaptureRequest& request = process_block_requests[i].request;
+      ProcessBlockNotifyMessage shutter = {
+          .request_id = block_requests[i].request_id,
+          .message = {.type = MessageType::kShutter,
+                      .message.shutter = {
+                          .frame_number = request.frame_number,
+                          .timestamp_ns = 0,
+                          .readout_timestamp_ns = 0,
+                      }}};
+      result_processor_->Notify(shutter);
+
+      auto result = std::make_unique<CaptureResult>();
+      result->frame_number = request.frame_number;
+      result->result_metadata =
+          HalCameraMetadata::Clone(request.settings.get());
+      result->output_buffers = block_requests[i].request.output_buffers;
+      result->input_buffers = request.input_buffers;
+      result->partial_result = 1;
+      result_processor_->ProcessResult(
+          {.request_id = block_requests[i].request_id,
+           .result = std::move(result)});
+    }
+    return OK;
+  }
+
+  status_t Flush() override {
+    return OK;
+  }
+
+ private:
+  mutable std::mutex lock_;
+  std::vector<HalStream> hal_streams_;  // Protected by lock_.
+  std::unique_ptr<ResultProcessor> result_processor_;  // Protected by lock_.
+};
+
+class FakeSnapshotProcessBlockFactory : public ExternalProcessBlockFactory {
+ public:
+  std::unique_ptr<ProcessBlock> CreateProcessBlock(
+      CameraDeviceSessionHwl* /*device_session_hwl*/) override {
+    return std::make_unique<FakeSnapshotProcessBlock>();
+  }
+
+  std::string GetBlockName() const override {
+    return "SnapshotProcessBlock";
+  }
+};
+
+class SessionHarness {
+ public:
+  // Create a CameraDeviceSession with num_streams streams for session_type.
+  static std::unique_ptr<SessionHarness> Create(SessionType session_type,
+                                                uint32_t num_streams);
+
+  ~SessionHarness();
+
+  // Send the request for frame_number.
+  status_t SubmitFrame(uint32_t frame_number);
+
+  // Wait until at most max_pending_frames frames are in flight.
+  status_t WaitForPendingFrames(uint32_t max_pending_frames);
+
+  uint32_t GetMaxPendingFrames() const {
+    return max_pending_frames_;
+  }
+
+  uint32_t GetNumFailedFrames() const {
+    return num_failed_frames_;
+  }
+
+  // Clear the latencies and the failed frames recorded so far.
+  void ResetStats();
+
+  LatencyRecorder submit_latencies;
+  LatencyRecorder submit_blocked_times;
+  LatencyRecorder shutter_latencies;
+  LatencyRecorder result_latencies;
+
+ private:
+  static constexpr uint32_t kMaxPendingFrames = kNumBuffersPerStream;
+
+  struct PendingFrame {
+    bool pending = false;
+    uint32_t frame_number = 0;
+    nsecs_t submit_time_ns = 0;
+    uint32_t num_pending_buffers = 0;
+    bool metadata_received = false;
+  };
+
+  SessionHarness() = default;
+
+  status_t Initialize(SessionType session_type, uint32_t num_streams);
+
+  std::unique_ptr<HalCameraMetadata> CreateCharacteristics(
+      SessionType session_type);
+
+  void GetStreamConfiguration(SessionType session_type, uint32_t num_streams,
+                              StreamConfiguration* config);
+
+  status_t AllocateBuffers(const Stream& stream, const HalStream& hal_stream);
+
+  // Callbacks invoked by CameraDeviceSession.
+  void ProcessCaptureResult(std::unique_ptr<CaptureResult> result);
+  void Notify(const NotifyMessage& message);
+
+  // Mark the frame done and wake up the waiting thread. Caller must lock
+  // frame_lock_.
+  void CompleteFrameLocked(PendingFrame* frame);
+
+  std::unique_ptr<CameraDeviceSession> session_;
+  std::unique_ptr<IHalBufferAllocator> allocator_;
+  std::vector<Stream> streams_;
+  std::vector<std::vector<buffer_handle_t>> buffers_;
+  int32_t jpeg_stream_id_ = -1;
+  std::unique_ptr<HalCameraMetadata> preview_settings_;
+  std::unique_ptr<HalCameraMetadata> still_settings_;
+  uint32_t max_pending_frames_ = kMaxPendingFrames;
+
+  std::mutex frame_lock_;
+  std::condition_variable frame_condition_;  // Protected by frame_lock_.
+  // Protected by frame_lock_.
+  PendingFrame pending_frames_[kMaxPendingFrames];
+  uint32_t num_pending_frames_ = 0;  // Protected by frame_lock_.
+  uint32_t num_failed_frames_ = 0;   // Protected by frame_lock_.
+};
+
+std::unique_ptr<SessionHarness> SessionHarness::Create(
+    SessionType session_type, uint32_t num_streams) {
+  auto harness = std::unique_ptr<SessionHarness>(new SessionHarness());
+  if (harness->Initialize(session_type, num_streams) != OK) {
+    return nullptr;
+  }
+  return harness;
+}
+
+SessionHarness::~SessionHarness() {
+  if (session_ != nullptr) {
+    session_->Flush();
+    WaitForPendingFrames(/*max_pending_frames=*/0);
+    session_ = nullptr;
+  }
+  for (auto& buffers : buffers_) {
+    allocator_->FreeBuffers(&buffers);
+  }
+}
+
+std::unique_ptr<HalCameraMetadata> SessionHarness::CreateCharacteristics(
+    SessionType session_type) {
+  auto characteristics = HalCameraMetadata::Create(/*num_entries=*/8,
+                                                   /*data_bytes=*/128);
+  if (characteristics == nullptr) {
+    return nullptr;
+  }
+
+  // The ZSL stream of both sessions is as large as the active array.
+  int32_t active_array[] = {0, 0, kJpegWidth, kJpegHeight};
+  status_t res = OK;
+  if (session_type == SessionType::kZslSnapshot) {
+    uint8_t sw_denoise_enabled = 1;
+    // The input size of the snapshot process block.
+    int32_t stream_config[] = {
+        HAL_PIXEL_FORMAT_YCbCr_420_888, kJpegWidth, kJpegHeight,
+        ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT};
+    res = characteristics->Set(VendorTagIds::kSwDenoiseEnabled,
+                               &sw_denoise_enabled, 1);
+    if (res == OK) {
+      res = characteristics->Set(
+          ANDROID_SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE, active_array,
+          std::size(active_array));
+    }
+    if (res == OK) {
+      res = characteristics->Set(ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
+                                 stream_config, std::size(stream_config));
+    }
+  } else if (session_type == SessionType::kHdrplus) {
+    int32_t payload_frames = 4;
+    uint8_t cfa = ANDROID_SENSOR_INFO_COLOR_FILTER_ARRANGEMENT_RGGB;
+    res = characteristics->Set(VendorTagIds::kHdrplusPayloadFrames,
+                               &payload_frames, 1);
+    if (res == OK) {
+      res = characteristics->Set(ANDROID_SENSOR_INFO_COLOR_FILTER_ARRANGEMENT,
+                                 &cfa, 1);
+    }
+    if (res == OK) {
+      res = characteristics->Set(
+          ANDROID_SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE, active_array,
+          std::size(active_array));
+    }
+  }
+
+  if (res != OK) {
+    ALOGE("%s: Setting characteristics failed: %s (%d).", __FUNCTION__,
+          strerror(-res), res);
+    return nullptr;
+  }
+  return characteristics;
+}
+
+void SessionHarness::GetStreamConfiguration(SessionType session_type,
+                                            uint32_t num_streams,
+                                            StreamConfiguration* config) {
+  test_utils::GetPreviewOnlyStreamConfiguration(config, kPreviewWidth,
+                                                kPreviewHeight);
+  // Stream counts below what the session type needs are raised to it.
+  int32_t next_stream_id = config->streams[0].id + 1;
+  if (session_type != SessionType::kBasic) {
+    Stream jpeg_stream = {};
+    jpeg_stream.id = next_stream_id++;
+    jpeg_stream.width = kJpegWidth;
+    jpeg_stream.height = kJpegHeight;
+    jpeg_stream.format = HAL_PIXEL_FORMAT_BLOB;
+    jpeg_stream.data_space = HAL_DATASPACE_V0_JFIF;
+    jpeg_stream.buffer_size = kJpegWidth * kJpegHeight;
+    config->streams.push_back(jpeg_stream);
+    jpeg_stream_id_ = jpeg_stream.id;
+  }
+
+  while (config->streams.size() < num_streams) {
+    Stream yuv_stream = {};
+    yuv_stream.id = next_stream_id++;
+    yuv_stream.width = kYuvWidth;
+    yuv_stream.height = kYuvHeight;
+    yuv_stream.format = HAL_PIXEL_FORMAT_YCbCr_420_888;
+    yuv_stream.usage = GRALLOC_USAGE_SW_READ_OFTEN;
+    yuv_stream.data_space = HAL_DATASPACE_V0_JFIF;
+    config->streams.push_back(yuv_stream);
+  }
+}
+
+status_t SessionHarness::AllocateBuffers(const Stream& stream,
+                                         const HalStream& hal_stream) {
+  HalBufferDescriptor buffer_descriptor = {
+      .stream_id = stream.id,
+      .width = stream.width,
+      .height = stream.height,
+      .format = hal_stream.override_format,
+      .producer_flags = hal_stream.producer_usage | stream.usage,
+      .consumer_flags = hal_stream.consumer_usage,
+      .immediate_num_buffers = kNumBuffersPerStream,
+      .max_num_buffers = kNumBuffersPerStream,
+  };
+
+  // BLOB buffers are allocated as one row of bytes.
+  if (hal_stream.override_format == HAL_PIXEL_FORMAT_BLOB) {
+    buffer_descriptor.width = stream.buffer_size;
+    buffer_descriptor.height = 1;
+  }
+
+  std::vector<buffer_handle_t> buffers;
+  status_t res = allocator_->AllocateBuffers(buffer_descriptor, &buffers);
+  if (res != OK || buffers.size() < kNumBuffersPerStream) {
+    ALOGE("%s: Allocating buffers for stream %d failed.", __FUNCTION__,
+          stream.id);
+    allocator_->FreeBuffers(&buffers);
+    return NO_MEMORY;
+  }
+
+  buffers_.push_back(std::move(buffers));
+  return OK;
+}
+
+status_t SessionHarness::Initialize(SessionType session_type,
+                                    uint32_t num_streams) {
+  auto session_hwl = std::make_unique<NiceMock<MockDeviceSessionHwl>>();
+  session_hwl->DelegateCallsToFakeSession();
+
+  std::shared_ptr<HalCameraMetadata> characteristics =
+      CreateCharacteristics(session_type);
+  if (characteristics == nullptr) {
+    ALOGE("%s: Creating characteristics failed.", __FUNCTION__);
+    return NO_MEMORY;
+  }
+  ON_CALL(*session_hwl, GetCameraCharacteristics(_))
+      .WillByDefault([characteristics](
+                         std::unique_ptr<HalCameraMetadata>* result) {
+        *result = HalCameraMetadata::Clone(characteristics.get());
+        return *result != nullptr ? OK : NO_MEMORY;
+      });
+
+  session_ = CameraDeviceSession::Create(
+      std::move(session_hwl), /*external_session_factory_entries=*/{});
+  if (session_ == nullptr) {
+    ALOGE("%s: Creating CameraDeviceSession failed.", __FUNCTION__);
+    return NO_INIT;
+  }
+
+  CameraDeviceSessionCallback session_callback = {
+      .process_capture_result =
+          [this](std::unique_ptr<CaptureResult> result) {
+            ProcessCaptureResult(std::move(result));
+          },
+      .process_batch_capture_result =
+          [this](std::vector<std::unique_ptr<CaptureResult>> results) {
+            for (auto& result : results) {
+              ProcessCaptureResult(std::move(result));
+            }
+          },
+      .notify = [this](const NotifyMessage& message) { Notify(message); },
+  };
+
+  ThermalCallback thermal_callback = {
+      .register_thermal_changed_callback =
+          RegisterThermalChangedCallbackFunc(
+              [](NotifyThrottlingFunc /*notify_throttling*/,
+                 bool /*filter_type*/, TemperatureType /*type*/) {
+                return INVALID_OPERATION;
+              }),
+      .unregister_thermal_changed_callback =
+          UnregisterThermalChangedCallbackFunc([]() {}),
+  };
+
+  session_->SetSessionCallback(session_callback, thermal_callback);
+
+  StreamConfiguration stream_config;
+  GetStreamConfiguration(session_type, num_streams, &stream_config);
+  ConfigureStreamsReturn hal_config;
+  status_t res = session_->ConfigureStreams(stream_config, /*v2=*/false,
+                                            &hal_config);
+  if (res != OK) {
+    ALOGE("%s: Configuring streams failed: %s (%d).", __FUNCTION__,
+          strerror(-res), res);
+    return res;
+  }
+
+  allocator_ = GrallocBufferAllocator::Create();
+  if (allocator_ == nullptr) {
+    ALOGE("%s: Creating a buffer allocator failed.", __FUNCTION__);
+    return NO_INIT;
+  }
+
+  for (auto& stream : stream_config.streams) {
+    auto hal_stream =
+        std::find_if(hal_config.hal_streams.begin(),
+                     hal_config.hal_streams.end(),
+                     [&](const HalStream& s) { return s.id == stream.id; });
+    if (hal_stream == hal_config.hal_streams.end()) {
+      ALOGE("%s: Stream %d is not configured.", __FUNCTION__, stream.id);
+      return BAD_VALUE;
+    }
+
+    res = AllocateBuffers(stream, *hal_stream);
+    if (res != OK) {
+      return res;
+    }
+    streams_.push_back(stream);
+    max_pending_frames_ =
+        std::min(max_pending_frames_, std::max(hal_stream->max_buffers, 1u));
+  }
+
+  res = session_->ConstructDefaultRequestSettings(RequestTemplate::kPreview,
+                                                  &preview_settings_);
+  if (res == OK) {
+    res = session_->ConstructDefaultRequestSettings(
+        RequestTemplate::kStillCapture, &still_settings_);
+  }
+  if (res != OK) {
+    ALOGE("%s: Constructing default request settings failed.", __FUNCTION__);
+    return res;
+  }
+
+  uint8_t capture_intent = ANDROID_CONTROL_CAPTURE_INTENT_PREVIEW;
+  res = preview_settings_->Set(ANDROID_CONTROL_CAPTURE_INTENT, &capture_intent,
+                               1);
+  if (res == OK) {
+    capture_intent = ANDROID_CONTROL_CAPTURE_INTENT_STILL_CAPTURE;
+    res = still_settings_->Set(ANDROID_CONTROL_CAPTURE_INTENT, &capture_intent,
+                               1);
+  }
+
+  // Snapshots with these settings go to the snapshot process block of
+  // ZslSnapshotCaptureSession.
+  uint8_t noise_reduction_mode = ANDROID_NOISE_REDUCTION_MODE_HIGH_QUALITY;
+  uint8_t edge_mode = ANDROID_EDGE_MODE_HIGH_QUALITY;
+  uint8_t effect_mode = ANDROID_CONTROL_EFFECT_MODE_OFF;
+  uint8_t tonemap_mode = ANDROID_TONEMAP_MODE_HIGH_QUALITY;
+  if (res == OK) {
+    res = still_settings_->Set(ANDROID_NOISE_REDUCTION_MODE,
+                               &noise_reduction_mode, 1);
+  }
+  if (res == OK) {
+    res = still_settings_->Set(ANDROID_EDGE_MODE, &edge_mode, 1);
+  }
+  if (res == OK) {
+    res = still_settings_->Set(ANDROID_CONTROL_EFFECT_MODE, &effect_mode, 1);
+  }
+  if (res == OK) {
+    res = still_settings_->Set(ANDROID_TONEMAP_MODE, &tonemap_mode, 1);
+  }
+
+  return res;
+}
+
+status_t SessionHarness::SubmitFrame(uint32_t frame_number) {
+  is_session_thread = true;
+  std::vector<CaptureRequest> requests(1);
+  {
+    ScopedIgnoreAllocations ignore;
+    bool is_snapshot = frame_number % kSnapshotInterval == 0;
+    CaptureRequest& request = requests[0];
+    request.frame_number = frame_number;
+    request.settings = HalCameraMetadata::Clone(
+        is_snapshot ? still_settings_.get() : preview_settings_.get());
+    for (size_t i = 0; i < streams_.size(); i++) {
+      if (streams_[i].id == jpeg_stream_id_ && !is_snapshot) {
+        continue;
+      }
+      uint32_t buffer_index = frame_number % kNumBuffersPerStream;
+      request.output_buffers.push_back(
+          {.stream_id = streams_[i].id,
+           .buffer_id = i * kNumBuffersPerStream + buffer_index,
+           .buffer = buffers_[i][buffer_index],
+           .status = BufferStatus::kOk});
+    }
+  }
+
+  nsecs_t submit_time_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+  {
+    std::lock_guard<std::mutex> lock(frame_lock_);
+    PendingFrame& frame = pending_frames_[frame_number % kMaxPendingFrames];
+    if (frame.pending) {
+      ALOGE("%s: Frame %u is still pending.", __FUNCTION__,
+            frame.frame_number);
+      return INVALID_OPERATION;
+    }
+    frame = {.pending = true,
+             .frame_number = frame_number,
+             .submit_time_ns = submit_time_ns,
+             .num_pending_buffers =
+                 static_cast<uint32_t>(requests[0].output_buffers.size())};
+    num_pending_frames_++;
+  }
+
+  nsecs_t cpu_start_ns = systemTime(SYSTEM_TIME_THREAD);
+  uint32_t num_processed_requests = 0;
+  status_t res =
+      session_->ProcessCaptureRequest(requests, &num_processed_requests);
+  nsecs_t cpu_time_ns = systemTime(SYSTEM_TIME_THREAD) - cpu_start_ns;
+  nsecs_t submit_latency_ns =
+      systemTime(SYSTEM_TIME_MONOTONIC) - submit_time_ns;
+
+  if (res != OK || num_processed_requests != 1) {
+    ALOGE("%s: Processing frame %u failed: %s (%d).", __FUNCTION__,
+          frame_number, strerror(-res), res);
+    std::lock_guard<std::mutex> lock(frame_lock_);
+    CompleteFrameLocked(&pending_frames_[frame_number % kMaxPendingFrames]);
+    return res != OK ? res : UNKNOWN_ERROR;
+  }
+
+  submit_latencies.Record(submit_latency_ns);
+  submit_blocked_times.Record(std::max(submit_latency_ns - cpu_time_ns,
+                                       nsecs_t(0)));
+  return OK;
+}
+
+void SessionHarness::ResetStats() {
+  std::lock_guard<std::mutex> lock(frame_lock_);
+  submit_latencies.Clear();
+  submit_blocked_times.Clear();
+  shutter_latencies.Clear();
+  result_latencies.Clear();
+  num_failed_frames_ = 0;
+}
+
+status_t SessionHarness::WaitForPendingFrames(uint32_t max_pending_frames) {
+  std::unique_lock<std::mutex> lock(frame_lock_);
+  bool done = frame_condition_.wait_for(
+      lock, std::chrono::milliseconds(kResultTimeoutMs),
+      [&] { return num_pending_frames_ <= max_pending_frames; });
+  return done ? OK : TIMED_OUT;
+}
+
+void SessionHarness::CompleteFrameLocked(PendingFrame* frame) {
+  if (!frame->pending) {
+    return;
+  }
+  frame->pending = false;
+  num_pending_frames_--;
+  frame_condition_.notify_one();
+}
+
+void SessionHarness::ProcessCaptureResult(
+    std::unique_ptr<CaptureResult> result) {
+  is_session_thread = true;
+  if (result == nullptr) {
+    return;
+  }
+
+  nsecs_t now_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+  std::lock_guard<std::mutex> lock(frame_lock_);
+  PendingFrame& frame =
+      pending_frames_[result->frame_number % kMaxPendingFrames];
+  if (!frame.pending || frame.frame_number != result->frame_number) {
+    return;
+  }
+
+  if (result->result_metadata != nullptr) {
+    frame.metadata_received = true;
+  }
+  frame.num_pending_buffers -=
+      std::min(frame.num_pending_buffers,
+               static_cast<uint32_t>(result->output_buffers.size()));
+  if (frame.metadata_received && frame.num_pending_buffers == 0) {
+    result_latencies.Record(now_ns - frame.submit_time_ns);
+    CompleteFrameLocked(&frame);
+  }
+}
+
+void SessionHarness::Notify(const NotifyMessage& message) {
+  is_session_thread = true;
+  nsecs_t now_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+  std::lock_guard<std::mutex> lock(frame_lock_);
+  if (message.type == MessageType::kShutter) {
+    const PendingFrame& frame =
+        pending_frames_[message.message.shutter.frame_number %
+                        kMaxPendingFrames];
+    if (frame.pending &&
+        frame.frame_number == message.message.shutter.frame_number) {
+      shutter_latencies.Record(now_ns - frame.submit_time_ns);
+    }
+    return;
+  }
+
+  // A request error means no more results will arrive for the frame.
+  PendingFrame& frame =
+      pending_frames_[message.message.error.frame_number % kMaxPendingFrames];
+  if (message.message.error.error_code == ErrorCode::kErrorRequest &&
+      frame.pending &&
+      frame.frame_number == message.message.error.frame_number) {
+    num_failed_frames_++;
+    CompleteFrameLocked(&frame);
+  }
+}
+
+void BM_CaptureSession(benchmark::State& state, SessionType session_type) {
+  uint32_t fps = state.range(0);
+  uint32_t num_streams = state.range(1);
+  auto harness = SessionHarness::Create(session_type, num_streams);
+  if (harness == nullptr) {
+    state.SkipWithError("Configuring the capture session failed.");
+    return;
+  }
+
+  uint32_t frame_number = 0;
+  for (; frame_number < kNumWarmUpFrames; frame_number++) {
+    if (harness->WaitForPendingFrames(harness->GetMaxPendingFrames() - 1) !=
+            OK ||
+        harness->SubmitFrame(frame_number) != OK) {
+      state.SkipWithError("Warming up the capture session failed.");
+      return;
+    }
+  }
+  if (harness->WaitForPendingFrames(/*max_pending_frames=*/0) != OK) {
+    state.SkipWithError("Waiting for results timed out.");
+    return;
+  }
+  harness->ResetStats();
+
+  nsecs_t frame_interval_ns = fps > 0 ? s2ns(1) / fps : 0;
+  nsecs_t next_frame_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+  nsecs_t cpu_start_ns = systemTime(SYSTEM_TIME_PROCESS);
+  uint64_t allocations_start = num_allocations.load();
+  count_allocations = true;
+  for (auto _ : state) {
+    if (harness->WaitForPendingFrames(harness->GetMaxPendingFrames() - 1) !=
+        OK) {
+      state.SkipWithError("Waiting for results timed out.");
+      break;
+    }
+
+    if (frame_interval_ns > 0) {
+      nsecs_t now_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+      if (next_frame_ns > now_ns) {
+        std::this_thread::sleep_for(
+            std::chrono::nanoseconds(next_frame_ns - now_ns));
+      }
+      next_frame_ns += frame_interval_ns;
+    }
+
+    if (harness->SubmitFrame(frame_number++) != OK) {
+      state.SkipWithError("Submitting a request failed.");
+      break;
+    }
+  }
+
+  if (harness->WaitForPendingFrames(/*max_pending_frames=*/0) != OK) {
+    state.SkipWithError("Waiting for results timed out.");
+  }
+  count_allocations = false;
+  nsecs_t cpu_time_ns = systemTime(SYSTEM_TIME_PROCESS) - cpu_start_ns;
+  uint64_t allocations = num_allocations.load() - allocations_start;
+
+  double num_frames = std::max(frame_number - kNumWarmUpFrames, 1u);
+  state.counters["cpu_us"] = cpu_time_ns / 1000.0 / num_frames;
+  state.counters["allocs"] = allocations / num_frames;
+  state.counters["failed"] = harness->GetNumFailedFrames();
+  state.counters["submit_blocked_p99"] =
+      harness->submit_blocked_times.GetPercentileUs(99);
+  std::pair<const char*, LatencyRecorder*> stages[] = {
+      {"submit", &harness->submit_latencies},
+      {"shutter", &harness->shutter_latencies},
+      {"result", &harness->result_latencies}};
+  for (auto& [name, latencies] : stages) {
+    state.counters[std::string(name) + "_p50"] =
+        latencies->GetPercentileUs(50);
+    state.counters[std::string(name) + "_p99"] =
+        latencies->GetPercentileUs(99);
+  }
+}
+
+// Parse a comma-separated list of integers following prefix in arg.
+bool ParseList(const char* arg, const char* prefix,
+               std::vector<int64_t>* values) {
+  size_t prefix_length = strlen(prefix);
+  if (strncmp(arg, prefix, prefix_length) != 0) {
+    return false;
+  }
+
+  values->clear();
+  const char* value = arg + prefix_length;
+  while (*value != '\0') {
+    char* end = nullptr;
+    values->push_back(strtoll(value, &end, 10));
+    value = *end == ',' ? end + 1 : end + strlen(end);
+  }
+  return true;
+}
+
+// Replaces the snapshot process block library of ZslSnapshotCaptureSession.
+ExternalProcessBlockFactory* GetFakeSnapshotProcessBlockFactory() {
+  static FakeSnapshotProcessBlockFactory factory;
+  return &factory;
+}
+
+}  // namespace
+
+}  // namespace google_camera_hal
+}  // namespace android
+
+int main(int argc, char** argv) {
+  using namespace android::google_camera_hal;
+
+  benchmark::Initialize(&argc, argv);
+
+  std::vector<int64_t> fps_list = {30, 60, 0};
+  std::vector<int64_t> num_streams_list = {1, 2, 4};
+  for (int i = 1; i < argc; i++) {
+    if (!ParseList(argv[i], "--fps=", &fps_list) &&
+        !ParseList(argv[i], "--streams=", &num_streams_list)) {
+      fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  // The HAL vendor tags are registered by CameraProvider on devices.
+  if (VendorTagManager::GetInstance().AddTags(kHalVendorTagSections) !=
+      android::OK) {
+    ALOGE("%s: Adding HAL vendor tags failed.", __FUNCTION__);
+    return 1;
+  }
+
+  ZslSnapshotCaptureSession::SetSnapshotProcessBlockFactoryOverride(
+      GetFakeSnapshotProcessBlockFactory);
+
+  std::pair<const char*, SessionType> session_types[] = {
+      {"BasicCaptureSession", SessionType::kBasic},
+      {"ZslSnapshotCaptureSession", SessionType::kZslSnapshot},
+      {"HdrplusCaptureSession", SessionType::kHdrplus}};
+  for (auto& [name, session_type] : session_types) {
+    benchmark::RegisterBenchmark(name, BM_CaptureSession, session_type)
+        ->ArgsProduct({fps_list, num_streams_list})
+        ->ArgNames({"fps", "streams"})
+        ->UseRealTime();
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  VendorTagManager::GetInstance().Reset();
+  return 0;
+}
@@ -79,9 +79,104 @@ TEST(CameraDeviceTests, GetResourceCost) {
   });
 }
 
-// TODO(b/138960498): Test GetCameraCharacteristics and
-// GetPhysicalCameraCharacteristicsafter HalCameraMetadata supports setting and
-// getting metadata.
+// Create characteristics that can be finalized by CameraDevice, with the
+// sensor orientation set to orientation.
+static std::unique_ptr<HalCameraMetadata> CreateCharacteristics(
+    int32_t orientation) {
+  auto characteristics = HalCameraMetadata::Create(/*num_entries=*/5,
+                                                   /*data_bytes=*/64);
+  if (characteristics == nullptr) {
+    return nullptr;
+  }
+
+  int32_t keys[] = {ANDROID_SENSOR_ORIENTATION};
+  for (uint32_t tag : {ANDROID_REQUEST_AVAILABLE_REQUEST_KEYS,
+                       ANDROID_REQUEST_AVAILABLE_RESULT_KEYS,
+                       ANDROID_REQUEST_AVAILABLE_CHARACTERISTICS_KEYS}) {
+    if (characteristics->Set(tag, keys, 1) != OK) {
+      return nullptr;
+    }
+  }
+
+  if (characteristics->Set(ANDROID_SENSOR_ORIENTATION, &orientation, 1) !=
+      OK) {
+    return nullptr;
+  }
+
+  return characteristics;
+}
+
+static void ExpectOrientation(const HalCameraMetadata* characteristics,
+                              int32_t orientation) {
+  ASSERT_NE(characteristics, nullptr);
+  camera_metadata_ro_entry entry = {};
+  ASSERT_EQ(characteristics->Get(ANDROID_SENSOR_ORIENTATION, &entry), OK);
+  ASSERT_EQ(entry.count, 1u);
+  EXPECT_EQ(entry.data.i32[0], orientation);
+}
+
+TEST(CameraDeviceTests, GetCameraCharacteristics) {
+  auto mock_device_hwl = MockDeviceHwl::Create();
+  ASSERT_NE(mock_device_hwl, nullptr);
+  mock_device_hwl->characteristics_ = CreateCharacteristics(90);
+  ASSERT_NE(mock_device_hwl->characteristics_, nullptr);
+  MockDeviceHwl* hwl = mock_device_hwl.get();
+
+  auto device = CameraDevice::Create(std::move(mock_device_hwl));
+  ASSERT_NE(device, nullptr);
+  EXPECT_EQ(device->GetCameraCharacteristics(nullptr), BAD_VALUE);
+
+  std::unique_ptr<HalCameraMetadata> characteristics;
+  ASSERT_EQ(device->GetCameraCharacteristics(&characteristics), OK);
+  ExpectOrientation(characteristics.get(), 90);
+
+  // Callers get their own copy of the finalized characteristics.
+  characteristics.reset();
+  hwl->characteristics_ = CreateCharacteristics(180);
+  ASSERT_NE(hwl->characteristics_, nullptr);
+  ASSERT_EQ(device->GetCameraCharacteristics(&characteristics), OK);
+  ExpectOrientation(characteristics.get(), 90);
+
+  // A device state change invalidates the cached characteristics.
+  CameraDevice::NotifyDeviceStateChange();
+  ASSERT_EQ(device->GetCameraCharacteristics(&characteristics), OK);
+  ExpectOrientation(characteristics.get(), 180);
+}
+
+TEST(CameraDeviceTests, GetPhysicalCameraCharacteristics) {
+  static constexpr uint32_t kPhysicalCameraId = 2;
+  auto mock_device_hwl = MockDeviceHwl::Create();
+  ASSERT_NE(mock_device_hwl, nullptr);
+  MockDeviceHwl* hwl = mock_device_hwl.get();
+
+  auto device = CameraDevice::Create(std::move(mock_device_hwl));
+  ASSERT_NE(device, nullptr);
+
+  // Failures are not cached.
+  std::unique_ptr<HalCameraMetadata> characteristics;
+  EXPECT_NE(device->GetPhysicalCameraCharacteristics(kPhysicalCameraId,
+                                                     &characteristics),
+            OK);
+  hwl->physical_camera_characteristics_[kPhysicalCameraId] =
+      CreateCharacteristics(270);
+  ASSERT_EQ(device->GetPhysicalCameraCharacteristics(kPhysicalCameraId,
+                                                     &characteristics),
+            OK);
+  ExpectOrientation(characteristics.get(), 270);
+
+  hwl->physical_camera_characteristics_[kPhysicalCameraId] =
+      CreateCharacteristics(0);
+  ASSERT_EQ(device->GetPhysicalCameraCharacteristics(kPhysicalCameraId,
+                                                     &characteristics),
+            OK);
+  ExpectOrientation(characteristics.get(), 270);
+
+  CameraDevice::NotifyDeviceStateChange();
+  ASSERT_EQ(device->GetPhysicalCameraCharacteristics(kPhysicalCameraId,
+                                                     &characteristics),
+            OK);
+  ExpectOrientation(characteristics.get(), 0);
+}
 
 TEST(CameraDeviceTests, SetTorchMode) {
   auto mock_device_hwl = MockDeviceHwl::Create();
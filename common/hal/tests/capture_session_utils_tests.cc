@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CaptureSessionUtilsTests"
+#include <log/log.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include "capture_session_utils.h"
+#include "test_utils.h"
+
+namespace android {
+namespace google_camera_hal {
+
+// Number of stream configuration values in the characteristics cloned by each
+// probe, similar to the static metadata of a camera.
+static constexpr uint32_t kNumStreamConfigurationValues = 4096;
+
+class FakeCaptureSession : public CaptureSession {
+ public:
+  status_t ProcessRequest(const CaptureRequest& /*request*/) override {
+    return OK;
+  }
+
+  status_t Flush() override {
+    return OK;
+  }
+};
+
+class FakeExternalCaptureSessionFactory : public ExternalCaptureSessionFactory {
+ public:
+  bool IsStreamConfigurationSupported(
+      CameraDeviceSessionHwl* /*device_session_hwl*/,
+      const StreamConfiguration& /*stream_config*/) override {
+    num_probes++;
+    return supported;
+  }
+
+  std::unique_ptr<CaptureSession> CreateSession(
+      CameraDeviceSessionHwl* /*device_session_hwl*/,
+      const StreamConfiguration& /*stream_config*/,
+      ProcessCaptureResultFunc /*process_capture_result*/,
+      NotifyFunc /*notify*/, HwlSessionCallback /*session_callback*/,
+      std::vector<HalStream>* /*hal_configured_streams*/,
+      CameraBufferAllocatorHwl* /*camera_allocator_hwl*/) override {
+    num_creates++;
+    return std::make_unique<FakeCaptureSession>();
+  }
+
+  bool supported = false;
+  uint32_t num_probes = 0;
+  uint32_t num_creates = 0;
+};
+
+class CaptureSessionUtilsTests : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    characteristics_ = HalCameraMetadata::Create(
+        /*num_entries=*/1,
+        /*data_bytes=*/kNumStreamConfigurationValues * sizeof(int32_t));
+    ASSERT_NE(characteristics_, nullptr);
+    std::vector<int32_t> stream_configurations(kNumStreamConfigurationValues);
+    ASSERT_EQ(
+        characteristics_->Set(ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
+                              stream_configurations.data(),
+                              stream_configurations.size()),
+        OK);
+
+    // Two sessions that don't support the configuration, followed by one that
+    // supports any.
+    for (uint32_t i = 0; i < 3; i++) {
+      bool supported = i == 2;
+      capture_session_entries_.push_back(
+          {.IsStreamConfigurationSupported =
+               [this, supported](CameraDeviceSessionHwl*,
+                                 const StreamConfiguration&) {
+                 // Sessions query the characteristics when probing.
+                 auto characteristics =
+                     HalCameraMetadata::Clone(characteristics_.get());
+                 num_probes_++;
+                 return supported && characteristics != nullptr;
+               },
+           .CreateSession =
+               [this](CameraDeviceSessionHwl*, const StreamConfiguration&,
+                      ProcessCaptureResultFunc, ProcessBatchCaptureResultFunc,
+                      NotifyFunc, HwlSessionCallback, std::vector<HalStream>*,
+                      CameraBufferAllocatorHwl*)
+               -> std::unique_ptr<CaptureSession> {
+                 num_creates_++;
+                 if (fail_create_) {
+                   return nullptr;
+                 }
+                 return std::make_unique<FakeCaptureSession>();
+               }});
+    }
+    external_capture_session_entries_.push_back(&external_factory_);
+  }
+
+  std::unique_ptr<CaptureSession> CreateSession(
+      const StreamConfiguration& stream_config,
+      CaptureSessionSelectionCache* cache) {
+    std::vector<HalStream> hal_config;
+    return CreateCaptureSession(
+        stream_config, /*wrapper_capture_session_entries=*/{},
+        external_capture_session_entries_, capture_session_entries_,
+        HwlSessionCallback(), /*camera_buffer_allocator_hwl=*/nullptr,
+        /*camera_device_session_hwl=*/nullptr, &hal_config,
+        ProcessCaptureResultFunc(), NotifyFunc(),
+        ProcessBatchCaptureResultFunc(), cache);
+  }
+
+  std::unique_ptr<HalCameraMetadata> characteristics_;
+  std::vector<CaptureSessionEntryFuncs> capture_session_entries_;
+  FakeExternalCaptureSessionFactory external_factory_;
+  std::vector<ExternalCaptureSessionFactory*> external_capture_session_entries_;
+  uint32_t num_probes_ = 0;
+  uint32_t num_creates_ = 0;
+  bool fail_create_ = false;
+};
+
+TEST_F(CaptureSessionUtilsTests, CachedSelectionSkipsProbing) {
+  CaptureSessionSelectionCache cache;
+  StreamConfiguration config;
+  test_utils::GetPreviewOnlyStreamConfiguration(&config);
+
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(num_probes_, 3u);
+  EXPECT_EQ(external_factory_.num_probes, 1u);
+
+  // Reconfiguring the same streams with new stream ids reuses the selection.
+  // External sessions are not cached, so they are probed again.
+  config.streams[0].id++;
+  config.stream_config_counter++;
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(num_probes_, 3u);
+  EXPECT_EQ(external_factory_.num_probes, 2u);
+  EXPECT_EQ(num_creates_, 2u);
+  EXPECT_EQ(cache.GetHitCount(), 1u);
+  EXPECT_EQ(cache.GetMissCount(), 1u);
+}
+
+TEST_F(CaptureSessionUtilsTests, DifferentConfigurationProbesAgain) {
+  CaptureSessionSelectionCache cache;
+  StreamConfiguration config;
+  test_utils::GetPreviewOnlyStreamConfiguration(&config);
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+
+  StreamConfiguration other_config;
+  test_utils::GetPreviewOnlyStreamConfiguration(&other_config, 1280, 720);
+  ASSERT_NE(CreateSession(other_config, &cache), nullptr);
+  EXPECT_EQ(num_probes_, 6u);
+
+  // Session parameters are part of the fingerprint.
+  other_config.session_params = HalCameraMetadata::Create(1, 16);
+  ASSERT_NE(other_config.session_params, nullptr);
+  int32_t fps_range[2] = {30, 60};
+  ASSERT_EQ(other_config.session_params->Set(
+                ANDROID_CONTROL_AE_TARGET_FPS_RANGE, fps_range, 2),
+            OK);
+  ASSERT_NE(CreateSession(other_config, &cache), nullptr);
+  EXPECT_EQ(num_probes_, 9u);
+
+  // Both earlier configurations are still cached.
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(num_probes_, 9u);
+}
+
+TEST_F(CaptureSessionUtilsTests, FailedCreationIsNotCached) {
+  CaptureSessionSelectionCache cache;
+  StreamConfiguration config;
+  test_utils::GetPreviewOnlyStreamConfiguration(&config);
+
+  fail_create_ = true;
+  EXPECT_EQ(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(num_probes_, 6u);
+
+  fail_create_ = false;
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(num_probes_, 9u);
+}
+
+TEST_F(CaptureSessionUtilsTests, ExternalSelectionIsNotCached) {
+  CaptureSessionSelectionCache cache;
+  StreamConfiguration config;
+  test_utils::GetPreviewOnlyStreamConfiguration(&config);
+
+  external_factory_.supported = true;
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(external_factory_.num_probes, 2u);
+  EXPECT_EQ(external_factory_.num_creates, 2u);
+  EXPECT_EQ(num_probes_, 0u);
+  EXPECT_EQ(cache.GetHitCount(), 0u);
+}
+
+TEST_F(CaptureSessionUtilsTests, ExternalSessionPrecedesCachedSelection) {
+  CaptureSessionSelectionCache cache;
+  StreamConfiguration config;
+  test_utils::GetPreviewOnlyStreamConfiguration(&config);
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(num_creates_, 1u);
+
+  // An external session that supports the configuration now is selected over
+  // the cached predefined session.
+  external_factory_.supported = true;
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(external_factory_.num_creates, 1u);
+  EXPECT_EQ(num_creates_, 1u);
+
+  // The cached predefined session is still used once it doesn't.
+  external_factory_.supported = false;
+  ASSERT_NE(CreateSession(config, &cache), nullptr);
+  EXPECT_EQ(num_creates_, 2u);
+  EXPECT_EQ(num_probes_, 3u);
+}
+
+TEST_F(CaptureSessionUtilsTests, LeastRecentlyUsedEviction) {
+  CaptureSessionSelectionCache cache(/*capacity=*/2);
+  StreamConfiguration configs[3];
+  for (uint32_t i = 0; i < 3; i++) {
+    test_utils::GetPreviewOnlyStreamConfiguration(&configs[i], 640 * (i + 1),
+                                                  480 * (i + 1));
+    ASSERT_NE(CreateSession(configs[i], &cache), nullptr);
+  }
+  EXPECT_EQ(num_probes_, 9u);
+
+  // configs[0] was evicted.
+  ASSERT_NE(CreateSession(configs[2], &cache), nullptr);
+  EXPECT_EQ(num_probes_, 9u);
+  ASSERT_NE(CreateSession(configs[0], &cache), nullptr);
+  EXPECT_EQ(num_probes_, 12u);
+}
+
+// Compare the latency of toggling between two stream configurations with and
+// without the selection cache.
+TEST_F(CaptureSessionUtilsTests, ReconfigureLatency) {
+  static constexpr uint32_t kNumReconfigures = 200;
+  StreamConfiguration configs[2];
+  test_utils::GetPreviewOnlyStreamConfiguration(&configs[0]);
+  test_utils::GetPreviewOnlyStreamConfiguration(&configs[1], 3840, 2160);
+
+  auto measure_us = [&](CaptureSessionSelectionCache* cache) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kNumReconfigures; i++) {
+      EXPECT_NE(CreateSession(configs[i % 2], cache), nullptr);
+    }
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / kNumReconfigures;
+  };
+
+  double uncached_us = measure_us(/*cache=*/nullptr);
+  uint32_t uncached_probes = num_probes_;
+  CaptureSessionSelectionCache cache;
+  double cached_us = measure_us(&cache);
+  uint32_t cached_probes = num_probes_ - uncached_probes;
+  ALOGI("%s: %.2f us per reconfigure without cache (%u probes), %.2f us with "
+        "cache (%u probes)",
+        __FUNCTION__, uncached_us, uncached_probes, cached_us, cached_probes);
+
+  EXPECT_EQ(uncached_probes, kNumReconfigures * 3);
+  EXPECT_EQ(cached_probes, 2u * 3);
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
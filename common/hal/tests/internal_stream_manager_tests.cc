@@ -17,11 +17,23 @@
 #define LOG_TAG "InternalStreamManagerTests"
 #include <log/log.h>
 
+#include <algorithm>
+#include <cinttypes>
+#include <deque>
+
 #include <gtest/gtest.h>
 #include <hal_types.h>
 #include <hardware/gralloc.h>
 #include <internal_stream_manager.h>
 
+#include "mock_device_session_hwl.h"
+#include "rgbird_rt_request_processor.h"
+#include "vendor_tag_defs.h"
+#include "vendor_tag_utils.h"
+
+using ::testing::_;
+using ::testing::Invoke;
+
 namespace android {
 namespace google_camera_hal {
 
@@ -58,6 +70,36 @@ static constexpr Stream kRawStreamTemplate{
     .rotation = StreamRotation::kRotation0,
 };
 
+// IR stream template used in the test.
+static constexpr Stream kIrStreamTemplate{
+    .stream_type = StreamType::kOutput,
+    .width = 640,
+    .height = 480,
+    .format = HAL_PIXEL_FORMAT_Y8,
+    .usage = 0,
+    .rotation = StreamRotation::kRotation0,
+};
+
+// Full resolution RAW16 stream template used in the test.
+static constexpr Stream kRaw16StreamTemplate{
+    .stream_type = StreamType::kOutput,
+    .width = 4032,
+    .height = 3024,
+    .format = HAL_PIXEL_FORMAT_RAW16,
+    .usage = 0,
+    .rotation = StreamRotation::kRotation0,
+};
+
+// Full resolution Y16 stream template used in the test.
+static constexpr Stream kY16StreamTemplate{
+    .stream_type = StreamType::kOutput,
+    .width = 4032,
+    .height = 3024,
+    .format = HAL_PIXEL_FORMAT_Y16,
+    .usage = 0,
+    .rotation = StreamRotation::kRotation0,
+};
+
 // Preview HAL stream template used in the test.
 static constexpr HalStream kPreviewHalStreamTemplate{
     .override_format = HAL_PIXEL_FORMAT_YV12,
@@ -79,9 +121,33 @@ static constexpr HalStream kRawHalStreamTemplate{
     .max_buffers = 16,
 };
 
+// IR HAL stream template used in the test.
+static constexpr HalStream kIrHalStreamTemplate{
+    .override_format = HAL_PIXEL_FORMAT_Y8,
+    .producer_usage = GRALLOC_USAGE_HW_CAMERA_WRITE,
+    .max_buffers = 4,
+};
+
+// Full resolution RAW16 HAL stream template used in the test.
+static constexpr HalStream kRaw16HalStreamTemplate{
+    .override_format = HAL_PIXEL_FORMAT_RAW16,
+    .producer_usage = GRALLOC_USAGE_HW_CAMERA_WRITE,
+    .max_buffers = 4,
+};
+
+// Full resolution Y16 HAL stream template used in the test.
+static constexpr HalStream kY16HalStreamTemplate{
+    .override_format = HAL_PIXEL_FORMAT_Y16,
+    .producer_usage = GRALLOC_USAGE_HW_CAMERA_WRITE,
+    .max_buffers = 4,
+};
+
 // Additional number of buffers to allocate.
 static constexpr uint32_t kNumAdditionalBuffers = 2;
 
+// Number of frames of a simulated in-flight load.
+static constexpr uint32_t kNumLoadFrames = 30;
+
 static void SetMetadata(std::unique_ptr<HalCameraMetadata>& hal_metadata) {
   // Set current BOOT_TIME timestamp in nanoseconds
   struct timespec ts;
@@ -325,5 +391,397 @@ TEST(InternalStreamManagerTests, GetMostRecentStreamBuffer) {
   ASSERT_EQ(empty, true) << "Pending buffer is not empty";
 }
 
+TEST(InternalStreamManagerTests, GetCapturePayloadBuffers) {
+  auto stream_manager = InternalStreamManager::Create();
+  ASSERT_NE(stream_manager, nullptr);
+
+  HalStream raw_hal_stream = kRawHalStreamTemplate;
+  ASSERT_EQ(stream_manager->RegisterNewInternalStream(kRawStreamTemplate,
+                                                      &raw_hal_stream.id),
+            OK);
+  ASSERT_EQ(stream_manager->AllocateBuffers(raw_hal_stream), OK);
+
+  uint32_t frame_index = 0;
+  for (uint32_t i = 0; i < kRawHalStreamTemplate.max_buffers; i++) {
+    StreamBuffer stream_buffer;
+    ASSERT_EQ(stream_manager->GetStreamBuffer(raw_hal_stream.id, &stream_buffer),
+              OK);
+    ASSERT_EQ(stream_manager->ReturnFilledBuffer(frame_index, stream_buffer),
+              OK);
+
+    auto metadata = HalCameraMetadata::Create(kNumEntries, kDataBytes);
+    SetMetadata(metadata);
+    ASSERT_EQ(stream_manager->ReturnMetadata(raw_hal_stream.id, frame_index,
+                                             metadata.get()),
+              OK);
+    frame_index++;
+  }
+
+  // Two captures hold their own payloads at the same time.
+  const uint32_t kPayloadFrames = 2;
+  const uint32_t kCaptureFrameNumbers[] = {frame_index, frame_index + 1};
+  for (auto capture_frame_number : kCaptureFrameNumbers) {
+    std::vector<StreamBuffer> input_buffers;
+    std::vector<std::unique_ptr<HalCameraMetadata>> input_buffer_metadata;
+    ASSERT_EQ(stream_manager->GetCapturePayloadBuffers(
+                  raw_hal_stream.id, capture_frame_number, &input_buffers,
+                  &input_buffer_metadata, kPayloadFrames),
+              OK);
+    EXPECT_EQ(input_buffers.size(), kPayloadFrames);
+    EXPECT_EQ(input_buffer_metadata.size(), kPayloadFrames);
+  }
+  EXPECT_EQ(stream_manager->GetPendingCaptureCount(raw_hal_stream.id), 2u);
+
+  // Returning one capture's payload must not release the other's.
+  ASSERT_EQ(stream_manager->ReturnCapturePayloadBuffers(kCaptureFrameNumbers[0],
+                                                        raw_hal_stream.id),
+            OK);
+  EXPECT_FALSE(stream_manager->HasPendingCapturePayload(
+      raw_hal_stream.id, kCaptureFrameNumbers[0]));
+  EXPECT_TRUE(stream_manager->HasPendingCapturePayload(
+      raw_hal_stream.id, kCaptureFrameNumbers[1]));
+  EXPECT_EQ(stream_manager->GetPendingCaptureCount(raw_hal_stream.id), 1u);
+  EXPECT_NE(stream_manager->ReturnCapturePayloadBuffers(kCaptureFrameNumbers[0],
+                                                        raw_hal_stream.id),
+            OK)
+      << "Returning a payload twice should fail";
+
+  ASSERT_EQ(stream_manager->ReturnCapturePayloadBuffers(kCaptureFrameNumbers[1],
+                                                        raw_hal_stream.id),
+            OK);
+  EXPECT_TRUE(stream_manager->IsPendingBufferEmpty(raw_hal_stream.id));
+}
+
+// Register streams and return the HAL streams with the registered stream IDs.
+static void RegisterStreams(InternalStreamManager* stream_manager,
+                            const std::vector<Stream>& streams,
+                            const std::vector<HalStream>& hal_stream_templates,
+                            std::vector<HalStream>* hal_streams) {
+  ASSERT_EQ(streams.size(), hal_stream_templates.size());
+  for (uint32_t i = 0; i < streams.size(); i++) {
+    HalStream hal_stream = hal_stream_templates[i];
+    ASSERT_EQ(
+        stream_manager->RegisterNewInternalStream(streams[i], &hal_stream.id),
+        OK);
+    hal_streams->push_back(hal_stream);
+  }
+}
+
+// Simulate an in-flight load and return the peak number of allocated buffer
+// bytes. frame_stream_ids[i] lists the streams requested in frame i. Each
+// frame gets a buffer of each of its streams, and at most
+// max_inflight_frames frames hold their buffers at a time.
+static uint64_t MeasurePeakBufferBytes(
+    InternalStreamManager* stream_manager,
+    const std::vector<std::vector<int32_t>>& frame_stream_ids,
+    uint32_t max_inflight_frames) {
+  uint64_t peak_bytes = stream_manager->GetAllocatedBufferBytes();
+  std::deque<std::vector<StreamBuffer>> inflight_frames;
+  for (auto& stream_ids : frame_stream_ids) {
+    if (inflight_frames.size() == max_inflight_frames) {
+      for (auto& buffer : inflight_frames.front()) {
+        EXPECT_EQ(stream_manager->ReturnStreamBuffer(buffer), OK);
+      }
+      inflight_frames.pop_front();
+    }
+
+    std::vector<StreamBuffer> buffers;
+    for (auto stream_id : stream_ids) {
+      StreamBuffer buffer;
+      EXPECT_EQ(stream_manager->GetStreamBuffer(stream_id, &buffer), OK);
+      buffers.push_back(buffer);
+    }
+    inflight_frames.push_back(buffers);
+    // Buffers are only allocated when they are requested.
+    peak_bytes =
+        std::max(peak_bytes, stream_manager->GetAllocatedBufferBytes());
+  }
+
+  for (auto& buffers : inflight_frames) {
+    for (auto& buffer : buffers) {
+      EXPECT_EQ(stream_manager->ReturnStreamBuffer(buffer), OK);
+    }
+  }
+
+  return peak_bytes;
+}
+
+// Return the characteristics of a RGBIRD logical camera whose RGB camera
+// supports 1920x1080 and 1280x720 YUV outputs.
+static status_t GetRgbirdCharacteristics(
+    std::unique_ptr<HalCameraMetadata>* characteristics) {
+  *characteristics = HalCameraMetadata::Create(/*num_entries=*/3,
+                                               /*data_bytes=*/128);
+  if (*characteristics == nullptr) {
+    return NO_MEMORY;
+  }
+
+  int32_t active_array[] = {0, 0, 4032, 3024};
+  int32_t stream_configs[] = {
+      HAL_PIXEL_FORMAT_YCbCr_420_888, 1920, 1080,
+      ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT,
+      HAL_PIXEL_FORMAT_YCbCr_420_888, 1280, 720,
+      ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT};
+  int32_t non_warped_yuv_sizes[] = {1280, 720};
+  status_t res = (*characteristics)
+                     ->Set(ANDROID_SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE,
+                           active_array, /*data_count=*/4);
+  if (res != OK) {
+    return res;
+  }
+
+  res = (*characteristics)
+            ->Set(ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
+                  stream_configs, /*data_count=*/8);
+  if (res != OK) {
+    return res;
+  }
+
+  return (*characteristics)
+      ->Set(VendorTagIds::kAvailableNonWarpedYuvSizes, non_warped_yuv_sizes,
+            /*data_count=*/2);
+}
+
+// Configure a RGBIRD preview and depth stream set and allocate the internal
+// streams with dedicated and size class shared buffers. Every frame requests
+// all internal streams, so the shared IR RAW pool reaches the same peak as
+// dedicated buffers. This is why RgbirdCaptureSession keeps dedicated buffers.
+TEST(InternalStreamManagerTests, RgbirdSizeClassSharedBuffers) {
+  ASSERT_EQ(VendorTagManager::GetInstance().AddTags(kHalVendorTagSections),
+            OK);
+  auto session_hwl = std::make_unique<MockDeviceSessionHwl>(
+      /*camera_id=*/3, /*physical_camera_ids=*/std::vector<uint32_t>{0, 1, 2});
+  ASSERT_NE(session_hwl, nullptr);
+  session_hwl->DelegateCallsToFakeSession();
+  ON_CALL(*session_hwl, GetCameraCharacteristics(_))
+      .WillByDefault(Invoke(GetRgbirdCharacteristics));
+
+  StreamConfiguration stream_config;
+  stream_config.operation_mode = StreamConfigurationMode::kNormal;
+  stream_config.streams.push_back({.id = 0,
+                                   .stream_type = StreamType::kOutput,
+                                   .width = 1920,
+                                   .height = 1080,
+                                   .format = HAL_PIXEL_FORMAT_YCbCr_420_888,
+                                   .usage = GRALLOC_USAGE_HW_TEXTURE,
+                                   .data_space = HAL_DATASPACE_ARBITRARY});
+  stream_config.streams.push_back({.id = 1,
+                                   .stream_type = StreamType::kOutput,
+                                   .width = 640,
+                                   .height = 480,
+                                   .format = HAL_PIXEL_FORMAT_Y16,
+                                   .usage = 0,
+                                   .data_space = HAL_DATASPACE_DEPTH});
+
+  // Configure the internal streams with a dedicated and a size class shared
+  // stream manager.
+  std::unique_ptr<InternalStreamManager> stream_managers[] = {
+      InternalStreamManager::Create(), InternalStreamManager::Create()};
+  std::vector<HalStream> internal_hal_streams[2];
+  for (uint32_t i = 0; i < 2; i++) {
+    ASSERT_NE(stream_managers[i], nullptr);
+    auto request_processor = RgbirdRtRequestProcessor::Create(
+        session_hwl.get(), /*is_hdrplus_supported=*/false);
+    ASSERT_NE(request_processor, nullptr);
+
+    StreamConfiguration process_block_stream_config;
+    ASSERT_EQ(request_processor->ConfigureStreams(stream_managers[i].get(),
+                                                  stream_config,
+                                                  &process_block_stream_config),
+              OK);
+
+    for (auto& stream : process_block_stream_config.streams) {
+      if (stream.id != stream_config.streams[0].id) {
+        internal_hal_streams[i].push_back(
+            {.id = stream.id,
+             .override_format = stream.format,
+             .producer_usage = GRALLOC_USAGE_HW_CAMERA_WRITE,
+             .max_buffers = 4});
+      }
+    }
+
+    // One internal YUV stream and two IR RAW streams.
+    ASSERT_EQ(internal_hal_streams[i].size(), 3u);
+  }
+
+  for (auto& hal_stream : internal_hal_streams[0]) {
+    ASSERT_EQ(stream_managers[0]->AllocateBuffers(hal_stream,
+                                                  kNumAdditionalBuffers),
+              OK);
+  }
+
+  std::vector<uint32_t> additional_num_buffers(internal_hal_streams[1].size(),
+                                               kNumAdditionalBuffers);
+  EXPECT_NE(stream_managers[1]->AllocateSizeClassSharedBuffers(
+                {}, /*additional_num_buffers=*/{}),
+            OK)
+      << "Allocating buffers for no streams should fail";
+  EXPECT_NE(stream_managers[1]->AllocateSizeClassSharedBuffers(
+                internal_hal_streams[1], /*additional_num_buffers=*/{}),
+            OK)
+      << "Allocating buffers without additional buffer counts should fail";
+  ASSERT_EQ(stream_managers[1]->AllocateSizeClassSharedBuffers(
+                internal_hal_streams[1], additional_num_buffers),
+            OK);
+  EXPECT_NE(stream_managers[1]->AllocateSizeClassSharedBuffers(
+                internal_hal_streams[1], additional_num_buffers),
+            OK)
+      << "Allocating buffers for the same streams again should fail";
+
+  // The IR RAW streams share one pool and the YUV stream has its own.
+  uint64_t yuv_bytes = 1280 * 720 * 3 / 2;
+  uint64_t ir_bytes = 640 * 480;
+  uint32_t max_buffers = internal_hal_streams[1][0].max_buffers;
+  uint64_t dedicated_bytes = stream_managers[0]->GetAllocatedBufferBytes();
+  uint64_t shared_bytes = stream_managers[1]->GetAllocatedBufferBytes();
+  ALOGI("%s: dedicated %" PRIu64 " bytes, size class shared %" PRIu64 " bytes",
+        __FUNCTION__, dedicated_bytes, shared_bytes);
+  EXPECT_EQ(dedicated_bytes, (yuv_bytes + 2 * ir_bytes) * max_buffers);
+  EXPECT_EQ(shared_bytes, (yuv_bytes + ir_bytes) * max_buffers);
+
+  // Both IR RAW streams are in flight in every frame, so the shared pool
+  // grows to the buffers of both streams under load.
+  std::vector<std::vector<int32_t>> frame_stream_ids;
+  for (uint32_t frame = 0; frame < kNumLoadFrames; frame++) {
+    frame_stream_ids.push_back({});
+    for (auto& hal_stream : internal_hal_streams[0]) {
+      frame_stream_ids.back().push_back(hal_stream.id);
+    }
+  }
+  uint64_t dedicated_peak_bytes = MeasurePeakBufferBytes(
+      stream_managers[0].get(), frame_stream_ids, max_buffers);
+  for (auto& stream_ids : frame_stream_ids) {
+    for (uint32_t i = 0; i < stream_ids.size(); i++) {
+      stream_ids[i] = internal_hal_streams[1][i].id;
+    }
+  }
+  uint64_t shared_peak_bytes = MeasurePeakBufferBytes(
+      stream_managers[1].get(), frame_stream_ids, max_buffers);
+  ALOGI("%s: peak under load: dedicated %" PRIu64
+        " bytes, size class shared %" PRIu64 " bytes",
+        __FUNCTION__, dedicated_peak_bytes, shared_peak_bytes);
+  EXPECT_EQ(dedicated_peak_bytes, dedicated_bytes);
+  EXPECT_EQ(shared_peak_bytes, dedicated_bytes);
+
+  // Verify every stream can still get and return buffers.
+  for (auto& hal_stream : internal_hal_streams[1]) {
+    StreamBuffer buffer;
+    ASSERT_EQ(stream_managers[1]->GetStreamBuffer(hal_stream.id, &buffer), OK);
+    EXPECT_EQ(buffer.stream_id, hal_stream.id);
+    EXPECT_EQ(stream_managers[1]->ReturnStreamBuffer(buffer), OK);
+  }
+
+  // Freeing an IR stream must keep the pool for the other IR stream.
+  stream_managers[1]->FreeStream(internal_hal_streams[1][1].id);
+  StreamBuffer buffer;
+  EXPECT_EQ(stream_managers[1]->GetStreamBuffer(internal_hal_streams[1][2].id,
+                                                &buffer),
+            OK);
+  EXPECT_EQ(stream_managers[1]->ReturnStreamBuffer(buffer), OK);
+
+  VendorTagManager::GetInstance().Reset();
+}
+
+TEST(InternalStreamManagerTests, SizeClassSharedBuffersAcrossFormats) {
+  // Full resolution RAW16 and Y16 streams have the same byte size.
+  const std::vector<Stream> streams = {kRaw16StreamTemplate,
+                                       kY16StreamTemplate};
+  const std::vector<HalStream> hal_stream_templates = {kRaw16HalStreamTemplate,
+                                                       kY16HalStreamTemplate};
+
+  auto stream_manager = InternalStreamManager::Create();
+  ASSERT_NE(stream_manager, nullptr);
+  std::vector<HalStream> hal_streams;
+  RegisterStreams(stream_manager.get(), streams, hal_stream_templates,
+                  &hal_streams);
+
+  ASSERT_EQ(stream_manager->AllocateSizeClassSharedBuffers(
+                hal_streams, /*additional_num_buffers=*/{0, 0}),
+            OK);
+
+  // Streams of different formats never share a pool.
+  uint64_t buffer_bytes =
+      static_cast<uint64_t>(kRaw16StreamTemplate.width) *
+      kRaw16StreamTemplate.height * 2;
+  EXPECT_EQ(stream_manager->GetAllocatedBufferBytes(),
+            buffer_bytes * (kRaw16HalStreamTemplate.max_buffers +
+                            kY16HalStreamTemplate.max_buffers));
+}
+
+TEST(InternalStreamManagerTests, SizeClassSharedBuffersFitInOwner) {
+  // A 480x640 stream is in the same size class as a 640x480 stream but does
+  // not fit in its buffers.
+  Stream portrait_stream = kIrStreamTemplate;
+  portrait_stream.width = kIrStreamTemplate.height;
+  portrait_stream.height = kIrStreamTemplate.width;
+  const std::vector<Stream> streams = {kIrStreamTemplate, portrait_stream};
+  const std::vector<HalStream> hal_stream_templates = {kIrHalStreamTemplate,
+                                                       kIrHalStreamTemplate};
+
+  auto stream_manager = InternalStreamManager::Create();
+  ASSERT_NE(stream_manager, nullptr);
+  std::vector<HalStream> hal_streams;
+  RegisterStreams(stream_manager.get(), streams, hal_stream_templates,
+                  &hal_streams);
+
+  ASSERT_EQ(stream_manager->AllocateSizeClassSharedBuffers(
+                hal_streams, /*additional_num_buffers=*/{0, 0}),
+            OK);
+  uint64_t buffer_bytes =
+      static_cast<uint64_t>(kIrStreamTemplate.width) * kIrStreamTemplate.height;
+  EXPECT_EQ(stream_manager->GetAllocatedBufferBytes(),
+            buffer_bytes * 2 * kIrHalStreamTemplate.max_buffers);
+}
+
+// Two IR streams used one after the other, e.g. by different phases of a
+// session, are never in flight together.
+TEST(InternalStreamManagerTests, SizeClassSharedBuffersSequentialStreams) {
+  const std::vector<Stream> streams = {kIrStreamTemplate, kIrStreamTemplate};
+  const std::vector<HalStream> hal_stream_templates = {kIrHalStreamTemplate,
+                                                       kIrHalStreamTemplate};
+
+  // Allocate with a dedicated and a size class shared stream manager.
+  std::unique_ptr<InternalStreamManager> stream_managers[] = {
+      InternalStreamManager::Create(), InternalStreamManager::Create()};
+  std::vector<HalStream> hal_streams[2];
+  for (uint32_t i = 0; i < 2; i++) {
+    ASSERT_NE(stream_managers[i], nullptr);
+    RegisterStreams(stream_managers[i].get(), streams, hal_stream_templates,
+                    &hal_streams[i]);
+  }
+
+  for (auto& hal_stream : hal_streams[0]) {
+    ASSERT_EQ(stream_managers[0]->AllocateBuffers(hal_stream,
+                                                  kNumAdditionalBuffers),
+              OK);
+  }
+  ASSERT_EQ(stream_managers[1]->AllocateSizeClassSharedBuffers(
+                hal_streams[1],
+                /*additional_num_buffers=*/{kNumAdditionalBuffers,
+                                            kNumAdditionalBuffers}),
+            OK);
+
+  uint64_t peak_bytes[2] = {};
+  for (uint32_t i = 0; i < 2; i++) {
+    // Each stream keeps max_buffers frames in flight while it is used.
+    for (auto& hal_stream : hal_streams[i]) {
+      std::vector<std::vector<int32_t>> frame_stream_ids(kNumLoadFrames,
+                                                         {hal_stream.id});
+      peak_bytes[i] = std::max(
+          peak_bytes[i],
+          MeasurePeakBufferBytes(stream_managers[i].get(), frame_stream_ids,
+                                 kIrHalStreamTemplate.max_buffers));
+    }
+  }
+
+  uint64_t buffer_bytes =
+      static_cast<uint64_t>(kIrStreamTemplate.width) * kIrStreamTemplate.height;
+  ALOGI("%s: peak under load: dedicated %" PRIu64
+        " bytes, size class shared %" PRIu64 " bytes",
+        __FUNCTION__, peak_bytes[0], peak_bytes[1]);
+  EXPECT_EQ(peak_bytes[0], buffer_bytes * 2 * kIrHalStreamTemplate.max_buffers);
+  EXPECT_EQ(peak_bytes[1], buffer_bytes * kIrHalStreamTemplate.max_buffers);
+}
+
 }  // namespace google_camera_hal
 }  // namespace android
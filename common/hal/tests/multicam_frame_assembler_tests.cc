@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MultiCameraFrameAssemblerTests"
+#include <log/log.h>
+
+#include <gtest/gtest.h>
+#include <multicam_frame_assembler.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace google_camera_hal {
+
+static constexpr uint32_t kNumCameras = 3;
+static constexpr uint32_t kAllCameraParts = (1 << kNumCameras) - 1;
+
+// A frame holding a value from each camera.
+struct TestFrame {
+  uint32_t request_value = 0;
+  std::array<uint32_t, kNumCameras> camera_values = {};
+};
+
+// Records dispatched and dropped frames.
+class FrameRecorder {
+ public:
+  std::unique_ptr<MultiCameraFrameAssembler<TestFrame>> CreateAssembler(
+      uint32_t num_slots) {
+    return MultiCameraFrameAssembler<TestFrame>::Create(
+        [this](uint32_t frame_number, TestFrame frame) {
+          std::lock_guard<std::mutex> lock(lock_);
+          dispatched_frames_.push_back({frame_number, frame});
+        },
+        [this](uint32_t frame_number, uint32_t arrived_parts, TestFrame frame) {
+          std::lock_guard<std::mutex> lock(lock_);
+          dropped_frames_.push_back({frame_number, arrived_parts, frame});
+        },
+        num_slots);
+  }
+
+  struct DispatchedFrame {
+    uint32_t frame_number;
+    TestFrame frame;
+  };
+
+  struct DroppedFrame {
+    uint32_t frame_number;
+    uint32_t arrived_parts;
+    TestFrame frame;
+  };
+
+  std::vector<DispatchedFrame> dispatched_frames() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return dispatched_frames_;
+  }
+
+  std::vector<DroppedFrame> dropped_frames() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return dropped_frames_;
+  }
+
+ private:
+  std::mutex lock_;
+  std::vector<DispatchedFrame> dispatched_frames_;
+  std::vector<DroppedFrame> dropped_frames_;
+};
+
+status_t AddCameraPart(MultiCameraFrameAssembler<TestFrame>* assembler,
+                       uint32_t frame_number, uint32_t camera, uint32_t value) {
+  return assembler->AddParts(frame_number, 1 << camera, [&](TestFrame* frame) {
+    frame->camera_values[camera] = value;
+  });
+}
+
+TEST(MultiCameraFrameAssemblerTests, DispatchCompleteFrame) {
+  FrameRecorder recorder;
+  auto assembler = recorder.CreateAssembler(/*num_slots=*/4);
+  ASSERT_NE(assembler, nullptr);
+
+  TestFrame frame;
+  frame.request_value = 7;
+  ASSERT_EQ(assembler->AddFrame(/*frame_number=*/1, kAllCameraParts, frame),
+            OK);
+  EXPECT_EQ(assembler->AddFrame(/*frame_number=*/1, kAllCameraParts, frame),
+            ALREADY_EXISTS);
+  EXPECT_TRUE(assembler->IsFramePending(1));
+
+  EXPECT_EQ(AddCameraPart(assembler.get(), 1, /*camera=*/2, 20), OK);
+  EXPECT_EQ(AddCameraPart(assembler.get(), 1, /*camera=*/2, 21),
+            ALREADY_EXISTS);
+  EXPECT_EQ(AddCameraPart(assembler.get(), 1, /*camera=*/0, 0), OK);
+  EXPECT_EQ(AddCameraPart(assembler.get(), 2, /*camera=*/1, 10),
+            NAME_NOT_FOUND);
+  EXPECT_TRUE(recorder.dispatched_frames().empty());
+
+  // The frame is dispatched by the last part.
+  EXPECT_EQ(AddCameraPart(assembler.get(), 1, /*camera=*/1, 10), OK);
+  auto dispatched_frames = recorder.dispatched_frames();
+  ASSERT_EQ(dispatched_frames.size(), 1u);
+  EXPECT_EQ(dispatched_frames[0].frame_number, 1u);
+  EXPECT_EQ(dispatched_frames[0].frame.request_value, 7u);
+  EXPECT_EQ(dispatched_frames[0].frame.camera_values,
+            (std::array<uint32_t, kNumCameras>{0, 10, 20}));
+  EXPECT_FALSE(assembler->IsFramePending(1));
+  EXPECT_EQ(AddCameraPart(assembler.get(), 1, /*camera=*/1, 10),
+            NAME_NOT_FOUND);
+
+  // A part that is not expected is rejected.
+  ASSERT_EQ(assembler->AddFrame(/*frame_number=*/2, /*expected_parts=*/0b011,
+                                TestFrame()),
+            OK);
+  EXPECT_EQ(AddCameraPart(assembler.get(), 2, /*camera=*/2, 20),
+            ALREADY_EXISTS);
+  EXPECT_TRUE(recorder.dropped_frames().empty());
+}
+
+TEST(MultiCameraFrameAssemblerTests, DropPendingFrames) {
+  static constexpr uint32_t kNumSlots = 4;
+  FrameRecorder recorder;
+  auto assembler = recorder.CreateAssembler(kNumSlots);
+  ASSERT_NE(assembler, nullptr);
+
+  ASSERT_EQ(assembler->AddFrame(/*frame_number=*/0, kAllCameraParts,
+                                TestFrame()),
+            OK);
+  ASSERT_EQ(AddCameraPart(assembler.get(), 0, /*camera=*/1, 10), OK);
+
+  // Frame 0 is evicted by the frame using the same slot.
+  ASSERT_EQ(assembler->AddFrame(kNumSlots, kAllCameraParts, TestFrame()), OK);
+  auto dropped_frames = recorder.dropped_frames();
+  ASSERT_EQ(dropped_frames.size(), 1u);
+  EXPECT_EQ(dropped_frames[0].frame_number, 0u);
+  EXPECT_EQ(dropped_frames[0].arrived_parts, 0b010u);
+  EXPECT_EQ(dropped_frames[0].frame.camera_values[1], 10u);
+  EXPECT_EQ(AddCameraPart(assembler.get(), 0, /*camera=*/0, 0), NAME_NOT_FOUND);
+
+  ASSERT_EQ(assembler->AddFrame(/*frame_number=*/1, kAllCameraParts,
+                                TestFrame()),
+            OK);
+  assembler->Flush();
+  dropped_frames = recorder.dropped_frames();
+  ASSERT_EQ(dropped_frames.size(), 3u);
+  EXPECT_FALSE(assembler->IsFramePending(1));
+  EXPECT_FALSE(assembler->IsFramePending(kNumSlots));
+  EXPECT_EQ(AddCameraPart(assembler.get(), 1, /*camera=*/0, 0), NAME_NOT_FOUND);
+  EXPECT_TRUE(recorder.dispatched_frames().empty());
+
+  // Slots can be reused after flushing.
+  ASSERT_EQ(assembler->AddFrame(/*frame_number=*/1, /*expected_parts=*/0b001,
+                                TestFrame()),
+            OK);
+  EXPECT_EQ(AddCameraPart(assembler.get(), 1, /*camera=*/0, 0), OK);
+  EXPECT_EQ(recorder.dispatched_frames().size(), 1u);
+}
+
+// Simulate 3 cameras streaming at 30 fps whose results arrive with random
+// jitter, each added from its own thread, and measure the time from the last
+// part of a frame arriving to the frame being dispatched.
+TEST(MultiCameraFrameAssemblerTests, JitteredArrivalBenchmark) {
+  static constexpr uint32_t kNumFrames = 300;
+  // The simulation runs 10 times faster than real time.
+  static constexpr std::chrono::microseconds kFrameInterval(33333 / 10);
+  static constexpr std::chrono::microseconds kPipelineDelay(2 * kFrameInterval);
+  static constexpr int64_t kMaxJitterUs = 8000 / 10;
+
+  using Clock = std::chrono::steady_clock;
+  std::mutex latency_lock;
+  std::vector<int64_t> dispatch_latencies_ns;
+  std::vector<uint32_t> dispatch_counts(kNumFrames, 0);
+  std::array<std::vector<Clock::time_point>, kNumCameras> arrival_times;
+
+  auto assembler = MultiCameraFrameAssembler<TestFrame>::Create(
+      [&](uint32_t frame_number, TestFrame frame) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point last_arrival;
+        for (uint32_t camera = 0; camera < kNumCameras; camera++) {
+          EXPECT_EQ(frame.camera_values[camera], frame_number);
+          last_arrival =
+              std::max(last_arrival, arrival_times[camera][frame_number]);
+        }
+
+        std::lock_guard<std::mutex> lock(latency_lock);
+        dispatch_counts[frame_number]++;
+        dispatch_latencies_ns.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now -
+                                                                 last_arrival)
+                .count());
+      },
+      [](uint32_t frame_number, uint32_t arrived_parts, TestFrame /*frame*/) {
+        ADD_FAILURE() << "Frame " << frame_number << " dropped with parts "
+                      << arrived_parts;
+      });
+  ASSERT_NE(assembler, nullptr);
+
+  // Precompute the arrival schedule. Jitter is smaller than half of a frame
+  // interval, so each camera's results arrive in order.
+  std::srand(1);
+  Clock::time_point start = Clock::now() + kFrameInterval;
+  std::array<std::vector<Clock::time_point>, kNumCameras> schedules;
+  for (uint32_t camera = 0; camera < kNumCameras; camera++) {
+    arrival_times[camera].resize(kNumFrames);
+    for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+      int64_t jitter_us = std::rand() % (kMaxJitterUs + 1);
+      schedules[camera].push_back(start + kFrameInterval * frame +
+                                  kPipelineDelay +
+                                  std::chrono::microseconds(jitter_us));
+    }
+  }
+
+  // Results of a frame never arrive before its request is added.
+  std::atomic<uint32_t> num_added_frames = 0;
+  std::thread request_thread([&] {
+    for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+      std::this_thread::sleep_until(start + kFrameInterval * frame);
+      EXPECT_EQ(assembler->AddFrame(frame, kAllCameraParts, TestFrame()), OK);
+      num_added_frames++;
+    }
+  });
+
+  std::vector<std::thread> camera_threads;
+  for (uint32_t camera = 0; camera < kNumCameras; camera++) {
+    camera_threads.emplace_back([&, camera] {
+      for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+        std::this_thread::sleep_until(schedules[camera][frame]);
+        while (num_added_frames <= frame) {
+          std::this_thread::yield();
+        }
+        arrival_times[camera][frame] = Clock::now();
+        EXPECT_EQ(AddCameraPart(assembler.get(), frame, camera, frame), OK);
+      }
+    });
+  }
+
+  request_thread.join();
+  for (auto& camera_thread : camera_threads) {
+    camera_thread.join();
+  }
+
+  for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+    EXPECT_EQ(dispatch_counts[frame], 1u) << "Frame " << frame;
+  }
+
+  ASSERT_EQ(dispatch_latencies_ns.size(), kNumFrames);
+  std::sort(dispatch_latencies_ns.begin(), dispatch_latencies_ns.end());
+  ALOGI("%s: %u frames from %u cameras, dispatch latency median %" PRId64
+        " ns, p99 %" PRId64 " ns, max %" PRId64 " ns",
+        __FUNCTION__, kNumFrames, kNumCameras,
+        dispatch_latencies_ns[kNumFrames / 2],
+        dispatch_latencies_ns[kNumFrames * 99 / 100],
+        dispatch_latencies_ns.back());
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
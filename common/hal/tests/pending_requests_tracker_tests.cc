@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PendingRequestsTrackerTests"
+#include <log/log.h>
+
+#include <gtest/gtest.h>
+#include <hal_types.h>
+#include <pending_requests_tracker.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace android {
+namespace google_camera_hal {
+
+static constexpr int32_t kPreviewStreamId = 0;
+static constexpr int32_t kVideoStreamId = 1;
+static constexpr int32_t kGroupedStreamId = 2;
+static constexpr uint32_t kMaxBuffers = 2;
+
+static std::vector<HalStream> GetHalStreams() {
+  return {
+      {.id = kPreviewStreamId, .max_buffers = kMaxBuffers},
+      {.id = kVideoStreamId, .max_buffers = kMaxBuffers},
+      {.id = kGroupedStreamId, .max_buffers = kMaxBuffers},
+  };
+}
+
+static std::unique_ptr<PendingRequestsTracker> CreateTracker() {
+  // kGroupedStreamId is in the same stream group as kVideoStreamId.
+  return PendingRequestsTracker::Create(
+      GetHalStreams(), {{kGroupedStreamId, kVideoStreamId}},
+      {kPreviewStreamId, kVideoStreamId, kGroupedStreamId});
+}
+
+static CaptureRequest GetRequest(const std::vector<int32_t>& stream_ids) {
+  CaptureRequest request = {};
+  for (auto stream_id : stream_ids) {
+    request.output_buffers.push_back({.stream_id = stream_id});
+  }
+  return request;
+}
+
+TEST(PendingRequestsTrackerTests, Create) {
+  EXPECT_NE(CreateTracker(), nullptr);
+
+  std::vector<HalStream> hal_streams = GetHalStreams();
+  hal_streams.push_back(hal_streams[0]);
+  EXPECT_EQ(PendingRequestsTracker::Create(hal_streams, {}, {}), nullptr)
+      << "Creating a tracker with duplicated streams should fail";
+}
+
+TEST(PendingRequestsTrackerTests, FirstRequestedStreamIds) {
+  auto tracker = CreateTracker();
+  ASSERT_NE(tracker, nullptr);
+
+  std::vector<int32_t> first_requested_stream_ids;
+  ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(
+                GetRequest({kPreviewStreamId}), &first_requested_stream_ids),
+            OK);
+  EXPECT_EQ(first_requested_stream_ids, std::vector<int32_t>{kPreviewStreamId});
+
+  // Requesting a stream in a group reports all streams in the group.
+  ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(
+                GetRequest({kPreviewStreamId, kGroupedStreamId}),
+                &first_requested_stream_ids),
+            OK);
+  EXPECT_EQ(first_requested_stream_ids,
+            std::vector<int32_t>({kVideoStreamId, kGroupedStreamId}));
+
+  tracker->TrackReturnedResultBuffers(
+      GetRequest({kPreviewStreamId, kPreviewStreamId, kGroupedStreamId})
+          .output_buffers);
+  ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(GetRequest({kVideoStreamId}),
+                                                &first_requested_stream_ids),
+            OK);
+  EXPECT_TRUE(first_requested_stream_ids.empty());
+
+  tracker->OnBufferCacheFlushed();
+  ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(GetRequest({kVideoStreamId}),
+                                                &first_requested_stream_ids),
+            OK);
+  EXPECT_EQ(first_requested_stream_ids,
+            std::vector<int32_t>({kVideoStreamId, kGroupedStreamId}));
+}
+
+TEST(PendingRequestsTrackerTests, WaitForReturnedResultBuffers) {
+  auto tracker = CreateTracker();
+  ASSERT_NE(tracker, nullptr);
+
+  // Exhaust the quota of kVideoStreamId's group and leave a free preview
+  // buffer so the group is the only limiter.
+  std::vector<int32_t> first_requested_stream_ids;
+  for (uint32_t i = 0; i < kMaxBuffers; i++) {
+    ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(GetRequest({kVideoStreamId}),
+                                                  &first_requested_stream_ids),
+              OK);
+  }
+  ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(GetRequest({kPreviewStreamId}),
+                                                &first_requested_stream_ids),
+            OK);
+
+  auto blocked_request = std::async(std::launch::async, [&tracker] {
+    std::vector<int32_t> stream_ids;
+    return tracker->WaitAndTrackRequestBuffers(
+        GetRequest({kPreviewStreamId, kGroupedStreamId}), &stream_ids);
+  });
+  EXPECT_EQ(blocked_request.wait_for(std::chrono::milliseconds(100)),
+            std::future_status::timeout);
+
+  tracker->TrackReturnedResultBuffers(
+      GetRequest({kVideoStreamId}).output_buffers);
+  EXPECT_EQ(blocked_request.get(), OK);
+}
+
+TEST(PendingRequestsTrackerTests, GroupedBuffersTakeGroupQuota) {
+  auto tracker = CreateTracker();
+  ASSERT_NE(tracker, nullptr);
+
+  // Each buffer of a stream group takes one buffer of the group's quota, even
+  // within one request.
+  std::vector<int32_t> first_requested_stream_ids;
+  ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(
+                GetRequest({kVideoStreamId, kGroupedStreamId}),
+                &first_requested_stream_ids),
+            OK);
+
+  auto blocked_request = std::async(std::launch::async, [&tracker] {
+    std::vector<int32_t> stream_ids;
+    return tracker->WaitAndTrackRequestBuffers(GetRequest({kGroupedStreamId}),
+                                               &stream_ids);
+  });
+  EXPECT_EQ(blocked_request.wait_for(std::chrono::milliseconds(100)),
+            std::future_status::timeout);
+
+  tracker->TrackReturnedResultBuffers(
+      GetRequest({kGroupedStreamId}).output_buffers);
+  EXPECT_EQ(blocked_request.get(), OK);
+}
+
+TEST(PendingRequestsTrackerTests, UnconfiguredStream) {
+  auto tracker = CreateTracker();
+  ASSERT_NE(tracker, nullptr);
+
+  static constexpr int32_t kUnconfiguredStreamId = 10;
+  std::vector<int32_t> first_requested_stream_ids;
+  EXPECT_EQ(tracker->WaitAndTrackRequestBuffers(
+                GetRequest({kUnconfiguredStreamId}),
+                &first_requested_stream_ids),
+            BAD_VALUE);
+  EXPECT_EQ(tracker->WaitAndTrackRequestBuffers(
+                GetRequest({kPreviewStreamId, kUnconfiguredStreamId}),
+                &first_requested_stream_ids),
+            BAD_VALUE);
+  EXPECT_EQ(tracker->WaitAndTrackAcquiredBuffers(kUnconfiguredStreamId, 1),
+            BAD_VALUE);
+
+  // The failed request must not keep the preview buffer it reserved.
+  for (uint32_t i = 0; i < kMaxBuffers; i++) {
+    EXPECT_EQ(tracker->WaitAndTrackRequestBuffers(
+                  GetRequest({kPreviewStreamId}), &first_requested_stream_ids),
+              OK);
+  }
+}
+
+// A request that reserves a preview buffer and then finds its group quota
+// exhausted releases the preview buffer. A preview request that found the
+// preview quota exhausted in between must be woken up instead of waiting for
+// the tracker timeout.
+TEST(PendingRequestsTrackerTests, RollbackNotifiesWaiters) {
+  static constexpr uint32_t kNumIterations = 100;
+  static constexpr auto kRequestTimeout = std::chrono::milliseconds(1000);
+
+  auto tracker = CreateTracker();
+  ASSERT_NE(tracker, nullptr);
+
+  // Exhaust the group quota and leave one free preview buffer.
+  std::vector<int32_t> first_requested_stream_ids;
+  for (uint32_t i = 0; i < kMaxBuffers; i++) {
+    ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(GetRequest({kVideoStreamId}),
+                                                  &first_requested_stream_ids),
+              OK);
+  }
+  ASSERT_EQ(tracker->WaitAndTrackRequestBuffers(GetRequest({kPreviewStreamId}),
+                                                &first_requested_stream_ids),
+            OK);
+
+  for (uint32_t i = 0; i < kNumIterations; i++) {
+    std::promise<void> start;
+    std::shared_future<void> started = start.get_future().share();
+    auto group_request = std::async(std::launch::async, [&tracker, started] {
+      started.wait();
+      std::vector<int32_t> stream_ids;
+      return tracker->WaitAndTrackRequestBuffers(
+          GetRequest({kPreviewStreamId, kGroupedStreamId}), &stream_ids);
+    });
+    auto preview_request = std::async(std::launch::async, [&tracker, started] {
+      started.wait();
+      std::vector<int32_t> stream_ids;
+      return tracker->WaitAndTrackRequestBuffers(
+          GetRequest({kPreviewStreamId}), &stream_ids);
+    });
+    start.set_value();
+
+    ASSERT_EQ(preview_request.wait_for(kRequestTimeout),
+              std::future_status::ready)
+        << "Iteration " << i << ": preview request missed a rollback";
+    ASSERT_EQ(preview_request.get(), OK);
+    tracker->TrackReturnedResultBuffers(
+        GetRequest({kPreviewStreamId}).output_buffers);
+
+    // Let the group request finish and exhaust the group quota again.
+    tracker->TrackReturnedResultBuffers(
+        GetRequest({kVideoStreamId}).output_buffers);
+    ASSERT_EQ(group_request.get(), OK);
+    tracker->TrackReturnedResultBuffers(
+        GetRequest({kPreviewStreamId}).output_buffers);
+  }
+}
+
+TEST(PendingRequestsTrackerTests, WaitAndTrackAcquiredBuffers) {
+  auto tracker = CreateTracker();
+  ASSERT_NE(tracker, nullptr);
+
+  ASSERT_EQ(tracker->WaitAndTrackAcquiredBuffers(kVideoStreamId, kMaxBuffers),
+            OK);
+  EXPECT_EQ(tracker->WaitAndTrackAcquiredBuffers(kGroupedStreamId, 1),
+            TIMED_OUT)
+      << "Acquiring buffers over the group's quota should time out";
+
+  tracker->TrackBufferAcquisitionFailure(kVideoStreamId, 1);
+  EXPECT_EQ(tracker->WaitAndTrackAcquiredBuffers(kGroupedStreamId, 1), OK);
+
+  tracker->TrackReturnedAcquiredBuffers(
+      GetRequest({kVideoStreamId, kGroupedStreamId}).output_buffers);
+  EXPECT_EQ(tracker->WaitAndTrackAcquiredBuffers(kVideoStreamId, kMaxBuffers),
+            OK);
+}
+
+// Track requests from a thread per stream and from threads sharing a stream,
+// and verify all quotas are released afterwards.
+TEST(PendingRequestsTrackerTests, ConcurrentRequests) {
+  static constexpr uint32_t kNumThreads = 3;
+  static constexpr uint32_t kNumIterations = 20000;
+
+  for (bool shared_stream : {false, true}) {
+    auto tracker = PendingRequestsTracker::Create(
+        GetHalStreams(), {},
+        {kPreviewStreamId, kVideoStreamId, kGroupedStreamId});
+    ASSERT_NE(tracker, nullptr);
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < kNumThreads; t++) {
+      threads.emplace_back([&tracker, shared_stream, t] {
+        CaptureRequest request = GetRequest(
+            {shared_stream ? kPreviewStreamId : static_cast<int32_t>(t)});
+        std::vector<int32_t> first_requested_stream_ids;
+        for (uint32_t i = 0; i < kNumIterations; i++) {
+          EXPECT_EQ(tracker->WaitAndTrackRequestBuffers(
+                        request, &first_requested_stream_ids),
+                    OK);
+          tracker->TrackReturnedResultBuffers(request.output_buffers);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    std::vector<int32_t> first_requested_stream_ids;
+    for (uint32_t i = 0; i < kMaxBuffers; i++) {
+      EXPECT_EQ(tracker->WaitAndTrackRequestBuffers(
+                    GetRequest({kPreviewStreamId, kVideoStreamId,
+                                kGroupedStreamId}),
+                    &first_requested_stream_ids),
+                OK);
+    }
+  }
+}
+
+// Reference tracker that counts pending buffers under one mutex, as
+// PendingRequestsTracker did before it used atomic quotas. It only supports
+// what ContentionBenchmark needs: ungrouped, HAL buffer managed streams.
+class MutexRequestsTracker {
+ public:
+  explicit MutexRequestsTracker(const std::vector<HalStream>& hal_streams) {
+    for (auto& hal_stream : hal_streams) {
+      stream_max_buffers_[hal_stream.id] = hal_stream.max_buffers;
+      stream_pending_buffers_[hal_stream.id] = 0;
+    }
+  }
+
+  status_t WaitAndTrackRequestBuffers(
+      const CaptureRequest& request,
+      std::vector<int32_t>* first_requested_stream_ids) {
+    first_requested_stream_ids->clear();
+    std::unique_lock<std::mutex> lock(pending_requests_mutex_);
+    tracker_request_condition_.wait(lock, [&] {
+      for (auto& buffer : request.output_buffers) {
+        if (stream_pending_buffers_.at(buffer.stream_id) >=
+            stream_max_buffers_.at(buffer.stream_id)) {
+          return false;
+        }
+      }
+      return true;
+    });
+    for (auto& buffer : request.output_buffers) {
+      stream_pending_buffers_[buffer.stream_id]++;
+    }
+    return OK;
+  }
+
+  status_t TrackReturnedResultBuffers(
+      const std::vector<StreamBuffer>& returned_buffers) {
+    {
+      std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+      for (auto& buffer : returned_buffers) {
+        stream_pending_buffers_[buffer.stream_id]--;
+      }
+    }
+    tracker_request_condition_.notify_one();
+    return OK;
+  }
+
+ private:
+  std::mutex pending_requests_mutex_;
+  std::condition_variable tracker_request_condition_;
+  std::unordered_map<int32_t, uint32_t> stream_max_buffers_;
+  std::unordered_map<int32_t, uint32_t> stream_pending_buffers_;
+};
+
+// Track and return requests from kNumThreads threads, each on its own stream
+// or all on the same stream. Return the average time per request.
+template <typename Tracker>
+static double MeasureRequestNs(Tracker* tracker, bool shared_stream) {
+  static constexpr uint32_t kNumThreads = 3;
+  static constexpr uint32_t kNumIterations = 100000;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([tracker, shared_stream, t] {
+      CaptureRequest request = GetRequest(
+          {shared_stream ? kPreviewStreamId : static_cast<int32_t>(t)});
+      std::vector<int32_t> first_requested_stream_ids;
+      for (uint32_t i = 0; i < kNumIterations; i++) {
+        EXPECT_EQ(tracker->WaitAndTrackRequestBuffers(
+                      request, &first_requested_stream_ids),
+                  OK);
+        tracker->TrackReturnedResultBuffers(request.output_buffers);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  return static_cast<double>(duration.count()) /
+         (kNumThreads * kNumIterations);
+}
+
+// Compare the atomic quotas with a single mutex under contention. Only logs
+// the results since timing depends on the device.
+TEST(PendingRequestsTrackerTests, ContentionBenchmark) {
+  for (bool shared_stream : {false, true}) {
+    auto tracker = PendingRequestsTracker::Create(
+        GetHalStreams(), {},
+        {kPreviewStreamId, kVideoStreamId, kGroupedStreamId});
+    ASSERT_NE(tracker, nullptr);
+    MutexRequestsTracker mutex_tracker(GetHalStreams());
+
+    double atomic_ns = MeasureRequestNs(tracker.get(), shared_stream);
+    double mutex_ns = MeasureRequestNs(&mutex_tracker, shared_stream);
+    ALOGI("%s: %s stream: atomic quotas %.1f ns/request, mutex %.1f ns/request",
+          __FUNCTION__, shared_stream ? "shared" : "per-thread", atomic_ns,
+          mutex_ns);
+  }
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
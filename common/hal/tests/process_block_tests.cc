@@ -15,11 +15,19 @@
  */
 
 #define LOG_TAG "ProcessBlockTest"
+#include <cutils/native_handle.h>
+#include <cutils/properties.h>
 #include <log/log.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
+#include <chrono>
+#include <future>
 #include <memory>
+#include <thread>
 
+#include "depth_process_block.h"
 #include "mock_device_session_hwl.h"
 #include "mock_result_processor.h"
 #include "multicam_realtime_process_block.h"
@@ -27,6 +35,8 @@
 #include "test_utils.h"
 
 using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Return;
 
 namespace android {
 namespace google_camera_hal {
@@ -255,6 +265,453 @@ TEST_F(ProcessBlockTest, MultiCameraRtProcessBlockRequest) {
 
   ASSERT_EQ(block->ProcessRequests(block_requests, remaining_session_requests),
             OK);
+
+  // The fake HWL sends the shutters of all physical cameras with the same
+  // timestamp. With a single frame, the totals equal the maximums.
+  auto multicam_block = static_cast<MultiCameraRtProcessBlock*>(block.get());
+  MultiCameraRtProcessBlock::PhysicalCameraSkewStats skew_stats =
+      multicam_block->GetPhysicalCameraSkewStats();
+  EXPECT_EQ(skew_stats.num_frames, 1u);
+  EXPECT_EQ(skew_stats.max_sensor_skew_ns, 0);
+  EXPECT_EQ(skew_stats.total_sensor_skew_ns, 0);
+  EXPECT_EQ(skew_stats.total_arrival_skew_ns, skew_stats.max_arrival_skew_ns);
+}
+
+TEST_F(ProcessBlockTest, MultiCameraRtProcessBlockLanesAreIndependent) {
+  ProcessBlockTestSetup& setup = multi_camera_process_block_setup_;
+  InitializeProcessBlockTest(setup);
+  ASSERT_EQ(setup.physical_camera_ids.size(), 2u);
+  uint32_t held_camera_id = setup.physical_camera_ids[0];
+  uint32_t other_camera_id = setup.physical_camera_ids[1];
+
+  // Keep the process block's pipeline callback so the test decides when each
+  // physical camera's result arrives. The pipeline ID of each physical camera
+  // is its camera ID.
+  HwlPipelineCallback hwl_pipeline_callback;
+  EXPECT_CALL(*session_hwl_, ConfigurePipeline(_, _, _, _, _))
+      .Times(setup.physical_camera_ids.size())
+      .WillRepeatedly(Invoke(
+          [&](uint32_t camera_id, HwlPipelineCallback callback,
+              const StreamConfiguration& /*request_config*/,
+              const StreamConfiguration& /*overall_config*/,
+              uint32_t* pipeline_id) {
+            hwl_pipeline_callback = callback;
+            *pipeline_id = camera_id;
+            return OK;
+          }));
+  EXPECT_CALL(*session_hwl_, SubmitRequests(_, _)).WillOnce(Return(OK));
+
+  // The held camera's result blocks in the result processor until it's
+  // released.
+  std::promise<void> held_result_received;
+  std::promise<void> release_held_result;
+  std::shared_future<void> held_result_released =
+      release_held_result.get_future().share();
+
+  auto result_processor = std::make_unique<MockResultProcessor>();
+  ASSERT_NE(result_processor, nullptr) << "Cannot create a MockResultProcessor";
+  EXPECT_CALL(*result_processor, AddPendingRequests(_, _)).Times(1);
+  EXPECT_CALL(*result_processor, ProcessResult(_))
+      .Times(2)
+      .WillRepeatedly(Invoke([&](ProcessBlockResult block_result) {
+        if (block_result.request_id == held_camera_id) {
+          held_result_received.set_value();
+          held_result_released.wait();
+        }
+      }));
+
+  auto block = setup.process_block_create_func();
+  ASSERT_NE(block, nullptr) << "Creating MultiCameraRtProcessBlock failed";
+  ASSERT_EQ(block->ConfigureStreams(test_config_, test_config_), OK);
+  ASSERT_EQ(block->SetResultProcessor(std::move(result_processor)), OK);
+
+  // Request ID of each physical camera's request is its camera ID.
+  std::vector<ProcessBlockRequest> block_requests;
+  CaptureRequest remaining_session_requests;
+  for (auto& stream : test_config_.streams) {
+    StreamBuffer buffer = {.stream_id = stream.id};
+
+    ProcessBlockRequest block_request;
+    block_request.request_id = stream.physical_camera_id;
+    block_request.request.output_buffers.push_back(buffer);
+    block_requests.push_back(std::move(block_request));
+    remaining_session_requests.output_buffers.push_back(buffer);
+  }
+  ASSERT_EQ(block->ProcessRequests(block_requests, remaining_session_requests),
+            OK);
+
+  auto send_result = [&](uint32_t camera_id) {
+    auto result = std::make_unique<HwlPipelineResult>();
+    result->camera_id = camera_id;
+    result->pipeline_id = camera_id;
+    result->frame_number = 0;
+    for (auto& block_request : block_requests) {
+      if (block_request.request_id == camera_id) {
+        result->output_buffers = block_request.request.output_buffers;
+      }
+    }
+    result->partial_result = 1;
+    hwl_pipeline_callback.process_pipeline_result(std::move(result));
+  };
+
+  std::thread held_thread(send_result, held_camera_id);
+  EXPECT_EQ(held_result_received.get_future().wait_for(std::chrono::seconds(1)),
+            std::future_status::ready);
+
+  // The other camera's result must arrive while the held one is blocked.
+  auto other_result = std::async(std::launch::async, send_result,
+                                 other_camera_id);
+  EXPECT_EQ(other_result.wait_for(std::chrono::seconds(1)),
+            std::future_status::ready)
+      << "A held result of camera " << held_camera_id
+      << " blocked the result of camera " << other_camera_id;
+
+  release_held_result.set_value();
+  held_thread.join();
+  other_result.wait();
+}
+
+TEST_F(ProcessBlockTest, MultiCameraRtProcessBlockOwnedRequests) {
+  ProcessBlockTestSetup& setup = multi_camera_process_block_setup_;
+  InitializeProcessBlockTest(setup);
+
+  size_t num_pipelines = setup.physical_camera_ids.size();
+  EXPECT_CALL(*session_hwl_, SubmitRequests(_, _)).Times(1);
+
+  auto result_processor = std::make_unique<MockResultProcessor>();
+  ASSERT_NE(result_processor, nullptr) << "Cannot create a MockResultProcessor";
+  EXPECT_CALL(*result_processor, AddPendingRequests(_, _)).Times(1);
+  EXPECT_CALL(*result_processor, ProcessResult(_)).Times(num_pipelines);
+  EXPECT_CALL(*result_processor, Notify(_)).Times(num_pipelines);
+
+  auto block = setup.process_block_create_func();
+  ASSERT_NE(block, nullptr) << "Creating MultiCameraRtProcessBlock failed";
+  ASSERT_EQ(block->ConfigureStreams(test_config_, test_config_), OK);
+  ASSERT_EQ(session_hwl_->BuildPipelines(), OK);
+  ASSERT_EQ(block->SetResultProcessor(std::move(result_processor)), OK);
+
+  CaptureRequest remaining_session_requests;
+  std::vector<ProcessBlockRequest> block_requests;
+  ProcessBlockRequest mixed_request;
+  for (auto& stream : test_config_.streams) {
+    StreamBuffer buffer = {.stream_id = stream.id};
+
+    ProcessBlockRequest block_request;
+    block_request.request.output_buffers.push_back(buffer);
+    block_requests.push_back(std::move(block_request));
+
+    mixed_request.request.output_buffers.push_back(buffer);
+    remaining_session_requests.output_buffers.push_back(buffer);
+  }
+
+  // A request must not contain buffers from different physical cameras.
+  std::vector<ProcessBlockRequest> mixed_requests(1);
+  mixed_requests[0] = std::move(mixed_request);
+  EXPECT_NE(block->ProcessOwnedRequests(std::move(mixed_requests),
+                                        remaining_session_requests),
+            OK);
+
+  ASSERT_EQ(block->ProcessOwnedRequests(std::move(block_requests),
+                                        remaining_session_requests),
+            OK);
+}
+
+// Depth generator that holds the enqueued requests until the test returns
+// them, or returns their results from within EnqueueProcessRequest() if
+// return_results_in_enqueue is true.
+class FakeDepthGenerator : public depth_generator::DepthGenerator {
+ public:
+  explicit FakeDepthGenerator(bool return_results_in_enqueue = false)
+      : return_results_in_enqueue_(return_results_in_enqueue) {
+  }
+
+  status_t EnqueueProcessRequest(const DepthRequestInfo& request_info) override {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      enqueued_frame_numbers_.push_back(request_info.frame_number);
+    }
+    if (return_results_in_enqueue_) {
+      ReturnResult(request_info.frame_number);
+    }
+    return OK;
+  }
+
+  status_t ExecuteProcessRequest(const DepthRequestInfo&) override {
+    return OK;
+  }
+
+  void SetResultCallback(
+      depth_generator::DepthResultCallbackFunction callback) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    result_callback_ = callback;
+  }
+
+  std::vector<uint32_t> GetEnqueuedFrameNumbers() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return enqueued_frame_numbers_;
+  }
+
+  // Return the result of a frame like a depth generator worker thread.
+  void ReturnResult(uint32_t frame_number) {
+    depth_generator::DepthResultCallbackFunction callback;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      callback = result_callback_;
+    }
+    ASSERT_NE(callback, nullptr);
+    callback(DepthResultStatus::kOk, frame_number);
+  }
+
+ private:
+  const bool return_results_in_enqueue_;
+  std::mutex lock_;
+  std::vector<uint32_t> enqueued_frame_numbers_;
+  depth_generator::DepthResultCallbackFunction result_callback_;
+};
+
+// Buffer handles backed by memfds that the depth process block can map,
+// released when the test ends.
+class DepthTestBuffers {
+ public:
+  ~DepthTestBuffers() {
+    for (native_handle_t* handle : handles_) {
+      close(handle->data[0]);
+      native_handle_delete(handle);
+    }
+  }
+
+  buffer_handle_t Allocate(uint32_t size) {
+    int fd = memfd_create("process_block_test", /*flags=*/0);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+      ALOGE("%s: Failed to create a memfd.", __FUNCTION__);
+      if (fd >= 0) {
+        close(fd);
+      }
+      return nullptr;
+    }
+
+    native_handle_t* handle = native_handle_create(/*numFds=*/1,
+                                                   /*numInts=*/0);
+    handle->data[0] = fd;
+    handles_.push_back(handle);
+    return handle;
+  }
+
+ private:
+  std::vector<native_handle_t*> handles_;
+};
+
+// Return the characteristics of a logical or IR camera with a 640x480 active
+// array.
+static status_t GetDepthCameraCharacteristics(
+    std::unique_ptr<HalCameraMetadata>* characteristics) {
+  *characteristics = HalCameraMetadata::Create(/*num_entries=*/2,
+                                               /*data_bytes=*/64);
+  if (*characteristics == nullptr) {
+    return NO_MEMORY;
+  }
+
+  int32_t active_array[] = {0, 0, 640, 480};
+  status_t res = (*characteristics)
+                     ->Set(ANDROID_SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE,
+                           active_array, /*data_count=*/4);
+  if (res != OK) {
+    return res;
+  }
+
+  uint8_t cfa = ANDROID_SENSOR_INFO_COLOR_FILTER_ARRANGEMENT_NIR;
+  return (*characteristics)
+      ->Set(ANDROID_SENSOR_INFO_COLOR_FILTER_ARRANGEMENT, &cfa,
+            /*data_count=*/1);
+}
+
+// Test a depth process block with a fake depth generator and an in-flight
+// window of one request.
+class DepthProcessBlockTest : public ProcessBlockTest {
+ protected:
+  static constexpr int32_t kIr1StreamId = 1;
+  static constexpr int32_t kIr2StreamId = 2;
+  static constexpr int32_t kDepthStreamId = 3;
+  static constexpr uint32_t kWidth = 640;
+  static constexpr uint32_t kHeight = 480;
+
+  void SetUp() override {
+    if (!property_get_bool("persist.vendor.camera.frontdepth.enablepipeline",
+                           true)) {
+      GTEST_SKIP() << "The depth process block uses the blocking depth API.";
+    }
+    ProcessBlockTest::SetUp();
+
+    session_hwl_ = std::make_unique<MockDeviceSessionHwl>(
+        /*camera_id=*/3,
+        /*physical_camera_ids=*/std::vector<uint32_t>{1, 5, 6});
+    ASSERT_NE(session_hwl_, nullptr);
+    session_hwl_->DelegateCallsToFakeSession();
+    ON_CALL(*session_hwl_, GetCameraCharacteristics(_))
+        .WillByDefault(Invoke(GetDepthCameraCharacteristics));
+    ON_CALL(*session_hwl_, GetPhysicalCameraCharacteristics(_, _))
+        .WillByDefault(
+            Invoke([](uint32_t /*physical_camera_id*/,
+                      std::unique_ptr<HalCameraMetadata>* characteristics) {
+              return GetDepthCameraCharacteristics(characteristics);
+            }));
+  }
+
+  // Create a depth process block on depth_generator, configure its streams
+  // and set a result processor that expects num_requests successful results.
+  void CreateDepthProcessBlock(
+      std::unique_ptr<FakeDepthGenerator> depth_generator,
+      uint32_t num_requests) {
+    StreamConfiguration stream_config;
+    for (int32_t stream_id : {kIr1StreamId, kIr2StreamId, kDepthStreamId}) {
+      Stream stream;
+      stream.id = stream_id;
+      stream.width = kWidth;
+      stream.height = kHeight;
+      if (stream_id == kDepthStreamId) {
+        stream.format = HAL_PIXEL_FORMAT_Y16;
+        stream.data_space = HAL_DATASPACE_DEPTH;
+      } else {
+        stream.format = HAL_PIXEL_FORMAT_Y8;
+      }
+      stream_config.streams.push_back(stream);
+    }
+
+    // Only one request can be with the depth generator at a time.
+    DepthProcessBlock::DepthProcessBlockCreateData create_data;
+    create_data.ir1_internal_raw_stream_id = kIr1StreamId;
+    create_data.ir2_internal_raw_stream_id = kIr2StreamId;
+    create_data.max_inflight_requests = 1;
+    block_ = DepthProcessBlock::Create(
+        session_hwl_.get(), /*request_stream_buffers=*/nullptr, create_data,
+        std::move(depth_generator));
+    ASSERT_NE(block_, nullptr) << "Creating DepthProcessBlock failed";
+    ASSERT_EQ(block_->ConfigureStreams(stream_config, stream_config), OK);
+
+    auto result_processor = std::make_unique<MockResultProcessor>();
+    ASSERT_NE(result_processor, nullptr)
+        << "Cannot create a MockResultProcessor";
+    EXPECT_CALL(*result_processor, AddPendingRequests(_, _))
+        .Times(num_requests)
+        .WillRepeatedly(Return(OK));
+    EXPECT_CALL(*result_processor, ProcessResult(_))
+        .Times(num_requests)
+        .WillRepeatedly(Invoke([this](const ProcessBlockResult& result) {
+          ASSERT_NE(result.result, nullptr);
+          EXPECT_EQ(result.result->output_buffers.size(), 1u);
+          EXPECT_EQ(result.result->output_buffers[0].status,
+                    BufferStatus::kOk);
+          std::lock_guard<std::mutex> lock(result_lock_);
+          result_frame_numbers_.push_back(result.result->frame_number);
+        }));
+    ASSERT_EQ(block_->SetResultProcessor(std::move(result_processor)), OK);
+  }
+
+  // Send a depth request to the block. Requests must not block the thread
+  // delivering them, which is usually the HWL result thread.
+  void ProcessDepthRequest(uint32_t frame_number) {
+    std::vector<ProcessBlockRequest> block_requests(1);
+    CaptureRequest& request = block_requests[0].request;
+    request.frame_number = frame_number;
+    for (int32_t stream_id : {kIr1StreamId, kIr2StreamId}) {
+      StreamBuffer buffer;
+      buffer.stream_id = stream_id;
+      buffer.buffer = buffers_.Allocate(kWidth * kHeight);
+      ASSERT_NE(buffer.buffer, nullptr);
+      request.input_buffers.push_back(buffer);
+    }
+    StreamBuffer depth_buffer;
+    depth_buffer.stream_id = kDepthStreamId;
+    depth_buffer.buffer = buffers_.Allocate(kWidth * kHeight * 2);
+    ASSERT_NE(depth_buffer.buffer, nullptr);
+    request.output_buffers.push_back(depth_buffer);
+
+    // The task is abandoned rather than waited for if it doesn't finish.
+    auto processed = std::make_shared<std::packaged_task<status_t()>>(
+        [this, block_requests = std::move(block_requests)]() {
+          return block_->ProcessRequests(block_requests,
+                                         block_requests[0].request);
+        });
+    auto result = processed->get_future();
+    std::thread([processed]() { (*processed)(); }).detach();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(1)),
+              std::future_status::ready)
+        << "Processing frame " << frame_number << " blocked";
+    ASSERT_EQ(result.get(), OK);
+  }
+
+  std::vector<uint32_t> GetResultFrameNumbers() {
+    std::lock_guard<std::mutex> lock(result_lock_);
+    return result_frame_numbers_;
+  }
+
+  // Buffers must outlive the block, which keeps them mapped.
+  DepthTestBuffers buffers_;
+  std::unique_ptr<DepthProcessBlock> block_;
+
+  std::mutex result_lock_;
+  // Frame numbers of the results in the order they were returned. Must be
+  // protected by result_lock_.
+  std::vector<uint32_t> result_frame_numbers_;
+};
+
+TEST_F(DepthProcessBlockTest, QueuesRequestsBeyondInflightWindow) {
+  const uint32_t kNumRequests = 3;
+  auto depth_generator = std::make_unique<FakeDepthGenerator>();
+  FakeDepthGenerator* fake_depth_generator = depth_generator.get();
+  CreateDepthProcessBlock(std::move(depth_generator), kNumRequests);
+  ASSERT_FALSE(HasFatalFailure());
+
+  for (uint32_t frame_number = 0; frame_number < kNumRequests;
+       frame_number++) {
+    ProcessDepthRequest(frame_number);
+    ASSERT_FALSE(HasFatalFailure());
+  }
+
+  // Only the first request was submitted. Returning each result submits the
+  // next queued request.
+  EXPECT_EQ(fake_depth_generator->GetEnqueuedFrameNumbers(),
+            std::vector<uint32_t>({0}));
+  EXPECT_TRUE(GetResultFrameNumbers().empty());
+  for (uint32_t frame_number = 0; frame_number < kNumRequests;
+       frame_number++) {
+    fake_depth_generator->ReturnResult(frame_number);
+
+    std::vector<uint32_t> expected_frame_numbers;
+    for (uint32_t i = 0; i <= frame_number; i++) {
+      expected_frame_numbers.push_back(i);
+    }
+    EXPECT_EQ(GetResultFrameNumbers(), expected_frame_numbers);
+    if (frame_number + 1 < kNumRequests) {
+      expected_frame_numbers.push_back(frame_number + 1);
+    }
+    EXPECT_EQ(fake_depth_generator->GetEnqueuedFrameNumbers(),
+              expected_frame_numbers);
+  }
+}
+
+TEST_F(DepthProcessBlockTest, AcceptsResultsFromEnqueue) {
+  const uint32_t kNumRequests = 3;
+  auto depth_generator =
+      std::make_unique<FakeDepthGenerator>(/*return_results_in_enqueue=*/true);
+  FakeDepthGenerator* fake_depth_generator = depth_generator.get();
+  CreateDepthProcessBlock(std::move(depth_generator), kNumRequests);
+  ASSERT_FALSE(HasFatalFailure());
+
+  // Each request is submitted and its result returned before ProcessRequests()
+  // returns. A block that calls the depth generator with its locks held would
+  // deadlock here.
+  std::vector<uint32_t> expected_frame_numbers;
+  for (uint32_t frame_number = 0; frame_number < kNumRequests;
+       frame_number++) {
+    ProcessDepthRequest(frame_number);
+    ASSERT_FALSE(HasFatalFailure());
+
+    expected_frame_numbers.push_back(frame_number);
+    EXPECT_EQ(fake_depth_generator->GetEnqueuedFrameNumbers(),
+              expected_frame_numbers);
+    EXPECT_EQ(GetResultFrameNumbers(), expected_frame_numbers);
+  }
 }
 
 }  // namespace google_camera_hal
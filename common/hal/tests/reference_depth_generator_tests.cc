@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ReferenceDepthGeneratorTests"
+#include <log/log.h>
+
+#include <gtest/gtest.h>
+#include <reference_depth_generator.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace depth_generator {
+
+static constexpr uint32_t kDisparity = 8;
+static constexpr uint32_t kDepthRangeMask = 0x1FFF;
+static constexpr uint32_t kConfidenceShift = 13;
+
+// IR images of a fronto-parallel textured plane at a constant disparity, and
+// the depth buffer to fill.
+class StereoFrame {
+ public:
+  StereoFrame(uint32_t width, uint32_t height)
+      : width_(width),
+        height_(height),
+        left_(width * height),
+        right_(width * height),
+        depth_(width * height) {
+    std::srand(1);
+    std::vector<uint8_t> texture((width + kDisparity) * height);
+    for (auto& pixel : texture) {
+      pixel = std::rand() & 0xFF;
+    }
+
+    // A pixel at x in the left image is at x - kDisparity in the right image.
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+        left_[y * width + x] = texture[y * (width + kDisparity) + x];
+        right_[y * width + x] =
+            texture[y * (width + kDisparity) + x + kDisparity];
+      }
+    }
+  }
+
+  DepthRequestInfo GetRequest(uint32_t frame_number) {
+    DepthRequestInfo request;
+    request.frame_number = frame_number;
+    request.ir_buffer.resize(2);
+    request.ir_buffer[0].push_back(GetBuffer(HAL_PIXEL_FORMAT_Y8, left_.data(),
+                                             width_));
+    request.ir_buffer[1].push_back(
+        GetBuffer(HAL_PIXEL_FORMAT_Y8, right_.data(), width_));
+    request.depth_buffer =
+        GetBuffer(HAL_PIXEL_FORMAT_Y16,
+                  reinterpret_cast<uint8_t*>(depth_.data()), width_ * 2);
+    return request;
+  }
+
+  const std::vector<uint16_t>& depth() const {
+    return depth_;
+  }
+
+ private:
+  Buffer GetBuffer(android_pixel_format_t format, uint8_t* addr,
+                   uint32_t stride) {
+    Buffer buffer;
+    buffer.format = format;
+    buffer.width = width_;
+    buffer.height = height_;
+    buffer.planes.push_back(
+        {.addr = addr, .stride = stride, .scanline = height_});
+    return buffer;
+  }
+
+  const uint32_t width_;
+  const uint32_t height_;
+  std::vector<uint8_t> left_;
+  std::vector<uint8_t> right_;
+  std::vector<uint16_t> depth_;
+};
+
+TEST(ReferenceDepthGeneratorTests, ExecuteProcessRequest) {
+  static constexpr uint32_t kWidth = 160;
+  static constexpr uint32_t kHeight = 120;
+  ReferenceDepthGenerator::Options options;
+  auto depth_generator = ReferenceDepthGenerator::Create(options);
+  ASSERT_NE(depth_generator, nullptr);
+
+  StereoFrame frame(kWidth, kHeight);
+  ASSERT_EQ(depth_generator->ExecuteProcessRequest(frame.GetRequest(0)), OK);
+
+  // Pixels whose match is outside the right image have no depth.
+  const uint32_t expected_range =
+      options.focal_length_px * options.baseline_mm / kDisparity;
+  uint32_t num_checked = 0;
+  uint32_t num_matched = 0;
+  for (uint32_t y = 0; y < kHeight; y++) {
+    for (uint32_t x = options.num_disparities + options.block_radius;
+         x < kWidth - options.block_radius; x++) {
+      uint16_t sample = frame.depth()[y * kWidth + x];
+      num_checked++;
+      // Allow 2% of range error from subpixel refinement. Confidence 0 is
+      // 100%.
+      if (std::abs(static_cast<int32_t>(sample & kDepthRangeMask) -
+                   static_cast<int32_t>(expected_range)) <=
+              static_cast<int32_t>(expected_range / 50) &&
+          (sample >> kConfidenceShift) == 0) {
+        num_matched++;
+      }
+    }
+  }
+  EXPECT_GE(num_matched, num_checked * 95 / 100)
+      << num_matched << " of " << num_checked << " samples are correct";
+
+  DepthRequestInfo request = frame.GetRequest(0);
+  request.ir_buffer.pop_back();
+  EXPECT_NE(depth_generator->ExecuteProcessRequest(request), OK)
+      << "Processing a request with one IR buffer should fail";
+
+  request = frame.GetRequest(0);
+  request.depth_buffer.format = HAL_PIXEL_FORMAT_RGBA_8888;
+  EXPECT_NE(depth_generator->ExecuteProcessRequest(request), OK)
+      << "Processing a request with a non-Y16 depth buffer should fail";
+}
+
+TEST(ReferenceDepthGeneratorTests, EnqueueProcessRequest) {
+  static constexpr uint32_t kWidth = 640;
+  static constexpr uint32_t kHeight = 480;
+  static constexpr uint32_t kNumFrames = 12;
+  auto depth_generator = ReferenceDepthGenerator::Create();
+  ASSERT_NE(depth_generator, nullptr);
+
+  std::vector<std::unique_ptr<StereoFrame>> frames;
+  for (uint32_t i = 0; i < kNumFrames; i++) {
+    frames.push_back(std::make_unique<StereoFrame>(kWidth, kHeight));
+  }
+
+  EXPECT_NE(depth_generator->EnqueueProcessRequest(frames[0]->GetRequest(0)),
+            OK)
+      << "Enqueuing a request without a result callback should fail";
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::vector<uint32_t> completed_frames;
+  depth_generator->SetResultCallback(
+      [&](DepthResultStatus result, uint32_t frame_number) {
+        EXPECT_EQ(result, DepthResultStatus::kOk);
+        std::lock_guard<std::mutex> guard(lock);
+        completed_frames.push_back(frame_number);
+        cond.notify_one();
+      });
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < kNumFrames; i++) {
+    ASSERT_EQ(depth_generator->EnqueueProcessRequest(frames[i]->GetRequest(i)),
+              OK);
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  ASSERT_TRUE(cond.wait_for(guard, std::chrono::seconds(30), [&] {
+    return completed_frames.size() == kNumFrames;
+  }));
+  auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  ALOGI("%s: %u frames of %ux%u in %lld ms", __FUNCTION__, kNumFrames, kWidth,
+        kHeight, static_cast<long long>(elapsed_ms.count()));
+
+  EXPECT_EQ(frames[0]->depth(), frames[kNumFrames - 1]->depth());
+}
+
+}  // namespace depth_generator
+}  // namespace android
@@ -18,15 +18,23 @@
 #include <log/log.h>
 
 #include <gtest/gtest.h>
+#include <hardware/gralloc.h>
+
+#include <future>
 #include <memory>
 
 #include "basic_request_processor.h"
+#include "hdrplus_request_processor.h"
 #include "mock_device_session_hwl.h"
 #include "mock_process_block.h"
 #include "result_processor.h"
 #include "test_utils.h"
+#include "vendor_tag_defs.h"
+#include "vendor_tag_utils.h"
 
 using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Return;
 
 namespace android {
 namespace google_camera_hal {
@@ -152,5 +160,217 @@ TEST_F(RequestProcessorTest, BasicRequestProcessorRequest) {
   ASSERT_EQ(request_processor->ProcessRequest(request), OK);
 }
 
+class HdrplusRequestProcessorTest : public RequestProcessorTest {
+ protected:
+  static constexpr int32_t kPayloadFrames = 2;
+  static constexpr int32_t kRawWidth = 640;
+  static constexpr int32_t kRawHeight = 480;
+  static constexpr uint64_t kPayloadBytes =
+      static_cast<uint64_t>(kRawWidth) * kRawHeight * 10 / 8 * kPayloadFrames;
+  static constexpr uint32_t kNumZslBuffers = 8;
+
+  void SetUp() override {
+    RequestProcessorTest::SetUp();
+    ASSERT_EQ(VendorTagManager::GetInstance().AddTags(kHalVendorTagSections),
+              OK);
+
+    ON_CALL(*session_hwl_, GetCameraCharacteristics(_))
+        .WillByDefault(Invoke(
+            [](std::unique_ptr<HalCameraMetadata>* characteristics) {
+              *characteristics = HalCameraMetadata::Create(/*num_entries=*/2,
+                                                           /*data_bytes=*/64);
+              int32_t active_array[] = {0, 0, kRawWidth, kRawHeight};
+              (*characteristics)
+                  ->Set(ANDROID_SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE,
+                        active_array, /*data_count=*/4);
+              int32_t payload_frames = kPayloadFrames;
+              (*characteristics)
+                  ->Set(VendorTagIds::kHdrplusPayloadFrames, &payload_frames,
+                        /*data_count=*/1);
+              return OK;
+            }));
+  }
+
+  void TearDown() override {
+    VendorTagManager::GetInstance().Reset();
+  }
+
+  // Allocate the internal raw stream and fill all of its ZSL buffers.
+  void PrepareRawStream(
+      InternalStreamManager* stream_manager, int32_t* raw_stream_id,
+      android_pixel_format_t raw_format = HAL_PIXEL_FORMAT_RAW10) {
+    Stream raw_stream = {
+        .stream_type = StreamType::kOutput,
+        .width = kRawWidth,
+        .height = kRawHeight,
+        .format = raw_format,
+    };
+    ASSERT_EQ(stream_manager->RegisterNewInternalStream(raw_stream,
+                                                        raw_stream_id),
+              OK);
+
+    HalStream raw_hal_stream = {
+        .id = *raw_stream_id,
+        .override_format = raw_format,
+        .producer_usage = GRALLOC_USAGE_HW_CAMERA_WRITE,
+        .max_buffers = kNumZslBuffers,
+    };
+    ASSERT_EQ(stream_manager->AllocateBuffers(raw_hal_stream), OK);
+
+    struct timespec ts;
+    ASSERT_EQ(clock_gettime(CLOCK_BOOTTIME, &ts), 0);
+    int64_t timestamp = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    for (uint32_t frame_number = 0; frame_number < kNumZslBuffers;
+         frame_number++) {
+      StreamBuffer buffer = {};
+      ASSERT_EQ(stream_manager->GetStreamBuffer(*raw_stream_id, &buffer), OK);
+      ASSERT_EQ(stream_manager->ReturnFilledBuffer(frame_number, buffer), OK);
+
+      auto metadata = HalCameraMetadata::Create(/*num_entries=*/1,
+                                                /*data_bytes=*/16);
+      ASSERT_EQ(metadata->Set(ANDROID_SENSOR_TIMESTAMP, &timestamp, 1), OK);
+      ASSERT_EQ(stream_manager->ReturnMetadata(*raw_stream_id, frame_number,
+                                               metadata.get()),
+                OK);
+    }
+  }
+
+  // Create a configured HDR+ request processor whose mock process block
+  // accepts every request. Payload buffers are held until the test returns
+  // them, like HdrplusResultProcessor does when the HWL finishes processing.
+  std::unique_ptr<HdrplusRequestProcessor> CreateConfiguredRequestProcessor(
+      InternalStreamManager* stream_manager, int32_t raw_stream_id,
+      uint64_t max_pending_payload_bytes) {
+    auto request_processor = HdrplusRequestProcessor::Create(
+        session_hwl_.get(), raw_stream_id, /*physical_camera_id=*/0,
+        max_pending_payload_bytes);
+    if (request_processor == nullptr) {
+      return nullptr;
+    }
+
+    StreamConfiguration preview_config;
+    test_utils::GetPreviewOnlyStreamConfiguration(&preview_config);
+    StreamConfiguration process_block_stream_config;
+    if (request_processor->ConfigureStreams(stream_manager, preview_config,
+                                            &process_block_stream_config) !=
+        OK) {
+      return nullptr;
+    }
+
+    auto process_block = std::make_unique<MockProcessBlock>();
+    ON_CALL(*process_block, ProcessRequests(_, _)).WillByDefault(Return(OK));
+    if (request_processor->SetProcessBlock(std::move(process_block)) != OK) {
+      return nullptr;
+    }
+
+    return request_processor;
+  }
+};
+
+TEST_F(HdrplusRequestProcessorTest, PipelinedCaptures) {
+  auto stream_manager = InternalStreamManager::Create();
+  ASSERT_NE(stream_manager, nullptr);
+  int32_t raw_stream_id = -1;
+  PrepareRawStream(stream_manager.get(), &raw_stream_id);
+
+  // The budget fits the payloads of two captures.
+  auto request_processor = CreateConfiguredRequestProcessor(
+      stream_manager.get(), raw_stream_id, 2 * kPayloadBytes);
+  ASSERT_NE(request_processor, nullptr);
+
+  uint32_t frame_number = kNumZslBuffers;
+  CaptureRequest first_capture = {.frame_number = frame_number++};
+  CaptureRequest second_capture = {.frame_number = frame_number++};
+  CaptureRequest third_capture = {.frame_number = frame_number++};
+  ASSERT_EQ(request_processor->ProcessRequest(first_capture), OK);
+  ASSERT_EQ(request_processor->ProcessRequest(second_capture), OK)
+      << "A second capture should not wait for the first one";
+  EXPECT_NE(request_processor->ProcessRequest(third_capture), OK)
+      << "A third capture exceeds the payload budget";
+
+  ASSERT_EQ(stream_manager->ReturnCapturePayloadBuffers(
+                first_capture.frame_number, raw_stream_id),
+            OK);
+  EXPECT_EQ(request_processor->ProcessRequest(third_capture), OK);
+}
+
+TEST_F(HdrplusRequestProcessorTest, SerialCaptures) {
+  auto stream_manager = InternalStreamManager::Create();
+  ASSERT_NE(stream_manager, nullptr);
+  int32_t raw_stream_id = -1;
+  PrepareRawStream(stream_manager.get(), &raw_stream_id);
+
+  // The budget fits the payload of one capture.
+  auto request_processor = CreateConfiguredRequestProcessor(
+      stream_manager.get(), raw_stream_id, kPayloadBytes);
+  ASSERT_NE(request_processor, nullptr);
+
+  CaptureRequest first_capture = {.frame_number = kNumZslBuffers};
+  CaptureRequest second_capture = {.frame_number = kNumZslBuffers + 1};
+  ASSERT_EQ(request_processor->ProcessRequest(first_capture), OK);
+  EXPECT_NE(request_processor->ProcessRequest(second_capture), OK);
+
+  ASSERT_EQ(stream_manager->ReturnCapturePayloadBuffers(
+                first_capture.frame_number, raw_stream_id),
+            OK);
+  EXPECT_EQ(request_processor->ProcessRequest(second_capture), OK);
+}
+
+// The payload budget is divided by the size of the allocated raw buffers, so
+// a budget fitting two RAW10 payloads fits only one RAW16 payload.
+TEST_F(HdrplusRequestProcessorTest, BudgetFollowsRawFormat) {
+  auto stream_manager = InternalStreamManager::Create();
+  ASSERT_NE(stream_manager, nullptr);
+  int32_t raw_stream_id = -1;
+  PrepareRawStream(stream_manager.get(), &raw_stream_id,
+                   HAL_PIXEL_FORMAT_RAW16);
+  auto request_processor = CreateConfiguredRequestProcessor(
+      stream_manager.get(), raw_stream_id, 2 * kPayloadBytes);
+  ASSERT_NE(request_processor, nullptr);
+
+  CaptureRequest first_capture = {.frame_number = kNumZslBuffers};
+  CaptureRequest second_capture = {.frame_number = kNumZslBuffers + 1};
+  ASSERT_EQ(request_processor->ProcessRequest(first_capture), OK);
+  EXPECT_NE(request_processor->ProcessRequest(second_capture), OK);
+}
+
+// Captures submitted at the same time must not exceed the payload budget.
+TEST_F(HdrplusRequestProcessorTest, ConcurrentCapturesStayInBudget) {
+  static constexpr uint32_t kNumThreads = 4;
+  static constexpr uint32_t kMaxPendingCaptures = 2;
+
+  auto stream_manager = InternalStreamManager::Create();
+  ASSERT_NE(stream_manager, nullptr);
+  int32_t raw_stream_id = -1;
+  PrepareRawStream(stream_manager.get(), &raw_stream_id);
+  auto request_processor = CreateConfiguredRequestProcessor(
+      stream_manager.get(), raw_stream_id,
+      kMaxPendingCaptures * kPayloadBytes);
+  ASSERT_NE(request_processor, nullptr);
+
+  std::promise<void> start;
+  std::shared_future<void> started = start.get_future().share();
+  std::vector<std::future<status_t>> captures;
+  for (uint32_t i = 0; i < kNumThreads; i++) {
+    captures.push_back(std::async(
+        std::launch::async, [&request_processor, started, i] {
+          started.wait();
+          CaptureRequest request = {.frame_number = kNumZslBuffers + i};
+          return request_processor->ProcessRequest(request);
+        }));
+  }
+  start.set_value();
+
+  uint32_t num_accepted = 0;
+  for (auto& capture : captures) {
+    if (capture.get() == OK) {
+      num_accepted++;
+    }
+  }
+  EXPECT_EQ(num_accepted, kMaxPendingCaptures);
+  EXPECT_EQ(stream_manager->GetPendingCaptureCount(raw_stream_id),
+            kMaxPendingCaptures);
+}
+
 }  // namespace google_camera_hal
 }  // namespace android
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ThermalGovernorTests"
+#include <log/log.h>
+
+#include <gtest/gtest.h>
+#include <simulated_thermal_feed.h>
+#include <thermal_governor.h>
+
+#include <algorithm>
+
+namespace android {
+namespace google_camera_hal {
+
+static constexpr int64_t kNsPerSec = 1'000'000'000;
+
+static Temperature GetTemperature(float value, ThrottlingSeverity status,
+                                  TemperatureType type = TemperatureType::kSkin,
+                                  const std::string& name = "skin") {
+  return {.type = type,
+          .name = name,
+          .value = value,
+          .throttling_status = status};
+}
+
+// Power drawn by a sustained recording at a thermal level, in watts.
+static float GetRecordingPower(ThermalLevel level) {
+  static constexpr float kPowers[kNumThermalLevels] = {4.5f, 4.0f, 3.0f, 2.0f};
+  return kPowers[static_cast<size_t>(level)];
+}
+
+TEST(ThermalGovernorTests, Create) {
+  EXPECT_NE(ThermalGovernor::Create(), nullptr);
+
+  ThermalGovernorConfig config;
+  config.level_temperatures = {40.0f, 38.0f, 42.0f};
+  EXPECT_EQ(ThermalGovernor::Create(config), nullptr)
+      << "Descending level temperatures should be rejected.";
+
+  config = ThermalGovernorConfig();
+  config.trend_smoothing = 0.0f;
+  EXPECT_EQ(ThermalGovernor::Create(config), nullptr)
+      << "Zero trend smoothing should be rejected.";
+}
+
+TEST(ThermalGovernorTests, SeverityLevels) {
+  auto governor = ThermalGovernor::Create();
+  ASSERT_NE(governor, nullptr);
+  EXPECT_EQ(governor->GetLevel(), ThermalLevel::kNone);
+
+  // Temperatures of other types only contribute their throttling status.
+  TemperatureType type = TemperatureType::kCpu;
+  EXPECT_EQ(governor->OnTemperature(
+                GetTemperature(90.0f, ThrottlingSeverity::kLight, type, "cpu"),
+                0),
+            ThermalLevel::kLight);
+  EXPECT_EQ(governor->OnTemperature(
+                GetTemperature(90.0f, ThrottlingSeverity::kModerate, type,
+                               "cpu"),
+                1),
+            ThermalLevel::kModerate);
+  EXPECT_EQ(governor->OnTemperature(
+                GetTemperature(90.0f, ThrottlingSeverity::kCritical, type,
+                               "cpu"),
+                2),
+            ThermalLevel::kSevere);
+  EXPECT_FALSE(governor->GetMitigation().hdrplus_zsl_enabled);
+}
+
+TEST(ThermalGovernorTests, StepDownAfterInterval) {
+  ThermalGovernorConfig config;
+  auto governor = ThermalGovernor::Create(config);
+  ASSERT_NE(governor, nullptr);
+
+  int64_t timestamp_ns = 0;
+  governor->OnTemperature(GetTemperature(45.0f, ThrottlingSeverity::kSevere),
+                          timestamp_ns);
+  ASSERT_EQ(governor->GetLevel(), ThermalLevel::kSevere);
+
+  // Cooling down steps down one level at a time after the interval.
+  timestamp_ns += kNsPerSec;
+  governor->OnTemperature(GetTemperature(30.0f, ThrottlingSeverity::kNone),
+                          timestamp_ns);
+  EXPECT_EQ(governor->GetLevel(), ThermalLevel::kSevere);
+
+  for (uint8_t level = static_cast<uint8_t>(ThermalLevel::kSevere);
+       level > 0; level--) {
+    timestamp_ns += config.min_step_down_interval_ns;
+    EXPECT_EQ(governor->Update(timestamp_ns),
+              static_cast<ThermalLevel>(level - 1));
+  }
+  EXPECT_TRUE(governor->GetMitigation().hdrplus_zsl_enabled);
+}
+
+TEST(ThermalGovernorTests, Hysteresis) {
+  ThermalGovernorConfig config;
+  config.prediction_horizon_ns = 0;
+  auto governor = ThermalGovernor::Create(config);
+  ASSERT_NE(governor, nullptr);
+
+  float light_temperature = config.level_temperatures[0];
+  int64_t timestamp_ns = 0;
+  governor->OnTemperature(
+      GetTemperature(light_temperature, ThrottlingSeverity::kNone),
+      timestamp_ns);
+  ASSERT_EQ(governor->GetLevel(), ThermalLevel::kLight);
+
+  // Within the hysteresis, the level is held.
+  timestamp_ns += config.min_step_down_interval_ns;
+  governor->OnTemperature(
+      GetTemperature(light_temperature - config.hysteresis / 2,
+                     ThrottlingSeverity::kNone),
+      timestamp_ns);
+  EXPECT_EQ(governor->GetLevel(), ThermalLevel::kLight);
+
+  timestamp_ns += config.min_step_down_interval_ns;
+  governor->OnTemperature(
+      GetTemperature(light_temperature - config.hysteresis * 2,
+                     ThrottlingSeverity::kNone),
+      timestamp_ns);
+  EXPECT_EQ(governor->GetLevel(), ThermalLevel::kNone);
+}
+
+TEST(ThermalGovernorTests, PredictionActsBeforeThrottling) {
+  auto governor = ThermalGovernor::Create();
+  ASSERT_NE(governor, nullptr);
+  SimulatedThermalFeed feed;
+  feed.SetPower(GetRecordingPower(ThermalLevel::kNone) * 2);
+
+  // Heat up without mitigation and record when each one reaches kSevere.
+  int64_t governor_severe_ns = -1;
+  int64_t feed_severe_ns = -1;
+  while (feed_severe_ns < 0 && feed.GetTimestampNs() < 3600 * kNsPerSec) {
+    Temperature temperature = feed.Advance(kNsPerSec);
+    ThermalLevel level =
+        governor->OnTemperature(temperature, feed.GetTimestampNs());
+    if (governor_severe_ns < 0 && level == ThermalLevel::kSevere) {
+      governor_severe_ns = feed.GetTimestampNs();
+    }
+    if (temperature.throttling_status >= ThrottlingSeverity::kSevere) {
+      feed_severe_ns = feed.GetTimestampNs();
+    }
+  }
+
+  ASSERT_GE(feed_severe_ns, 0) << "The simulated feed never got severe.";
+  ASSERT_GE(governor_severe_ns, 0);
+  EXPECT_LT(governor_severe_ns, feed_severe_ns);
+
+  float predicted = 0.0f;
+  ASSERT_TRUE(governor->GetPredictedTemperature(&predicted));
+  EXPECT_GT(predicted, feed.Advance(0).value);
+}
+
+TEST(ThermalGovernorTests, Reversible) {
+  auto governor = ThermalGovernor::Create();
+  ASSERT_NE(governor, nullptr);
+  SimulatedThermalFeed feed;
+
+  feed.SetPower(GetRecordingPower(ThermalLevel::kNone) * 2);
+  while (governor->GetLevel() != ThermalLevel::kSevere &&
+         feed.GetTimestampNs() < 3600 * kNsPerSec) {
+    governor->OnTemperature(feed.Advance(kNsPerSec), feed.GetTimestampNs());
+  }
+  ASSERT_EQ(governor->GetLevel(), ThermalLevel::kSevere);
+
+  // Once the power drops, the device cools down and quality is restored.
+  feed.SetPower(0.0f);
+  int64_t end_ns = feed.GetTimestampNs() + 3600 * kNsPerSec;
+  while (governor->GetLevel() != ThermalLevel::kNone &&
+         feed.GetTimestampNs() < end_ns) {
+    governor->OnTemperature(feed.Advance(kNsPerSec), feed.GetTimestampNs());
+  }
+  EXPECT_EQ(governor->GetLevel(), ThermalLevel::kNone);
+  EXPECT_TRUE(governor->GetMitigation().hdrplus_zsl_enabled);
+  EXPECT_EQ(governor->GetMitigation().max_preview_fps, 0);
+}
+
+// Simulate a sustained 30-minute recording and compare the time spent at
+// kSevere or above with and without the governor lowering the power.
+TEST(ThermalGovernorTests, SustainedRecordingBenchmark) {
+  static constexpr int64_t kRecordingNs = 1800 * kNsPerSec;
+  static constexpr int64_t kSampleIntervalNs = kNsPerSec;
+
+  SimulatedThermalFeedConfig feed_config;
+  feed_config.thermal_resistance = 5.0f;
+
+  auto run = [&](bool governed) {
+    auto governor = ThermalGovernor::Create();
+    SimulatedThermalFeed feed(feed_config);
+    int64_t severe_ns = 0;
+    int64_t level_ns[kNumThermalLevels] = {};
+    float max_temperature = 0.0f;
+    while (feed.GetTimestampNs() < kRecordingNs) {
+      ThermalLevel level =
+          governed ? governor->GetLevel() : ThermalLevel::kNone;
+      feed.SetPower(GetRecordingPower(level));
+      Temperature temperature = feed.Advance(kSampleIntervalNs);
+      governor->OnTemperature(temperature, feed.GetTimestampNs());
+      if (temperature.throttling_status >= ThrottlingSeverity::kSevere) {
+        severe_ns += kSampleIntervalNs;
+      }
+      level_ns[static_cast<size_t>(level)] += kSampleIntervalNs;
+      max_temperature = std::max(max_temperature, temperature.value);
+    }
+    ALOGI("%s: governed %d, severe %lld s, max %f C, "
+          "levels %lld/%lld/%lld/%lld s",
+          __FUNCTION__, governed, (long long)(severe_ns / kNsPerSec),
+          max_temperature, (long long)(level_ns[0] / kNsPerSec),
+          (long long)(level_ns[1] / kNsPerSec),
+          (long long)(level_ns[2] / kNsPerSec),
+          (long long)(level_ns[3] / kNsPerSec));
+    return severe_ns;
+  };
+
+  int64_t ungoverned_severe_ns = run(/*governed=*/false);
+  int64_t governed_severe_ns = run(/*governed=*/true);
+  EXPECT_GT(ungoverned_severe_ns, 0);
+  EXPECT_LT(governed_severe_ns, ungoverned_severe_ns);
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ZoomRatioMapperTests"
+#include <log/log.h>
+
+#include <gtest/gtest.h>
+#include <hal_types.h>
+#include <utils.h>
+#include <zoom_ratio_mapper.h>
+
+#include <chrono>
+
+namespace android {
+namespace google_camera_hal {
+
+static constexpr uint32_t kCameraId = 0;
+static constexpr Dimension kActiveArrayDimension = {.width = 4000,
+                                                    .height = 3000};
+static constexpr float kZoomRatio = 2.0f;
+static constexpr uint32_t kNumFaces = 12;
+// Left eye, right eye and mouth of each face.
+static constexpr uint32_t kNumLandmarksPerFace = 3;
+
+static void InitializeMapper(ZoomRatioMapper* mapper) {
+  ZoomRatioMapper::InitParams params = {
+      .active_array_dimension = kActiveArrayDimension,
+      .active_array_maximum_resolution_dimension = kActiveArrayDimension,
+      .zoom_ratio_range = {.min = 1.0f, .max = 8.0f},
+      .camera_id = kCameraId,
+  };
+  mapper->Initialize(&params);
+}
+
+static std::vector<int32_t> GetLandmarks() {
+  std::vector<int32_t> landmarks;
+  for (uint32_t i = 0; i < kNumFaces * kNumLandmarksPerFace; i++) {
+    landmarks.push_back(1000 + i * 37);  // x
+    landmarks.push_back(800 + i * 29);   // y
+  }
+  return landmarks;
+}
+
+static std::unique_ptr<CaptureResult> GetFaceResult(
+    const std::vector<int32_t>& landmarks, const int32_t (&crop_region)[4],
+    float zoom_ratio = kZoomRatio) {
+  auto result = std::make_unique<CaptureResult>();
+  result->result_metadata =
+      HalCameraMetadata::Create(/*num_entries=*/4, /*data_bytes=*/1024);
+  EXPECT_EQ(result->result_metadata->Set(ANDROID_CONTROL_ZOOM_RATIO,
+                                         &zoom_ratio, 1),
+            OK);
+  EXPECT_EQ(result->result_metadata->Set(ANDROID_SCALER_CROP_REGION,
+                                         crop_region, 4),
+            OK);
+  EXPECT_EQ(result->result_metadata->Set(ANDROID_STATISTICS_FACE_LANDMARKS,
+                                         landmarks.data(), landmarks.size()),
+            OK);
+  return result;
+}
+
+TEST(ZoomRatioMapperTests, UpdateCaptureResultFaces) {
+  ZoomRatioMapper mapper;
+  InitializeMapper(&mapper);
+
+  std::vector<int32_t> landmarks = GetLandmarks();
+  const int32_t kCropRegion[4] = {1000, 750, 2000, 1500};
+
+  std::vector<int32_t> expected_landmarks = landmarks;
+  for (size_t i = 0; i < expected_landmarks.size(); i += 2) {
+    utils::RevertZoomRatio(kZoomRatio, kActiveArrayDimension,
+                           /*round_to_int=*/true, &expected_landmarks[i],
+                           &expected_landmarks[i + 1]);
+  }
+  int32_t expected_crop_region[4] = {kCropRegion[0], kCropRegion[1],
+                                     kCropRegion[2], kCropRegion[3]};
+  utils::RevertZoomRatio(kZoomRatio, kActiveArrayDimension,
+                         /*round_to_int=*/true, &expected_crop_region[0],
+                         &expected_crop_region[1], &expected_crop_region[2],
+                         &expected_crop_region[3]);
+
+  // The same faces in consecutive frames are transformed the same way.
+  for (uint32_t frame = 0; frame < 2; frame++) {
+    auto result = GetFaceResult(landmarks, kCropRegion);
+    mapper.UpdateCaptureResult(result.get());
+
+    camera_metadata_ro_entry entry = {};
+    ASSERT_EQ(result->result_metadata->Get(ANDROID_STATISTICS_FACE_LANDMARKS,
+                                           &entry),
+              OK);
+    ASSERT_EQ(entry.count, expected_landmarks.size());
+    for (size_t i = 0; i < entry.count; i++) {
+      EXPECT_EQ(entry.data.i32[i], expected_landmarks[i])
+          << "Frame " << frame << " landmark " << i;
+    }
+
+    ASSERT_EQ(
+        result->result_metadata->Get(ANDROID_SCALER_CROP_REGION, &entry), OK);
+    ASSERT_EQ(entry.count, 4u);
+    for (size_t i = 0; i < entry.count; i++) {
+      EXPECT_EQ(entry.data.i32[i], expected_crop_region[i]);
+    }
+  }
+
+  // A moved face is transformed from its new landmarks.
+  landmarks[0] += 100;
+  expected_landmarks[0] = landmarks[0];
+  expected_landmarks[1] = landmarks[1];
+  utils::RevertZoomRatio(kZoomRatio, kActiveArrayDimension,
+                         /*round_to_int=*/true, &expected_landmarks[0],
+                         &expected_landmarks[1]);
+  auto result = GetFaceResult(landmarks, kCropRegion);
+  mapper.UpdateCaptureResult(result.get());
+  camera_metadata_ro_entry entry = {};
+  ASSERT_EQ(
+      result->result_metadata->Get(ANDROID_STATISTICS_FACE_LANDMARKS, &entry),
+      OK);
+  EXPECT_EQ(entry.data.i32[0], expected_landmarks[0]);
+  EXPECT_EQ(entry.data.i32[1], expected_landmarks[1]);
+}
+
+TEST(ZoomRatioMapperTests, UpdateCaptureResultZoomChange) {
+  ZoomRatioMapper mapper;
+  InitializeMapper(&mapper);
+
+  std::vector<int32_t> landmarks = GetLandmarks();
+  const int32_t kCropRegion[4] = {1000, 750, 2000, 1500};
+
+  // The same faces at another zoom ratio must not reuse the landmarks
+  // converted for the previous zoom ratio.
+  for (float zoom_ratio : {kZoomRatio, 2 * kZoomRatio}) {
+    auto result = GetFaceResult(landmarks, kCropRegion, zoom_ratio);
+    mapper.UpdateCaptureResult(result.get());
+
+    int32_t expected_x = landmarks[0];
+    int32_t expected_y = landmarks[1];
+    utils::RevertZoomRatio(zoom_ratio, kActiveArrayDimension,
+                           /*round_to_int=*/true, &expected_x, &expected_y);
+    camera_metadata_ro_entry entry = {};
+    ASSERT_EQ(result->result_metadata->Get(ANDROID_STATISTICS_FACE_LANDMARKS,
+                                           &entry),
+              OK);
+    EXPECT_EQ(entry.data.i32[0], expected_x) << "Zoom ratio " << zoom_ratio;
+    EXPECT_EQ(entry.data.i32[1], expected_y) << "Zoom ratio " << zoom_ratio;
+  }
+}
+
+// Measure the conversion of results with kNumFaces faces when the faces stay
+// in place, so converted landmarks are reused, and when they move in every
+// frame. Only logs the results since timing depends on the device.
+TEST(ZoomRatioMapperTests, FaceResultBenchmark) {
+  static constexpr uint32_t kNumFrames = 2000;
+  const int32_t kCropRegion[4] = {1000, 750, 2000, 1500};
+
+  for (bool moving_faces : {false, true}) {
+    ZoomRatioMapper mapper;
+    InitializeMapper(&mapper);
+
+    std::vector<std::unique_ptr<CaptureResult>> results;
+    std::vector<int32_t> landmarks = GetLandmarks();
+    for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+      if (moving_faces) {
+        for (auto& coordinate : landmarks) {
+          coordinate += (frame % 2 == 0) ? 1 : -1;
+        }
+      }
+      results.push_back(GetFaceResult(landmarks, kCropRegion));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& result : results) {
+      mapper.UpdateCaptureResult(result.get());
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    ALOGI("%s: %u faces, %s: %.1f ns/result", __FUNCTION__, kNumFaces,
+          moving_faces ? "moving" : "static",
+          static_cast<double>(duration.count()) / kNumFrames);
+  }
+}
+
+TEST(ZoomRatioMapperTests, UpdateCaptureRequestRegions) {
+  ZoomRatioMapper mapper;
+  InitializeMapper(&mapper);
+
+  CaptureRequest request;
+  request.settings =
+      HalCameraMetadata::Create(/*num_entries=*/4, /*data_bytes=*/256);
+  float zoom_ratio = kZoomRatio;
+  ASSERT_EQ(request.settings->Set(ANDROID_CONTROL_ZOOM_RATIO, &zoom_ratio, 1),
+            OK);
+  const int32_t kAeRegions[] = {0,    0,    3999, 2999, 1,
+                                1000, 1000, 1999, 1999, 2};
+  ASSERT_EQ(request.settings->Set(ANDROID_CONTROL_AE_REGIONS, kAeRegions,
+                                  sizeof(kAeRegions) / sizeof(int32_t)),
+            OK);
+
+  mapper.UpdateCaptureRequest(&request);
+
+  camera_metadata_ro_entry entry = {};
+  ASSERT_EQ(request.settings->Get(ANDROID_CONTROL_AE_REGIONS, &entry), OK);
+  ASSERT_EQ(entry.count, sizeof(kAeRegions) / sizeof(int32_t));
+  for (size_t i = 0; i < entry.count; i += 5) {
+    int32_t left = kAeRegions[i];
+    int32_t top = kAeRegions[i + 1];
+    int32_t width = kAeRegions[i + 2] - left + 1;
+    int32_t height = kAeRegions[i + 3] - top + 1;
+    utils::ConvertZoomRatio(kZoomRatio, kActiveArrayDimension, &left, &top,
+                            &width, &height);
+    EXPECT_EQ(entry.data.i32[i], left);
+    EXPECT_EQ(entry.data.i32[i + 1], top);
+    EXPECT_EQ(entry.data.i32[i + 2], left + width - 1);
+    EXPECT_EQ(entry.data.i32[i + 3], top + height - 1);
+    EXPECT_EQ(entry.data.i32[i + 4], kAeRegions[i + 4]);
+  }
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
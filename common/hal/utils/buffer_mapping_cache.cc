@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "GCH_BufferMappingCache"
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#include <log/log.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <utils/Trace.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "buffer_mapping_cache.h"
+
+namespace android {
+namespace google_camera_hal {
+
+std::unique_ptr<BufferMappingCache> BufferMappingCache::Create(
+    size_t max_cached_mappings) {
+  ATRACE_CALL();
+  auto cache = std::unique_ptr<BufferMappingCache>(
+      new BufferMappingCache(max_cached_mappings));
+  if (cache == nullptr) {
+    ALOGE("%s: Creating BufferMappingCache failed.", __FUNCTION__);
+    return nullptr;
+  }
+
+  return cache;
+}
+
+BufferMappingCache::BufferMappingCache(size_t max_cached_mappings)
+    : max_cached_mappings_(max_cached_mappings) {
+}
+
+BufferMappingCache::~BufferMappingCache() {
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  for (auto& [key, mapping] : mappings_) {
+    if (mapping.ref_count > 0) {
+      ALOGW("%s: Buffer mapping %p is still in use.", __FUNCTION__,
+            mapping.addr);
+    }
+    munmap(mapping.addr, mapping.size);
+  }
+
+  for (auto& [addr, size_ref_count] : uncached_mappings_) {
+    munmap(addr, size_ref_count.first);
+  }
+}
+
+status_t BufferMappingCache::Map(int fd, size_t size, uint8_t** addr) {
+  ATRACE_CALL();
+  if (fd < 0 || size == 0 || addr == nullptr) {
+    ALOGE("%s: Invalid fd %d, size %zu or addr %p", __FUNCTION__, fd, size,
+          addr);
+    return BAD_VALUE;
+  }
+
+  struct stat buffer_stat = {};
+  bool cacheable = (fstat(fd, &buffer_stat) == 0);
+  MappingKey key(buffer_stat.st_dev, buffer_stat.st_ino, size);
+
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  if (cacheable) {
+    auto mapping_it = mappings_.find(key);
+    if (mapping_it != mappings_.end()) {
+      Mapping& mapping = mapping_it->second;
+      if (mapping.ref_count == 0) {
+        idle_mappings_.erase(mapping.idle_it);
+      }
+      mapping.ref_count++;
+      *addr = mapping.addr;
+      return OK;
+    }
+  }
+
+  void* virtual_addr =
+      mmap(nullptr, size, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+  if (virtual_addr == MAP_FAILED) {
+    ALOGE("%s: Failed to map fd %d: %s", __FUNCTION__, fd, strerror(errno));
+    return UNKNOWN_ERROR;
+  }
+  map_count_++;
+
+  uint8_t* mapped_addr = reinterpret_cast<uint8_t*>(virtual_addr);
+  if (!cacheable) {
+    ALOGW("%s: Failed to get identity of fd %d. Mapping is not cached.",
+          __FUNCTION__, fd);
+    uncached_mappings_[mapped_addr] = {size, 1};
+  } else {
+    Mapping& mapping = mappings_[key];
+    mapping.addr = mapped_addr;
+    mapping.size = size;
+    mapping.ref_count = 1;
+    mapped_addrs_[mapped_addr] = key;
+  }
+
+  *addr = mapped_addr;
+  return OK;
+}
+
+status_t BufferMappingCache::Unmap(uint8_t* addr, bool keep_mapping) {
+  ATRACE_CALL();
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  auto uncached_it = uncached_mappings_.find(addr);
+  if (uncached_it != uncached_mappings_.end()) {
+    auto& [size, ref_count] = uncached_it->second;
+    if (--ref_count == 0) {
+      munmap(addr, size);
+      uncached_mappings_.erase(uncached_it);
+    }
+    return OK;
+  }
+
+  auto addr_it = mapped_addrs_.find(addr);
+  if (addr_it == mapped_addrs_.end()) {
+    ALOGE("%s: Address %p is not mapped.", __FUNCTION__, addr);
+    return BAD_VALUE;
+  }
+
+  auto mapping_it = mappings_.find(addr_it->second);
+  if (mapping_it == mappings_.end() || mapping_it->second.ref_count == 0) {
+    ALOGE("%s: Address %p is not in use.", __FUNCTION__, addr);
+    return BAD_VALUE;
+  }
+
+  Mapping& mapping = mapping_it->second;
+  if (--mapping.ref_count > 0) {
+    return OK;
+  }
+
+  if (!keep_mapping) {
+    ALOGV("%s: Unmapping %p", __FUNCTION__, addr);
+    munmap(mapping.addr, mapping.size);
+    mappings_.erase(mapping_it);
+    mapped_addrs_.erase(addr_it);
+    return OK;
+  }
+
+  mapping.idle_it =
+      idle_mappings_.insert(idle_mappings_.end(), addr_it->second);
+  EvictIdleMappingsLocked(max_cached_mappings_);
+  return OK;
+}
+
+void BufferMappingCache::SetMaxCachedMappings(size_t max_cached_mappings) {
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  max_cached_mappings_ = max_cached_mappings;
+  EvictIdleMappingsLocked(max_cached_mappings_);
+}
+
+void BufferMappingCache::Invalidate() {
+  ATRACE_CALL();
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  EvictIdleMappingsLocked(/*max_cached_mappings=*/0);
+
+  // Remaining mappings are in use. Unmap them when they are released.
+  for (auto& [key, mapping] : mappings_) {
+    uncached_mappings_[mapping.addr] = {mapping.size, mapping.ref_count};
+  }
+  mappings_.clear();
+  mapped_addrs_.clear();
+}
+
+uint64_t BufferMappingCache::GetMapCount() const {
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  return map_count_;
+}
+
+size_t BufferMappingCache::GetMappingCount() const {
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  return mappings_.size() + uncached_mappings_.size();
+}
+
+size_t BufferMappingCache::GetIdleMappingCount() const {
+  std::lock_guard<std::mutex> lock(mapping_lock_);
+  return idle_mappings_.size();
+}
+
+void BufferMappingCache::EvictIdleMappingsLocked(size_t max_cached_mappings) {
+  while (idle_mappings_.size() > max_cached_mappings) {
+    auto mapping_it = mappings_.find(idle_mappings_.front());
+    idle_mappings_.pop_front();
+    if (mapping_it == mappings_.end()) {
+      continue;
+    }
+
+    ALOGV("%s: Unmapping %p", __FUNCTION__, mapping_it->second.addr);
+    munmap(mapping_it->second.addr, mapping_it->second.size);
+    mapped_addrs_.erase(mapping_it->second.addr);
+    mappings_.erase(mapping_it);
+  }
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
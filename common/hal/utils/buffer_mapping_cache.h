@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_GOOGLE_CAMERA_HAL_UTILS_BUFFER_MAPPING_CACHE_H_
+#define HARDWARE_GOOGLE_CAMERA_HAL_UTILS_BUFFER_MAPPING_CACHE_H_
+
+#include <sys/types.h>
+#include <utils/Errors.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+
+namespace android {
+namespace google_camera_hal {
+
+// BufferMappingCache keeps CPU mappings of buffer fds alive across requests so
+// a buffer that is used repeatedly is only mmap'ed once. Mappings are keyed by
+// the identity of the underlying buffer (device and inode of the fd, e.g. a
+// dmabuf) rather than by fd number, so a buffer imported several times maps
+// to the same entry. Mappings that are not in use are evicted in LRU order
+// when the cache holds more than max_cached_mappings idle mappings, which
+// should be set to the number of buffers whose mappings are worth reusing.
+// BufferMappingCache is thread-safe.
+class BufferMappingCache {
+ public:
+  static constexpr size_t kDefaultMaxCachedMappings = 64;
+
+  // Creates a BufferMappingCache that keeps up to max_cached_mappings idle
+  // mappings.
+  static std::unique_ptr<BufferMappingCache> Create(
+      size_t max_cached_mappings = kDefaultMaxCachedMappings);
+
+  // Unmaps all mappings. Mapped addresses must not be used afterwards.
+  virtual ~BufferMappingCache();
+
+  // Map size bytes of fd for reading and writing, reusing a cached mapping of
+  // the same buffer if there is one. Every successful Map() must be paired
+  // with a Unmap() of the returned address.
+  status_t Map(int fd, size_t size, uint8_t** addr);
+
+  // Release a mapping returned by Map(). If keep_mapping is true, the mapping
+  // stays cached until it is evicted or invalidated. Otherwise it is unmapped
+  // once it is no longer in use, e.g. for buffers owned by the framework that
+  // may be freed after they are returned.
+  status_t Unmap(uint8_t* addr, bool keep_mapping = true);
+
+  // Set the number of idle mappings to keep and evict idle mappings beyond
+  // it.
+  void SetMaxCachedMappings(size_t max_cached_mappings);
+
+  // Drop all cached mappings, e.g. when streams are reconfigured or flushed.
+  // Mappings still in use are unmapped when they are released.
+  void Invalidate();
+
+  // Return the number of mmap calls made so far.
+  uint64_t GetMapCount() const;
+
+  // Return the number of mappings currently held, in use or idle.
+  size_t GetMappingCount() const;
+
+  // Return the number of idle mappings currently held.
+  size_t GetIdleMappingCount() const;
+
+ protected:
+  BufferMappingCache(size_t max_cached_mappings);
+
+ private:
+  // Identity of a mapping: device and inode of the buffer and mapping size.
+  using MappingKey = std::tuple<dev_t, ino_t, size_t>;
+
+  struct Mapping {
+    uint8_t* addr = nullptr;
+    size_t size = 0;
+    // Number of outstanding Map() calls that have not been released.
+    uint32_t ref_count = 0;
+    // Position in idle_mappings_ when ref_count is 0.
+    std::list<MappingKey>::iterator idle_it;
+  };
+
+  // Unmap idle mappings until at most max_cached_mappings remain.
+  // mapping_lock_ must be locked.
+  void EvictIdleMappingsLocked(size_t max_cached_mappings);
+
+  mutable std::mutex mapping_lock_;
+
+  // Maximum number of idle mappings. Must be protected by mapping_lock_.
+  size_t max_cached_mappings_ = 0;
+
+  // Cached mappings. Must be protected by mapping_lock_.
+  std::map<MappingKey, Mapping> mappings_;
+
+  // Keys of the mappings whose ref_count is 0, least recently used first.
+  // Must be protected by mapping_lock_.
+  std::list<MappingKey> idle_mappings_;
+
+  // Map from a mapped address to its key in mappings_. Must be protected by
+  // mapping_lock_.
+  std::unordered_map<uint8_t*, MappingKey> mapped_addrs_;
+
+  // Mappings dropped by Invalidate() while in use or that could not be keyed,
+  // indexed by address with their size and ref count. Must be protected by
+  // mapping_lock_.
+  std::unordered_map<uint8_t*, std::pair<size_t, uint32_t>> uncached_mappings_;
+
+  // Number of mmap calls. Must be protected by mapping_lock_.
+  uint64_t map_count_ = 0;
+};
+
+}  // namespace google_camera_hal
+}  // namespace android
+
+#endif  // HARDWARE_GOOGLE_CAMERA_HAL_UTILS_BUFFER_MAPPING_CACHE_H_
@@ -58,6 +58,59 @@ status_t CreateHwlPipelineRequest(HwlPipelineRequest* hwl_request,
   return OK;
 }
 
+status_t CreateHwlPipelineRequest(HwlPipelineRequest* hwl_request,
+                                  uint32_t pipeline_id,
+                                  CaptureRequest&& request) {
+  if (hwl_request == nullptr) {
+    ALOGE("%s: hwl_request is nullptr", __FUNCTION__);
+    return BAD_VALUE;
+  }
+
+  hwl_request->pipeline_id = pipeline_id;
+  hwl_request->settings = std::move(request.settings);
+  hwl_request->input_buffers = std::move(request.input_buffers);
+  hwl_request->output_buffers = std::move(request.output_buffers);
+  hwl_request->input_width = request.input_width;
+  hwl_request->input_height = request.input_height;
+  hwl_request->input_buffer_metadata = std::move(request.input_buffer_metadata);
+  hwl_request->physical_camera_settings =
+      std::move(request.physical_camera_settings);
+
+  return OK;
+}
+
+status_t CreateHwlPipelineRequests(
+    std::vector<HwlPipelineRequest>* hwl_requests,
+    const std::vector<uint32_t>& pipeline_ids,
+    std::vector<ProcessBlockRequest>&& requests) {
+  if (hwl_requests == nullptr) {
+    ALOGE("%s: hwl_requests is nullptr", __FUNCTION__);
+    return BAD_VALUE;
+  }
+
+  if (pipeline_ids.size() != requests.size()) {
+    ALOGE("%s: There are %zu pipeline IDs but %zu requests", __FUNCTION__,
+          pipeline_ids.size(), requests.size());
+    return BAD_VALUE;
+  }
+
+  hwl_requests->reserve(hwl_requests->size() + requests.size());
+  for (size_t i = 0; i < pipeline_ids.size(); i++) {
+    HwlPipelineRequest hwl_request;
+    status_t res = CreateHwlPipelineRequest(&hwl_request, pipeline_ids[i],
+                                            std::move(requests[i].request));
+    if (res != OK) {
+      ALOGE("%s: Creating a HWL pipeline request failed: %s(%d)", __FUNCTION__,
+            strerror(-res), res);
+      return res;
+    }
+
+    hwl_requests->push_back(std::move(hwl_request));
+  }
+
+  return OK;
+}
+
 status_t CreateHwlPipelineRequests(
     std::vector<HwlPipelineRequest>* hwl_requests,
     const std::vector<uint32_t>& pipeline_ids,
@@ -606,6 +659,24 @@ status_t RemoveLsInfoFromResult(HalCameraMetadata* metadata) {
   return OK;
 }
 
+status_t GetThermalMitigation(const HalCameraMetadata* settings,
+                              ThermalMitigation* mitigation) {
+  if (settings == nullptr || mitigation == nullptr) {
+    ALOGE("%s: settings or mitigation is nullptr", __FUNCTION__);
+    return BAD_VALUE;
+  }
+
+  camera_metadata_ro_entry entry = {};
+  if (settings->Get(VendorTagIds::kThermalThrottlingLevel, &entry) != OK ||
+      entry.count != 1) {
+    return NAME_NOT_FOUND;
+  }
+
+  *mitigation = ThermalGovernor::GetDefaultMitigation(
+      static_cast<ThermalLevel>(entry.data.u8[0]));
+  return OK;
+}
+
 status_t GetFdMode(const CaptureRequest& request, uint8_t* face_detect_mode) {
   if (request.settings == nullptr || face_detect_mode == nullptr) {
     ALOGE("%s: request.settings or face_detect_mode is nullptr", __FUNCTION__);
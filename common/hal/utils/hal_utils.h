@@ -20,6 +20,7 @@
 #include "hal_types.h"
 #include "hwl_types.h"
 #include "process_block.h"
+#include "thermal_governor.h"
 #include "utils.h"
 
 namespace android {
@@ -31,6 +32,12 @@ status_t CreateHwlPipelineRequest(HwlPipelineRequest* hwl_request,
                                   uint32_t pipeline_id,
                                   const CaptureRequest& request);
 
+// Create a HWL pipeline request for a pipeline by moving the settings and
+// metadata out of a capture request instead of cloning them.
+status_t CreateHwlPipelineRequest(HwlPipelineRequest* hwl_request,
+                                  uint32_t pipeline_id,
+                                  CaptureRequest&& request);
+
 // Create a vector of sychrounous HWL pipeline requests for pipelines
 // based on capture requests.
 // pipeline_ids and requests must have the same size.
@@ -40,6 +47,37 @@ status_t CreateHwlPipelineRequests(
     const std::vector<uint32_t>& pipeline_ids,
     const std::vector<ProcessBlockRequest>& requests);
 
+// Same as above but the settings and metadata are moved out of requests
+// instead of being cloned.
+status_t CreateHwlPipelineRequests(
+    std::vector<HwlPipelineRequest>* hwl_requests,
+    const std::vector<uint32_t>& pipeline_ids,
+    std::vector<ProcessBlockRequest>&& requests);
+
+// Create HWL pipeline requests for pipelines and submit them to a HWL device
+// session. The settings and metadata are moved out of requests if requests is
+// an rvalue and cloned otherwise. pipeline_ids and requests must have the same
+// size.
+template <typename ProcessBlockRequests>
+status_t SubmitHwlPipelineRequests(CameraDeviceSessionHwl* device_session_hwl,
+                                   const std::vector<uint32_t>& pipeline_ids,
+                                   ProcessBlockRequests&& requests) {
+  if (device_session_hwl == nullptr || requests.empty()) {
+    return BAD_VALUE;
+  }
+
+  uint32_t frame_number = requests[0].request.frame_number;
+  std::vector<HwlPipelineRequest> hwl_requests;
+  status_t res =
+      CreateHwlPipelineRequests(&hwl_requests, pipeline_ids,
+                                std::forward<ProcessBlockRequests>(requests));
+  if (res != OK) {
+    return res;
+  }
+
+  return device_session_hwl->SubmitRequests(frame_number, hwl_requests);
+}
+
 // Convert a HWL result to a capture result.
 std::unique_ptr<CaptureResult> ConvertToCaptureResult(
     std::unique_ptr<HwlPipelineResult> hwl_result);
@@ -100,6 +138,11 @@ status_t GetLensShadingMapMode(const CaptureRequest& request,
 // Remove lens shading information
 status_t RemoveLsInfoFromResult(HalCameraMetadata* metadata);
 
+// Get the quality settings of the thermal level in settings. Returns
+// NAME_NOT_FOUND if settings don't have a thermal level.
+status_t GetThermalMitigation(const HalCameraMetadata* settings,
+                              ThermalMitigation* mitigation);
+
 // Dump the information in the stream configuration
 void DumpStreamConfiguration(const StreamConfiguration& stream_configuration,
                              const std::string& title);
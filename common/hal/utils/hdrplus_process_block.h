@@ -50,6 +50,12 @@ class HdrplusProcessBlock : public ProcessBlock {
       const std::vector<ProcessBlockRequest>& process_block_requests,
       const CaptureRequest& remaining_session_request) override;
 
+  // Moves the payload buffers and metadata into the HWL request instead of
+  // copying them.
+  status_t ProcessOwnedRequests(
+      std::vector<ProcessBlockRequest> process_block_requests,
+      const CaptureRequest& remaining_session_request) override;
+
   status_t Flush() override;
   // Override functions of ProcessBlock end.
 
@@ -64,6 +70,18 @@ class HdrplusProcessBlock : public ProcessBlock {
   // If the process block supports the device session.
   static bool IsSupported(CameraDeviceSessionHwl* device_session_hwl);
 
+  // Shared implementation of ProcessRequests() and ProcessOwnedRequests().
+  // process_block_requests are moved into the HWL requests if they are an
+  // rvalue and cloned otherwise.
+  template <typename ProcessBlockRequests>
+  status_t DoProcessRequests(ProcessBlockRequests&& process_block_requests,
+                             const CaptureRequest& remaining_session_request);
+
+  // Check process_block_requests and forward them to the result processor.
+  status_t AddPendingRequests(
+      const std::vector<ProcessBlockRequest>& process_block_requests,
+      const CaptureRequest& remaining_session_request);
+
   // Invoked when the HWL pipeline sends a result.
   void NotifyHwlPipelineResult(std::unique_ptr<HwlPipelineResult> hwl_result);
 
@@ -20,6 +20,9 @@
 #include <log/log.h>
 #include <utils/Trace.h>
 
+#include <algorithm>
+
+#include "hal_utils.h"
 #include "hdrplus_request_processor.h"
 #include "vendor_tag_defs.h"
 
@@ -28,7 +31,7 @@ namespace google_camera_hal {
 
 std::unique_ptr<HdrplusRequestProcessor> HdrplusRequestProcessor::Create(
     CameraDeviceSessionHwl* device_session_hwl, int32_t raw_stream_id,
-    uint32_t physical_camera_id) {
+    uint32_t physical_camera_id, uint64_t max_pending_payload_bytes) {
   ATRACE_CALL();
   if (device_session_hwl == nullptr) {
     ALOGE("%s: device_session_hwl (%p) is nullptr", __FUNCTION__,
@@ -43,8 +46,8 @@ std::unique_ptr<HdrplusRequestProcessor> HdrplusRequestProcessor::Create(
     return nullptr;
   }
 
-  status_t res =
-      request_processor->Initialize(device_session_hwl, raw_stream_id);
+  status_t res = request_processor->Initialize(device_session_hwl, raw_stream_id,
+                                               max_pending_payload_bytes);
   if (res != OK) {
     ALOGE("%s: Initializing HdrplusRequestProcessor failed: %s (%d).",
           __FUNCTION__, strerror(-res), res);
@@ -55,7 +58,8 @@ std::unique_ptr<HdrplusRequestProcessor> HdrplusRequestProcessor::Create(
 }
 
 status_t HdrplusRequestProcessor::Initialize(
-    CameraDeviceSessionHwl* device_session_hwl, int32_t raw_stream_id) {
+    CameraDeviceSessionHwl* device_session_hwl, int32_t raw_stream_id,
+    uint64_t max_pending_payload_bytes) {
   ATRACE_CALL();
   std::unique_ptr<HalCameraMetadata> characteristics;
   status_t res = NO_INIT;
@@ -100,6 +104,8 @@ status_t HdrplusRequestProcessor::Initialize(
   ALOGI("%s: HDR+ payload_frames_: %d", __FUNCTION__, payload_frames_);
   raw_stream_id_ = raw_stream_id;
 
+  max_pending_payload_bytes_ = max_pending_payload_bytes;
+
   return OK;
 }
 
@@ -161,13 +167,34 @@ status_t HdrplusRequestProcessor::SetProcessBlock(
   return OK;
 }
 
-bool HdrplusRequestProcessor::IsReadyForNextRequest() {
+bool HdrplusRequestProcessor::IsReadyForNextRequestLocked() {
   ATRACE_CALL();
   if (internal_stream_manager_ == nullptr) {
     ALOGW("%s: internal_stream_manager_ nullptr", __FUNCTION__);
     return false;
   }
-  if (internal_stream_manager_->IsPendingBufferEmpty(raw_stream_id_) == false) {
+
+  // The raw buffers are allocated after the streams are configured, so the
+  // budget is converted to a number of captures on the first capture, from
+  // the format and dimension the buffers were allocated with.
+  if (max_pending_captures_ == 0) {
+    uint64_t payload_bytes =
+        internal_stream_manager_->GetStreamBufferBytes(raw_stream_id_) *
+        payload_frames_;
+    uint64_t max_pending_captures =
+        payload_bytes > 0 ? max_pending_payload_bytes_ / payload_bytes : 1;
+    max_pending_captures_ = static_cast<uint32_t>(std::clamp(
+        max_pending_captures, static_cast<uint64_t>(1),
+        static_cast<uint64_t>(kMaxPendingCaptures)));
+    ALOGI("%s: HDR+ max_pending_captures_: %u", __FUNCTION__,
+          max_pending_captures_);
+  }
+
+  uint32_t pending_captures =
+      internal_stream_manager_->GetPendingCaptureCount(raw_stream_id_);
+  if (pending_captures >= max_pending_captures_) {
+    ALOGD("%s: %u HDR+ captures are in flight.", __FUNCTION__,
+          pending_captures);
     return false;
   }
   return true;
@@ -202,18 +229,52 @@ void HdrplusRequestProcessor::RemoveJpegMetadata(
 
 status_t HdrplusRequestProcessor::ProcessRequest(const CaptureRequest& request) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(process_block_lock_);
-  if (process_block_ == nullptr) {
-    ALOGE("%s: Not configured yet.", __FUNCTION__);
-    return NO_INIT;
-  }
-
-  if (IsReadyForNextRequest() == false) {
-    return BAD_VALUE;
+  {
+    std::lock_guard<std::mutex> lock(process_block_lock_);
+    if (process_block_ == nullptr) {
+      ALOGE("%s: Not configured yet.", __FUNCTION__);
+      return NO_INIT;
+    }
   }
 
+  // Payload selection and metadata rewriting don't need the process block so
+  // they can overlap with other captures being submitted or flushed.
   CaptureRequest block_request;
   block_request.frame_number = request.frame_number;
+
+  // Use fewer ZSL frames while the device is thermally mitigated.
+  uint32_t payload_frames = payload_frames_;
+  ThermalMitigation mitigation;
+  if (request.settings != nullptr &&
+      hal_utils::GetThermalMitigation(request.settings.get(), &mitigation) ==
+          OK &&
+      mitigation.max_zsl_payload_frames > 0) {
+    payload_frames =
+        std::min(payload_frames, mitigation.max_zsl_payload_frames);
+  }
+
+  {
+    // Check the memory budget and take the payload under one lock so
+    // concurrent captures cannot exceed the budget.
+    std::lock_guard<std::mutex> lock(payload_lock_);
+    if (IsReadyForNextRequestLocked() == false) {
+      return BAD_VALUE;
+    }
+
+    // Get multiple raw buffer and metadata from internal stream as input
+    status_t result = internal_stream_manager_->GetCapturePayloadBuffers(
+        raw_stream_id_, request.frame_number, &(block_request.input_buffers),
+        &(block_request.input_buffer_metadata), payload_frames);
+    if (result != OK) {
+      ALOGE("%s: frame:%d GetCapturePayloadBuffers failed.", __FUNCTION__,
+            request.frame_number);
+      return UNKNOWN_ERROR;
+    }
+  }
+
+  // The session falls back to the realtime request processor with the same
+  // request if this one fails, so the settings are cloned rather than moved.
+  // Cloning after the budget check keeps rejected captures from paying it.
   block_request.settings = HalCameraMetadata::Clone(request.settings.get());
   block_request.output_buffers = request.output_buffers;
   for (auto& [camera_id, physical_metadata] : request.physical_camera_settings) {
@@ -221,23 +282,23 @@ status_t HdrplusRequestProcessor::ProcessRequest(const CaptureRequest& request)
         HalCameraMetadata::Clone(physical_metadata.get());
   }
 
-  // Get multiple raw buffer and metadata from internal stream as input
-  status_t result = internal_stream_manager_->GetMostRecentStreamBuffer(
-      raw_stream_id_, &(block_request.input_buffers),
-      &(block_request.input_buffer_metadata), payload_frames_);
-  if (result != OK) {
-    ALOGE("%s: frame:%d GetStreamBuffer failed.", __FUNCTION__,
-          request.frame_number);
-    return UNKNOWN_ERROR;
-  }
-
   RemoveJpegMetadata(&(block_request.input_buffer_metadata));
   std::vector<ProcessBlockRequest> block_requests(1);
   block_requests[0].request = std::move(block_request);
   ALOGD("%s: frame number %u is an HDR+ request.", __FUNCTION__,
         request.frame_number);
 
-  return process_block_->ProcessRequests(block_requests, request);
+  std::lock_guard<std::mutex> lock(process_block_lock_);
+  status_t result = process_block_->ProcessOwnedRequests(
+      std::move(block_requests), request);
+  if (result != OK) {
+    // The capture will fall back to the realtime pipeline, so release its
+    // payload for the next HDR+ capture.
+    internal_stream_manager_->ReturnCapturePayloadBuffers(request.frame_number,
+                                                          raw_stream_id_);
+  }
+
+  return result;
 }
 
 status_t HdrplusRequestProcessor::Flush() {
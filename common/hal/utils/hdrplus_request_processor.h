@@ -28,11 +28,18 @@ namespace google_camera_hal {
 // its ProcessBlock.
 class HdrplusRequestProcessor : public RequestProcessor {
  public:
+  // Default memory budget for the RAW payload buffers held by in-flight HDR+
+  // captures.
+  static constexpr uint64_t kDefaultMaxPendingPayloadBytes = 256 * 1024 * 1024;
+
   // device_session_hwl is owned by the caller and must be valid during the
   // lifetime of this HdrplusRequestProcessor.
+  // max_pending_payload_bytes caps the number of HDR+ captures that can be in
+  // flight at the same time. At least one capture is always allowed.
   static std::unique_ptr<HdrplusRequestProcessor> Create(
       CameraDeviceSessionHwl* device_session_hwl, int32_t raw_stream_id,
-      uint32_t physical_camera_id);
+      uint32_t physical_camera_id,
+      uint64_t max_pending_payload_bytes = kDefaultMaxPendingPayloadBytes);
 
   virtual ~HdrplusRequestProcessor() = default;
 
@@ -45,7 +52,8 @@ class HdrplusRequestProcessor : public RequestProcessor {
   status_t SetProcessBlock(std::unique_ptr<ProcessBlock> process_block) override;
 
   // Adds internal raw stream as input stream to request and forwards the
-  // request to its ProcessBlock.
+  // request to its ProcessBlock. Multiple HDR+ captures can be in flight as
+  // long as their payloads fit in the memory budget.
   status_t ProcessRequest(const CaptureRequest& request) override;
 
   status_t Flush() override;
@@ -56,12 +64,17 @@ class HdrplusRequestProcessor : public RequestProcessor {
       : kCameraId(physical_camera_id){};
 
  private:
+  // Maximum number of HDR+ captures in flight regardless of the memory budget.
+  static constexpr uint32_t kMaxPendingCaptures = 4;
+
   // Physical camera ID of request processor.
   const uint32_t kCameraId;
 
   status_t Initialize(CameraDeviceSessionHwl* device_session_hwl,
-                      int32_t raw_stream_id);
-  bool IsReadyForNextRequest();
+                      int32_t raw_stream_id, uint64_t max_pending_payload_bytes);
+  // Return if another capture can hold payload buffers. Must be called with
+  // payload_lock_ locked.
+  bool IsReadyForNextRequestLocked();
   // For CTS (android.hardware.camera2.cts.StillCaptureTest#testJpegExif)
   // Remove JPEG metadata (THUMBNAIL_SIZE, ORIENTATION...) from internal raw
   // buffer in order to get these metadata from HDR+ capture request directly
@@ -72,12 +85,22 @@ class HdrplusRequestProcessor : public RequestProcessor {
   // Protected by process_block_lock_.
   std::unique_ptr<ProcessBlock> process_block_;
 
+  // Serializes checking the number of captures holding payload buffers with
+  // taking the payload buffers of a new capture.
+  std::mutex payload_lock_;
+
   InternalStreamManager* internal_stream_manager_;
   int32_t raw_stream_id_ = -1;
   uint32_t active_array_width_ = 0;
   uint32_t active_array_height_ = 0;
   // The number of HDR+ input buffers
   uint32_t payload_frames_ = 0;
+  // Memory budget for the payload buffers of in-flight HDR+ captures.
+  uint64_t max_pending_payload_bytes_ = kDefaultMaxPendingPayloadBytes;
+  // The number of HDR+ captures that can hold payload buffers at the same
+  // time, or 0 if it has not been derived from the budget yet. Must be
+  // protected by payload_lock_.
+  uint32_t max_pending_captures_ = 0;
 };
 
 }  // namespace google_camera_hal
@@ -91,18 +91,20 @@ void HdrplusResultProcessor::ProcessResult(ProcessBlockResult block_result) {
     return;
   }
 
-  // Return raw buffer to internal stream manager and remove it from result
+  // Return raw buffers held by this capture to internal stream manager and
+  // remove them from result. Other HDR+ captures may still be in flight.
   status_t res;
   if (result->output_buffers.size() != 0 &&
-      internal_stream_manager_->IsPendingBufferEmpty(raw_stream_id_) == false) {
-    res = internal_stream_manager_->ReturnZslStreamBuffers(result->frame_number,
-                                                           raw_stream_id_);
+      internal_stream_manager_->HasPendingCapturePayload(
+          raw_stream_id_, result->frame_number)) {
+    res = internal_stream_manager_->ReturnCapturePayloadBuffers(
+        result->frame_number, raw_stream_id_);
     if (res != OK) {
-      ALOGE("%s: (%d)ReturnZslStreamBuffers fail", __FUNCTION__,
+      ALOGE("%s: (%d)ReturnCapturePayloadBuffers fail", __FUNCTION__,
             result->frame_number);
       return;
     } else {
-      ALOGI("%s: (%d)ReturnZslStreamBuffers ok", __FUNCTION__,
+      ALOGI("%s: (%d)ReturnCapturePayloadBuffers ok", __FUNCTION__,
             result->frame_number);
     }
     result->input_buffers.clear();
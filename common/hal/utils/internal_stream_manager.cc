@@ -15,6 +15,7 @@
  */
 
 //#define LOG_NDEBUG 0
+#include <cinttypes>
 #include <cstdint>
 #define LOG_TAG "GCH_InternalStreamManager"
 #define ATRACE_TAG ATRACE_TAG_CAMERA
@@ -250,6 +251,110 @@ bool InternalStreamManager::CanHalStreamsShareBuffersLocked(
   return true;
 }
 
+uint64_t InternalStreamManager::GetEstimatedBufferBytes(
+    uint32_t width, uint32_t height, android_pixel_format_t format) {
+  uint64_t num_pixels = static_cast<uint64_t>(width) * height;
+  switch (format) {
+    case HAL_PIXEL_FORMAT_Y8:
+      return num_pixels;
+    case HAL_PIXEL_FORMAT_RAW10:
+      return num_pixels * 10 / 8;
+    case HAL_PIXEL_FORMAT_RAW12:
+    case HAL_PIXEL_FORMAT_YCbCr_420_888:
+    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+    case HAL_PIXEL_FORMAT_YV12:
+      return num_pixels * 12 / 8;
+    case HAL_PIXEL_FORMAT_RAW16:
+    case HAL_PIXEL_FORMAT_Y16:
+      return num_pixels * 2;
+    case HAL_PIXEL_FORMAT_RGB_888:
+    case HAL_PIXEL_FORMAT_YCBCR_P010:
+      return num_pixels * 3;
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+      return num_pixels * 4;
+    default:
+      // The size of implementation defined, opaque and blob buffers cannot be
+      // derived from the dimension.
+      return 0;
+  }
+}
+
+uint64_t InternalStreamManager::GetSizeClass(uint64_t buffer_bytes) {
+  if (buffer_bytes == 0) {
+    return 0;
+  }
+
+  uint64_t aligned_bytes =
+      (buffer_bytes + kSizeClassAlignmentBytes - 1) / kSizeClassAlignmentBytes *
+      kSizeClassAlignmentBytes;
+
+  // Round up to the next of kSizeClassStepsPerOctave steps between the
+  // previous and the next power of two.
+  uint64_t octave = 1ull << (63 - __builtin_clzll(aligned_bytes));
+  uint64_t step = std::max(octave / kSizeClassStepsPerOctave,
+                           kSizeClassAlignmentBytes);
+  return (aligned_bytes + step - 1) / step * step;
+}
+
+bool InternalStreamManager::AreStreamsSizeClassCompatible(
+    const Stream& stream_0, const HalStream& hal_stream_0,
+    const Stream& stream_1, const HalStream& hal_stream_1) const {
+  uint64_t size_class_0 = GetSizeClass(GetEstimatedBufferBytes(
+      stream_0.width, stream_0.height, hal_stream_0.override_format));
+  uint64_t size_class_1 = GetSizeClass(GetEstimatedBufferBytes(
+      stream_1.width, stream_1.height, hal_stream_1.override_format));
+
+  return size_class_0 != 0 && size_class_0 == size_class_1 &&
+         hal_stream_0.override_format == hal_stream_1.override_format &&
+         stream_0.data_space == stream_1.data_space &&
+         hal_stream_0.producer_usage == hal_stream_1.producer_usage &&
+         hal_stream_0.consumer_usage == hal_stream_1.consumer_usage;
+}
+
+status_t InternalStreamManager::AllocateSharedBuffersLocked(
+    const std::vector<HalStream>& hal_streams, uint32_t owner_index,
+    uint32_t additional_num_buffers, bool need_vendor_buffer) {
+  if (owner_index >= hal_streams.size()) {
+    ALOGE("%s: Owner index %u is out of range (%zu streams).", __FUNCTION__,
+          owner_index, hal_streams.size());
+    return BAD_VALUE;
+  }
+
+  uint32_t max_buffers = 0;
+  uint32_t total_max_buffers = 0;
+
+  // Find the maximum and total of all hal_streams' max_buffers.
+  for (auto& hal_stream : hal_streams) {
+    total_max_buffers += hal_stream.max_buffers;
+    max_buffers = std::max(max_buffers, hal_stream.max_buffers);
+  }
+
+  // Allocate the maximum of all hal_streams' max_buffers immediately and
+  // additional (total_max_buffers + additional_num_buffers - max_buffers)
+  // buffers.
+  HalStream hal_stream = hal_streams[owner_index];
+  hal_stream.max_buffers = max_buffers;
+  uint32_t total_additional_num_buffers =
+      total_max_buffers + additional_num_buffers - max_buffers;
+
+  status_t res = AllocateBuffersLocked(hal_stream, total_additional_num_buffers,
+                                       need_vendor_buffer);
+  if (res != OK) {
+    ALOGE("%s: Allocating buffers for stream %d failed: %s(%d)", __FUNCTION__,
+          hal_stream.id, strerror(-res), res);
+    return res;
+  }
+
+  for (uint32_t i = 0; i < hal_streams.size(); i++) {
+    if (i != owner_index) {
+      shared_stream_owner_ids_[hal_streams[i].id] = hal_stream.id;
+    }
+  }
+
+  return OK;
+}
+
 status_t InternalStreamManager::AllocateSharedBuffers(
     const std::vector<HalStream>& hal_streams, uint32_t additional_num_buffers,
     bool need_vendor_buffer) {
@@ -260,10 +365,6 @@ status_t InternalStreamManager::AllocateSharedBuffers(
     return BAD_VALUE;
   }
 
-  uint32_t max_buffers = 0;
-  uint32_t total_max_buffers = 0;
-
-  // Find the maximum and total of all hal_streams' max_buffers.
   for (auto& hal_stream : hal_streams) {
     if (!IsStreamRegisteredLocked(hal_stream.id)) {
       ALOGE("%s: Stream %d was not registered.", __FUNCTION__, hal_stream.id);
@@ -274,9 +375,6 @@ status_t InternalStreamManager::AllocateSharedBuffers(
       ALOGE("%s: Stream %d has been allocated.", __FUNCTION__, hal_stream.id);
       return BAD_VALUE;
     }
-
-    total_max_buffers += hal_stream.max_buffers;
-    max_buffers = std::max(max_buffers, hal_stream.max_buffers);
   }
 
   if (!CanHalStreamsShareBuffersLocked(hal_streams)) {
@@ -284,27 +382,160 @@ status_t InternalStreamManager::AllocateSharedBuffers(
     return BAD_VALUE;
   }
 
-  // Allocate the maximum of all hal_streams' max_buffers immediately and
-  // additional (total_max_buffers + additional_num_buffers - max_buffers)
-  // buffers.
-  HalStream hal_stream = hal_streams[0];
-  hal_stream.max_buffers = max_buffers;
-  uint32_t total_additional_num_buffers =
-      total_max_buffers + additional_num_buffers - max_buffers;
+  return AllocateSharedBuffersLocked(hal_streams, /*owner_index=*/0,
+                                     additional_num_buffers, need_vendor_buffer);
+}
+
+status_t InternalStreamManager::AllocateSizeClassSharedBuffers(
+    const std::vector<HalStream>& hal_streams,
+    const std::vector<uint32_t>& additional_num_buffers,
+    bool need_vendor_buffer) {
+  ATRACE_CALL();
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (hal_streams.empty()) {
+    ALOGE("%s: hal_streams is empty.", __FUNCTION__);
+    return BAD_VALUE;
+  }
+
+  if (additional_num_buffers.size() != hal_streams.size()) {
+    ALOGE("%s: %zu additional buffer counts for %zu streams.", __FUNCTION__,
+          additional_num_buffers.size(), hal_streams.size());
+    return BAD_VALUE;
+  }
+
+  for (auto& hal_stream : hal_streams) {
+    if (!IsStreamRegisteredLocked(hal_stream.id)) {
+      ALOGE("%s: Stream %d was not registered.", __FUNCTION__, hal_stream.id);
+      return BAD_VALUE;
+    }
+
+    if (IsStreamAllocatedLocked(hal_stream.id)) {
+      ALOGE("%s: Stream %d has been allocated.", __FUNCTION__, hal_stream.id);
+      return BAD_VALUE;
+    }
+  }
+
+  // Group streams by size class. Each group keeps the index of its largest
+  // stream, which owns the buffers. A stream joins a group only if it fits in
+  // the owner or the owner fits in it, so every stream in a group fits in the
+  // buffers of the owner.
+  struct SizeClassGroup {
+    std::vector<HalStream> hal_streams;
+    uint32_t owner_index = 0;
+    uint32_t additional_num_buffers = 0;
+  };
+  std::vector<SizeClassGroup> groups;
+  for (uint32_t i = 0; i < hal_streams.size(); i++) {
+    const HalStream& hal_stream = hal_streams[i];
+    const Stream& stream = registered_streams_.at(hal_stream.id);
+    bool grouped = false;
+    for (auto& group : groups) {
+      const HalStream& owner = group.hal_streams[group.owner_index];
+      const Stream& owner_stream = registered_streams_.at(owner.id);
+      if (!AreStreamsSizeClassCompatible(owner_stream, owner, stream,
+                                         hal_stream)) {
+        continue;
+      }
+
+      bool fits_in_owner = stream.width <= owner_stream.width &&
+                           stream.height <= owner_stream.height;
+      bool owner_fits = owner_stream.width <= stream.width &&
+                        owner_stream.height <= stream.height;
+      if (!fits_in_owner && !owner_fits) {
+        continue;
+      }
+
+      group.hal_streams.push_back(hal_stream);
+      group.additional_num_buffers += additional_num_buffers[i];
+      if (!fits_in_owner) {
+        group.owner_index = group.hal_streams.size() - 1;
+      }
+      grouped = true;
+      break;
+    }
+
+    if (!grouped) {
+      SizeClassGroup group;
+      group.hal_streams.push_back(hal_stream);
+      group.additional_num_buffers = additional_num_buffers[i];
+      groups.push_back(group);
+    }
+  }
+
+  std::vector<int32_t> owner_stream_ids;
+  status_t res = OK;
+  for (auto& group : groups) {
+    const HalStream& owner = group.hal_streams[group.owner_index];
+    if (group.hal_streams.size() == 1) {
+      res = AllocateBuffersLocked(owner, group.additional_num_buffers,
+                                  need_vendor_buffer);
+    } else {
+      const Stream& owner_stream = registered_streams_.at(owner.id);
+      ALOGI("%s: %zu streams share a pool owned by stream %d (%" PRIu64
+            " bytes per buffer)",
+            __FUNCTION__, group.hal_streams.size(), owner.id,
+            GetEstimatedBufferBytes(owner_stream.width, owner_stream.height,
+                                    owner.override_format));
+      res = AllocateSharedBuffersLocked(group.hal_streams, group.owner_index,
+                                        group.additional_num_buffers,
+                                        need_vendor_buffer);
+    }
+
+    if (res != OK) {
+      ALOGE("%s: Allocating buffers for stream %d failed: %s(%d)", __FUNCTION__,
+            owner.id, strerror(-res), res);
+      break;
+    }
+
+    owner_stream_ids.push_back(owner.id);
+  }
 
-  status_t res = AllocateBuffersLocked(hal_stream, total_additional_num_buffers,
-                                       need_vendor_buffer);
   if (res != OK) {
-    ALOGE("%s: Allocating buffers for stream %d failed: %s(%d)", __FUNCTION__,
-          hal_stream.id, strerror(-res), res);
-    return res;
+    // Roll back the pools that were allocated.
+    for (auto owner_stream_id : owner_stream_ids) {
+      auto owner_id_it = shared_stream_owner_ids_.begin();
+      while (owner_id_it != shared_stream_owner_ids_.end()) {
+        if (owner_id_it->second == owner_stream_id) {
+          owner_id_it = shared_stream_owner_ids_.erase(owner_id_it);
+        } else {
+          owner_id_it++;
+        }
+      }
+      buffer_managers_.erase(owner_stream_id);
+    }
   }
 
-  for (uint32_t i = 1; i < hal_streams.size(); i++) {
-    shared_stream_owner_ids_[hal_streams[i].id] = hal_streams[0].id;
+  return res;
+}
+
+uint64_t InternalStreamManager::GetAllocatedBufferBytes() {
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  uint64_t total_bytes = 0;
+  for (auto& [owner_stream_id, buffer_manager] : buffer_managers_) {
+    HalBufferDescriptor descriptor = buffer_manager->GetBufferDescriptor();
+    total_bytes += GetEstimatedBufferBytes(descriptor.width, descriptor.height,
+                                           descriptor.format) *
+                   buffer_manager->GetAllocatedBufferCount();
   }
 
-  return OK;
+  return total_bytes;
+}
+
+uint64_t InternalStreamManager::GetStreamBufferBytes(int32_t stream_id) {
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (!IsStreamAllocatedLocked(stream_id)) {
+    return 0;
+  }
+
+  int32_t owner_stream_id = GetBufferManagerOwnerIdLocked(stream_id);
+  if (owner_stream_id == kInvalidStreamId) {
+    return 0;
+  }
+
+  HalBufferDescriptor descriptor =
+      buffer_managers_[owner_stream_id]->GetBufferDescriptor();
+  return GetEstimatedBufferBytes(descriptor.width, descriptor.height,
+                                 descriptor.format);
 }
 
 status_t InternalStreamManager::RemoveOwnerStreamIdLocked(
@@ -429,13 +660,10 @@ bool InternalStreamManager::IsPendingBufferEmpty(int32_t stream_id) {
   return buffer_managers_[owner_stream_id]->IsPendingBufferEmpty();
 }
 
-status_t InternalStreamManager::GetMostRecentStreamBuffer(
-    int32_t stream_id, std::vector<StreamBuffer>* input_buffers,
-    std::vector<std::unique_ptr<HalCameraMetadata>>* input_buffer_metadata,
-    uint32_t payload_frames, int32_t min_filled_buffers) {
-  ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(stream_mutex_);
-
+status_t InternalStreamManager::GetMostRecentZslBuffersLocked(
+    int32_t stream_id, uint32_t payload_frames, int32_t min_filled_buffers,
+    int32_t* owner_stream_id,
+    std::vector<ZslBufferManager::ZslBuffer>* filled_buffers) {
   if (static_cast<int32_t>(payload_frames) < min_filled_buffers) {
     ALOGW("%s: payload frames %d is smaller than min filled buffers %d",
           __FUNCTION__, payload_frames, min_filled_buffers);
@@ -446,53 +674,192 @@ status_t InternalStreamManager::GetMostRecentStreamBuffer(
     return BAD_VALUE;
   }
 
-  int32_t owner_stream_id = GetBufferManagerOwnerIdLocked(stream_id);
-  if (owner_stream_id == kInvalidStreamId) {
+  *owner_stream_id = GetBufferManagerOwnerIdLocked(stream_id);
+  if (*owner_stream_id == kInvalidStreamId) {
     ALOGE("%s: Cannot find a owner stream ID for stream %d", __FUNCTION__,
           stream_id);
     return BAD_VALUE;
   }
 
-  if (input_buffers == nullptr || input_buffer_metadata == nullptr) {
-    ALOGE("%s: input_buffers (%p) or input_buffer_metadata (%p) is nullptr",
-          __FUNCTION__, input_buffers, input_buffer_metadata);
-    return BAD_VALUE;
-  }
-
-  std::vector<ZslBufferManager::ZslBuffer> filled_buffers;
-  buffer_managers_[owner_stream_id]->GetMostRecentZslBuffers(
-      &filled_buffers, payload_frames, min_filled_buffers);
+  buffer_managers_[*owner_stream_id]->GetMostRecentZslBuffers(
+      filled_buffers, payload_frames, min_filled_buffers);
 
-  if (filled_buffers.size() == 0) {
+  if (filled_buffers->size() == 0) {
     ALOGE("%s: There is no input buffers.", __FUNCTION__);
     return INVALID_OPERATION;
   }
 
-  // TODO(b/138592133): Remove AddPendingBuffers because internal stream manager
-  // should not be responsible for saving the pending buffers' metadata.
-  buffer_managers_[owner_stream_id]->AddPendingBuffers(filled_buffers);
+  return OK;
+}
 
-  for (uint32_t i = 0; i < filled_buffers.size(); i++) {
+status_t InternalStreamManager::ConvertZslBuffers(
+    int32_t stream_id, std::vector<ZslBufferManager::ZslBuffer>* filled_buffers,
+    std::vector<StreamBuffer>* input_buffers,
+    std::vector<std::unique_ptr<HalCameraMetadata>>* input_buffer_metadata) {
+  for (uint32_t i = 0; i < filled_buffers->size(); i++) {
     StreamBuffer buffer = {};
     buffer.stream_id = stream_id;
     buffer.buffer_id = 0;  // Buffer ID should be irrelevant internally in HAL.
     buffer.status = BufferStatus::kOk;
     buffer.acquire_fence = nullptr;
     buffer.release_fence = nullptr;
-    buffer.buffer = filled_buffers[i].buffer.buffer;
+    buffer.buffer = filled_buffers->at(i).buffer.buffer;
     input_buffers->push_back(buffer);
-    if (filled_buffers[i].metadata == nullptr) {
-      std::vector<ZslBufferManager::ZslBuffer> buffers;
-      buffer_managers_[owner_stream_id]->CleanPendingBuffers(&buffers);
-      buffer_managers_[owner_stream_id]->ReturnZslBuffers(std::move(buffers));
+    if (filled_buffers->at(i).metadata == nullptr) {
       return INVALID_OPERATION;
     }
-    input_buffer_metadata->push_back(std::move(filled_buffers[i].metadata));
+    input_buffer_metadata->push_back(std::move(filled_buffers->at(i).metadata));
+  }
+
+  return OK;
+}
+
+status_t InternalStreamManager::GetMostRecentStreamBuffer(
+    int32_t stream_id, std::vector<StreamBuffer>* input_buffers,
+    std::vector<std::unique_ptr<HalCameraMetadata>>* input_buffer_metadata,
+    uint32_t payload_frames, int32_t min_filled_buffers) {
+  ATRACE_CALL();
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (input_buffers == nullptr || input_buffer_metadata == nullptr) {
+    ALOGE("%s: input_buffers (%p) or input_buffer_metadata (%p) is nullptr",
+          __FUNCTION__, input_buffers, input_buffer_metadata);
+    return BAD_VALUE;
+  }
+
+  int32_t owner_stream_id = kInvalidStreamId;
+  std::vector<ZslBufferManager::ZslBuffer> filled_buffers;
+  status_t res = GetMostRecentZslBuffersLocked(stream_id, payload_frames,
+                                               min_filled_buffers,
+                                               &owner_stream_id, &filled_buffers);
+  if (res != OK) {
+    return res;
+  }
+
+  // TODO(b/138592133): Remove AddPendingBuffers because internal stream manager
+  // should not be responsible for saving the pending buffers' metadata.
+  buffer_managers_[owner_stream_id]->AddPendingBuffers(filled_buffers);
+
+  res = ConvertZslBuffers(stream_id, &filled_buffers, input_buffers,
+                          input_buffer_metadata);
+  if (res != OK) {
+    std::vector<ZslBufferManager::ZslBuffer> buffers;
+    buffer_managers_[owner_stream_id]->CleanPendingBuffers(&buffers);
+    buffer_managers_[owner_stream_id]->ReturnZslBuffers(std::move(buffers));
+    return res;
+  }
+
+  return OK;
+}
+
+status_t InternalStreamManager::GetCapturePayloadBuffers(
+    int32_t stream_id, uint32_t frame_number,
+    std::vector<StreamBuffer>* input_buffers,
+    std::vector<std::unique_ptr<HalCameraMetadata>>* input_buffer_metadata,
+    uint32_t payload_frames, int32_t min_filled_buffers) {
+  ATRACE_CALL();
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (input_buffers == nullptr || input_buffer_metadata == nullptr) {
+    ALOGE("%s: input_buffers (%p) or input_buffer_metadata (%p) is nullptr",
+          __FUNCTION__, input_buffers, input_buffer_metadata);
+    return BAD_VALUE;
+  }
+
+  int32_t owner_stream_id = kInvalidStreamId;
+  std::vector<ZslBufferManager::ZslBuffer> filled_buffers;
+  status_t res = GetMostRecentZslBuffersLocked(stream_id, payload_frames,
+                                               min_filled_buffers,
+                                               &owner_stream_id, &filled_buffers);
+  if (res != OK) {
+    return res;
+  }
+
+  ZslBufferManager* buffer_manager = buffer_managers_[owner_stream_id].get();
+  if (buffer_manager->HasPendingCaptureBuffers(frame_number)) {
+    ALOGE("%s: Capture %u already holds payload buffers.", __FUNCTION__,
+          frame_number);
+    buffer_manager->ReturnZslBuffers(std::move(filled_buffers));
+    return ALREADY_EXISTS;
+  }
+
+  buffer_manager->AddPendingCaptureBuffers(frame_number, filled_buffers);
+
+  res = ConvertZslBuffers(stream_id, &filled_buffers, input_buffers,
+                          input_buffer_metadata);
+  if (res != OK) {
+    std::vector<ZslBufferManager::ZslBuffer> buffers;
+    buffer_manager->CleanPendingCaptureBuffers(frame_number, &buffers);
+    buffer_manager->ReturnZslBuffers(std::move(buffers));
+    return res;
   }
 
   return OK;
 }
 
+status_t InternalStreamManager::ReturnCapturePayloadBuffers(
+    uint32_t frame_number, int32_t stream_id) {
+  ATRACE_CALL();
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (!IsStreamAllocatedLocked(stream_id)) {
+    ALOGE("%s: Unknown stream ID %d.", __FUNCTION__, stream_id);
+    return BAD_VALUE;
+  }
+
+  int32_t owner_stream_id = GetBufferManagerOwnerIdLocked(stream_id);
+  if (owner_stream_id == kInvalidStreamId) {
+    ALOGE("%s: Cannot find a owner stream ID for stream %d", __FUNCTION__,
+          stream_id);
+    return BAD_VALUE;
+  }
+
+  std::vector<ZslBufferManager::ZslBuffer> zsl_buffers;
+  status_t res = buffer_managers_[owner_stream_id]->CleanPendingCaptureBuffers(
+      frame_number, &zsl_buffers);
+  if (res != OK) {
+    ALOGE("%s: frame (%u) fail to return payload buffers", __FUNCTION__,
+          frame_number);
+    return res;
+  }
+  buffer_managers_[owner_stream_id]->ReturnZslBuffers(std::move(zsl_buffers));
+
+  return OK;
+}
+
+bool InternalStreamManager::HasPendingCapturePayload(int32_t stream_id,
+                                                     uint32_t frame_number) {
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (!IsStreamAllocatedLocked(stream_id)) {
+    ALOGE("%s: Stream %d was not allocated.", __FUNCTION__, stream_id);
+    return false;
+  }
+
+  int32_t owner_stream_id = GetBufferManagerOwnerIdLocked(stream_id);
+  if (owner_stream_id == kInvalidStreamId) {
+    ALOGE("%s: Cannot find a owner stream ID for stream %d", __FUNCTION__,
+          stream_id);
+    return false;
+  }
+
+  return buffer_managers_[owner_stream_id]->HasPendingCaptureBuffers(
+      frame_number);
+}
+
+uint32_t InternalStreamManager::GetPendingCaptureCount(int32_t stream_id) {
+  std::lock_guard<std::mutex> lock(stream_mutex_);
+  if (!IsStreamAllocatedLocked(stream_id)) {
+    ALOGE("%s: Stream %d was not allocated.", __FUNCTION__, stream_id);
+    return 0;
+  }
+
+  int32_t owner_stream_id = GetBufferManagerOwnerIdLocked(stream_id);
+  if (owner_stream_id == kInvalidStreamId) {
+    ALOGE("%s: Cannot find a owner stream ID for stream %d", __FUNCTION__,
+          stream_id);
+    return 0;
+  }
+
+  return buffer_managers_[owner_stream_id]->GetPendingCaptureCount();
+}
+
 status_t InternalStreamManager::ReturnZslStreamBuffers(uint32_t frame_number,
                                                        int32_t stream_id) {
   ATRACE_CALL();
@@ -67,6 +67,41 @@ class InternalStreamManager {
                                  uint32_t additional_num_buffers = 0,
                                  bool need_vendor_buffer = false);
 
+  // Allocate buffers for streams grouped by buffer size class.
+  // Unlike AllocateSharedBuffers(), hal_streams do not need to have the same
+  // dimension. Streams with the same format, usage flags and data space whose
+  // buffers fall into the same size class (byte size rounded up to
+  // kSizeClassAlignmentBytes and then to one of kSizeClassStepsPerOctave steps
+  // per power of two) share one pool of buffers allocated for the largest
+  // stream in the group, as long as the dimension of every stream in the
+  // group fits in the largest one. Streams that cannot be sized by format, or
+  // that are alone in their group, get dedicated buffers.
+  // additional_num_buffers[i] is the number of additional buffers of
+  // hal_streams[i], as in AllocateBuffers(). Each pool allocates the maximum
+  // of its streams' max_buffers immediately and grows up to the total of its
+  // streams' max_buffers and additional buffers only while the streams'
+  // in-flight windows overlap, so it never holds more buffers than dedicated
+  // allocations would. Sharing only lowers the peak for streams whose
+  // buffers are not in flight together, e.g. streams used in different
+  // phases of a session. Streams requested in the same frames reach the same
+  // peak as with dedicated buffers.
+  // Streams passed in must read the stride from the buffers they get, since
+  // buffers of a larger stream in the group may be handed to them.
+  status_t AllocateSizeClassSharedBuffers(
+      const std::vector<HalStream>& hal_streams,
+      const std::vector<uint32_t>& additional_num_buffers,
+      bool need_vendor_buffer = false);
+
+  // Return the estimated number of bytes of all internal stream buffers that
+  // are currently allocated. Buffers of formats that cannot be sized, such as
+  // HAL_PIXEL_FORMAT_BLOB, are not counted.
+  uint64_t GetAllocatedBufferBytes();
+
+  // Return the estimated size in bytes of a buffer of stream_id, from the
+  // dimension and format its buffers were allocated with. Returns 0 if the
+  // stream is not allocated or its format cannot be sized.
+  uint64_t GetStreamBufferBytes(int32_t stream_id);
+
   // Free a stream and its stream buffers.
   void FreeStream(int32_t stream_id);
 
@@ -96,12 +131,45 @@ class InternalStreamManager {
   // Check the pending buffer is empty or not
   bool IsPendingBufferEmpty(int32_t stream_id);
 
+  // Get the most recent buffers and metadata as the payload of the capture
+  // request frame_number. Unlike GetMostRecentStreamBuffer, the buffers are
+  // tracked per capture so multiple captures can hold payloads at the same
+  // time.
+  status_t GetCapturePayloadBuffers(
+      int32_t stream_id, uint32_t frame_number,
+      std::vector<StreamBuffer>* input_buffers,
+      std::vector<std::unique_ptr<HalCameraMetadata>>* input_buffer_metadata,
+      uint32_t payload_frames, int32_t min_filled_buffers = kMinFilledBuffers);
+
+  // Return the payload buffers held by the capture request frame_number.
+  status_t ReturnCapturePayloadBuffers(uint32_t frame_number,
+                                       int32_t stream_id);
+
+  // Return if the capture request frame_number holds payload buffers.
+  bool HasPendingCapturePayload(int32_t stream_id, uint32_t frame_number);
+
+  // Return the number of capture requests holding payload buffers.
+  uint32_t GetPendingCaptureCount(int32_t stream_id);
+
  private:
   static constexpr int32_t kMinFilledBuffers = 3;
   static constexpr int32_t kStreamIdStart = kHalInternalStreamStart;
   static constexpr int32_t kStreamIdReserve =
       kImplementationDefinedInternalStreamStart;
   static constexpr int32_t kInvalidStreamId = -1;
+  static constexpr uint64_t kSizeClassAlignmentBytes = 4096;
+  static constexpr uint32_t kSizeClassStepsPerOctave = 4;
+
+  // Return the estimated size in bytes of a buffer of the given dimension and
+  // format, or 0 if it cannot be derived from the format.
+  static uint64_t GetEstimatedBufferBytes(uint32_t width, uint32_t height,
+                                          android_pixel_format_t format);
+
+  // Return the size class of a buffer of buffer_bytes. Size classes are
+  // aligned to kSizeClassAlignmentBytes and spaced kSizeClassStepsPerOctave
+  // per power of two, so buffers in one class differ by less than
+  // 1 / kSizeClassStepsPerOctave of their size. Returns 0 for 0 bytes.
+  static uint64_t GetSizeClass(uint64_t buffer_bytes);
 
   // Initialize internal stream manager
   void Initialize(IHalBufferAllocator* buffer_allocator,
@@ -122,12 +190,33 @@ class InternalStreamManager {
   // stream_mutex_.
   int32_t GetBufferManagerOwnerIdLocked(int32_t stream_id);
 
+  // Get the most recent filled ZSL buffers of a stream. Must be called with
+  // stream_mutex_ locked.
+  status_t GetMostRecentZslBuffersLocked(
+      int32_t stream_id, uint32_t payload_frames, int32_t min_filled_buffers,
+      int32_t* owner_stream_id,
+      std::vector<ZslBufferManager::ZslBuffer>* filled_buffers);
+
+  // Convert filled ZSL buffers to input buffers and metadata. Returns
+  // INVALID_OPERATION if any buffer is missing its metadata.
+  static status_t ConvertZslBuffers(
+      int32_t stream_id, std::vector<ZslBufferManager::ZslBuffer>* filled_buffers,
+      std::vector<StreamBuffer>* input_buffers,
+      std::vector<std::unique_ptr<HalCameraMetadata>>* input_buffer_metadata);
+
   // Return if two streams and hal_streams are compatible and can share buffers.
   bool AreStreamsCompatible(const Stream& stream_0,
                             const HalStream& hal_stream_0,
                             const Stream& stream_1,
                             const HalStream& hal_stream_1) const;
 
+  // Return if two streams and hal_streams have the same format, usage and
+  // data space, and are in the same size class.
+  bool AreStreamsSizeClassCompatible(const Stream& stream_0,
+                                     const HalStream& hal_stream_0,
+                                     const Stream& stream_1,
+                                     const HalStream& hal_stream_1) const;
+
   // Return if all hal_streams can share buffers. Protected by stream_mutex_.
   bool CanHalStreamsShareBuffersLocked(
       const std::vector<HalStream>& hal_streams) const;
@@ -138,6 +227,13 @@ class InternalStreamManager {
   // will be destroyed. Protected by stream_mutex_.
   status_t RemoveOwnerStreamIdLocked(int32_t old_owner_stream_id);
 
+  // Allocate one buffer pool shared by hal_streams. hal_streams[owner_index]
+  // will own the buffer manager. Protected by stream_mutex_.
+  status_t AllocateSharedBuffersLocked(const std::vector<HalStream>& hal_streams,
+                                       uint32_t owner_index,
+                                       uint32_t additional_num_buffers,
+                                       bool need_vendor_buffer);
+
   // Allocate buffers. Protected by stream_mutex_.
   status_t AllocateBuffersLocked(const HalStream& hal_stream,
                                  uint32_t additional_num_buffers,
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_GOOGLE_CAMERA_HAL_UTILS_MULTICAM_FRAME_ASSEMBLER_H_
+#define HARDWARE_GOOGLE_CAMERA_HAL_UTILS_MULTICAM_FRAME_ASSEMBLER_H_
+
+#include <log/log.h>
+#include <utils/Errors.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace google_camera_hal {
+
+// MultiCameraFrameAssembler collects the parts of a frame that arrive
+// separately from multiple physical cameras, e.g. result metadata or internal
+// buffers of each camera, and dispatches the frame as soon as all of its
+// expected parts have arrived.
+//
+// Frames are kept in a fixed number of slots indexed by frame number. Parts
+// are identified by a bit in a part mask. Adding parts is lock-free: a part is
+// claimed and published with atomic operations on the slot, so results from
+// different cameras can be added concurrently without serializing on a lock.
+// The thread adding the last part dispatches the frame.
+//
+// Frame is the type holding the parts of a frame. It must be default
+// constructible and movable. Each part must be stored in its own member of
+// Frame, because parts of a frame may be filled concurrently.
+template <typename Frame>
+class MultiCameraFrameAssembler {
+ public:
+  static constexpr uint32_t kDefaultNumSlots = 32;
+  // Mask of all parts. The most significant bit is reserved.
+  static constexpr uint32_t kAllParts = 0x7FFFFFFF;
+
+  // Invoked with a frame whose expected parts have all arrived, on the thread
+  // that added the last part.
+  using DispatchFunc = std::function<void(uint32_t frame_number, Frame frame)>;
+
+  // Invoked with a frame that is dropped before all of its expected parts
+  // arrived, because it was flushed or its slot was needed by a newer frame.
+  // arrived_parts is the mask of the parts that arrived.
+  using DropFunc = std::function<void(uint32_t frame_number,
+                                      uint32_t arrived_parts, Frame frame)>;
+
+  // num_slots is the number of frames that can be pending at the same time.
+  // Adding a frame evicts the pending frame num_slots frame numbers before it.
+  static std::unique_ptr<MultiCameraFrameAssembler> Create(
+      DispatchFunc dispatch, DropFunc drop,
+      uint32_t num_slots = kDefaultNumSlots);
+
+  virtual ~MultiCameraFrameAssembler() = default;
+
+  // Add a pending frame expecting the parts in expected_parts. frame holds
+  // any data of the frame that is not a part.
+  status_t AddFrame(uint32_t frame_number, uint32_t expected_parts,
+                    Frame frame);
+
+  // Add the parts in the mask parts to a pending frame. fill is invoked with
+  // the frame to store the parts, and must only write the members of the
+  // parts. If this completes the frame, it is dispatched before returning.
+  // Returns NAME_NOT_FOUND if the frame is not pending, or ALREADY_EXISTS if
+  // any of the parts was already added or is not expected.
+  template <typename FillFunc>
+  status_t AddParts(uint32_t frame_number, uint32_t parts, FillFunc fill);
+
+  // Whether the frame is pending and not all of its parts have been added.
+  bool IsFramePending(uint32_t frame_number) const;
+
+  // Drop all pending frames. Parts being added concurrently are waited for.
+  void Flush();
+
+ protected:
+  MultiCameraFrameAssembler(DispatchFunc dispatch, DropFunc drop,
+                            uint32_t num_slots);
+
+ private:
+  // Claims of a slot that cannot be claimed.
+  static constexpr uint32_t kUnclaimable = 0xFFFFFFFF;
+  // Set in the arrived parts of a slot when its frame is dropped.
+  static constexpr uint32_t kDroppedBit = 0x80000000;
+
+  enum class SlotState : uint32_t {
+    kFree = 0,
+    kPending,
+  };
+
+  struct Slot {
+    // Written under frame_lock_. A slot is released by storing kFree after
+    // its frame has been moved out.
+    std::atomic<SlotState> state = SlotState::kFree;
+    // Frame number in the upper 32 bits and the mask of claimed parts in the
+    // lower 32 bits. Parts that are not expected are claimed when the frame
+    // is added, and all parts are claimed when it is dropped.
+    std::atomic<uint64_t> claims = kUnclaimable;
+    // Mask of the parts that have been filled, and kDroppedBit.
+    std::atomic<uint32_t> arrived_parts = 0;
+    // The following are written under frame_lock_ before claims is released.
+    uint32_t frame_number = 0;
+    uint32_t expected_parts = 0;
+    Frame frame;
+  };
+
+  // A frame dropped under frame_lock_, to be passed to drop_ after unlocking.
+  struct DroppedFrame {
+    uint32_t frame_number = 0;
+    uint32_t arrived_parts = 0;
+    Frame frame;
+  };
+
+  Slot& GetSlot(uint32_t frame_number) const {
+    return slots_[frame_number % num_slots_];
+  }
+
+  // Drop the frame pending in slot if all of its parts have not arrived.
+  // Otherwise wait for the thread dispatching it to release the slot. Must
+  // have frame_lock_ locked.
+  void DropSlotLocked(Slot* slot, std::vector<DroppedFrame>* dropped_frames);
+
+  void DropFrames(std::vector<DroppedFrame>* dropped_frames);
+
+  const DispatchFunc dispatch_;
+  const DropFunc drop_;
+  const uint32_t num_slots_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Serializes adding and dropping frames. Adding parts does not take it.
+  std::mutex frame_lock_;
+};
+
+template <typename Frame>
+std::unique_ptr<MultiCameraFrameAssembler<Frame>>
+MultiCameraFrameAssembler<Frame>::Create(DispatchFunc dispatch, DropFunc drop,
+                                         uint32_t num_slots) {
+  if (dispatch == nullptr || drop == nullptr || num_slots == 0) {
+    ALOGE("%s: Invalid dispatch or drop callback, or num_slots %u",
+          __FUNCTION__, num_slots);
+    return nullptr;
+  }
+
+  auto assembler =
+      std::unique_ptr<MultiCameraFrameAssembler<Frame>>(
+          new MultiCameraFrameAssembler<Frame>(dispatch, drop, num_slots));
+  if (assembler == nullptr) {
+    ALOGE("%s: Creating MultiCameraFrameAssembler failed.", __FUNCTION__);
+    return nullptr;
+  }
+
+  return assembler;
+}
+
+template <typename Frame>
+MultiCameraFrameAssembler<Frame>::MultiCameraFrameAssembler(
+    DispatchFunc dispatch, DropFunc drop, uint32_t num_slots)
+    : dispatch_(dispatch),
+      drop_(drop),
+      num_slots_(num_slots),
+      slots_(std::make_unique<Slot[]>(num_slots)) {
+}
+
+template <typename Frame>
+status_t MultiCameraFrameAssembler<Frame>::AddFrame(uint32_t frame_number,
+                                                    uint32_t expected_parts,
+                                                    Frame frame) {
+  if (expected_parts == 0 || (expected_parts & ~kAllParts) != 0) {
+    ALOGE("%s: Invalid expected parts 0x%x for frame %u", __FUNCTION__,
+          expected_parts, frame_number);
+    return BAD_VALUE;
+  }
+
+  std::vector<DroppedFrame> dropped_frames;
+  {
+    std::lock_guard<std::mutex> lock(frame_lock_);
+    Slot& slot = GetSlot(frame_number);
+    if (slot.state.load(std::memory_order_acquire) == SlotState::kPending) {
+      if (slot.frame_number == frame_number) {
+        ALOGE("%s: Frame %u was already added.", __FUNCTION__, frame_number);
+        return ALREADY_EXISTS;
+      }
+
+      ALOGW("%s: Frame %u is still pending. Evicting it for frame %u",
+            __FUNCTION__, slot.frame_number, frame_number);
+      DropSlotLocked(&slot, &dropped_frames);
+    }
+
+    slot.frame_number = frame_number;
+    slot.expected_parts = expected_parts;
+    slot.frame = std::move(frame);
+    slot.arrived_parts.store(0, std::memory_order_relaxed);
+    slot.state.store(SlotState::kPending, std::memory_order_relaxed);
+    slot.claims.store(
+        (static_cast<uint64_t>(frame_number) << 32) | ~expected_parts,
+        std::memory_order_release);
+  }
+
+  DropFrames(&dropped_frames);
+  return OK;
+}
+
+template <typename Frame>
+template <typename FillFunc>
+status_t MultiCameraFrameAssembler<Frame>::AddParts(uint32_t frame_number,
+                                                    uint32_t parts,
+                                                    FillFunc fill) {
+  if (parts == 0 || (parts & ~kAllParts) != 0) {
+    ALOGE("%s: Invalid parts 0x%x for frame %u", __FUNCTION__, parts,
+          frame_number);
+    return BAD_VALUE;
+  }
+
+  // Claim the parts. The claims are tagged with the frame number so a slot
+  // that is reused for a newer frame cannot be claimed by a late part.
+  Slot& slot = GetSlot(frame_number);
+  uint64_t claims = slot.claims.load(std::memory_order_acquire);
+  do {
+    if ((claims >> 32) != frame_number ||
+        static_cast<uint32_t>(claims) == kUnclaimable) {
+      return NAME_NOT_FOUND;
+    }
+
+    if ((static_cast<uint32_t>(claims) & parts) != 0) {
+      return ALREADY_EXISTS;
+    }
+  } while (!slot.claims.compare_exchange_weak(claims, claims | parts,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire));
+
+  // The slot cannot be released until the claimed parts are published, so
+  // nothing in the slot may be accessed after publishing unless this thread
+  // completes the frame.
+  fill(&slot.frame);
+  uint32_t expected_parts = slot.expected_parts;
+
+  uint32_t arrived_parts =
+      slot.arrived_parts.fetch_or(parts, std::memory_order_acq_rel) | parts;
+  if ((arrived_parts & kDroppedBit) != 0 || arrived_parts != expected_parts) {
+    return OK;
+  }
+
+  Frame frame = std::move(slot.frame);
+  slot.frame = Frame();
+  slot.state.store(SlotState::kFree, std::memory_order_release);
+  dispatch_(frame_number, std::move(frame));
+  return OK;
+}
+
+template <typename Frame>
+bool MultiCameraFrameAssembler<Frame>::IsFramePending(
+    uint32_t frame_number) const {
+  const Slot& slot = GetSlot(frame_number);
+  uint64_t claims = slot.claims.load(std::memory_order_acquire);
+  return (claims >> 32) == frame_number &&
+         static_cast<uint32_t>(claims) != kUnclaimable;
+}
+
+template <typename Frame>
+void MultiCameraFrameAssembler<Frame>::Flush() {
+  std::vector<DroppedFrame> dropped_frames;
+  {
+    std::lock_guard<std::mutex> lock(frame_lock_);
+    for (uint32_t i = 0; i < num_slots_; i++) {
+      if (slots_[i].state.load(std::memory_order_acquire) ==
+          SlotState::kPending) {
+        DropSlotLocked(&slots_[i], &dropped_frames);
+      }
+    }
+  }
+
+  DropFrames(&dropped_frames);
+}
+
+template <typename Frame>
+void MultiCameraFrameAssembler<Frame>::DropSlotLocked(
+    Slot* slot, std::vector<DroppedFrame>* dropped_frames) {
+  // Claim all remaining parts so no more parts can be added, and mark the
+  // frame dropped so the thread adding its last part does not dispatch it.
+  uint32_t claimed_parts =
+      static_cast<uint32_t>(
+          slot->claims.fetch_or(kUnclaimable, std::memory_order_acq_rel)) &
+      slot->expected_parts;
+  uint32_t arrived_parts =
+      slot->arrived_parts.fetch_or(kDroppedBit, std::memory_order_acq_rel);
+
+  if ((arrived_parts & slot->expected_parts) == slot->expected_parts) {
+    // The frame is being dispatched.
+    while (slot->state.load(std::memory_order_acquire) != SlotState::kFree) {
+      std::this_thread::yield();
+    }
+    return;
+  }
+
+  // Wait for the parts that were claimed before the drop to be filled.
+  while ((arrived_parts & claimed_parts) != claimed_parts) {
+    std::this_thread::yield();
+    arrived_parts = slot->arrived_parts.load(std::memory_order_acquire);
+  }
+
+  dropped_frames->push_back({.frame_number = slot->frame_number,
+                             .arrived_parts = arrived_parts & ~kDroppedBit,
+                             .frame = std::move(slot->frame)});
+  slot->frame = Frame();
+  slot->state.store(SlotState::kFree, std::memory_order_release);
+}
+
+template <typename Frame>
+void MultiCameraFrameAssembler<Frame>::DropFrames(
+    std::vector<DroppedFrame>* dropped_frames) {
+  for (auto& dropped_frame : *dropped_frames) {
+    drop_(dropped_frame.frame_number, dropped_frame.arrived_parts,
+          std::move(dropped_frame.frame));
+  }
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
+
+#endif  // HARDWARE_GOOGLE_CAMERA_HAL_UTILS_MULTICAM_FRAME_ASSEMBLER_H_
@@ -20,7 +20,8 @@
 #include <log/log.h>
 #include <utils/Trace.h>
 
-#include <unordered_set>
+#include <algorithm>
+#include <chrono>
 
 #include "hal_utils.h"
 #include "multicam_realtime_process_block.h"
@@ -43,9 +44,19 @@ std::unique_ptr<MultiCameraRtProcessBlock> MultiCameraRtProcessBlock::Create(
     ALOGE("%s: Creating MultiCameraRtProcessBlock failed.", __FUNCTION__);
     return nullptr;
   }
-  block->request_id_manager_ = PipelineRequestIdManager::Create();
-  if (block->request_id_manager_ == nullptr) {
-    ALOGE("%s: Creating PipelineRequestIdManager failed.", __FUNCTION__);
+
+  MultiCameraRtProcessBlock* block_ptr = block.get();
+  block->frame_shutters_ = MultiCameraFrameAssembler<FrameShutters>::Create(
+      [block_ptr](uint32_t /*frame_number*/, FrameShutters shutters) {
+        block_ptr->UpdateSkewStats(shutters);
+      },
+      [](uint32_t frame_number, uint32_t arrived_parts,
+         FrameShutters /*shutters*/) {
+        ALOGV("%s: Shutters of frame %u are incomplete (lanes 0x%x)",
+              __FUNCTION__, frame_number, arrived_parts);
+      });
+  if (block->frame_shutters_ == nullptr) {
+    ALOGE("%s: Creating frame shutter assembler failed.", __FUNCTION__);
     return nullptr;
   }
   return block;
@@ -90,7 +101,7 @@ status_t MultiCameraRtProcessBlock::SetResultProcessor(
     return BAD_VALUE;
   }
 
-  std::lock_guard<std::mutex> lock(result_processor_mutex_);
+  std::lock_guard lock(configure_shared_mutex_);
   if (result_processor_ != nullptr) {
     ALOGE("%s: result_processor_ was already set.", __FUNCTION__);
     return ALREADY_EXISTS;
@@ -150,8 +161,16 @@ status_t MultiCameraRtProcessBlock::ConfigureStreams(
     return res;
   }
 
-  configured_streams_.clear();
-  camera_pipeline_ids_.clear();
+  // Each physical camera is a part of the frames in frame_shutters_, which
+  // supports up to 31 parts.
+  static constexpr size_t kMaxNumLanes = 31;
+  if (camera_stream_configs.size() > kMaxNumLanes) {
+    ALOGE("%s: Too many physical cameras (%zu)", __FUNCTION__,
+          camera_stream_configs.size());
+    return BAD_VALUE;
+  }
+
+  ClearConfigurationLocked();
 
   // Configuration a pipeline for each camera.
   for (auto& [camera_id, config] : camera_stream_configs) {
@@ -161,12 +180,26 @@ status_t MultiCameraRtProcessBlock::ConfigureStreams(
     if (res != OK) {
       ALOGE("%s: Configuring stream for camera %u failed: %s(%d)", __FUNCTION__,
             camera_id, strerror(-res), res);
+      ClearConfigurationLocked();
       return res;
     }
     ALOGV("%s: config realtime pipeline camera id %u pipeline_id %u",
           __FUNCTION__, camera_id, pipeline_id);
 
     camera_pipeline_ids_[camera_id] = pipeline_id;
+
+    auto lane = std::make_unique<CameraLane>();
+    lane->camera_id = camera_id;
+    lane->pipeline_id = pipeline_id;
+    lane->request_id_manager = PipelineRequestIdManager::Create();
+    if (lane->request_id_manager == nullptr) {
+      ALOGE("%s: Creating PipelineRequestIdManager failed.", __FUNCTION__);
+      ClearConfigurationLocked();
+      return NO_MEMORY;
+    }
+    pipeline_lane_indices_[pipeline_id] = lanes_.size();
+    lanes_.push_back(std::move(lane));
+
     for (auto& stream : config.streams) {
       configured_streams_[stream.id].pipeline_id = pipeline_id;
       configured_streams_[stream.id].stream = stream;
@@ -177,6 +210,13 @@ status_t MultiCameraRtProcessBlock::ConfigureStreams(
   return OK;
 }
 
+void MultiCameraRtProcessBlock::ClearConfigurationLocked() {
+  configured_streams_.clear();
+  camera_pipeline_ids_.clear();
+  lanes_.clear();
+  pipeline_lane_indices_.clear();
+}
+
 status_t MultiCameraRtProcessBlock::GetConfiguredHalStreams(
     std::vector<HalStream>* hal_streams) const {
   ATRACE_CALL();
@@ -209,116 +249,80 @@ status_t MultiCameraRtProcessBlock::GetConfiguredHalStreams(
   return OK;
 }
 
-status_t MultiCameraRtProcessBlock::GetBufferPhysicalCameraIdLocked(
-    const StreamBuffer& buffer, uint32_t* camera_id) const {
-  if (camera_id == nullptr) {
-    ALOGE("%s: camera_id is nullptr", __FUNCTION__);
-    return BAD_VALUE;
-  }
-
-  int32_t stream_id = buffer.stream_id;
-  auto configured_stream_iter = configured_streams_.find(stream_id);
-  if (configured_stream_iter == configured_streams_.end()) {
-    ALOGE("%s: Stream %d was not configured.", __FUNCTION__, stream_id);
-    return BAD_VALUE;
-  }
-
-  const ConfiguredStream& configure_stream = configured_stream_iter->second;
-  if (!configure_stream.stream.is_physical_camera_stream) {
-    ALOGE("%s: Stream %d is not a physical stream.", __FUNCTION__, stream_id);
-    return BAD_VALUE;
-  }
-
-  *camera_id = configure_stream.stream.physical_camera_id;
-  return OK;
-}
-
-status_t MultiCameraRtProcessBlock::GetOutputBufferPipelineIdLocked(
-    const StreamBuffer& buffer, uint32_t* pipeline_id) const {
-  if (pipeline_id == nullptr) {
-    ALOGE("%s: pipeline_id is nullptr", __FUNCTION__);
-    return BAD_VALUE;
-  }
-
-  uint32_t camera_id;
-  status_t res = GetBufferPhysicalCameraIdLocked(buffer, &camera_id);
-  if (res != OK) {
-    ALOGE("%s: Getting buffer's physical camera ID failed: %s(%d)",
-          __FUNCTION__, strerror(-res), res);
-    return res;
-  }
-
-  auto camera_pipeline_id_iter = camera_pipeline_ids_.find(camera_id);
-  if (camera_pipeline_id_iter == camera_pipeline_ids_.end()) {
-    ALOGE("%s: Cannot find the pipeline ID for camera %u", __FUNCTION__,
-          camera_id);
+status_t MultiCameraRtProcessBlock::GetRequestPipelineIdsLocked(
+    const std::vector<ProcessBlockRequest>& block_requests,
+    std::vector<uint32_t>* pipeline_ids) const {
+  ATRACE_CALL();
+  if (pipeline_ids == nullptr) {
+    ALOGE("%s: pipeline_ids is nullptr", __FUNCTION__);
     return BAD_VALUE;
   }
 
-  *pipeline_id = camera_pipeline_id_iter->second;
-  return OK;
-}
-
-bool MultiCameraRtProcessBlock::AreRequestsValidLocked(
-    const std::vector<ProcessBlockRequest>& block_requests) const {
-  ATRACE_CALL();
   if (block_requests.empty()) {
     ALOGE("%s: requests is empty.", __FUNCTION__);
-    return false;
+    return BAD_VALUE;
   }
 
-  std::unordered_set<int32_t> request_camera_ids;
+  pipeline_ids->clear();
+  pipeline_ids->reserve(block_requests.size());
   uint32_t frame_number = block_requests[0].request.frame_number;
   for (auto& block_request : block_requests) {
     if (block_request.request.output_buffers.size() == 0) {
       ALOGE("%s: request %u doesn't contain any output streams.", __FUNCTION__,
             block_request.request.frame_number);
-      return false;
+      return BAD_VALUE;
     }
 
     if (block_request.request.frame_number != frame_number) {
       ALOGE("%s: Not all frame numbers in requests are the same.", __FUNCTION__);
-      return false;
+      return BAD_VALUE;
     }
 
     // Check all output buffers will be captured from the same physical camera.
-    uint32_t physical_camera_id;
+    // Each physical camera has its own pipeline so comparing the pipeline ID
+    // resolved at configuration time is sufficient.
+    uint32_t pipeline_id = 0;
     for (uint32_t i = 0; i < block_request.request.output_buffers.size(); i++) {
-      uint32_t buffer_camera_id;
-      status_t res = GetBufferPhysicalCameraIdLocked(
-          block_request.request.output_buffers[0], &buffer_camera_id);
-      if (res != OK) {
-        ALOGE("%s: Getting buffer's physical camera ID failed: %s(%d)",
-              __FUNCTION__, strerror(-res), res);
-        return false;
+      int32_t stream_id = block_request.request.output_buffers[i].stream_id;
+      auto configured_stream_iter = configured_streams_.find(stream_id);
+      if (configured_stream_iter == configured_streams_.end()) {
+        ALOGE("%s: Stream %d was not configured.", __FUNCTION__, stream_id);
+        return BAD_VALUE;
+      }
+
+      const ConfiguredStream& configured_stream = configured_stream_iter->second;
+      if (!configured_stream.stream.is_physical_camera_stream) {
+        ALOGE("%s: Stream %d is not a physical stream.", __FUNCTION__,
+              stream_id);
+        return BAD_VALUE;
       }
 
       if (i == 0) {
-        physical_camera_id = buffer_camera_id;
-      } else if (buffer_camera_id != physical_camera_id) {
+        pipeline_id = configured_stream.pipeline_id;
+      } else if (configured_stream.pipeline_id != pipeline_id) {
         ALOGE("%s: Buffers should belong to the same camera ID in a request.",
               __FUNCTION__);
-        return false;
+        return BAD_VALUE;
       }
     }
 
     // Check no two requests will be captured from the same physical camera.
-    if (request_camera_ids.find(physical_camera_id) != request_camera_ids.end()) {
-      ALOGE("%s: No two requests can be captured from the same camera ID (%u).",
-            __FUNCTION__, physical_camera_id);
-      return false;
+    if (std::find(pipeline_ids->begin(), pipeline_ids->end(), pipeline_id) !=
+        pipeline_ids->end()) {
+      ALOGE("%s: No two requests can be captured from the same pipeline (%u).",
+            __FUNCTION__, pipeline_id);
+      return BAD_VALUE;
     }
 
-    request_camera_ids.insert(physical_camera_id);
+    pipeline_ids->push_back(pipeline_id);
   }
 
-  return true;
+  return OK;
 }
 
-status_t MultiCameraRtProcessBlock::ForwardPendingRequests(
+status_t MultiCameraRtProcessBlock::ForwardPendingRequestsLocked(
     const std::vector<ProcessBlockRequest>& process_block_requests,
     const CaptureRequest& remaining_session_request) {
-  std::lock_guard<std::mutex> lock(result_processor_mutex_);
   if (result_processor_ == nullptr) {
     ALOGE("%s: result processor was not set.", __FUNCTION__);
     return NO_INIT;
@@ -334,71 +338,108 @@ status_t MultiCameraRtProcessBlock::PrepareBlockByCameraId(
                                               frame_number);
 }
 
-status_t MultiCameraRtProcessBlock::ProcessRequests(
+status_t MultiCameraRtProcessBlock::PrepareRequestsLocked(
     const std::vector<ProcessBlockRequest>& process_block_requests,
-    const CaptureRequest& remaining_session_request) {
-  ATRACE_CALL();
-  std::shared_lock lock(configure_shared_mutex_);
+    const CaptureRequest& remaining_session_request,
+    std::vector<uint32_t>* pipeline_ids) {
   if (configured_streams_.empty()) {
     ALOGE("%s: block is not configured.", __FUNCTION__);
     return NO_INIT;
   }
 
-  if (!AreRequestsValidLocked(process_block_requests)) {
+  status_t res = GetRequestPipelineIdsLocked(process_block_requests, pipeline_ids);
+  if (res != OK) {
     ALOGE("%s: Requests are not supported.", __FUNCTION__);
-    return BAD_VALUE;
+    return res;
   }
 
-  status_t res =
-      ForwardPendingRequests(process_block_requests, remaining_session_request);
+  res = ForwardPendingRequestsLocked(process_block_requests,
+                                    remaining_session_request);
   if (res != OK) {
     ALOGE("%s: Forwarding pending requests failed: %s(%d)", __FUNCTION__,
           strerror(-res), res);
     return res;
   }
 
-  // Get pipeline ID for each request.
-  std::vector<uint32_t> pipeline_ids;
-  for (auto& block_request : process_block_requests) {
-    uint32_t pipeline_id;
-
-    // Get the camera ID of the request's first output buffer. All output
-    // buffers should belong to the same pipeline ID, which is checked in
-    // AreRequestsSupportedLocked.
-    res = GetOutputBufferPipelineIdLocked(
-        block_request.request.output_buffers[0], &pipeline_id);
-    if (res != OK) {
-      ALOGE("%s: Getting buffer's pipeline ID failed: %s(%d)", __FUNCTION__,
-            strerror(-res), res);
-      return res;
+  uint32_t lane_parts = 0;
+  for (size_t i = 0; i < process_block_requests.size(); i++) {
+    const ProcessBlockRequest& block_request = process_block_requests[i];
+    uint32_t lane_index = 0;
+    if (!GetLaneIndexLocked(pipeline_ids->at(i), &lane_index)) {
+      ALOGE("%s: Pipeline %u was not configured.", __FUNCTION__,
+            pipeline_ids->at(i));
+      return BAD_VALUE;
     }
 
-    res = request_id_manager_->SetPipelineRequestId(
+    res = lanes_[lane_index]->request_id_manager->SetPipelineRequestId(
         block_request.request_id, block_request.request.frame_number,
-        pipeline_id);
+        pipeline_ids->at(i));
     if (res != OK) {
       ALOGE("%s: Adding pipeline request id info failed: %s(%d)", __FUNCTION__,
             strerror(-res), res);
       return res;
     }
 
-    pipeline_ids.push_back(pipeline_id);
     ALOGV("%s: frame_number %u pipeline_id %u request_id %u", __FUNCTION__,
-          block_request.request.frame_number, pipeline_id,
+          block_request.request.frame_number, pipeline_ids->at(i),
           block_request.request_id);
+    lane_parts |= 1 << lane_index;
+  }
+
+  // Skew is only measured between the physical cameras of a frame.
+  if (process_block_requests.size() > 1) {
+    FrameShutters shutters;
+    shutters.timestamps_ns.resize(lanes_.size());
+    shutters.arrival_times_ns.resize(lanes_.size());
+    uint32_t frame_number = process_block_requests[0].request.frame_number;
+    res = frame_shutters_->AddFrame(frame_number, lane_parts,
+                                    std::move(shutters));
+    if (res != OK) {
+      // Skew statistics are best effort.
+      ALOGW("%s: Adding frame %u for skew statistics failed: %s(%d)",
+            __FUNCTION__, frame_number, strerror(-res), res);
+    }
   }
 
-  std::vector<HwlPipelineRequest> hwl_requests;
-  res = hal_utils::CreateHwlPipelineRequests(&hwl_requests, pipeline_ids,
-                                             process_block_requests);
+  return OK;
+}
+
+template <typename ProcessBlockRequests>
+status_t MultiCameraRtProcessBlock::DoProcessRequests(
+    ProcessBlockRequests&& process_block_requests,
+    const CaptureRequest& remaining_session_request) {
+  std::shared_lock lock(configure_shared_mutex_);
+  std::vector<uint32_t> pipeline_ids;
+  status_t res = PrepareRequestsLocked(process_block_requests,
+                                       remaining_session_request, &pipeline_ids);
   if (res != OK) {
-    ALOGE("%s: Creating HWL pipeline requests failed: %s(%d)", __FUNCTION__,
-          strerror(-res), res);
     return res;
   }
 
-  return device_session_hwl_->SubmitRequests(
-      process_block_requests[0].request.frame_number, hwl_requests);
+  res = hal_utils::SubmitHwlPipelineRequests(
+      device_session_hwl_, pipeline_ids,
+      std::forward<ProcessBlockRequests>(process_block_requests));
+  if (res != OK) {
+    ALOGE("%s: Submitting HWL pipeline requests failed: %s(%d)", __FUNCTION__,
+          strerror(-res), res);
+  }
+
+  return res;
+}
+
+status_t MultiCameraRtProcessBlock::ProcessRequests(
+    const std::vector<ProcessBlockRequest>& process_block_requests,
+    const CaptureRequest& remaining_session_request) {
+  ATRACE_CALL();
+  return DoProcessRequests(process_block_requests, remaining_session_request);
+}
+
+status_t MultiCameraRtProcessBlock::ProcessOwnedRequests(
+    std::vector<ProcessBlockRequest> process_block_requests,
+    const CaptureRequest& remaining_session_request) {
+  ATRACE_CALL();
+  return DoProcessRequests(std::move(process_block_requests),
+                           remaining_session_request);
 }
 
 status_t MultiCameraRtProcessBlock::Flush() {
@@ -414,6 +455,8 @@ status_t MultiCameraRtProcessBlock::Flush() {
     return res;
   }
 
+  frame_shutters_->Flush();
+
   if (result_processor_ == nullptr) {
     ALOGW("%s: result processor is nullptr.", __FUNCTION__);
     return res;
@@ -422,10 +465,21 @@ status_t MultiCameraRtProcessBlock::Flush() {
   return result_processor_->FlushPendingRequests();
 }
 
+bool MultiCameraRtProcessBlock::GetLaneIndexLocked(
+    uint32_t pipeline_id, uint32_t* lane_index) const {
+  auto lane_index_iter = pipeline_lane_indices_.find(pipeline_id);
+  if (lane_index_iter == pipeline_lane_indices_.end()) {
+    return false;
+  }
+
+  *lane_index = lane_index_iter->second;
+  return true;
+}
+
 void MultiCameraRtProcessBlock::NotifyHwlPipelineResult(
     std::unique_ptr<HwlPipelineResult> hwl_result) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(result_processor_mutex_);
+  std::shared_lock lock(configure_shared_mutex_);
   if (result_processor_ == nullptr) {
     ALOGE("%s: result processor is nullptr. Dropping a result", __FUNCTION__);
     return;
@@ -433,6 +487,15 @@ void MultiCameraRtProcessBlock::NotifyHwlPipelineResult(
 
   uint32_t frame_number = hwl_result->frame_number;
   uint32_t pipeline_id = hwl_result->pipeline_id;
+  uint32_t lane_index = 0;
+  if (!GetLaneIndexLocked(pipeline_id, &lane_index)) {
+    ALOGE("%s: Pipeline %u was not configured. Dropping a result",
+          __FUNCTION__, pipeline_id);
+    return;
+  }
+
+  CameraLane* lane = lanes_[lane_index].get();
+  std::lock_guard<std::mutex> lane_lock(lane->result_lock);
   if (hwl_result->result_metadata == nullptr &&
       hwl_result->input_buffers.empty() && hwl_result->output_buffers.empty()) {
     ALOGV("%s: Skip empty result. pipeline_id %u frame_number %u", __FUNCTION__,
@@ -454,7 +517,7 @@ void MultiCameraRtProcessBlock::NotifyHwlPipelineResult(
       capture_result->result_metadata.get());
 
   uint32_t request_id = 0;
-  status_t res = request_id_manager_->GetPipelineRequestId(
+  status_t res = lane->request_id_manager->GetPipelineRequestId(
       pipeline_id, frame_number, &request_id);
   if (res != OK) {
     ALOGE("%s: Get request Id and remove pending failed. res %d", __FUNCTION__,
@@ -470,18 +533,32 @@ void MultiCameraRtProcessBlock::NotifyHwlPipelineResult(
 void MultiCameraRtProcessBlock::NotifyHwlPipelineMessage(
     uint32_t pipeline_id, const NotifyMessage& message) {
   ATRACE_CALL();
-  std::lock_guard<std::mutex> lock(result_processor_mutex_);
+  std::shared_lock lock(configure_shared_mutex_);
   if (result_processor_ == nullptr) {
     ALOGE("%s: result processor is nullptr. Dropping a message", __FUNCTION__);
     return;
   }
+
+  uint32_t lane_index = 0;
+  if (!GetLaneIndexLocked(pipeline_id, &lane_index)) {
+    ALOGE("%s: Pipeline %u was not configured. Dropping a message",
+          __FUNCTION__, pipeline_id);
+    return;
+  }
+
+  if (message.type == MessageType::kShutter) {
+    AddShutterLocked(lane_index, message.message.shutter);
+  }
+
+  CameraLane* lane = lanes_[lane_index].get();
+  std::lock_guard<std::mutex> lane_lock(lane->result_lock);
   uint32_t frame_number = message.type == MessageType::kShutter
                               ? message.message.shutter.frame_number
                               : message.message.error.frame_number;
   ALOGV("%s: pipeline id %u frame_number %u type %d", __FUNCTION__, pipeline_id,
         frame_number, message.type);
   uint32_t request_id = 0;
-  status_t res = request_id_manager_->GetPipelineRequestId(
+  status_t res = lane->request_id_manager->GetPipelineRequestId(
       pipeline_id, frame_number, &request_id);
   if (res != OK) {
     ALOGE("%s: Get request Id and remove pending failed. res %d", __FUNCTION__,
@@ -493,5 +570,66 @@ void MultiCameraRtProcessBlock::NotifyHwlPipelineMessage(
   result_processor_->Notify(std::move(block_message));
 }
 
+void MultiCameraRtProcessBlock::AddShutterLocked(
+    uint32_t lane_index, const ShutterMessage& shutter) {
+  int64_t arrival_time_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+
+  // Frames captured from a single physical camera are not tracked.
+  frame_shutters_->AddParts(shutter.frame_number, 1 << lane_index,
+                            [&](FrameShutters* shutters) {
+                              shutters->timestamps_ns[lane_index] =
+                                  shutter.timestamp_ns;
+                              shutters->arrival_times_ns[lane_index] =
+                                  arrival_time_ns;
+                            });
+}
+
+void MultiCameraRtProcessBlock::UpdateSkewStats(const FrameShutters& shutters) {
+  // Lanes not in the frame have 0 arrival times.
+  int64_t min_timestamp_ns = INT64_MAX;
+  int64_t max_timestamp_ns = INT64_MIN;
+  int64_t min_arrival_time_ns = INT64_MAX;
+  int64_t max_arrival_time_ns = INT64_MIN;
+  for (size_t i = 0; i < shutters.arrival_times_ns.size(); i++) {
+    if (shutters.arrival_times_ns[i] == 0) {
+      continue;
+    }
+
+    min_timestamp_ns = std::min(min_timestamp_ns, shutters.timestamps_ns[i]);
+    max_timestamp_ns = std::max(max_timestamp_ns, shutters.timestamps_ns[i]);
+    min_arrival_time_ns =
+        std::min(min_arrival_time_ns, shutters.arrival_times_ns[i]);
+    max_arrival_time_ns =
+        std::max(max_arrival_time_ns, shutters.arrival_times_ns[i]);
+  }
+
+  if (min_arrival_time_ns > max_arrival_time_ns) {
+    return;
+  }
+
+  int64_t sensor_skew_ns = max_timestamp_ns - min_timestamp_ns;
+  int64_t arrival_skew_ns = max_arrival_time_ns - min_arrival_time_ns;
+  ATRACE_INT64("multicam_sensor_skew_ns", sensor_skew_ns);
+  ATRACE_INT64("multicam_shutter_arrival_skew_ns", arrival_skew_ns);
+
+  std::lock_guard<std::mutex> lock(skew_stats_lock_);
+  skew_stats_.num_frames++;
+  skew_stats_.max_sensor_skew_ns =
+      std::max(skew_stats_.max_sensor_skew_ns, sensor_skew_ns);
+  skew_stats_.total_sensor_skew_ns += sensor_skew_ns;
+  skew_stats_.max_arrival_skew_ns =
+      std::max(skew_stats_.max_arrival_skew_ns, arrival_skew_ns);
+  skew_stats_.total_arrival_skew_ns += arrival_skew_ns;
+}
+
+MultiCameraRtProcessBlock::PhysicalCameraSkewStats
+MultiCameraRtProcessBlock::GetPhysicalCameraSkewStats() const {
+  std::lock_guard<std::mutex> lock(skew_stats_lock_);
+  return skew_stats_;
+}
+
 }  // namespace google_camera_hal
 }  // namespace android
@@ -19,7 +19,9 @@
 
 #include <map>
 #include <shared_mutex>
+#include <vector>
 
+#include "multicam_frame_assembler.h"
 #include "pipeline_request_id_manager.h"
 #include "process_block.h"
 #include "result_processor.h"
@@ -31,8 +33,27 @@ namespace google_camera_hal {
 // process real-time capture requests for multiple physical cameras.
 // MultiCameraRtProcessBlock only supports a logical camera with multiple
 // physical cameras. It also only supports physical output streams.
+// Each physical camera has its own lane for request IDs and results, so
+// results from a slow physical camera do not hold up the others. Requests of a
+// frame are still submitted to the HWL in one SubmitRequests() call, which
+// the HWL needs to capture the physical cameras synchronously.
 class MultiCameraRtProcessBlock : public ProcessBlock {
  public:
+  // Skew between the physical cameras of the frames captured from more than
+  // one physical camera, measured from their shutter notifications.
+  struct PhysicalCameraSkewStats {
+    // Number of frames whose shutters from all physical cameras arrived.
+    uint64_t num_frames = 0;
+    // Difference between the earliest and the latest start of exposure of a
+    // frame.
+    int64_t max_sensor_skew_ns = 0;
+    int64_t total_sensor_skew_ns = 0;
+    // Difference between the earliest and the latest arrival of the shutter
+    // notifications of a frame.
+    int64_t max_arrival_skew_ns = 0;
+    int64_t total_arrival_skew_ns = 0;
+  };
+
   // Create a MultiCameraRtProcessBlock.
   // device_session_hwl is owned by the caller and must be valid during the
   // lifetime of this MultiCameraRtProcessBlock.
@@ -56,12 +77,19 @@ class MultiCameraRtProcessBlock : public ProcessBlock {
       const std::vector<ProcessBlockRequest>& process_block_requests,
       const CaptureRequest& remaining_session_request) override;
 
+  status_t ProcessOwnedRequests(
+      std::vector<ProcessBlockRequest> process_block_requests,
+      const CaptureRequest& remaining_session_request) override;
+
   status_t Flush() override;
   // Override functions of ProcessBlock end.
 
   // Prepare pipeline by camera id
   status_t PrepareBlockByCameraId(uint32_t camera_id, uint32_t frame_number);
 
+  // Get the skew statistics of the frames captured so far.
+  PhysicalCameraSkewStats GetPhysicalCameraSkewStats() const;
+
  protected:
   MultiCameraRtProcessBlock(CameraDeviceSessionHwl* device_session_hwl);
 
@@ -78,6 +106,25 @@ class MultiCameraRtProcessBlock : public ProcessBlock {
   // Map from a camera ID to the camera's stream configuration.
   using CameraStreamConfigurationMap = std::map<uint32_t, StreamConfiguration>;
 
+  // Define the lane of a physical camera's pipeline.
+  struct CameraLane {
+    uint32_t camera_id = 0;
+    uint32_t pipeline_id = 0;
+    // Map from the pipeline's frame numbers to request IDs.
+    std::unique_ptr<PipelineRequestIdManager> request_id_manager;
+    // Serializes the pipeline's results and messages so they reach the
+    // result processor in order.
+    std::mutex result_lock;
+  };
+
+  // Shutters of a frame from each physical camera, indexed by lane.
+  struct FrameShutters {
+    // Start of exposure reported by each physical camera.
+    std::vector<int64_t> timestamps_ns;
+    // Time each physical camera's shutter notification arrived.
+    std::vector<int64_t> arrival_times_ns;
+  };
+
   // If the real-time process block supports the device session.
   static bool IsSupported(CameraDeviceSessionHwl* device_session_hwl);
 
@@ -94,25 +141,52 @@ class MultiCameraRtProcessBlock : public ProcessBlock {
       const StreamConfiguration& stream_config,
       CameraStreamConfigurationMap* camera_stream_config_map) const;
 
-  // Get the camera ID that a buffer will be captured from. Must be called with
+  // Remove the streams, pipeline IDs and lanes of a configuration, including
+  // the ones of a configuration that failed halfway. Must be called with
   // configure_shared_mutex_ locked.
-  status_t GetBufferPhysicalCameraIdLocked(const StreamBuffer& buffer,
-                                           uint32_t* camera_id) const;
-
-  // Get the pipeline ID that a buffer will be captured from. Must be called
-  // with configure_shared_mutex_ locked.
-  status_t GetOutputBufferPipelineIdLocked(const StreamBuffer& buffer,
-                                           uint32_t* pipeline_id) const;
+  void ClearConfigurationLocked();
+
+  // Validate requests and get the pipeline ID of each request in a single
+  // pass over the output buffers. Must be called with configure_shared_mutex_
+  // locked.
+  status_t GetRequestPipelineIdsLocked(
+      const std::vector<ProcessBlockRequest>& requests,
+      std::vector<uint32_t>* pipeline_ids) const;
+
+  // Validate requests, forward them to the result processor, and register
+  // their pipeline request IDs. Must be called with configure_shared_mutex_
+  // locked.
+  status_t PrepareRequestsLocked(
+      const std::vector<ProcessBlockRequest>& process_block_requests,
+      const CaptureRequest& remaining_session_request,
+      std::vector<uint32_t>* pipeline_ids);
 
-  // Return if requests are valid. Must be called with configure_shared_mutex_ locked.
-  bool AreRequestsValidLocked(
-      const std::vector<ProcessBlockRequest>& requests) const;
+  // Shared implementation of ProcessRequests() and ProcessOwnedRequests().
+  // process_block_requests are moved into the HWL requests if they are an
+  // rvalue and cloned otherwise.
+  template <typename ProcessBlockRequests>
+  status_t DoProcessRequests(ProcessBlockRequests&& process_block_requests,
+                             const CaptureRequest& remaining_session_request);
 
-  // Forward the pending requests to result processor.
-  status_t ForwardPendingRequests(
+  // Forward the pending requests to result processor. Must be called with
+  // configure_shared_mutex_ locked.
+  status_t ForwardPendingRequestsLocked(
       const std::vector<ProcessBlockRequest>& process_block_requests,
       const CaptureRequest& remaining_session_request);
 
+  // Get the index of a pipeline's lane. Returns false if the pipeline was not
+  // configured by this process block. Must be called with
+  // configure_shared_mutex_ locked.
+  bool GetLaneIndexLocked(uint32_t pipeline_id, uint32_t* lane_index) const;
+
+  // Record a physical camera's shutter for the skew statistics. Must be called
+  // with configure_shared_mutex_ locked.
+  void AddShutterLocked(uint32_t lane_index, const ShutterMessage& shutter);
+
+  // Update the skew statistics with a frame whose shutters from all of its
+  // physical cameras arrived.
+  void UpdateSkewStats(const FrameShutters& shutters);
+
   HwlPipelineCallback hwl_pipeline_callback_;
   CameraDeviceSessionHwl* device_session_hwl_ = nullptr;
 
@@ -128,13 +202,23 @@ class MultiCameraRtProcessBlock : public ProcessBlock {
   // configure_shared_mutex_.
   std::unordered_map<uint32_t, ConfiguredStream> configured_streams_;
 
-  std::mutex result_processor_mutex_;
+  // Lanes of the physical cameras' pipelines and map from a pipeline ID to the
+  // index of its lane. Must be protected by configure_shared_mutex_. Results
+  // and messages lock it shared, so lanes deliver them concurrently.
+  std::vector<std::unique_ptr<CameraLane>> lanes_;
+  std::unordered_map<uint32_t, uint32_t> pipeline_lane_indices_;
 
-  // Result processor. Must be protected by result_processor_mutex_.
+  // Result processor. Must be protected by configure_shared_mutex_.
   std::unique_ptr<ResultProcessor> result_processor_ = nullptr;
 
-  // Pipeline request id manager
-  std::unique_ptr<PipelineRequestIdManager> request_id_manager_ = nullptr;
+  // Assembles the shutters of frames captured from more than one physical
+  // camera. A frame's parts are the lanes of its physical cameras.
+  std::unique_ptr<MultiCameraFrameAssembler<FrameShutters>> frame_shutters_;
+
+  mutable std::mutex skew_stats_lock_;
+
+  // Must be protected by skew_stats_lock_.
+  PhysicalCameraSkewStats skew_stats_;
 };
 
 }  // namespace google_camera_hal
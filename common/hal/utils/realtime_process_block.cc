@@ -135,30 +135,40 @@ status_t RealtimeProcessBlock::GetConfiguredHalStreams(
   return device_session_hwl_->GetConfiguredHalStream(pipeline_id_, hal_streams);
 }
 
-status_t RealtimeProcessBlock::ProcessRequests(
+status_t RealtimeProcessBlock::AddPendingRequests(
     const std::vector<ProcessBlockRequest>& process_block_requests,
     const CaptureRequest& remaining_session_request) {
-  ATRACE_CALL();
   if (process_block_requests.size() != 1) {
     ALOGE("%s: Only a single request is supported but there are %zu",
           __FUNCTION__, process_block_requests.size());
     return BAD_VALUE;
   }
 
-  {
-    std::lock_guard<std::mutex> lock(result_processor_lock_);
-    if (result_processor_ == nullptr) {
-      ALOGE("%s: result processor was not set.", __FUNCTION__);
-      return NO_INIT;
-    }
+  std::lock_guard<std::mutex> lock(result_processor_lock_);
+  if (result_processor_ == nullptr) {
+    ALOGE("%s: result processor was not set.", __FUNCTION__);
+    return NO_INIT;
+  }
 
-    status_t res = result_processor_->AddPendingRequests(
-        process_block_requests, remaining_session_request);
-    if (res != OK) {
-      ALOGE("%s: Adding a pending request to result processor failed: %s(%d)",
-            __FUNCTION__, strerror(-res), res);
-      return res;
-    }
+  status_t res = result_processor_->AddPendingRequests(
+      process_block_requests, remaining_session_request);
+  if (res != OK) {
+    ALOGE("%s: Adding a pending request to result processor failed: %s(%d)",
+          __FUNCTION__, strerror(-res), res);
+    return res;
+  }
+
+  return OK;
+}
+
+template <typename ProcessBlockRequests>
+status_t RealtimeProcessBlock::DoProcessRequests(
+    ProcessBlockRequests&& process_block_requests,
+    const CaptureRequest& remaining_session_request) {
+  status_t res =
+      AddPendingRequests(process_block_requests, remaining_session_request);
+  if (res != OK) {
+    return res;
   }
 
   std::shared_lock lock(configure_shared_mutex_);
@@ -167,17 +177,30 @@ status_t RealtimeProcessBlock::ProcessRequests(
     return NO_INIT;
   }
 
-  std::vector<HwlPipelineRequest> hwl_requests(1);
-  status_t res = hal_utils::CreateHwlPipelineRequest(
-      &hwl_requests[0], pipeline_id_, process_block_requests[0].request);
+  res = hal_utils::SubmitHwlPipelineRequests(
+      device_session_hwl_, {pipeline_id_},
+      std::forward<ProcessBlockRequests>(process_block_requests));
   if (res != OK) {
-    ALOGE("%s: Creating HWL pipeline request failed: %s(%d)", __FUNCTION__,
+    ALOGE("%s: Submitting HWL pipeline requests failed: %s(%d)", __FUNCTION__,
           strerror(-res), res);
-    return res;
   }
 
-  return device_session_hwl_->SubmitRequests(
-      process_block_requests[0].request.frame_number, hwl_requests);
+  return res;
+}
+
+status_t RealtimeProcessBlock::ProcessRequests(
+    const std::vector<ProcessBlockRequest>& process_block_requests,
+    const CaptureRequest& remaining_session_request) {
+  ATRACE_CALL();
+  return DoProcessRequests(process_block_requests, remaining_session_request);
+}
+
+status_t RealtimeProcessBlock::ProcessOwnedRequests(
+    std::vector<ProcessBlockRequest> process_block_requests,
+    const CaptureRequest& remaining_session_request) {
+  ATRACE_CALL();
+  return DoProcessRequests(std::move(process_block_requests),
+                           remaining_session_request);
 }
 
 status_t RealtimeProcessBlock::Flush() {
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "GCH_SimulatedThermalFeed"
+#include "simulated_thermal_feed.h"
+
+#include <log/log.h>
+
+#include <cmath>
+
+namespace android {
+namespace google_camera_hal {
+
+SimulatedThermalFeed::SimulatedThermalFeed(
+    const SimulatedThermalFeedConfig& config)
+    : config_(config), temperature_(config.initial_temperature) {
+}
+
+void SimulatedThermalFeed::SetPower(float power_watts) {
+  power_watts_ = power_watts;
+}
+
+Temperature SimulatedThermalFeed::Advance(int64_t duration_ns) {
+  if (duration_ns > 0) {
+    float steady_temperature =
+        config_.ambient_temperature + power_watts_ * config_.thermal_resistance;
+    float decay = config_.time_constant_ns > 0
+                      ? std::exp(-static_cast<double>(duration_ns) /
+                                 config_.time_constant_ns)
+                      : 0.0f;
+    temperature_ =
+        steady_temperature + (temperature_ - steady_temperature) * decay;
+    timestamp_ns_ += duration_ns;
+  }
+
+  return {.type = config_.type,
+          .name = config_.name,
+          .value = temperature_,
+          .throttling_status = GetThrottlingStatus(temperature_)};
+}
+
+ThrottlingSeverity SimulatedThermalFeed::GetThrottlingStatus(
+    float temperature) const {
+  uint32_t severity = 0;
+  for (float severity_temperature : config_.severity_temperatures) {
+    if (temperature < severity_temperature) {
+      break;
+    }
+    severity++;
+  }
+  return static_cast<ThrottlingSeverity>(severity);
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_GOOGLE_CAMERA_HAL_UTILS_SIMULATED_THERMAL_FEED_H_
+#define HARDWARE_GOOGLE_CAMERA_HAL_UTILS_SIMULATED_THERMAL_FEED_H_
+
+#include <array>
+#include <string>
+
+#include "thermal_types.h"
+
+namespace android {
+namespace google_camera_hal {
+
+struct SimulatedThermalFeedConfig {
+  TemperatureType type = TemperatureType::kSkin;
+  std::string name = "simulated_skin";
+
+  // Temperature in Celsius the device settles to without power.
+  float ambient_temperature = 25.0f;
+
+  // Temperature at the start of the simulation.
+  float initial_temperature = 25.0f;
+
+  // Steady-state temperature rise per watt.
+  float thermal_resistance = 5.0f;
+
+  // Time constant of the temperature response to a power change.
+  int64_t time_constant_ns = 300'000'000'000;
+
+  // Temperatures at which the simulated thermal HAL reports kLight, kModerate,
+  // kSevere, kCritical, kEmergency and kShutdown.
+  std::array<float, 6> severity_temperatures = {39.0f, 41.0f, 43.0f,
+                                                45.0f, 48.0f, 52.0f};
+};
+
+// SimulatedThermalFeed models the temperature of a device with a first-order
+// thermal model and reports it like the thermal HAL, for tests and
+// sustained-recording benchmarks of thermal mitigation. The temperature
+// approaches ambient_temperature + power * thermal_resistance exponentially
+// with time_constant_ns.
+// SimulatedThermalFeed is not thread-safe.
+class SimulatedThermalFeed {
+ public:
+  explicit SimulatedThermalFeed(
+      const SimulatedThermalFeedConfig& config = SimulatedThermalFeedConfig());
+
+  // Set the power drawn by the camera pipeline from now on.
+  void SetPower(float power_watts);
+
+  // Advance the simulation by duration_ns and return the temperature at the
+  // end of it.
+  Temperature Advance(int64_t duration_ns);
+
+  // Time since the start of the simulation.
+  int64_t GetTimestampNs() const {
+    return timestamp_ns_;
+  }
+
+ private:
+  ThrottlingSeverity GetThrottlingStatus(float temperature) const;
+
+  const SimulatedThermalFeedConfig config_;
+  float temperature_ = 0.0f;
+  float power_watts_ = 0.0f;
+  int64_t timestamp_ns_ = 0;
+};
+
+}  // namespace google_camera_hal
+}  // namespace android
+
+#endif  // HARDWARE_GOOGLE_CAMERA_HAL_UTILS_SIMULATED_THERMAL_FEED_H_
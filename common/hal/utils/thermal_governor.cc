@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "GCH_ThermalGovernor"
+#include "thermal_governor.h"
+
+#include <inttypes.h>
+#include <log/log.h>
+
+#include <algorithm>
+
+namespace android {
+namespace google_camera_hal {
+
+std::unique_ptr<ThermalGovernor> ThermalGovernor::Create(
+    const ThermalGovernorConfig& config) {
+  for (size_t i = 1; i < config.level_temperatures.size(); i++) {
+    if (config.level_temperatures[i] < config.level_temperatures[i - 1]) {
+      ALOGE("%s: Level temperatures must be ascending", __FUNCTION__);
+      return nullptr;
+    }
+  }
+  if (config.trend_smoothing <= 0.0f || config.trend_smoothing > 1.0f ||
+      config.hysteresis < 0.0f || config.prediction_horizon_ns < 0) {
+    ALOGE("%s: Invalid trend smoothing %f, hysteresis %f or horizon %" PRId64,
+          __FUNCTION__, config.trend_smoothing, config.hysteresis,
+          config.prediction_horizon_ns);
+    return nullptr;
+  }
+
+  return std::unique_ptr<ThermalGovernor>(new ThermalGovernor(config));
+}
+
+ThermalGovernor::ThermalGovernor(const ThermalGovernorConfig& config)
+    : config_(config) {
+}
+
+ThermalLevel ThermalGovernor::OnTemperature(const Temperature& temperature,
+                                            int64_t timestamp_ns) {
+  std::lock_guard<std::mutex> lock(governor_lock_);
+  SensorState& state = sensors_[temperature.name];
+  state.throttling_status = temperature.throttling_status;
+
+  if (temperature.type == config_.predicted_type) {
+    if (state.has_temperature && timestamp_ns > state.timestamp_ns) {
+      float trend = (temperature.value - state.temperature) * 1e9f /
+                    (timestamp_ns - state.timestamp_ns);
+      state.trend = config_.trend_smoothing * trend +
+                    (1.0f - config_.trend_smoothing) * state.trend;
+    }
+    state.has_temperature = true;
+    state.temperature = temperature.value;
+    state.timestamp_ns = timestamp_ns;
+  }
+
+  ThermalLevel previous_level = level_;
+  ThermalLevel level = UpdateLocked(timestamp_ns);
+  if (level != previous_level) {
+    ALOGI("%s: %s at %f C, trend %f C/s: level %u -> %u", __FUNCTION__,
+          temperature.name.c_str(), temperature.value, state.trend,
+          static_cast<uint32_t>(previous_level),
+          static_cast<uint32_t>(level));
+  }
+  return level;
+}
+
+ThermalLevel ThermalGovernor::Update(int64_t timestamp_ns) {
+  std::lock_guard<std::mutex> lock(governor_lock_);
+  return UpdateLocked(timestamp_ns);
+}
+
+ThermalLevel ThermalGovernor::GetLevel() const {
+  std::lock_guard<std::mutex> lock(governor_lock_);
+  return level_;
+}
+
+ThermalMitigation ThermalGovernor::GetMitigation() const {
+  std::lock_guard<std::mutex> lock(governor_lock_);
+  return GetMitigation(level_);
+}
+
+const ThermalMitigation& ThermalGovernor::GetMitigation(
+    ThermalLevel level) const {
+  return config_.mitigations[static_cast<size_t>(level)];
+}
+
+const ThermalMitigation& ThermalGovernor::GetDefaultMitigation(
+    ThermalLevel level) {
+  static const ThermalGovernorConfig kDefaultConfig;
+  size_t index = std::min(static_cast<size_t>(level),
+                          kDefaultConfig.mitigations.size() - 1);
+  return kDefaultConfig.mitigations[index];
+}
+
+bool ThermalGovernor::GetPredictedTemperature(float* temperature) const {
+  if (temperature == nullptr) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(governor_lock_);
+  bool found = false;
+  for (auto& [name, state] : sensors_) {
+    if (!state.has_temperature) {
+      continue;
+    }
+    float predicted = GetPredictedTemperatureLocked(state);
+    *temperature = found ? std::max(*temperature, predicted) : predicted;
+    found = true;
+  }
+  return found;
+}
+
+ThermalLevel ThermalGovernor::GetSeverityLevel(
+    ThrottlingSeverity throttling_status) {
+  switch (throttling_status) {
+    case ThrottlingSeverity::kNone:
+      return ThermalLevel::kNone;
+    case ThrottlingSeverity::kLight:
+      return ThermalLevel::kLight;
+    case ThrottlingSeverity::kModerate:
+      return ThermalLevel::kModerate;
+    default:
+      return ThermalLevel::kSevere;
+  }
+}
+
+ThermalLevel ThermalGovernor::GetTemperatureLevel(float temperature,
+                                                  float margin) const {
+  uint8_t level = 0;
+  for (float level_temperature : config_.level_temperatures) {
+    if (temperature < level_temperature - margin) {
+      break;
+    }
+    level++;
+  }
+  return static_cast<ThermalLevel>(level);
+}
+
+float ThermalGovernor::GetPredictedTemperatureLocked(
+    const SensorState& state) const {
+  // Only a rising trend is extrapolated, so that a cooling trend doesn't lower
+  // the level before the temperature itself drops.
+  return state.temperature + std::max(state.trend, 0.0f) *
+                                 config_.prediction_horizon_ns * 1e-9f;
+}
+
+ThermalLevel ThermalGovernor::UpdateLocked(int64_t timestamp_ns) {
+  // Level to go up to, and level that holds the current one with hysteresis.
+  ThermalLevel up_level = ThermalLevel::kNone;
+  ThermalLevel hold_level = ThermalLevel::kNone;
+  for (auto& [name, state] : sensors_) {
+    ThermalLevel severity_level = GetSeverityLevel(state.throttling_status);
+    up_level = std::max(up_level, severity_level);
+    hold_level = std::max(hold_level, severity_level);
+    if (state.has_temperature) {
+      float predicted = GetPredictedTemperatureLocked(state);
+      up_level = std::max(up_level, GetTemperatureLevel(predicted, 0.0f));
+      hold_level = std::max(hold_level,
+                            GetTemperatureLevel(predicted, config_.hysteresis));
+    }
+  }
+
+  if (up_level > level_) {
+    level_ = up_level;
+    level_changed_timestamp_ns_ = timestamp_ns;
+  } else if (hold_level < level_ &&
+             timestamp_ns - level_changed_timestamp_ns_ >=
+                 config_.min_step_down_interval_ns) {
+    level_ = static_cast<ThermalLevel>(static_cast<uint8_t>(level_) - 1);
+    level_changed_timestamp_ns_ = timestamp_ns;
+  }
+  return level_;
+}
+
+}  // namespace google_camera_hal
+}  // namespace android
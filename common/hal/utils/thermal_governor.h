@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_GOOGLE_CAMERA_HAL_UTILS_THERMAL_GOVERNOR_H_
+#define HARDWARE_GOOGLE_CAMERA_HAL_UTILS_THERMAL_GOVERNOR_H_
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "thermal_types.h"
+
+namespace android {
+namespace google_camera_hal {
+
+// Graduated thermal mitigation levels. Each level degrades quality more than
+// the previous one, and all of them are reversible.
+enum class ThermalLevel : uint8_t {
+  kNone = 0,
+  kLight,
+  kModerate,
+  kSevere,
+};
+
+constexpr size_t kNumThermalLevels = 4;
+
+// Quality settings to apply at a thermal level.
+struct ThermalMitigation {
+  // Whether HDR+ ZSL is enabled.
+  bool hdrplus_zsl_enabled = true;
+
+  // Max number of ZSL frames per HDR+ capture. 0 means no limit.
+  uint32_t max_zsl_payload_frames = 0;
+
+  // Max number of concurrent JPEG encodes in the HWL. 0 means no limit.
+  uint32_t max_jpeg_workers = 0;
+
+  // Max frame rate of preview requests. 0 means no cap.
+  int32_t max_preview_fps = 0;
+
+  // Scale of internal stream resolutions in (0, 1].
+  float internal_stream_scale = 1.0f;
+};
+
+struct ThermalGovernorConfig {
+  // Type of the temperatures whose trend is predicted. Temperatures of other
+  // types only contribute their throttling status.
+  TemperatureType predicted_type = TemperatureType::kSkin;
+
+  // Temperatures in Celsius at which kLight, kModerate and kSevere start.
+  // They should be below the thresholds of the thermal HAL so that the
+  // governor acts before the device throttles.
+  std::array<float, kNumThermalLevels - 1> level_temperatures = {38.0f, 40.0f,
+                                                                 42.0f};
+
+  // A level is left once the predicted temperature is this much below the
+  // temperature at which it starts.
+  float hysteresis = 1.0f;
+
+  // How far ahead the temperature trend is extrapolated.
+  int64_t prediction_horizon_ns = 20'000'000'000;
+
+  // Smoothing factor of the temperature trend in (0, 1]. Higher values follow
+  // the latest samples more closely.
+  float trend_smoothing = 0.3f;
+
+  // Minimum time between stepping down one level, so that the level doesn't
+  // oscillate around a threshold.
+  int64_t min_step_down_interval_ns = 10'000'000'000;
+
+  // Quality settings of each level.
+  std::array<ThermalMitigation, kNumThermalLevels> mitigations = {{
+      {},
+      {.max_jpeg_workers = 2},
+      {.max_zsl_payload_frames = 4,
+       .max_jpeg_workers = 1,
+       .max_preview_fps = 30,
+       .internal_stream_scale = 0.75f},
+      {.hdrplus_zsl_enabled = false,
+       .max_zsl_payload_frames = 1,
+       .max_jpeg_workers = 1,
+       .max_preview_fps = 24,
+       .internal_stream_scale = 0.5f},
+  }};
+};
+
+// ThermalGovernor turns temperature samples into a graduated thermal level.
+// The level is the highest of
+//   - the level matching the throttling status reported for each sensor, and
+//   - the level whose temperature the predicted type is expected to reach
+//     within the prediction horizon, following its smoothed trend.
+// The level goes up as soon as either does, and steps down one level at a
+// time after min_step_down_interval_ns once both are below it, with
+// hysteresis on the predicted temperature.
+// ThermalGovernor is thread-safe.
+class ThermalGovernor {
+ public:
+  static std::unique_ptr<ThermalGovernor> Create(
+      const ThermalGovernorConfig& config = ThermalGovernorConfig());
+
+  // Add a temperature sample taken at timestamp_ns and return the updated
+  // level. Samples can come from thermal HAL callbacks, polling, or a
+  // SimulatedThermalFeed.
+  ThermalLevel OnTemperature(const Temperature& temperature,
+                             int64_t timestamp_ns);
+
+  // Re-evaluate the level at timestamp_ns without a new sample, so that the
+  // level can step down when samples only arrive on status changes.
+  ThermalLevel Update(int64_t timestamp_ns);
+
+  ThermalLevel GetLevel() const;
+
+  // Quality settings of the current level.
+  ThermalMitigation GetMitigation() const;
+
+  // Quality settings of level.
+  const ThermalMitigation& GetMitigation(ThermalLevel level) const;
+
+  // Quality settings of level in the default configuration, for consumers of
+  // the level that don't own the governor.
+  static const ThermalMitigation& GetDefaultMitigation(ThermalLevel level);
+
+  // Latest temperature of the predicted type extrapolated over the
+  // prediction horizon. Returns false if no sample of that type was added.
+  bool GetPredictedTemperature(float* temperature) const;
+
+ protected:
+  explicit ThermalGovernor(const ThermalGovernorConfig& config);
+
+ private:
+  // State of one temperature sensor.
+  struct SensorState {
+    ThrottlingSeverity throttling_status = ThrottlingSeverity::kNone;
+    bool has_temperature = false;
+    float temperature = 0.0f;
+    int64_t timestamp_ns = 0;
+    // Smoothed temperature trend in Celsius per second.
+    float trend = 0.0f;
+  };
+
+  // Return the level of a throttling status reported by the thermal HAL.
+  static ThermalLevel GetSeverityLevel(ThrottlingSeverity throttling_status);
+
+  // Return the highest level whose starting temperature minus margin is at or
+  // below temperature.
+  ThermalLevel GetTemperatureLevel(float temperature, float margin) const;
+
+  float GetPredictedTemperatureLocked(const SensorState& state) const;
+
+  ThermalLevel UpdateLocked(int64_t timestamp_ns);
+
+  const ThermalGovernorConfig config_;
+
+  mutable std::mutex governor_lock_;
+
+  // Map from a sensor name to its state. Protected by governor_lock_.
+  std::unordered_map<std::string, SensorState> sensors_;
+
+  // Current level. Protected by governor_lock_.
+  ThermalLevel level_ = ThermalLevel::kNone;
+
+  // When level_ last changed. Protected by governor_lock_.
+  int64_t level_changed_timestamp_ns_ = 0;
+};
+
+}  // namespace google_camera_hal
+}  // namespace android
+
+#endif  // HARDWARE_GOOGLE_CAMERA_HAL_UTILS_THERMAL_GOVERNOR_H_
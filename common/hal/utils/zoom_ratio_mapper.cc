@@ -20,6 +20,7 @@
 
 #include <log/log.h>
 
+#include <algorithm>
 #include <cmath>
 
 #include "utils.h"
@@ -73,16 +74,6 @@ void ZoomRatioMapper::Initialize(InitParams* params) {
 Dimension ZoomRatioMapper::GetActiveArrayDimension(
     const HalCameraMetadata& metadata, bool is_physical,
     uint32_t camera_id) const {
-  Dimension active_array_dimension = active_array_dimension_;
-
-  // Overwrite based on zoom_ratio_mapper_hwl_
-  Dimension override_dimension;
-  if (zoom_ratio_mapper_hwl_ &&
-      zoom_ratio_mapper_hwl_->GetActiveArrayDimensionToBeUsed(
-          camera_id, &metadata, &override_dimension)) {
-    active_array_dimension = override_dimension;
-  }
-
   // Overwrite based on sensor pixel mode
   if (is_physical) {
     if (GetSensorPixelMode(metadata) ==
@@ -111,11 +102,18 @@ Dimension ZoomRatioMapper::GetActiveArrayDimension(
     if (GetSensorPixelMode(metadata) ==
         ANDROID_SENSOR_PIXEL_MODE_MAXIMUM_RESOLUTION) {
       return active_array_maximum_resolution_dimension_;
-    } else {
-      return active_array_dimension;
     }
   }
-  return active_array_dimension;
+
+  // Overwrite based on zoom_ratio_mapper_hwl_. This only applies to the
+  // logical camera in default pixel mode, so skip querying the HWL otherwise.
+  Dimension override_dimension;
+  if (zoom_ratio_mapper_hwl_ &&
+      zoom_ratio_mapper_hwl_->GetActiveArrayDimensionToBeUsed(
+          camera_id, &metadata, &override_dimension)) {
+    return override_dimension;
+  }
+  return active_array_dimension_;
 }
 
 void ZoomRatioMapper::UpdateCaptureRequest(CaptureRequest* request) {
@@ -132,14 +130,16 @@ void ZoomRatioMapper::UpdateCaptureRequest(CaptureRequest* request) {
   if (request->settings != nullptr) {
     Dimension active_array_dimension = GetActiveArrayDimension(
         *request->settings, /*is_physical*/ false, camera_id_);
-    ApplyZoomRatio(active_array_dimension, true, request->settings.get());
+    ApplyZoomRatio(camera_id_, active_array_dimension, true,
+                   request->settings.get());
   }
 
   for (auto& [camera_id, metadata] : request->physical_camera_settings) {
     if (metadata != nullptr) {
       Dimension physical_active_array_dimension =
           GetActiveArrayDimension(*metadata, /*is_physical*/ true, camera_id);
-      ApplyZoomRatio(physical_active_array_dimension, true, metadata.get());
+      ApplyZoomRatio(camera_id, physical_active_array_dimension, true,
+                     metadata.get());
     }
   }
   if (zoom_ratio_mapper_hwl_) {
@@ -161,14 +161,16 @@ void ZoomRatioMapper::UpdateCaptureResult(CaptureResult* result) {
   if (result->result_metadata != nullptr) {
     Dimension active_array_dimension = GetActiveArrayDimension(
         *result->result_metadata, /*is_physical*/ false, camera_id_);
-    ApplyZoomRatio(active_array_dimension, false, result->result_metadata.get());
+    ApplyZoomRatio(camera_id_, active_array_dimension, false,
+                   result->result_metadata.get());
   }
 
   for (auto& [camera_id, metadata] : result->physical_metadata) {
     if (metadata != nullptr) {
       Dimension physical_active_array_dimension =
           GetActiveArrayDimension(*metadata, /*is_physical*/ true, camera_id);
-      ApplyZoomRatio(physical_active_array_dimension, false, metadata.get());
+      ApplyZoomRatio(camera_id, physical_active_array_dimension, false,
+                     metadata.get());
     }
   }
   if (zoom_ratio_mapper_hwl_) {
@@ -176,7 +178,8 @@ void ZoomRatioMapper::UpdateCaptureResult(CaptureResult* result) {
   }
 }
 
-void ZoomRatioMapper::ApplyZoomRatio(const Dimension& active_array_dimension,
+void ZoomRatioMapper::ApplyZoomRatio(uint32_t camera_id,
+                                     const Dimension& active_array_dimension,
                                      const bool is_request,
                                      HalCameraMetadata* metadata) {
   if (metadata == nullptr) {
@@ -210,153 +213,182 @@ void ZoomRatioMapper::ApplyZoomRatio(const Dimension& active_array_dimension,
     metadata->Set(ANDROID_CONTROL_ZOOM_RATIO, &zoom_ratio, entry.count);
   }
 
+  ZoomTransform transform =
+      GetZoomTransform(zoom_ratio, active_array_dimension, is_request);
+
+  // Regions converted with a different zoom ratio or active array dimension
+  // cannot be reused.
+  ConvertedRegionCache& cache =
+      is_request ? request_region_cache_ : result_region_cache_;
+  std::lock_guard<std::mutex> lock(cache.lock);
+  ConvertedRegions& regions =
+      cache.regions[{camera_id, GetSensorPixelMode(*metadata)}];
+  if (regions.zoom_ratio != zoom_ratio ||
+      regions.active_array_dimension.width != active_array_dimension.width ||
+      regions.active_array_dimension.height != active_array_dimension.height) {
+    regions.zoom_ratio = zoom_ratio;
+    regions.active_array_dimension = active_array_dimension;
+    regions.tags.clear();
+  }
+
+  const size_t kRectSize = 4;
   for (auto tag_id : kRectToConvert) {
-    UpdateRects(zoom_ratio, tag_id, active_array_dimension, is_request,
-                metadata);
+    UpdateTag(transform, tag_id, TransformRects, kRectSize,
+              /*max_count=*/kRectSize, &regions.tags[tag_id], metadata);
   }
 
+  const size_t kWeightedRectSize = sizeof(WeightedRect) / sizeof(int32_t);
   for (auto tag_id : kWeightedRectToConvert) {
-    UpdateWeightedRects(zoom_ratio, tag_id, active_array_dimension, is_request,
-                        metadata);
+    UpdateTag(transform, tag_id, TransformWeightedRects, kWeightedRectSize,
+              /*max_count=*/0, &regions.tags[tag_id], metadata);
   }
 
   if (!is_request) {
+    const size_t kPointSize = sizeof(PointI) / sizeof(int32_t);
     for (auto tag_id : kResultPointsToConvert) {
-      UpdatePoints(zoom_ratio, tag_id, active_array_dimension, metadata);
+      UpdateTag(transform, tag_id, TransformPoints, kPointSize,
+                /*max_count=*/0, &regions.tags[tag_id], metadata);
     }
   }
 }
 
-void ZoomRatioMapper::UpdateRects(const float zoom_ratio, const uint32_t tag_id,
-                                  const Dimension& active_array_dimension,
-                                  const bool is_request,
-                                  HalCameraMetadata* metadata) {
-  if (metadata == nullptr) {
-    ALOGE("%s: metadata is nullptr", __FUNCTION__);
-    return;
-  }
-  camera_metadata_ro_entry entry = {};
-  status_t res = metadata->Get(tag_id, &entry);
-  if (res != OK || entry.count == 0) {
-    ALOGE("%s: Failed to get the region: %d, res: %d", __FUNCTION__, tag_id,
-          res);
-    return;
-  }
-  int32_t left = entry.data.i32[0];
-  int32_t top = entry.data.i32[1];
-  int32_t width = entry.data.i32[2];
-  int32_t height = entry.data.i32[3];
+ZoomRatioMapper::ZoomTransform ZoomRatioMapper::GetZoomTransform(
+    float zoom_ratio, const Dimension& active_array_dimension,
+    bool is_request) {
+  ZoomTransform transform = {
+      .zoom_ratio = zoom_ratio,
+      .active_array_dimension = active_array_dimension,
+      .is_request = is_request,
+  };
+
+  // The transforms below keep the same expressions as utils::ConvertZoomRatio
+  // for requests and utils::RevertZoomRatio for results so the results are
+  // identical.
+  transform.half_width = 0.5f * active_array_dimension.width;
+  transform.half_height = 0.5f * active_array_dimension.height;
+  transform.offset_factor =
+      is_request ? 1.0f - 1.0f / zoom_ratio : zoom_ratio - 1.0f;
+
+  return transform;
+}
 
-  if (is_request) {
-    utils::ConvertZoomRatio(zoom_ratio, active_array_dimension, &left, &top,
-                            &width, &height);
+void ZoomRatioMapper::TransformRects(const ZoomTransform& transform,
+                                     const int32_t* input, int32_t* output,
+                                     size_t count) {
+  const float zoom_ratio = transform.zoom_ratio;
+  const float half_width = transform.half_width;
+  const float half_height = transform.half_height;
+  const float factor = transform.offset_factor;
+  const Dimension& dimension = transform.active_array_dimension;
+  if (transform.is_request) {
+    const bool clamp = zoom_ratio >= 1.0f;
+    for (size_t i = 0; i + 3 < count; i += 4) {
+      int32_t left = std::round(input[i] / zoom_ratio + half_width * factor);
+      int32_t top =
+          std::round(input[i + 1] / zoom_ratio + half_height * factor);
+      int32_t width = std::round(input[i + 2] / zoom_ratio);
+      int32_t height = std::round(input[i + 3] / zoom_ratio);
+      if (clamp) {
+        utils::ClampBoundary(dimension, &left, &top, &width, &height);
+      }
+      output[i] = left;
+      output[i + 1] = top;
+      output[i + 2] = width;
+      output[i + 3] = height;
+    }
   } else {
-    utils::RevertZoomRatio(zoom_ratio, active_array_dimension, true, &left,
-                           &top, &width, &height);
-  }
-  int32_t rect[4] = {left, top, width, height};
-
-  ALOGV(
-      "%s: is request: %d, zoom ratio: %f, set rect: [%d, %d, %d, %d] -> [%d, "
-      "%d, %d, %d]",
-      __FUNCTION__, is_request, zoom_ratio, entry.data.i32[0], entry.data.i32[1],
-      entry.data.i32[2], entry.data.i32[3], rect[0], rect[1], rect[2], rect[3]);
-
-  res = metadata->Set(tag_id, rect, sizeof(rect) / sizeof(int32_t));
-  if (res != OK) {
-    ALOGE("%s: Updating region: %u failed: %s (%d)", __FUNCTION__, tag_id,
-          strerror(-res), res);
+    for (size_t i = 0; i + 3 < count; i += 4) {
+      int32_t left = std::round(input[i] * zoom_ratio - half_width * factor);
+      int32_t top =
+          std::round(input[i + 1] * zoom_ratio - half_height * factor);
+      int32_t width = std::round(input[i + 2] * zoom_ratio);
+      int32_t height = std::round(input[i + 3] * zoom_ratio);
+      utils::ClampBoundary(dimension, &left, &top, &width, &height);
+      output[i] = left;
+      output[i + 1] = top;
+      output[i + 2] = width;
+      output[i + 3] = height;
+    }
   }
 }
 
-void ZoomRatioMapper::UpdateWeightedRects(
-    const float zoom_ratio, const uint32_t tag_id,
-    const Dimension& active_array_dimension, const bool is_request,
-    HalCameraMetadata* metadata) {
-  if (metadata == nullptr) {
-    ALOGE("%s: metadata is nullptr", __FUNCTION__);
-    return;
-  }
-  camera_metadata_ro_entry entry = {};
-  status_t res = metadata->Get(tag_id, &entry);
-  if (res != OK || entry.count == 0) {
-    ALOGV("%s: Failed to get the region: %d, res: %d", __FUNCTION__, tag_id,
-          res);
-    return;
-  }
-  const WeightedRect* regions =
-      reinterpret_cast<const WeightedRect*>(entry.data.i32);
+void ZoomRatioMapper::TransformWeightedRects(const ZoomTransform& transform,
+                                             const int32_t* input,
+                                             int32_t* output, size_t count) {
+  // Each weighted rect is (left, top, right, bottom, weight).
   const size_t kNumElementsInTuple = sizeof(WeightedRect) / sizeof(int32_t);
-  std::vector<WeightedRect> updated_regions(entry.count / kNumElementsInTuple);
-
-  for (size_t i = 0; i < updated_regions.size(); i++) {
-    int32_t left = regions[i].left;
-    int32_t top = regions[i].top;
-    int32_t width = regions[i].right - regions[i].left + 1;
-    int32_t height = regions[i].bottom - regions[i].top + 1;
-
-    if (is_request) {
-      utils::ConvertZoomRatio(zoom_ratio, active_array_dimension, &left, &top,
-                              &width, &height);
-    } else {
-      utils::RevertZoomRatio(zoom_ratio, active_array_dimension, true, &left,
-                             &top, &width, &height);
-    }
-
-    updated_regions[i].left = left;
-    updated_regions[i].top = top;
-    updated_regions[i].right = left + width - 1;
-    updated_regions[i].bottom = top + height - 1;
-    updated_regions[i].weight = regions[i].weight;
-
-    ALOGV("%s: set region(%d): [%d, %d, %d, %d, %d]", __FUNCTION__, tag_id,
-          updated_regions[i].left, updated_regions[i].top,
-          updated_regions[i].right, updated_regions[i].bottom,
-          updated_regions[i].weight);
-  }
-  res = metadata->Set(tag_id, reinterpret_cast<int32_t*>(updated_regions.data()),
-                      updated_regions.size() * kNumElementsInTuple);
-  if (res != OK) {
-    ALOGE("%s: Updating region(%d) failed: %s (%d)", __FUNCTION__, tag_id,
-          strerror(-res), res);
+  for (size_t i = 0; i + kNumElementsInTuple - 1 < count;
+       i += kNumElementsInTuple) {
+    int32_t rect[4] = {input[i], input[i + 1], input[i + 2] - input[i] + 1,
+                       input[i + 3] - input[i + 1] + 1};
+    TransformRects(transform, rect, rect, /*count=*/4);
+
+    output[i] = rect[0];
+    output[i + 1] = rect[1];
+    output[i + 2] = rect[0] + rect[2] - 1;
+    output[i + 3] = rect[1] + rect[3] - 1;
+    output[i + 4] = input[i + 4];
   }
 }
 
-void ZoomRatioMapper::UpdatePoints(const float zoom_ratio, const uint32_t tag_id,
-                                   const Dimension& active_array_dimension,
-                                   HalCameraMetadata* metadata) {
-  if (metadata == nullptr) {
-    ALOGE("%s: metadata is nullptr", __FUNCTION__);
-    return;
+void ZoomRatioMapper::TransformPoints(const ZoomTransform& transform,
+                                      const int32_t* input, int32_t* output,
+                                      size_t count) {
+  const float zoom_ratio = transform.zoom_ratio;
+  const float half_width = transform.half_width;
+  const float half_height = transform.half_height;
+  const float factor = transform.offset_factor;
+  const int32_t max_x =
+      static_cast<int32_t>(transform.active_array_dimension.width) - 1;
+  const int32_t max_y =
+      static_cast<int32_t>(transform.active_array_dimension.height) - 1;
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    int32_t x = std::round(input[i] * zoom_ratio - half_width * factor);
+    int32_t y = std::round(input[i + 1] * zoom_ratio - half_height * factor);
+    output[i] = std::clamp(x, 0, max_x);
+    output[i + 1] = std::clamp(y, 0, max_y);
   }
+}
+
+void ZoomRatioMapper::UpdateTag(const ZoomTransform& transform,
+                                uint32_t tag_id, TransformFunc transform_func,
+                                size_t tuple_size, size_t max_count,
+                                ConvertedTag* converted,
+                                HalCameraMetadata* metadata) {
   camera_metadata_ro_entry entry = {};
   if (metadata->Get(tag_id, &entry) != OK) {
     ALOGV("%s: tag: %u not published.", __FUNCTION__, tag_id);
     return;
   }
 
-  if (entry.count <= 0) {
+  size_t count = entry.count - entry.count % tuple_size;
+  if (max_count != 0) {
+    count = std::min(count, max_count);
+  }
+  if (count == 0) {
     ALOGV("%s: No data found, tag: %u", __FUNCTION__, tag_id);
     return;
   }
-  // x, y
-  const uint32_t kDataSizePerPoint = 2;
-  const uint32_t point_num = entry.count / kDataSizePerPoint;
-  std::vector<PointI> points(point_num);
-  uint32_t data_index = 0;
 
-  for (uint32_t i = 0; i < point_num; i++) {
-    data_index = i * kDataSizePerPoint;
-    PointI* transformed = &points.at(i);
-    transformed->x = entry.data.i32[data_index];
-    transformed->y = entry.data.i32[data_index + 1];
-    utils::RevertZoomRatio(zoom_ratio, active_array_dimension, true,
-                           &transformed->x, &transformed->y);
+  const int32_t* input = entry.data.i32;
+  if (converted->input.size() != count ||
+      !std::equal(input, input + count, converted->input.begin())) {
+    converted->input.assign(input, input + count);
+    converted->output.resize(count);
+    transform_func(transform, input, converted->output.data(), count);
+
+    ALOGV("%s: is request: %d, zoom ratio: %f, tag: %u, count: %zu",
+          __FUNCTION__, transform.is_request, transform.zoom_ratio, tag_id,
+          count);
   }
 
-  status_t res = metadata->Set(
-      tag_id, reinterpret_cast<int32_t*>(points.data()), entry.count);
+  const std::vector<int32_t>& output = converted->output;
+  if (count == entry.count &&
+      std::equal(output.begin(), output.end(), input)) {
+    return;
+  }
 
+  status_t res = metadata->Set(tag_id, output.data(), output.size());
   if (res != OK) {
     ALOGE("%s: Updating tag: %u failed: %s (%d)", __FUNCTION__, tag_id,
           strerror(-res), res);
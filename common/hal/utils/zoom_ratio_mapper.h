@@ -17,6 +17,12 @@
 #ifndef HARDWARE_GOOGLE_CAMERA_HAL_UTILS_ZOOM_RATIO_MAPPER_H_
 #define HARDWARE_GOOGLE_CAMERA_HAL_UTILS_ZOOM_RATIO_MAPPER_H_
 
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "hal_types.h"
 #include "zoom_ratio_mapper_hwl.h"
 
@@ -45,31 +51,92 @@ class ZoomRatioMapper {
   void UpdateCaptureResult(CaptureResult* result);
 
  private:
+  // Affine transform between framework and HAL coordinates for a zoom ratio
+  // and an active array dimension. Computed once per metadata and applied to
+  // all regions and points in it.
+  struct ZoomTransform {
+    float zoom_ratio = 1.0f;
+    Dimension active_array_dimension;
+    bool is_request = false;
+    // Half of the active array dimension, and the factor scaling it into the
+    // translation applied after scaling by the zoom ratio.
+    float half_width = 0.0f;
+    float half_height = 0.0f;
+    float offset_factor = 0.0f;
+  };
+
+  // Coordinates of a tag and their converted values. Reused while the tag
+  // has the same coordinates in consecutive requests or results.
+  struct ConvertedTag {
+    std::vector<int32_t> input;
+    std::vector<int32_t> output;
+  };
+
+  // Tags converted for a camera and sensor pixel mode with a zoom ratio and
+  // an active array dimension.
+  struct ConvertedRegions {
+    float zoom_ratio = 0.0f;
+    Dimension active_array_dimension;
+    // Map from a tag ID to its converted coordinates.
+    std::unordered_map<uint32_t, ConvertedTag> tags;
+  };
+
+  // Camera ID and sensor pixel mode of converted regions.
+  using RegionKey =
+      std::pair<uint32_t, camera_metadata_enum_android_sensor_pixel_mode>;
+
+  // Converted regions of requests or of results.
+  struct ConvertedRegionCache {
+    std::mutex lock;
+    // The regions converted last for each camera and sensor pixel mode. Must
+    // be protected by lock.
+    std::map<RegionKey, ConvertedRegions> regions;
+  };
+
+  // Transforms count coordinates of a tag from input to output.
+  using TransformFunc = void (*)(const ZoomTransform& transform,
+                                 const int32_t* input, int32_t* output,
+                                 size_t count);
+
   // Gets active array dimension
   Dimension GetActiveArrayDimension(const HalCameraMetadata& metadata,
                                     bool is_physical, uint32_t camera_id) const;
 
-  // Apply zoom ratio to the capture request or result.
-  void ApplyZoomRatio(const Dimension& active_array_dimension,
-                      const bool is_request, HalCameraMetadata* metadata);
-
-  // Update rect region with respect to zoom ratio and active array
-  // dimension.
-  void UpdateRects(float zoom_ratio, const uint32_t tag_id,
-                   const Dimension& active_array_dimension,
-                   const bool is_request, HalCameraMetadata* metadata);
+  // Build the transform for a zoom ratio and active array dimension.
+  static ZoomTransform GetZoomTransform(float zoom_ratio,
+                                        const Dimension& active_array_dimension,
+                                        bool is_request);
 
-  // Update weighted rect regions with respect to zoom ratio and active array
-  // dimension.
-  void UpdateWeightedRects(float zoom_ratio, const uint32_t tag_id,
-                           const Dimension& active_array_dimension,
-                           const bool is_request, HalCameraMetadata* metadata);
+  // Apply zoom ratio to the capture request or result of camera_id.
+  void ApplyZoomRatio(uint32_t camera_id,
+                      const Dimension& active_array_dimension,
+                      const bool is_request, HalCameraMetadata* metadata);
 
-  // Update point position with respect to zoom ratio and active array
-  // dimension.
-  void UpdatePoints(float zoom_ratio, const uint32_t tag_id,
-                    const Dimension& active_array_dimension,
-                    HalCameraMetadata* metadata);
+  // Transform the coordinates of tag_id with transform_func in a single pass.
+  // Only whole tuples of tuple_size coordinates are transformed, and at most
+  // max_count coordinates are kept if max_count is not 0. The transform is
+  // skipped if the coordinates are the same as in converted, which must have
+  // been converted with the same transform, and the metadata is only updated
+  // if the coordinates change.
+  void UpdateTag(const ZoomTransform& transform, uint32_t tag_id,
+                 TransformFunc transform_func, size_t tuple_size,
+                 size_t max_count, ConvertedTag* converted,
+                 HalCameraMetadata* metadata);
+
+  // Transform rects of (left, top, width, height).
+  static void TransformRects(const ZoomTransform& transform,
+                             const int32_t* input, int32_t* output,
+                             size_t count);
+
+  // Transform weighted rects of (left, top, right, bottom, weight).
+  static void TransformWeightedRects(const ZoomTransform& transform,
+                                     const int32_t* input, int32_t* output,
+                                     size_t count);
+
+  // Transform points of (x, y). Only used for results.
+  static void TransformPoints(const ZoomTransform& transform,
+                              const int32_t* input, int32_t* output,
+                              size_t count);
 
   // Active array dimension of logical camera.
   Dimension active_array_dimension_;
@@ -93,6 +160,11 @@ class ZoomRatioMapper {
   std::unique_ptr<ZoomRatioMapperHwl> zoom_ratio_mapper_hwl_;
 
   uint32_t camera_id_;
+
+  // Tags converted in the last request and result of each camera and sensor
+  // pixel mode.
+  ConvertedRegionCache request_region_cache_;
+  ConvertedRegionCache result_region_cache_;
 };
 
 }  // namespace google_camera_hal
@@ -206,6 +206,16 @@ buffer_handle_t ZslBufferManager::GetEmptyBufferLocked() {
   return buffer;
 }
 
+uint32_t ZslBufferManager::GetAllocatedBufferCount() {
+  std::unique_lock<std::mutex> lock(zsl_buffers_lock_);
+  return buffers_.size();
+}
+
+HalBufferDescriptor ZslBufferManager::GetBufferDescriptor() {
+  std::unique_lock<std::mutex> lock(zsl_buffers_lock_);
+  return buffer_descriptor_;
+}
+
 void ZslBufferManager::FreeUnusedBuffersLocked() {
   ATRACE_CALL();
   if (empty_zsl_buffers_.size() <= kMaxUnusedBuffers ||
@@ -538,8 +548,70 @@ status_t ZslBufferManager::CleanPendingBuffers(std::vector<ZslBuffer>* buffers)
   }
 
   pending_zsl_buffers_.clear();
+  pending_capture_buffers_.clear();
   return OK;
 }
 
+void ZslBufferManager::AddPendingCaptureBuffers(
+    uint32_t frame_number, const std::vector<ZslBuffer>& buffers) {
+  ATRACE_CALL();
+  std::lock_guard<std::mutex> lock(pending_zsl_buffers_mutex);
+  std::vector<buffer_handle_t>& capture_buffers =
+      pending_capture_buffers_[frame_number];
+  for (auto& buffer : buffers) {
+    ZslBuffer zsl_buffer = {
+        .frame_number = buffer.frame_number,
+        .buffer = buffer.buffer,
+        .metadata = HalCameraMetadata::Clone(buffer.metadata.get()),
+    };
+
+    pending_zsl_buffers_.emplace(buffer.buffer.buffer, std::move(zsl_buffer));
+    capture_buffers.push_back(buffer.buffer.buffer);
+  }
+}
+
+status_t ZslBufferManager::CleanPendingCaptureBuffers(
+    uint32_t frame_number, std::vector<ZslBuffer>* buffers) {
+  ATRACE_CALL();
+  if (buffers == nullptr) {
+    ALOGE("%s: buffers is nullptr", __FUNCTION__);
+    return BAD_VALUE;
+  }
+
+  std::lock_guard<std::mutex> lock(pending_zsl_buffers_mutex);
+  auto capture_iter = pending_capture_buffers_.find(frame_number);
+  if (capture_iter == pending_capture_buffers_.end()) {
+    ALOGE("%s: Capture %u doesn't hold any buffers.", __FUNCTION__,
+          frame_number);
+    return BAD_VALUE;
+  }
+
+  for (auto& handle : capture_iter->second) {
+    auto zsl_buffer_iter = pending_zsl_buffers_.find(handle);
+    if (zsl_buffer_iter == pending_zsl_buffers_.end()) {
+      ALOGW("%s: Buffer %p of capture %u is not pending.", __FUNCTION__,
+            handle, frame_number);
+      continue;
+    }
+
+    buffers->push_back(std::move(zsl_buffer_iter->second));
+    pending_zsl_buffers_.erase(zsl_buffer_iter);
+  }
+
+  pending_capture_buffers_.erase(capture_iter);
+  return OK;
+}
+
+bool ZslBufferManager::HasPendingCaptureBuffers(uint32_t frame_number) {
+  std::lock_guard<std::mutex> lock(pending_zsl_buffers_mutex);
+  return pending_capture_buffers_.find(frame_number) !=
+         pending_capture_buffers_.end();
+}
+
+uint32_t ZslBufferManager::GetPendingCaptureCount() {
+  std::lock_guard<std::mutex> lock(pending_zsl_buffers_mutex);
+  return pending_capture_buffers_.size();
+}
+
 }  // namespace google_camera_hal
 }  // namespace android
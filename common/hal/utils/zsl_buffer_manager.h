@@ -107,12 +107,36 @@ class ZslBufferManager {
   // Check pending_zsl_buffers_ is empty or not.
   bool IsPendingBufferEmpty();
 
+  // Return the number of buffers currently allocated.
+  uint32_t GetAllocatedBufferCount();
+
+  // Return the buffer descriptor used to allocate buffers.
+  HalBufferDescriptor GetBufferDescriptor();
+
   // Add buffer map to pending_zsl_buffers_
   void AddPendingBuffers(const std::vector<ZslBuffer>& buffers);
 
   // Clean buffer map from pending_zsl_buffers_
   status_t CleanPendingBuffers(std::vector<ZslBuffer>* buffers);
 
+  // Add buffer map to pending_zsl_buffers_ and record that the buffers are
+  // held by the capture request frame_number, so that multiple captures can
+  // hold ZSL buffers at the same time.
+  void AddPendingCaptureBuffers(uint32_t frame_number,
+                                const std::vector<ZslBuffer>& buffers);
+
+  // Clean the buffers held by the capture request frame_number from
+  // pending_zsl_buffers_. Returns BAD_VALUE if the capture doesn't hold any
+  // buffers.
+  status_t CleanPendingCaptureBuffers(uint32_t frame_number,
+                                      std::vector<ZslBuffer>* buffers);
+
+  // Return if the capture request frame_number holds pending buffers.
+  bool HasPendingCaptureBuffers(uint32_t frame_number);
+
+  // Return the number of capture requests holding pending buffers.
+  uint32_t GetPendingCaptureCount();
+
  private:
   static const uint32_t kMaxPartialZslBuffers = 100;
 
@@ -178,6 +202,10 @@ class ZslBufferManager {
   // Map from buffer handle to ZSL buffer. Protected by pending_zsl_buffers_mutex.
   std::unordered_map<buffer_handle_t, ZslBuffer> pending_zsl_buffers_;
 
+  // Map from a capture request frame number to the pending buffers it holds.
+  // Protected by pending_zsl_buffers_mutex.
+  std::map<uint32_t, std::vector<buffer_handle_t>> pending_capture_buffers_;
+
   // Store the buffer descriptor when call AllocateBuffers()
   // Use it for AllocateExtraBuffers()
   HalBufferDescriptor buffer_descriptor_;
@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "reference_depth_generator.h"
+
+using android::depth_generator::DepthGenerator;
+using android::depth_generator::ReferenceDepthGenerator;
+
+// Entry point loaded by DepthProcessBlock.
+extern "C" DepthGenerator* CreateDepthGenerator() {
+  return ReferenceDepthGenerator::Create().release();
+}
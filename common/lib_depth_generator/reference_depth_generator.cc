@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ReferenceDepthGenerator"
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "reference_depth_generator.h"
+
+namespace android {
+namespace depth_generator {
+
+// Absolute difference used when the matching pixel is outside the right image.
+static constexpr uint16_t kInvalidDiff = 255;
+// DEPTH16 stores the range in the lower 13 bits and the confidence in the
+// upper 3 bits.
+static constexpr uint32_t kMaxDepthRange = 0x1FFF;
+static constexpr uint32_t kConfidenceShift = 13;
+static constexpr uint32_t kMaxDisparities = 256;
+static constexpr uint32_t kMaxBlockRadius = 64;
+
+// Return the number of bytes between rows of plane. BufferPlane::stride is in
+// bytes, but DepthProcessBlock sets it to the width in pixels.
+static uint32_t GetRowPitch(const BufferPlane& plane, uint32_t width,
+                            uint32_t bytes_per_pixel) {
+  if (plane.stride >= width * bytes_per_pixel) {
+    return plane.stride;
+  }
+  return plane.stride * bytes_per_pixel;
+}
+
+static bool IsValidBuffer(const Buffer& buffer, android_pixel_format_t format) {
+  return buffer.format == format && buffer.width > 0 && buffer.height > 0 &&
+         !buffer.planes.empty() && buffer.planes[0].addr != nullptr;
+}
+
+// Return the minimum of costs[begin, end), or the maximum cost if the range is
+// empty.
+static uint32_t MinCost(const uint32_t* costs, uint32_t begin, uint32_t end) {
+  uint32_t min_cost = std::numeric_limits<uint32_t>::max();
+  for (uint32_t d = begin; d < end; d++) {
+    min_cost = std::min(min_cost, costs[d]);
+  }
+  return min_cost;
+}
+
+std::unique_ptr<ReferenceDepthGenerator> ReferenceDepthGenerator::Create() {
+  return Create(Options());
+}
+
+std::unique_ptr<ReferenceDepthGenerator> ReferenceDepthGenerator::Create(
+    const Options& options) {
+  ATRACE_CALL();
+  if (options.num_disparities < 2 ||
+      options.num_disparities > kMaxDisparities ||
+      options.block_radius > kMaxBlockRadius || options.num_threads == 0 ||
+      options.focal_length_px <= 0.0f || options.baseline_mm <= 0.0f) {
+    ALOGE("%s: Invalid options: %u disparities, block radius %u, %u threads",
+          __FUNCTION__, options.num_disparities, options.block_radius,
+          options.num_threads);
+    return nullptr;
+  }
+
+  auto depth_generator = std::unique_ptr<ReferenceDepthGenerator>(
+      new ReferenceDepthGenerator(options));
+  if (depth_generator == nullptr) {
+    ALOGE("%s: Creating ReferenceDepthGenerator failed.", __FUNCTION__);
+    return nullptr;
+  }
+
+  depth_generator->StartWorkers();
+  return depth_generator;
+}
+
+ReferenceDepthGenerator::ReferenceDepthGenerator(const Options& options)
+    : options_(options) {
+}
+
+ReferenceDepthGenerator::~ReferenceDepthGenerator() {
+  {
+    std::lock_guard<std::mutex> lock(queue_lock_);
+    exiting_ = true;
+  }
+  queue_cond_.notify_all();
+
+  for (auto& thread : worker_threads_) {
+    thread.join();
+  }
+}
+
+void ReferenceDepthGenerator::StartWorkers() {
+  for (uint32_t i = 0; i < options_.num_threads; i++) {
+    worker_threads_.push_back(std::thread([this] { WorkerThreadLoop(); }));
+  }
+}
+
+void ReferenceDepthGenerator::SetResultCallback(
+    DepthResultCallbackFunction callback) {
+  std::lock_guard<std::mutex> lock(callback_lock_);
+  result_callback_ = callback;
+}
+
+status_t ReferenceDepthGenerator::EnqueueProcessRequest(
+    const DepthRequestInfo& request_info) {
+  ATRACE_CALL();
+  {
+    std::lock_guard<std::mutex> lock(callback_lock_);
+    if (result_callback_ == nullptr) {
+      ALOGE("%s: Result callback is not set.", __FUNCTION__);
+      return INVALID_OPERATION;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queue_lock_);
+    pending_requests_.push_back(request_info);
+    // The caller only guarantees color_buffer_metadata during the call.
+    pending_requests_.back().color_buffer_metadata = nullptr;
+  }
+  queue_cond_.notify_one();
+  return OK;
+}
+
+status_t ReferenceDepthGenerator::ExecuteProcessRequest(
+    const DepthRequestInfo& request_info) {
+  ATRACE_CALL();
+  Scratch scratch;
+  return ProcessRequest(request_info, &scratch);
+}
+
+void ReferenceDepthGenerator::WorkerThreadLoop() {
+  Scratch scratch;
+  while (true) {
+    DepthRequestInfo request_info;
+    bool exiting = false;
+    {
+      std::unique_lock<std::mutex> lock(queue_lock_);
+      queue_cond_.wait(
+          lock, [this] { return exiting_ || !pending_requests_.empty(); });
+      if (pending_requests_.empty()) {
+        return;
+      }
+
+      request_info = std::move(pending_requests_.front());
+      pending_requests_.pop_front();
+      exiting = exiting_;
+    }
+
+    // Fail the remaining requests instead of processing them when exiting.
+    status_t res = exiting ? INVALID_OPERATION
+                           : ProcessRequest(request_info, &scratch);
+
+    DepthResultCallbackFunction callback;
+    {
+      std::lock_guard<std::mutex> lock(callback_lock_);
+      callback = result_callback_;
+    }
+
+    if (callback != nullptr) {
+      callback(res == OK ? DepthResultStatus::kOk : DepthResultStatus::kError,
+               request_info.frame_number);
+    }
+  }
+}
+
+status_t ReferenceDepthGenerator::ProcessRequest(
+    const DepthRequestInfo& request_info, Scratch* scratch) const {
+  ATRACE_CALL();
+  if (request_info.ir_buffer.size() < 2 || request_info.ir_buffer[0].empty() ||
+      request_info.ir_buffer[1].empty()) {
+    ALOGE("%s: Frame %u does not have two IR buffers.", __FUNCTION__,
+          request_info.frame_number);
+    return BAD_VALUE;
+  }
+
+  const Buffer& left = request_info.ir_buffer[0][0];
+  const Buffer& right = request_info.ir_buffer[1][0];
+  const Buffer& depth = request_info.depth_buffer;
+  if (!IsValidBuffer(left, HAL_PIXEL_FORMAT_Y8) ||
+      !IsValidBuffer(right, HAL_PIXEL_FORMAT_Y8) ||
+      !IsValidBuffer(depth, HAL_PIXEL_FORMAT_Y16)) {
+    ALOGE("%s: Frame %u needs Y8 IR buffers and a Y16 depth buffer.",
+          __FUNCTION__, request_info.frame_number);
+    return BAD_VALUE;
+  }
+
+  if (left.width != right.width || left.height != right.height) {
+    ALOGE("%s: IR buffer sizes %ux%u and %ux%u differ.", __FUNCTION__,
+          left.width, left.height, right.width, right.height);
+    return BAD_VALUE;
+  }
+
+  const uint32_t width = left.width;
+  const uint32_t height = left.height;
+  const uint32_t left_pitch = GetRowPitch(left.planes[0], width, 1);
+  const uint32_t right_pitch = GetRowPitch(right.planes[0], width, 1);
+  const uint32_t depth_pitch = GetRowPitch(depth.planes[0], depth.width, 2);
+  const int32_t radius = options_.block_radius;
+  const uint32_t num_disparities = options_.num_disparities;
+
+  scratch->column_sums.assign(width * num_disparities, 0);
+  scratch->block_costs.resize(width * num_disparities);
+  scratch->aggregated_costs.resize(width * num_disparities);
+  scratch->path_costs.resize(2 * num_disparities);
+  scratch->reversed_right_row.resize(width);
+  scratch->depth_row.resize(width);
+
+  auto left_row = [&](int32_t y) {
+    y = std::clamp(y, 0, static_cast<int32_t>(height) - 1);
+    return left.planes[0].addr + y * left_pitch;
+  };
+  auto right_row = [&](int32_t y) {
+    y = std::clamp(y, 0, static_cast<int32_t>(height) - 1);
+    return right.planes[0].addr + y * right_pitch;
+  };
+
+  // Column sums over the block rows centered at row 0, replicating the
+  // border rows.
+  for (int32_t y = -radius; y <= radius; y++) {
+    AccumulateColumnSums(left_row(y), right_row(y), width, 1, scratch);
+  }
+
+  // The depth buffer may be smaller than the IR buffers. Each depth sample
+  // takes the nearest IR sample, so only the sampled rows are computed.
+  uint32_t depth_y = 0;
+  for (uint32_t y = 0; y < height && depth_y < depth.height; y++) {
+    if (y > 0) {
+      AccumulateColumnSums(left_row(y + radius), right_row(y + radius), width,
+                           1, scratch);
+      AccumulateColumnSums(left_row(y - radius - 1), right_row(y - radius - 1),
+                           width, -1, scratch);
+    }
+
+    if (depth_y * height / depth.height != y) {
+      continue;
+    }
+
+    ComputeDepthRow(width, scratch);
+    for (; depth_y < depth.height && depth_y * height / depth.height == y;
+         depth_y++) {
+      uint16_t* out = reinterpret_cast<uint16_t*>(depth.planes[0].addr +
+                                                  depth_y * depth_pitch);
+      for (uint32_t x = 0; x < depth.width; x++) {
+        out[x] = scratch->depth_row[x * width / depth.width];
+      }
+    }
+  }
+
+  return OK;
+}
+
+void ReferenceDepthGenerator::AccumulateColumnSums(const uint8_t* left_row,
+                                                   const uint8_t* right_row,
+                                                   uint32_t width,
+                                                   int32_t sign,
+                                                   Scratch* scratch) const {
+  // A pixel at x in the left image is at x - d in the right image. The inner
+  // loops are over contiguous disparities so the compiler can vectorize them,
+  // reading the right row reversed so that x - d increases with d.
+  const uint32_t num_disparities = options_.num_disparities;
+  uint8_t* reversed_right_row = scratch->reversed_right_row.data();
+  std::reverse_copy(right_row, right_row + width, reversed_right_row);
+  for (uint32_t x = 0; x < width; x++) {
+    // reversed_right_row[i + d] is right_row[x - d].
+    const uint8_t* right_pixels = reversed_right_row + (width - 1 - x);
+    uint16_t* sums = scratch->column_sums.data() + x * num_disparities;
+    const int32_t left_pixel = left_row[x];
+    const uint32_t valid_disparities = std::min(x + 1, num_disparities);
+    if (sign > 0) {
+      for (uint32_t d = 0; d < valid_disparities; d++) {
+        sums[d] += static_cast<uint16_t>(
+            std::abs(left_pixel - right_pixels[d]));
+      }
+      for (uint32_t d = valid_disparities; d < num_disparities; d++) {
+        sums[d] += kInvalidDiff;
+      }
+    } else {
+      for (uint32_t d = 0; d < valid_disparities; d++) {
+        sums[d] -= static_cast<uint16_t>(
+            std::abs(left_pixel - right_pixels[d]));
+      }
+      for (uint32_t d = valid_disparities; d < num_disparities; d++) {
+        sums[d] -= kInvalidDiff;
+      }
+    }
+  }
+}
+
+void ReferenceDepthGenerator::ComputeDepthRow(uint32_t width,
+                                              Scratch* scratch) const {
+  const int32_t radius = options_.block_radius;
+  const int32_t last_x = static_cast<int32_t>(width) - 1;
+  const uint32_t num_disparities = options_.num_disparities;
+
+  // Block costs are sliding sums of the column sums, replicating the border
+  // columns.
+  auto column_sums = [&](int32_t x) {
+    return scratch->column_sums.data() +
+           std::clamp(x, 0, last_x) * num_disparities;
+  };
+  uint32_t* block_costs = scratch->block_costs.data();
+  std::fill(block_costs, block_costs + num_disparities, 0);
+  for (int32_t x = -radius; x <= radius; x++) {
+    const uint16_t* sums = column_sums(x);
+    for (uint32_t d = 0; d < num_disparities; d++) {
+      block_costs[d] += sums[d];
+    }
+  }
+  for (int32_t x = 1; x <= last_x; x++) {
+    const uint32_t* prev_costs = block_costs;
+    block_costs += num_disparities;
+    const uint16_t* added_sums = column_sums(x + radius);
+    const uint16_t* removed_sums = column_sums(x - radius - 1);
+    for (uint32_t d = 0; d < num_disparities; d++) {
+      block_costs[d] = prev_costs[d] + added_sums[d] - removed_sums[d];
+    }
+  }
+
+  const uint32_t* row_costs = scratch->block_costs.data();
+  if (options_.small_penalty != 0 || options_.large_penalty != 0) {
+    AggregateScanline(width, /*left_to_right=*/true, scratch);
+    AggregateScanline(width, /*left_to_right=*/false, scratch);
+    row_costs = scratch->aggregated_costs.data();
+  }
+
+  for (uint32_t x = 0; x < width; x++) {
+    const uint32_t* costs = row_costs + x * num_disparities;
+    // Only disparities whose block stays inside the right image are valid.
+    const uint32_t max_d =
+        std::min(num_disparities, x >= static_cast<uint32_t>(radius)
+                                      ? x - radius + 1
+                                      : 1u);
+    // The minimum is found as a branchless reduction, which vectorizes, and
+    // then located with a scan that usually stops early.
+    const uint32_t best_cost = MinCost(costs, 0, max_d);
+    const uint32_t best_d = static_cast<uint32_t>(
+        std::find(costs, costs + max_d, best_cost) - costs);
+
+    // The second best cost away from the best disparity measures how unique
+    // the match is.
+    const uint32_t second_cost =
+        std::min(MinCost(costs, 0, best_d > 0 ? best_d - 1 : 0),
+                 MinCost(costs, std::min(best_d + 2, max_d), max_d));
+
+    if (best_d == 0 || best_d + 1 >= max_d ||
+        second_cost == std::numeric_limits<uint32_t>::max()) {
+      scratch->depth_row[x] = 0;
+      continue;
+    }
+
+    // Refine the disparity by fitting a parabola to the neighboring costs.
+    float prev_cost = costs[best_d - 1];
+    float next_cost = costs[best_d + 1];
+    float denominator = prev_cost - 2.0f * best_cost + next_cost;
+    float disparity = best_d;
+    if (denominator > 0.0f) {
+      disparity += (prev_cost - next_cost) / (2.0f * denominator);
+    }
+
+    float confidence =
+        second_cost > 0
+            ? 1.0f - static_cast<float>(best_cost) / second_cost
+            : 0.0f;
+    scratch->depth_row[x] = ToDepth16(disparity, confidence);
+  }
+}
+
+void ReferenceDepthGenerator::AggregateScanline(uint32_t width,
+                                                bool left_to_right,
+                                                Scratch* scratch) const {
+  const uint32_t num_disparities = options_.num_disparities;
+  const uint32_t block_area =
+      (2 * options_.block_radius + 1) * (2 * options_.block_radius + 1);
+  const uint32_t small_penalty = options_.small_penalty * block_area;
+  const uint32_t large_penalty = options_.large_penalty * block_area;
+  const uint32_t last_d = num_disparities - 1;
+
+  // Path costs of the previous and the current pixel along the scanline.
+  uint32_t* prev = scratch->path_costs.data();
+  uint32_t* path = prev + num_disparities;
+  uint32_t prev_min = 0;
+  for (uint32_t i = 0; i < width; i++) {
+    const uint32_t x = left_to_right ? i : width - 1 - i;
+    const uint32_t* costs = scratch->block_costs.data() + x * num_disparities;
+    uint32_t* aggregated_costs =
+        scratch->aggregated_costs.data() + x * num_disparities;
+
+    if (i == 0) {
+      std::copy(costs, costs + num_disparities, path);
+    } else {
+      const uint32_t jump_cost = prev_min + large_penalty;
+      path[0] = costs[0] - prev_min +
+                std::min({prev[0], prev[1] + small_penalty, jump_cost});
+      for (uint32_t d = 1; d < last_d; d++) {
+        path[d] = costs[d] - prev_min +
+                  std::min(std::min(prev[d], jump_cost),
+                           std::min(prev[d - 1], prev[d + 1]) + small_penalty);
+      }
+      path[last_d] =
+          costs[last_d] - prev_min +
+          std::min({prev[last_d], prev[last_d - 1] + small_penalty, jump_cost});
+    }
+
+    uint32_t min_cost = std::numeric_limits<uint32_t>::max();
+    for (uint32_t d = 0; d < num_disparities; d++) {
+      min_cost = std::min(min_cost, path[d]);
+    }
+
+    // The first pass initializes the aggregated costs and the second adds to
+    // them.
+    if (left_to_right) {
+      std::copy(path, path + num_disparities, aggregated_costs);
+    } else {
+      for (uint32_t d = 0; d < num_disparities; d++) {
+        aggregated_costs[d] += path[d];
+      }
+    }
+
+    std::swap(prev, path);
+    prev_min = min_cost;
+  }
+}
+
+uint16_t ReferenceDepthGenerator::ToDepth16(float disparity,
+                                            float confidence) const {
+  float range = options_.focal_length_px * options_.baseline_mm / disparity;
+  if (!(range > 0.0f) || range > kMaxDepthRange) {
+    return 0;
+  }
+
+  // Confidence 0 encodes 100%, and n in [1, 7] encodes (n - 1) / 7.
+  uint32_t level = static_cast<uint32_t>(
+      std::lround(std::clamp(confidence, 0.0f, 1.0f) * 7.0f));
+  uint32_t confidence_code = level == 7 ? 0 : level + 1;
+  return static_cast<uint16_t>((confidence_code << kConfidenceShift) |
+                               static_cast<uint32_t>(std::lround(range)));
+}
+
+}  // namespace depth_generator
+}  // namespace android
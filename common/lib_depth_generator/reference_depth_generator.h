@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_GOOGLE_CAMERA_LIB_REFERENCE_DEPTH_GENERATOR_H_
+#define HARDWARE_GOOGLE_CAMERA_LIB_REFERENCE_DEPTH_GENERATOR_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "depth_generator.h"
+
+namespace android {
+namespace depth_generator {
+
+// ReferenceDepthGenerator is a CPU implementation of DepthGenerator. It
+// computes a DEPTH16 buffer from the two rectified Y8 IR buffers of a request
+// (ir_buffer[0][0] and ir_buffer[1][0]) with SAD block matching, aggregated
+// along horizontal scanlines in both directions as in semi-global matching.
+// Color buffers and metadata are ignored. It does not aim to match the quality
+// of vendor depth generators, but gives a realistic workload to exercise and
+// profile the depth pipeline when no vendor library is present.
+class ReferenceDepthGenerator : public DepthGenerator {
+ public:
+  struct Options {
+    // Number of disparities searched, starting from 0.
+    uint32_t num_disparities = 64;
+    // The matching block is (2 * block_radius + 1) pixels square.
+    uint32_t block_radius = 3;
+    // Scanline aggregation penalties per block pixel for disparity changes of
+    // one and of more than one between neighboring pixels. Scanline
+    // aggregation is disabled if both are 0.
+    uint32_t small_penalty = 2;
+    uint32_t large_penalty = 16;
+    // Focal length of the IR cameras in pixels and distance between them in
+    // millimeters, used to convert disparities to depth.
+    float focal_length_px = 450.0f;
+    float baseline_mm = 25.0f;
+    // Number of threads processing asynchronous requests.
+    uint32_t num_threads = 2;
+  };
+
+  static std::unique_ptr<ReferenceDepthGenerator> Create();
+  static std::unique_ptr<ReferenceDepthGenerator> Create(
+      const Options& options);
+
+  virtual ~ReferenceDepthGenerator();
+
+  // Override functions in DepthGenerator start.
+  status_t EnqueueProcessRequest(const DepthRequestInfo& request_info) override;
+
+  status_t ExecuteProcessRequest(const DepthRequestInfo& request_info) override;
+
+  void SetResultCallback(DepthResultCallbackFunction callback) override;
+  // Override functions in DepthGenerator end.
+
+ protected:
+  ReferenceDepthGenerator(const Options& options);
+
+ private:
+  // Working memory of a depth request, reused across requests by a thread.
+  struct Scratch {
+    // Costs are stored with disparities contiguous, indexed by
+    // x * num_disparities + disparity, so the inner loops over disparities
+    // can be vectorized.
+    // Block costs of the current row.
+    std::vector<uint32_t> block_costs;
+    // Column sums of absolute differences over the block rows.
+    std::vector<uint16_t> column_sums;
+    // Block costs of the current row aggregated along the scanline in both
+    // directions.
+    std::vector<uint32_t> aggregated_costs;
+    // Path costs of two neighboring pixels during scanline aggregation.
+    std::vector<uint32_t> path_costs;
+    // The IR row of the right image in reverse order.
+    std::vector<uint8_t> reversed_right_row;
+    // DEPTH16 samples of the current row.
+    std::vector<uint16_t> depth_row;
+  };
+
+  // Start the worker threads.
+  void StartWorkers();
+
+  // Worker thread processing enqueued requests.
+  void WorkerThreadLoop();
+
+  // Compute the depth buffer of request_info.
+  status_t ProcessRequest(const DepthRequestInfo& request_info,
+                          Scratch* scratch) const;
+
+  // Add (sign 1) or subtract (sign -1) the absolute differences of IR row y
+  // to scratch->column_sums for all disparities.
+  void AccumulateColumnSums(const uint8_t* left_row, const uint8_t* right_row,
+                            uint32_t width, int32_t sign,
+                            Scratch* scratch) const;
+
+  // Compute the DEPTH16 samples of the current row into scratch->depth_row
+  // from scratch->column_sums.
+  void ComputeDepthRow(uint32_t width, Scratch* scratch) const;
+
+  // Aggregate scratch->block_costs along a horizontal scanline from left to
+  // right into scratch->aggregated_costs, or from right to left adding to it.
+  void AggregateScanline(uint32_t width, bool left_to_right,
+                         Scratch* scratch) const;
+
+  // Convert a disparity to a DEPTH16 sample with the given confidence in
+  // [0, 1].
+  uint16_t ToDepth16(float disparity, float confidence) const;
+
+  const Options options_;
+
+  std::mutex callback_lock_;
+
+  // Result callback. Must be protected by callback_lock_.
+  DepthResultCallbackFunction result_callback_;
+
+  std::mutex queue_lock_;
+
+  // Signaled when a request is enqueued or the workers should exit.
+  std::condition_variable queue_cond_;
+
+  // Requests waiting to be processed. Must be protected by queue_lock_.
+  std::deque<DepthRequestInfo> pending_requests_;
+
+  // Whether the worker threads should exit. Must be protected by queue_lock_.
+  bool exiting_ = false;
+
+  std::vector<std::thread> worker_threads_;
+};
+
+}  // namespace depth_generator
+}  // namespace android
+
+#endif  // HARDWARE_GOOGLE_CAMERA_LIB_REFERENCE_DEPTH_GENERATOR_H_
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "goog_direct_channel_reader"
+
+#include "goog_direct_channel_reader.h"
+
+#include <string.h>
+#include <utils/Log.h>
+
+#include <atomic>
+
+namespace android {
+namespace camera_sensor_listener {
+namespace {
+
+// Whether counter a is after counter b, modulo 2^32.
+bool IsCounterAfter(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) > 0;
+}
+
+}  // namespace
+
+DirectChannelReader::DirectChannelReader(const sensors_event_t* buffer,
+                                         size_t buffer_length)
+    : buffer_(buffer),
+      buffer_length_(buffer_length),
+      events_(buffer_length),
+      arrival_times_(buffer_length) {
+}
+
+size_t DirectChannelReader::Update(int64_t arrival_time) {
+  if (buffer_ == nullptr || buffer_length_ == 0) {
+    return 0;
+  }
+  if (!synced_) {
+    return Resync(arrival_time);
+  }
+
+  size_t num_new_events = 0;
+  for (size_t i = 0; i < buffer_length_; i++) {
+    uint32_t counter = LoadCounter(next_slot_);
+    if (counter != next_counter_) {
+      // Until the writer reaches the slot, it holds an event from the previous
+      // lap. A newer event means the writer lapped the reader.
+      if (IsCounterAfter(counter, next_counter_)) {
+        ALOGV("%s %d writer lapped the reader at counter %u", __func__,
+              __LINE__, next_counter_);
+        return num_new_events + Resync(arrival_time);
+      }
+      break;
+    }
+
+    sensors_event_t event;
+    if (!ReadSlot(next_slot_, next_counter_, &event)) {
+      stats_.num_torn_reads++;
+      return num_new_events + Resync(arrival_time);
+    }
+    AddEvent(event, arrival_time);
+    next_counter_++;
+    next_slot_ = (next_slot_ + 1) % buffer_length_;
+    num_new_events++;
+  }
+  return num_new_events;
+}
+
+size_t DirectChannelReader::Resync(int64_t arrival_time) {
+  // Counter 0 marks a slot that was never written.
+  bool found = false;
+  uint32_t newest_counter = 0;
+  size_t newest_slot = 0;
+  for (size_t slot = 0; slot < buffer_length_; slot++) {
+    uint32_t counter = LoadCounter(slot);
+    if (counter != 0 &&
+        (!found || IsCounterAfter(counter, newest_counter))) {
+      found = true;
+      newest_counter = counter;
+      newest_slot = slot;
+    }
+  }
+  if (!found) {
+    return 0;
+  }
+  stats_.num_resyncs++;
+
+  // Read from the oldest event that can still be in the buffer, skipping the
+  // events that were already read.
+  uint32_t first_counter = newest_counter - (buffer_length_ - 1);
+  if (synced_) {
+    if (IsCounterAfter(first_counter, next_counter_)) {
+      stats_.num_lost_events += first_counter - next_counter_;
+    } else {
+      first_counter = next_counter_;
+    }
+  }
+
+  size_t num_new_events = 0;
+  for (uint32_t counter = first_counter;
+       !IsCounterAfter(counter, newest_counter); counter++) {
+    size_t slot = (newest_slot + buffer_length_ - (newest_counter - counter)) %
+                  buffer_length_;
+    uint32_t slot_counter = LoadCounter(slot);
+    if (counter == 0 || slot_counter != counter) {
+      // Never written, or overwritten since the search.
+      if (slot_counter != 0) {
+        stats_.num_lost_events++;
+      }
+      continue;
+    }
+
+    sensors_event_t event;
+    if (!ReadSlot(slot, counter, &event)) {
+      stats_.num_torn_reads++;
+      continue;
+    }
+    AddEvent(event, arrival_time);
+    num_new_events++;
+  }
+
+  synced_ = true;
+  next_counter_ = newest_counter + 1;
+  next_slot_ = (newest_slot + 1) % buffer_length_;
+  return num_new_events;
+}
+
+bool DirectChannelReader::ReadSlot(size_t slot, uint32_t expected_counter,
+                                   sensors_event_t* event) {
+  if (LoadCounter(slot) != expected_counter) {
+    return false;
+  }
+  memcpy(event, &buffer_[slot], sizeof(*event));
+
+  // The writer updates the counter after the rest of the event, so an
+  // unchanged counter means the copy is not torn.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return static_cast<uint32_t>(__atomic_load_n(&buffer_[slot].reserved0,
+                                               __ATOMIC_RELAXED)) ==
+         expected_counter;
+}
+
+void DirectChannelReader::AddEvent(const sensors_event_t& event,
+                                   int64_t arrival_time) {
+  size_t index;
+  if (num_events_ < events_.size()) {
+    index = (oldest_index_ + num_events_) % events_.size();
+    num_events_++;
+  } else {
+    index = oldest_index_;
+    oldest_index_ = (oldest_index_ + 1) % events_.size();
+  }
+  events_[index] = event;
+  arrival_times_[index] = arrival_time;
+  stats_.num_events++;
+}
+
+uint32_t DirectChannelReader::LoadCounter(size_t slot) const {
+  return static_cast<uint32_t>(
+      __atomic_load_n(&buffer_[slot].reserved0, __ATOMIC_ACQUIRE));
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
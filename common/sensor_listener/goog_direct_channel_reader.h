@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_DIRECT_CHANNEL_READER_H_
+#define VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_DIRECT_CHANNEL_READER_H_
+
+#include <hardware/sensors.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace camera_sensor_listener {
+
+// DirectChannelReader reads the events a sensor writes to a direct channel
+// shared memory ring without locking against the writer.
+// In a direct channel, the writer stores event i (counted from 1) in slot
+// (i - 1) % buffer_length and writes the atomic counter field of the event
+// (sensors_event_t::reserved0) with i after the rest of the event. The reader
+// follows the writer head through these counters and copies only the events
+// written since the previous Update(), so the cost of an update scales with
+// the number of new events rather than the buffer length. An event whose
+// counter changes while it's being copied was overwritten and is dropped.
+// Counters are compared modulo 2^32.
+// DirectChannelReader is not thread-safe.
+class DirectChannelReader {
+ public:
+  struct Stats {
+    // Number of events copied from the shared buffer.
+    uint64_t num_events = 0;
+    // Number of events that were overwritten while being copied.
+    uint64_t num_torn_reads = 0;
+    // Number of events overwritten before they were read.
+    uint64_t num_lost_events = 0;
+    // Number of times the reader searched the whole buffer for the writer
+    // head.
+    uint64_t num_resyncs = 0;
+  };
+
+  // buffer is the direct channel shared memory holding buffer_length events.
+  // It must stay valid during the lifetime of the reader.
+  DirectChannelReader(const sensors_event_t* buffer, size_t buffer_length);
+
+  // Copy the events written since the previous update. arrival_time is
+  // recorded as the arrival time of the new events. Return the number of new
+  // events, which can be more than size() if the writer lapped the reader.
+  size_t Update(int64_t arrival_time);
+
+  // Number of events read so far that are kept, up to buffer_length.
+  size_t size() const {
+    return num_events_;
+  }
+
+  // Event i of the kept events in chronological order. Event 0 is the oldest.
+  const sensors_event_t& event(size_t i) const {
+    return events_[(oldest_index_ + i) % events_.size()];
+  }
+
+  // Arrival time of event i.
+  int64_t arrival_time(size_t i) const {
+    return arrival_times_[(oldest_index_ + i) % arrival_times_.size()];
+  }
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  // Find the writer head by searching the whole buffer and copy the events
+  // that have not been read yet. Return the number of new events.
+  size_t Resync(int64_t arrival_time);
+
+  // Copy the event in slot into event if its counter is expected_counter.
+  // Return false if the slot holds another event or the event was overwritten
+  // while being copied.
+  bool ReadSlot(size_t slot, uint32_t expected_counter,
+                sensors_event_t* event);
+
+  // Keep event, evicting the oldest kept event if needed.
+  void AddEvent(const sensors_event_t& event, int64_t arrival_time);
+
+  // Load the atomic counter of the event in slot.
+  uint32_t LoadCounter(size_t slot) const;
+
+  const sensors_event_t* const buffer_;
+  const size_t buffer_length_;
+
+  // Whether next_counter_ and next_slot_ follow the writer head.
+  bool synced_ = false;
+
+  // Counter and slot of the next event to read.
+  uint32_t next_counter_ = 0;
+  size_t next_slot_ = 0;
+
+  // Ring of the kept events and their arrival times.
+  std::vector<sensors_event_t> events_;
+  std::vector<int64_t> arrival_times_;
+  size_t oldest_index_ = 0;
+  size_t num_events_ = 0;
+
+  Stats stats_;
+};
+
+}  // namespace camera_sensor_listener
+}  // namespace android
+
+#endif  // VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_DIRECT_CHANNEL_READER_H_
@@ -54,6 +54,10 @@ GoogGyroDirect::~GoogGyroDirect() {
   if (gyro_direct_enabled_) {
     DisableDirectChannel();
   }
+  {
+    std::lock_guard<std::mutex> l(channel_reader_lock_);
+    channel_reader_ = nullptr;
+  }
   if (gyro_direct_channel_addr_) {
     goog_gralloc_wrapper_ptr_->Unlock(gyro_direct_channel_native_buf_handle_);
   }
@@ -170,6 +174,13 @@ status_t GoogGyroDirect::EnableDirectChannel() {
       return UNKNOWN_ERROR;
     }
 
+    {
+      std::lock_guard<std::mutex> l(channel_reader_lock_);
+      channel_reader_ = std::make_unique<DirectChannelReader>(
+          reinterpret_cast<const sensors_event_t*>(gyro_direct_channel_addr_),
+          gyro_direct_buf_length_);
+    }
+
     gyro_direct_initialized_ = true;
     manager->createGrallocDirectChannel(
         gyro_direct_channel_native_buf_handle_, buffer_size,
@@ -211,48 +222,75 @@ void GoogGyroDirect::QueryGyroEventsBetweenTimestamps(
   motion_vector_z->clear();
   event_arrival_timestamps->clear();
 
-  if (gyro_direct_channel_addr_ == nullptr) {
+  std::lock_guard<std::mutex> l(channel_reader_lock_);
+  if (channel_reader_ == nullptr) {
     return;
   }
-  sensors_event_t* buffer_head_ptr =
-      reinterpret_cast<sensors_event_t*>(gyro_direct_channel_addr_);
-
-  // Copy shared buffer content to local buffer as lock is lacking.
-  std::vector<sensors_event_t> event_vector;
-  event_vector.insert(event_vector.begin(), buffer_head_ptr,
-                      buffer_head_ptr + gyro_direct_buf_length_);
-
-  int64_t event_arrival_time = elapsedRealtimeNano();
-  int64_t earliest_timestamp = LLONG_MAX;
-  int head_pos = -1;
-  int num_events = event_vector.size();
-  for (int i = 0; i < num_events; ++i) {
-    if (event_vector[i].timestamp != 0 &&
-        event_vector[i].timestamp < earliest_timestamp) {
-      earliest_timestamp = event_vector[i].timestamp;
-      head_pos = i;
+  channel_reader_->Update(elapsedRealtimeNano());
+
+  // Binary search the first event after start_time.
+  size_t begin = 0;
+  size_t end = channel_reader_->size();
+  while (begin < end) {
+    size_t mid = begin + (end - begin) / 2;
+    if (channel_reader_->event(mid).timestamp <= start_time) {
+      begin = mid + 1;
+    } else {
+      end = mid;
     }
   }
 
   // Fill events within timestamps range to output vectors.
-  if (head_pos == -1) {
-    return;
-  }
-  for (int i = 0; i < num_events; ++i) {
-    int index = (head_pos + i) % num_events;
-    if (event_vector[index].timestamp <= start_time) {
-      continue;
-    }
-    if (event_vector[index].timestamp > end_time) {
+  for (size_t i = begin; i < channel_reader_->size(); ++i) {
+    const sensors_event_t& event = channel_reader_->event(i);
+    if (event.timestamp > end_time) {
       break;
     }
 
-    event_timestamps->push_back(event_vector[index].timestamp);
-    motion_vector_x->push_back(event_vector[index].data[0]);
-    motion_vector_y->push_back(event_vector[index].data[1]);
-    motion_vector_z->push_back(event_vector[index].data[2]);
-    event_arrival_timestamps->push_back(event_arrival_time);
+    event_timestamps->push_back(event.timestamp);
+    motion_vector_x->push_back(event.data[0]);
+    motion_vector_y->push_back(event.data[1]);
+    motion_vector_z->push_back(event.data[2]);
+    event_arrival_timestamps->push_back(channel_reader_->arrival_time(i));
+  }
+}
+
+void GoogGyroDirect::QueryGyroEventsForIntervals(
+    const std::vector<MotionSampleInterval>& intervals,
+    MotionSampleBatch* batch) const {
+  if (batch == nullptr) {
+    return;
+  }
+  batch->Clear();
+
+  std::lock_guard<std::mutex> l(channel_reader_lock_);
+  if (channel_reader_ == nullptr) {
+    return;
+  }
+  channel_reader_->Update(elapsedRealtimeNano());
+
+  const DirectChannelReader& reader = *channel_reader_;
+  FillMotionSampleBatch(
+      reader.size(), [&](size_t i) { return reader.event(i).timestamp; },
+      [&](size_t i) {
+        const sensors_event_t& event = reader.event(i);
+        return MotionSample{
+            .timestamp = event.timestamp,
+            .x = event.data[0],
+            .y = event.data[1],
+            .z = event.data[2],
+            .arrival_timestamp = reader.arrival_time(i),
+        };
+      },
+      intervals, batch);
+}
+
+DirectChannelReader::Stats GoogGyroDirect::GetDirectChannelStats() const {
+  std::lock_guard<std::mutex> l(channel_reader_lock_);
+  if (channel_reader_ == nullptr) {
+    return DirectChannelReader::Stats();
   }
+  return channel_reader_->stats();
 }
 
 }  // namespace camera_sensor_listener
@@ -17,10 +17,17 @@
 #ifndef VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_GYRO_DIRECT_H_
 #define VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_GYRO_DIRECT_H_
 
+#include <android-base/thread_annotations.h>
 #include <android/frameworks/sensorservice/1.0/ISensorManager.h>
 #include <android/hardware/sensors/1.0/types.h>
+#include <hardware/sensors.h>
 
+#include <mutex>
+#include <vector>
+
+#include "goog_direct_channel_reader.h"
 #include "goog_gralloc_wrapper.h"
+#include "goog_motion_sample_batch.h"
 
 namespace android {
 namespace camera_sensor_listener {
@@ -102,6 +109,18 @@ class GoogGyroDirect {
       std::vector<float>* motion_vector_z,
       std::vector<int64_t>* event_arrival_timestamps) const;
 
+  // Query gyro events of many intervals at once, e.g. all row groups of a
+  // rolling shutter readout, into batch. batch is cleared first and should be
+  // reused across queries so that steady-state queries don't allocate. See
+  // MotionSampleBatch for the output layout.
+  void QueryGyroEventsForIntervals(
+      const std::vector<MotionSampleInterval>& intervals,
+      MotionSampleBatch* batch) const;
+
+  // Get the statistics of reading the direct channel, e.g. the number of
+  // events that were overwritten before they were read.
+  DirectChannelReader::Stats GetDirectChannelStats() const;
+
   // Enable GoogGyroDirect to query events from direct channel.
   // Return 0 on success.
   status_t EnableDirectChannel();
@@ -149,6 +168,14 @@ class GoogGyroDirect {
   // Gyro sensor info.
   ::android::hardware::sensors::V1_0::SensorInfo sensor_info_;
 
+  // Lock protecting channel_reader_.
+  mutable std::mutex channel_reader_lock_;
+
+  // Reader of the direct channel buffer. Queries update it with the events
+  // written since the previous query.
+  std::unique_ptr<DirectChannelReader> channel_reader_
+      GUARDED_BY(channel_reader_lock_);
+
   // Default sensor event queue size is set to 20.
   static constexpr size_t kDefaultEventQueueSize = 20;
 
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "goog_motion_sample_batch.h"
+
+#include <cmath>
+
+namespace android {
+namespace camera_sensor_listener {
+
+void MotionSampleBatch::Clear() {
+  sample_offsets.clear();
+  timestamps.clear();
+  x.clear();
+  y.clear();
+  z.clear();
+  arrival_timestamps.clear();
+  rotations.clear();
+}
+
+void MotionSampleBatch::AddSample(const MotionSample& sample) {
+  timestamps.push_back(sample.timestamp);
+  x.push_back(sample.x);
+  y.push_back(sample.y);
+  z.push_back(sample.z);
+  arrival_timestamps.push_back(sample.arrival_timestamp);
+}
+
+void IntegrateRotation(float x, float y, float z, int64_t duration_ns,
+                       MotionQuaternion* rotation) {
+  double duration_s = duration_ns * 1e-9;
+  double angle = std::sqrt(static_cast<double>(x) * x +
+                           static_cast<double>(y) * y +
+                           static_cast<double>(z) * z) *
+                 duration_s;
+  if (angle == 0.0) {
+    return;
+  }
+
+  // Delta rotation of angle around the angular velocity axis.
+  double scale = std::sin(angle / 2) / (angle / duration_s);
+  double dw = std::cos(angle / 2);
+  double dx = x * scale;
+  double dy = y * scale;
+  double dz = z * scale;
+
+  // rotation = rotation * delta.
+  double w = rotation->w;
+  double rx = rotation->x;
+  double ry = rotation->y;
+  double rz = rotation->z;
+  double nw = w * dw - rx * dx - ry * dy - rz * dz;
+  double nx = w * dx + rx * dw + ry * dz - rz * dy;
+  double ny = w * dy - rx * dz + ry * dw + rz * dx;
+  double nz = w * dz + rx * dy - ry * dx + rz * dw;
+
+  // Renormalize to keep the rotation a unit quaternion.
+  double norm = std::sqrt(nw * nw + nx * nx + ny * ny + nz * nz);
+  rotation->w = nw / norm;
+  rotation->x = nx / norm;
+  rotation->y = ny / norm;
+  rotation->z = nz / norm;
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_MOTION_SAMPLE_BATCH_H_
+#define VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_MOTION_SAMPLE_BATCH_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace camera_sensor_listener {
+
+// Time range (start_time, end_time] of a batch query, e.g. the exposure of a
+// group of rows of a rolling shutter readout.
+struct MotionSampleInterval {
+  int64_t start_time;
+  int64_t end_time;
+};
+
+// Rotation quaternion (w, x, y, z).
+struct MotionQuaternion {
+  float w = 1.0f;
+  float x = 0.0f;
+  float y = 0.0f;
+  float z = 0.0f;
+};
+
+// One motion sensor event.
+struct MotionSample {
+  int64_t timestamp;
+  float x;
+  float y;
+  float z;
+  int64_t arrival_timestamp;
+};
+
+// MotionSampleBatch holds the motion sensor events of many intervals in
+// structure-of-arrays form. It is meant to be reused across queries: the
+// arrays are cleared but keep their capacity, so queries don't allocate once
+// the batch has grown to the largest query.
+// Sample usage:
+//   MotionSampleBatch batch;
+//   batch.integrate_rotations = true;
+//   for (each frame) {
+//     gyro->QuerySensorEventsForIntervals(row_intervals, &batch);
+//     for (size_t i = 0; i < row_intervals.size(); i++) {
+//       for (size_t j = batch.sample_offsets[i];
+//            j < batch.sample_offsets[i + 1]; j++) {
+//         Use(batch.timestamps[j], batch.x[j], batch.y[j], batch.z[j]);
+//       }
+//       Use(batch.rotations[i]);
+//     }
+//   }
+struct MotionSampleBatch {
+  // Whether queries fill rotations. Only meaningful for gyroscope events,
+  // whose data is angular velocity in rad/s.
+  bool integrate_rotations = false;
+
+  // The samples of interval i are [sample_offsets[i], sample_offsets[i + 1])
+  // of the sample arrays, in chronological order. Has one more element than
+  // the number of intervals.
+  std::vector<uint32_t> sample_offsets;
+
+  // Sample arrays.
+  std::vector<int64_t> timestamps;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<int64_t> arrival_timestamps;
+
+  // Rotation over each interval, integrated from the angular velocity of the
+  // samples. A sample's angular velocity applies from the previous sample's
+  // timestamp to its own. Empty if integrate_rotations is false.
+  std::vector<MotionQuaternion> rotations;
+
+  // Remove all samples and rotations, keeping the capacity.
+  void Clear();
+
+  // Append a sample to the current interval.
+  void AddSample(const MotionSample& sample);
+};
+
+// Rotate rotation by angular velocity (x, y, z) in rad/s for duration_ns.
+void IntegrateRotation(float x, float y, float z, int64_t duration_ns,
+                       MotionQuaternion* rotation);
+
+// Fill batch with the samples of each interval from num_events events in
+// chronological order. get_timestamp(i) returns the timestamp of event i and
+// get_sample(i) returns event i as a MotionSample.
+template <typename GetTimestamp, typename GetSample>
+void FillMotionSampleBatch(size_t num_events, GetTimestamp get_timestamp,
+                           GetSample get_sample,
+                           const std::vector<MotionSampleInterval>& intervals,
+                           MotionSampleBatch* batch) {
+  batch->Clear();
+
+  // Index of the first event whose timestamp is > timestamp.
+  auto upper_bound = [&](int64_t timestamp, size_t low) {
+    size_t high = num_events;
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      if (get_timestamp(mid) <= timestamp) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  };
+
+  for (const MotionSampleInterval& interval : intervals) {
+    batch->sample_offsets.push_back(batch->timestamps.size());
+    size_t begin = upper_bound(interval.start_time, 0);
+    size_t end = upper_bound(interval.end_time, begin);
+    for (size_t i = begin; i < end; i++) {
+      batch->AddSample(get_sample(i));
+    }
+
+    if (!batch->integrate_rotations) {
+      continue;
+    }
+
+    // Event i covers (timestamp of event i - 1, timestamp of event i], so the
+    // first event after the interval covers its end.
+    MotionQuaternion rotation;
+    size_t last = std::min(end + 1, num_events);
+    for (size_t i = std::max<size_t>(begin, 1); i < last; i++) {
+      int64_t segment_start =
+          std::max(get_timestamp(i - 1), interval.start_time);
+      int64_t segment_end = std::min(get_timestamp(i), interval.end_time);
+      if (segment_end > segment_start) {
+        MotionSample sample = get_sample(i);
+        IntegrateRotation(sample.x, sample.y, sample.z,
+                          segment_end - segment_start, &rotation);
+      }
+    }
+    batch->rotations.push_back(rotation);
+  }
+  batch->sample_offsets.push_back(batch->timestamps.size());
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
+
+#endif  // VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_MOTION_SAMPLE_BATCH_H_
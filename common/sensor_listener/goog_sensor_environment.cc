@@ -61,7 +61,8 @@ GoogSensorEnvironment::~GoogSensorEnvironment() {
 }
 
 sp<GoogSensorEnvironment> GoogSensorEnvironment::Create(
-    EnvironmentSensorType environment_sensor_type, size_t event_queue_size) {
+    EnvironmentSensorType environment_sensor_type, size_t event_queue_size,
+    std::unique_ptr<SensorEventSource> event_source) {
   // Check sensor_type validity.
   int environment_sensor_type_index = static_cast<int>(environment_sensor_type);
   if (environment_sensor_type_index >=
@@ -78,6 +79,9 @@ sp<GoogSensorEnvironment> GoogSensorEnvironment::Create(
     ALOGE("%s %d failed to create GoogSensorEnvironment for %s", __func__,
           __LINE__, GetSensorName(environment_sensor_type));
   } else {
+    if (event_source != nullptr) {
+      sensor_ptr->SetEventSource(std::move(event_source));
+    }
     // Enable sensor.
     status_t result = sensor_ptr->Enable();
     if (result != 0) {
@@ -102,19 +106,18 @@ void GoogSensorEnvironment::GetLatestNSensorEvents(
   if (num_sample < 0) {
     return;
   }
-  std::lock_guard<std::mutex> l(event_buffer_lock_);
-  int start_index =
-      std::max(0, static_cast<int>(event_buffer_.size()) - num_sample);
-  auto event = event_buffer_.begin();
-  std::advance(event, start_index);
-  for (; event != event_buffer_.end(); ++event) {
-    event_timestamps->push_back(event->sensor_event.timestamp);
-    event_data->push_back(event->sensor_event.u.scalar);
-    event_arrival_timestamps->push_back(event->event_arrival_time_ns);
-    if (event_arrival_timestamps->size() >= num_sample) {
-      break;
+  event_buffer_.Read([&](const SensorEventView& events) {
+    event_timestamps->clear();
+    event_data->clear();
+    event_arrival_timestamps->clear();
+    size_t start_index =
+        events.size() - std::min<size_t>(events.size(), num_sample);
+    for (size_t i = start_index; i < events.size(); i++) {
+      event_timestamps->push_back(events[i].sensor_event.timestamp);
+      event_data->push_back(events[i].sensor_event.u.scalar);
+      event_arrival_timestamps->push_back(events[i].event_arrival_time_ns);
     }
-  }
+  });
 }
 
 int32_t GoogSensorEnvironment::GetSensorHandle() {
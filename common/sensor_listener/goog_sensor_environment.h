@@ -72,9 +72,12 @@ class GoogSensorEnvironment : public GoogSensorWrapper {
   //   environment_sensor_type: sensor type defined in enum class
   //     EnvironmentSensorType.
   //   event_queue_size: size of event queue to hold incoming sensor events.
+  //   event_source: if not null, events come from event_source instead of
+  //     the sensor service.
   static sp<GoogSensorEnvironment> Create(
       EnvironmentSensorType environment_sensor_type,
-      size_t event_queue_size = kDefaultEventQueueSize);
+      size_t event_queue_size = kDefaultEventQueueSize,
+      std::unique_ptr<SensorEventSource> event_source = nullptr);
 
   // Destructor.
   // Destroy and free the resources of a GoogSensorEnvironment.
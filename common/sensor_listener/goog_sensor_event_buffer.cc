@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "goog_sensor_event_buffer.h"
+
+#include <stdlib.h>
+
+namespace android {
+namespace camera_sensor_listener {
+
+size_t SensorEventView::LowerBound(int64_t timestamp) const {
+  size_t low = 0;
+  size_t high = size();
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if ((*this)[mid].sensor_event.timestamp < timestamp) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+size_t SensorEventView::UpperBound(int64_t timestamp) const {
+  size_t low = 0;
+  size_t high = size();
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if ((*this)[mid].sensor_event.timestamp <= timestamp) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+size_t SensorEventView::FindNearest(int64_t timestamp) const {
+  size_t index = LowerBound(timestamp);
+  if (index == size()) {
+    return empty() ? size() : index - 1;
+  }
+  if (index > 0 &&
+      llabs((*this)[index - 1].sensor_event.timestamp - timestamp) <=
+          llabs((*this)[index].sensor_event.timestamp - timestamp)) {
+    return index - 1;
+  }
+  return index;
+}
+
+SensorEventBuffer::SensorEventBuffer(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+  events_ = std::make_unique<ExtendedSensorEvent[]>(capacity_);
+}
+
+bool SensorEventBuffer::Push(const ExtendedSensorEvent& event) {
+  if (event.sensor_event.timestamp < newest_timestamp_) {
+    return false;
+  }
+  newest_timestamp_ = event.sensor_event.timestamp;
+
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+  uint64_t num_pushed_events =
+      num_pushed_events_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  events_[num_pushed_events % capacity_] = event;
+  num_pushed_events_.store(num_pushed_events + 1, std::memory_order_relaxed);
+
+  sequence_.store(sequence + 2, std::memory_order_release);
+  return true;
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
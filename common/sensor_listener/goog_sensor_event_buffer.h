@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_EVENT_BUFFER_H_
+#define VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_EVENT_BUFFER_H_
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+
+namespace android {
+namespace camera_sensor_listener {
+
+struct ExtendedSensorEvent {
+  // Actual sensor event data.
+  ::android::hardware::sensors::V1_0::Event sensor_event;
+  // Event arrival time, i.e., time of callback being triggered.
+  int64_t event_arrival_time_ns;
+};
+
+// A snapshot of the events in a SensorEventBuffer, oldest first. The events
+// are stored in up to two contiguous spans because the buffer wraps around.
+class SensorEventView {
+ public:
+  SensorEventView(std::span<const ExtendedSensorEvent> older,
+                  std::span<const ExtendedSensorEvent> newer)
+      : older_(older), newer_(newer) {
+  }
+
+  size_t size() const {
+    return older_.size() + newer_.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  // Index 0 is the oldest event.
+  const ExtendedSensorEvent& operator[](size_t index) const {
+    return index < older_.size() ? older_[index]
+                                 : newer_[index - older_.size()];
+  }
+
+  // The events in chronological order. Events in older are before events in
+  // newer.
+  std::span<const ExtendedSensorEvent> older() const {
+    return older_;
+  }
+  std::span<const ExtendedSensorEvent> newer() const {
+    return newer_;
+  }
+
+  // Index of the first event whose timestamp is >= timestamp, or size() if
+  // there is none.
+  size_t LowerBound(int64_t timestamp) const;
+
+  // Index of the first event whose timestamp is > timestamp, or size() if
+  // there is none.
+  size_t UpperBound(int64_t timestamp) const;
+
+  // Index of the event whose timestamp is nearest to timestamp, or size() if
+  // the view is empty. The earlier event is returned on a tie.
+  size_t FindNearest(int64_t timestamp) const;
+
+ private:
+  std::span<const ExtendedSensorEvent> older_;
+  std::span<const ExtendedSensorEvent> newer_;
+};
+
+// SensorEventBuffer is a fixed-capacity ring of the most recent sensor events
+// in timestamp order. It has a single writer, the sensor event callback, and
+// any number of readers that do not block the writer.
+// Reads are protected by a sequence counter: a reader is retried if the
+// writer pushed an event while it was reading.
+// Sample usage:
+//   int64_t nearest_timestamp = 0;
+//   buffer.Read([&](const SensorEventView& events) {
+//     size_t index = events.FindNearest(timestamp);
+//     nearest_timestamp = index < events.size()
+//                             ? events[index].sensor_event.timestamp
+//                             : 0;
+//   });
+class SensorEventBuffer {
+ public:
+  explicit SensorEventBuffer(size_t capacity);
+
+  // Push an event, evicting the oldest one if the buffer is full. Events older
+  // than the newest event are dropped to keep the buffer in timestamp order.
+  // Must only be called from one thread at a time.
+  // Return false if the event is dropped.
+  bool Push(const ExtendedSensorEvent& event);
+
+  // Invoke reader with a consistent view of the buffered events. The view is
+  // only valid during the call. reader may be invoked more than once if the
+  // writer pushes an event concurrently, and must reset what it produced in a
+  // previous invocation. reader must not block or keep references to the
+  // events.
+  template <typename Reader>
+  void Read(Reader&& reader) const;
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+ private:
+  // Event storage. Slot i % capacity_ holds the i-th pushed event.
+  const size_t capacity_;
+  std::unique_ptr<ExtendedSensorEvent[]> events_;
+
+  // Odd while the writer is updating events_.
+  std::atomic<uint64_t> sequence_ = 0;
+
+  // Number of events pushed so far.
+  std::atomic<uint64_t> num_pushed_events_ = 0;
+
+  // Timestamp of the newest event. Only accessed by the writer.
+  int64_t newest_timestamp_ = INT64_MIN;
+};
+
+template <typename Reader>
+void SensorEventBuffer::Read(Reader&& reader) const {
+  while (true) {
+    uint64_t sequence = sequence_.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    uint64_t num_pushed_events =
+        num_pushed_events_.load(std::memory_order_relaxed);
+    size_t size = std::min<uint64_t>(num_pushed_events, capacity_);
+    size_t oldest_slot = (num_pushed_events - size) % capacity_;
+    size_t num_older = std::min(size, capacity_ - oldest_slot);
+    SensorEventView view(
+        std::span<const ExtendedSensorEvent>(&events_[oldest_slot], num_older),
+        std::span<const ExtendedSensorEvent>(&events_[0], size - num_older));
+    reader(view);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence_.load(std::memory_order_relaxed) == sequence) {
+      return;
+    }
+  }
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
+
+#endif  // VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_EVENT_BUFFER_H_
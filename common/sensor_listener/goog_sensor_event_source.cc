@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "goog_sensor_event_source"
+
+#include "goog_sensor_event_source.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <utils/Log.h>
+#include <utils/SystemClock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace android {
+namespace camera_sensor_listener {
+
+SensorEventSource::~SensorEventSource() {
+  Stop();
+}
+
+status_t SensorEventSource::Start(int64_t sampling_period_us,
+                                  EventCallback callback) {
+  if (delivery_thread_.joinable()) {
+    ALOGE("%s %d event source is already started", __func__, __LINE__);
+    return INVALID_OPERATION;
+  }
+  if (callback == nullptr) {
+    ALOGE("%s %d callback is null", __func__, __LINE__);
+    return BAD_VALUE;
+  }
+
+  {
+    std::lock_guard<std::mutex> l(stop_lock_);
+    stop_requested_ = false;
+  }
+  done_ = false;
+  num_delivered_events_ = 0;
+  Reset(elapsedRealtimeNano(), sampling_period_us * 1000);
+  delivery_thread_ =
+      std::thread([this, callback = std::move(callback)]() mutable {
+        DeliveryLoop(std::move(callback));
+      });
+  return OK;
+}
+
+void SensorEventSource::Stop() {
+  if (!delivery_thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(stop_lock_);
+    stop_requested_ = true;
+  }
+  stop_cv_.notify_one();
+  delivery_thread_.join();
+}
+
+bool SensorEventSource::IsDone() const {
+  return done_;
+}
+
+uint64_t SensorEventSource::GetNumDeliveredEvents() const {
+  return num_delivered_events_;
+}
+
+void SensorEventSource::DeliveryLoop(EventCallback callback) {
+  Event event;
+  int64_t delivery_time_ns = 0;
+  while (GetNextEvent(&event, &delivery_time_ns)) {
+    if (!WaitForDeliveryTime(delivery_time_ns)) {
+      return;
+    }
+    callback(event);
+    num_delivered_events_++;
+  }
+  done_ = true;
+}
+
+bool SensorEventSource::WaitForDeliveryTime(int64_t delivery_time_ns) {
+  std::unique_lock<std::mutex> l(stop_lock_);
+  while (!stop_requested_) {
+    int64_t now_ns = elapsedRealtimeNano();
+    if (delivery_time_ns <= now_ns) {
+      return true;
+    }
+    stop_cv_.wait_for(l, std::chrono::nanoseconds(delivery_time_ns - now_ns));
+  }
+  return false;
+}
+
+SyntheticSensorEventSource::SyntheticSensorEventSource(Config config)
+    : config_(std::move(config)), jitter_generator_(config_.seed) {
+}
+
+SyntheticSensorEventSource::~SyntheticSensorEventSource() {
+  // Stop before the members used by GetNextEvent are destroyed.
+  Stop();
+}
+
+void SyntheticSensorEventSource::Reset(int64_t start_time_ns,
+                                       int64_t sampling_period_ns) {
+  start_time_ns_ =
+      config_.start_time_ns != 0 ? config_.start_time_ns : start_time_ns;
+  period_ns_ = config_.rate_hz > 0 ? 1e9 / config_.rate_hz
+                                   : static_cast<double>(sampling_period_ns);
+  period_ns_ *= 1.0 + config_.drift_ppm * 1e-6;
+
+  // Rounded timestamps of consecutive events are at least floor(period)
+  // apart, so jitter below half of that keeps them strictly increasing.
+  int64_t max_jitter_ns =
+      std::max<int64_t>(0, (static_cast<int64_t>(period_ns_) - 1) / 2);
+  jitter_ns_ = std::min(config_.jitter_ns, max_jitter_ns);
+  if (jitter_ns_ < config_.jitter_ns) {
+    ALOGW("%s %d jitter %" PRId64 " ns is clamped to %" PRId64
+          " ns for period %.0f ns",
+          __func__, __LINE__, config_.jitter_ns, jitter_ns_, period_ns_);
+  }
+  next_index_ = 0;
+  jitter_generator_.seed(config_.seed);
+}
+
+bool SyntheticSensorEventSource::GetNextEvent(Event* event,
+                                              int64_t* delivery_time_ns) {
+  if (config_.max_num_events != 0 && next_index_ >= config_.max_num_events) {
+    return false;
+  }
+
+  int64_t jitter_ns = 0;
+  if (jitter_ns_ > 0) {
+    std::uniform_int_distribution<int64_t> jitter(-jitter_ns_, jitter_ns_);
+    jitter_ns = jitter(jitter_generator_);
+  }
+
+  memset(event, 0, sizeof(*event));
+  event->timestamp = start_time_ns_ +
+                     std::llround(next_index_ * period_ns_) + jitter_ns;
+  event->sensorHandle = config_.sensor_handle;
+  event->sensorType = config_.sensor_type;
+  if (config_.fill_payload != nullptr) {
+    config_.fill_payload(next_index_, event);
+  }
+  *delivery_time_ns = config_.realtime ? event->timestamp : 0;
+  next_index_++;
+  return true;
+}
+
+std::unique_ptr<ReplaySensorEventSource> ReplaySensorEventSource::Create(
+    const Config& config, const std::string& log_filename) {
+  std::ifstream log(log_filename);
+  if (!log.is_open()) {
+    ALOGE("%s %d failed to open %s", __func__, __LINE__, log_filename.c_str());
+    return nullptr;
+  }
+  return Create(config, log);
+}
+
+std::unique_ptr<ReplaySensorEventSource> ReplaySensorEventSource::Create(
+    const Config& config, std::istream& log) {
+  static constexpr size_t kMaxNumValues = 16;
+  if (config.num_values > kMaxNumValues) {
+    ALOGE("%s %d %zu payload values is more than %zu", __func__, __LINE__,
+          config.num_values, kMaxNumValues);
+    return nullptr;
+  }
+
+  std::vector<Event> events;
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(log, line)) {
+    line_number++;
+    std::istringstream fields(line);
+    Event event;
+    memset(&event, 0, sizeof(event));
+    if (!(fields >> event.timestamp)) {
+      // Skip empty lines.
+      continue;
+    }
+    for (size_t i = 0; i < config.num_values; i++) {
+      if (!(fields >> event.u.data[i])) {
+        ALOGE("%s %d line %zu has less than %zu payload values", __func__,
+              __LINE__, line_number, config.num_values);
+        return nullptr;
+      }
+    }
+    if (!events.empty() && event.timestamp <= events.back().timestamp) {
+      ALOGE("%s %d line %zu timestamp %" PRId64 " is out of order", __func__,
+            __LINE__, line_number, event.timestamp);
+      return nullptr;
+    }
+    event.sensorHandle = config.sensor_handle;
+    event.sensorType = config.sensor_type;
+    events.push_back(event);
+  }
+
+  if (events.empty()) {
+    ALOGE("%s %d log holds no events", __func__, __LINE__);
+    return nullptr;
+  }
+  return std::unique_ptr<ReplaySensorEventSource>(
+      new ReplaySensorEventSource(config, std::move(events)));
+}
+
+ReplaySensorEventSource::ReplaySensorEventSource(const Config& config,
+                                                 std::vector<Event> events)
+    : config_(config), events_(std::move(events)) {
+}
+
+ReplaySensorEventSource::~ReplaySensorEventSource() {
+  // Stop before the members used by GetNextEvent are destroyed.
+  Stop();
+}
+
+void ReplaySensorEventSource::Reset(int64_t start_time_ns,
+                                    int64_t /*sampling_period_ns*/) {
+  next_index_ = 0;
+  delivery_offset_ns_ = start_time_ns - events_.front().timestamp;
+}
+
+bool ReplaySensorEventSource::GetNextEvent(Event* event,
+                                           int64_t* delivery_time_ns) {
+  if (next_index_ >= events_.size()) {
+    return false;
+  }
+  *event = events_[next_index_++];
+  int64_t delivery_time = event->timestamp + delivery_offset_ns_;
+  if (config_.rebase_timestamps) {
+    event->timestamp = delivery_time;
+  }
+  *delivery_time_ns = config_.realtime ? delivery_time : 0;
+  return true;
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
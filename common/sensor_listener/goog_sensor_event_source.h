@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_EVENT_SOURCE_H_
+#define VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_EVENT_SOURCE_H_
+
+#include <android-base/thread_annotations.h>
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/Errors.h"
+
+namespace android {
+namespace camera_sensor_listener {
+
+// SensorEventSource delivers sensor events in place of the sensor service,
+// so that GoogSensorWrapper and its users can run without one, e.g. in
+// benchmarks on a Linux host. Events are delivered from a thread owned by
+// the source.
+// Sample usage:
+//   SyntheticSensorEventSource::Config config;
+//   config.sensor_type = SensorType::GYROSCOPE;
+//   config.rate_hz = 400;
+//   config.jitter_ns = 100000;
+//   sp<GoogSensorMotion> gyro = GoogSensorMotion::Create(
+//       MotionSensorType::GYROSCOPE, /*sampling_period_us=*/2500,
+//       /*event_queue_size=*/20,
+//       std::make_unique<SyntheticSensorEventSource>(config));
+class SensorEventSource {
+ public:
+  using Event = ::android::hardware::sensors::V1_0::Event;
+  using SensorType = ::android::hardware::sensors::V1_0::SensorType;
+  using EventCallback = std::function<void(const Event& event)>;
+
+  virtual ~SensorEventSource();
+
+  // Sensor handle of the delivered events.
+  virtual int32_t GetSensorHandle() const = 0;
+
+  // Start delivering events to callback. sampling_period_us is the sampling
+  // period requested by the listener, which a source may ignore.
+  // Return INVALID_OPERATION if the source is already started.
+  status_t Start(int64_t sampling_period_us, EventCallback callback);
+
+  // Stop delivering events. callback is not invoked after Stop returns.
+  void Stop();
+
+  // Whether all events of a finite source have been delivered.
+  bool IsDone() const;
+
+  // Number of events delivered since the last Start.
+  uint64_t GetNumDeliveredEvents() const;
+
+ protected:
+  SensorEventSource() = default;
+
+  // Rewind the source before events are delivered. start_time_ns is the
+  // elapsedRealtimeNano() time of Start.
+  virtual void Reset(int64_t start_time_ns, int64_t sampling_period_ns) = 0;
+
+  // Get the next event. delivery_time_ns is the elapsedRealtimeNano() time
+  // to deliver the event at, or 0 to deliver it right away. Return false if
+  // there are no more events.
+  virtual bool GetNextEvent(Event* event, int64_t* delivery_time_ns) = 0;
+
+ private:
+  void DeliveryLoop(EventCallback callback);
+
+  // Wait until delivery_time_ns. Return false if the source is stopped
+  // first.
+  bool WaitForDeliveryTime(int64_t delivery_time_ns);
+
+  std::thread delivery_thread_;
+
+  // Lock protecting stop_requested_.
+  std::mutex stop_lock_;
+  bool stop_requested_ GUARDED_BY(stop_lock_) = false;
+  std::condition_variable stop_cv_;
+
+  std::atomic<bool> done_ = false;
+  std::atomic<uint64_t> num_delivered_events_ = 0;
+};
+
+// SyntheticSensorEventSource generates events at a fixed rate, with optional
+// timestamp jitter and clock drift. Event k has the timestamp
+//   start_time + k * period * (1 + drift_ppm * 1e-6) + jitter
+// where jitter is uniform in [-jitter_ns, jitter_ns]. Jitter is clamped to
+// less than half of the period so the timestamps keep increasing.
+class SyntheticSensorEventSource : public SensorEventSource {
+ public:
+  struct Config {
+    SensorType sensor_type = SensorType::GYROSCOPE;
+    int32_t sensor_handle = 1;
+    // Event rate. If 0, the sampling period requested by the listener is
+    // used.
+    double rate_hz = 0;
+    // Timestamp jitter. Clamped to less than half of the period to keep the
+    // events in order.
+    int64_t jitter_ns = 0;
+    // Drift of the sensor clock in parts per million. A positive drift
+    // spaces the events further apart.
+    double drift_ppm = 0;
+    // Timestamp of the first event. If 0, the time of Start is used.
+    int64_t start_time_ns = 0;
+    // If true, events are delivered at their timestamps on the
+    // elapsedRealtimeNano() clock. Otherwise they are delivered as fast as
+    // possible, e.g. for throughput benchmarks.
+    bool realtime = true;
+    // Number of events to deliver. 0 means unlimited.
+    uint64_t max_num_events = 0;
+    // Seed of the jitter, so runs are reproducible.
+    uint32_t seed = 0;
+    // Fill the payload of event index. If null, the payload is zero.
+    std::function<void(uint64_t index, Event* event)> fill_payload;
+  };
+
+  explicit SyntheticSensorEventSource(Config config);
+  ~SyntheticSensorEventSource();
+
+  int32_t GetSensorHandle() const override {
+    return config_.sensor_handle;
+  }
+
+ protected:
+  void Reset(int64_t start_time_ns, int64_t sampling_period_ns) override;
+  bool GetNextEvent(Event* event, int64_t* delivery_time_ns) override;
+
+ private:
+  const Config config_;
+  int64_t start_time_ns_ = 0;
+  double period_ns_ = 0;
+  // config_.jitter_ns clamped for period_ns_.
+  int64_t jitter_ns_ = 0;
+  uint64_t next_index_ = 0;
+  std::mt19937 jitter_generator_;
+};
+
+// ReplaySensorEventSource replays recorded sensor events. A log has one
+// event per line: the timestamp in ns followed by the payload values, e.g.
+// the logs written by lib_sensor_listener_test. Columns after num_values
+// payload values are ignored.
+class ReplaySensorEventSource : public SensorEventSource {
+ public:
+  struct Config {
+    SensorType sensor_type = SensorType::GYROSCOPE;
+    int32_t sensor_handle = 1;
+    // Number of payload values per event, up to 16.
+    size_t num_values = 3;
+    // If true, events are delivered with the recorded spacing. Otherwise
+    // they are delivered as fast as possible.
+    bool realtime = true;
+    // If true, timestamps are shifted so that the first event has the
+    // timestamp of Start. Otherwise the recorded timestamps are kept.
+    bool rebase_timestamps = true;
+  };
+
+  // Return a replay source of the log in log_filename, or nullptr if the
+  // log can't be read or holds no events.
+  static std::unique_ptr<ReplaySensorEventSource> Create(
+      const Config& config, const std::string& log_filename);
+
+  // Return a replay source of the log read from log, or nullptr if it holds
+  // no events.
+  static std::unique_ptr<ReplaySensorEventSource> Create(const Config& config,
+                                                         std::istream& log);
+
+  ~ReplaySensorEventSource();
+
+  int32_t GetSensorHandle() const override {
+    return config_.sensor_handle;
+  }
+
+  size_t GetNumRecordedEvents() const {
+    return events_.size();
+  }
+
+ protected:
+  void Reset(int64_t start_time_ns, int64_t sampling_period_ns) override;
+  bool GetNextEvent(Event* event, int64_t* delivery_time_ns) override;
+
+ private:
+  ReplaySensorEventSource(const Config& config, std::vector<Event> events);
+
+  const Config config_;
+  const std::vector<Event> events_;
+  size_t next_index_ = 0;
+  // Offset from the recorded timestamps to the delivery times.
+  int64_t delivery_offset_ns_ = 0;
+};
+
+}  // namespace camera_sensor_listener
+}  // namespace android
+
+#endif  // VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_EVENT_SOURCE_H_
@@ -18,6 +18,7 @@
 
 #include "goog_sensor_motion.h"
 
+#include <algorithm>
 #include <cinttypes>
 
 #include "utils/Errors.h"
@@ -53,6 +54,38 @@ SensorType GetHalSensorType(MotionSensorType sensor_type) {
   }
 }
 
+// Copy events [begin, end) of events to the output vectors, replacing their
+// contents.
+void CopySensorEvents(const SensorEventView& events, size_t begin, size_t end,
+                      std::vector<int64_t>* event_timestamps,
+                      std::vector<float>* motion_vector_x,
+                      std::vector<float>* motion_vector_y,
+                      std::vector<float>* motion_vector_z,
+                      std::vector<int64_t>* event_arrival_timestamps) {
+  event_timestamps->clear();
+  motion_vector_x->clear();
+  motion_vector_y->clear();
+  motion_vector_z->clear();
+  event_arrival_timestamps->clear();
+  if (begin >= end) {
+    return;
+  }
+
+  event_timestamps->reserve(end - begin);
+  motion_vector_x->reserve(end - begin);
+  motion_vector_y->reserve(end - begin);
+  motion_vector_z->reserve(end - begin);
+  event_arrival_timestamps->reserve(end - begin);
+  for (size_t i = begin; i < end; i++) {
+    const ExtendedSensorEvent& event = events[i];
+    event_timestamps->push_back(event.sensor_event.timestamp);
+    motion_vector_x->push_back(event.sensor_event.u.vec3.x);
+    motion_vector_y->push_back(event.sensor_event.u.vec3.y);
+    motion_vector_z->push_back(event.sensor_event.u.vec3.z);
+    event_arrival_timestamps->push_back(event.event_arrival_time_ns);
+  }
+}
+
 }  // namespace
 
 GoogSensorMotion::GoogSensorMotion(MotionSensorType motion_sensor_type,
@@ -69,9 +102,9 @@ GoogSensorMotion::~GoogSensorMotion() {
   ALOGD("%s %d destroy sensor %s", __func__, __LINE__, GetSensorName());
 }
 
-sp<GoogSensorMotion> GoogSensorMotion::Create(MotionSensorType motion_sensor_type,
-                                              int64_t sampling_period_us,
-                                              size_t event_queue_size) {
+sp<GoogSensorMotion> GoogSensorMotion::Create(
+    MotionSensorType motion_sensor_type, int64_t sampling_period_us,
+    size_t event_queue_size, std::unique_ptr<SensorEventSource> event_source) {
   // Check sensor_type validity.
   int motion_sensor_type_index = static_cast<int>(motion_sensor_type);
   if (motion_sensor_type_index >= static_cast<int>(MotionSensorType::TOTAL_NUM)) {
@@ -94,6 +127,9 @@ sp<GoogSensorMotion> GoogSensorMotion::Create(MotionSensorType motion_sensor_typ
     ALOGE("%s %d failed to create GoogSensorMotion for %s", __func__, __LINE__,
           GetSensorName(motion_sensor_type));
   } else {
+    if (event_source != nullptr) {
+      sensor_ptr->SetEventSource(std::move(event_source));
+    }
     // Enable sensor.
     status_t result = sensor_ptr->Enable();
     if (result != 0) {
@@ -121,18 +157,13 @@ void GoogSensorMotion::GetLatestNSensorEvents(
   if (num_sample < 0) {
     return;
   }
-  std::lock_guard<std::mutex> l(event_buffer_lock_);
-  int start_index =
-      std::max(0, static_cast<int>(event_buffer_.size()) - num_sample);
-  auto event = event_buffer_.begin();
-  std::advance(event, start_index);
-  for (; event != event_buffer_.end(); ++event) {
-    event_timestamps->push_back(event->sensor_event.timestamp);
-    motion_vector_x->push_back(event->sensor_event.u.vec3.x);
-    motion_vector_y->push_back(event->sensor_event.u.vec3.y);
-    motion_vector_z->push_back(event->sensor_event.u.vec3.z);
-    event_arrival_timestamps->push_back(event->event_arrival_time_ns);
-  }
+  event_buffer_.Read([&](const SensorEventView& events) {
+    size_t start_index =
+        events.size() - std::min<size_t>(events.size(), num_sample);
+    CopySensorEvents(events, start_index, events.size(), event_timestamps,
+                     motion_vector_x, motion_vector_y, motion_vector_z,
+                     event_arrival_timestamps);
+  });
 }
 
 void GoogSensorMotion::QuerySensorEventsBetweenTimestamps(
@@ -140,31 +171,37 @@ void GoogSensorMotion::QuerySensorEventsBetweenTimestamps(
     std::vector<int64_t>* event_timestamps, std::vector<float>* motion_vector_x,
     std::vector<float>* motion_vector_y, std::vector<float>* motion_vector_z,
     std::vector<int64_t>* event_arrival_timestamps) const {
-  event_timestamps->clear();
-  motion_vector_x->clear();
-  motion_vector_y->clear();
-  motion_vector_z->clear();
-  event_arrival_timestamps->clear();
-
-  std::lock_guard<std::mutex> l(event_buffer_lock_);
-
-  event_timestamps->reserve(event_buffer_.size());
-  motion_vector_x->reserve(event_buffer_.size());
-  motion_vector_y->reserve(event_buffer_.size());
-  motion_vector_z->reserve(event_buffer_.size());
-  event_arrival_timestamps->reserve(event_buffer_.size());
+  event_buffer_.Read([&](const SensorEventView& events) {
+    CopySensorEvents(events, events.UpperBound(start_time),
+                     events.UpperBound(end_time), event_timestamps,
+                     motion_vector_x, motion_vector_y, motion_vector_z,
+                     event_arrival_timestamps);
+  });
+}
 
-  for (const auto& event : event_buffer_) {
-    int64_t event_time = event.sensor_event.timestamp;
-    if (event_time <= start_time || event_time > end_time) {
-      continue;
-    }
-    event_timestamps->push_back(event_time);
-    motion_vector_x->push_back(event.sensor_event.u.vec3.x);
-    motion_vector_y->push_back(event.sensor_event.u.vec3.y);
-    motion_vector_z->push_back(event.sensor_event.u.vec3.z);
-    event_arrival_timestamps->push_back(event.event_arrival_time_ns);
+void GoogSensorMotion::QuerySensorEventsForIntervals(
+    const std::vector<MotionSampleInterval>& intervals,
+    MotionSampleBatch* batch) const {
+  if (batch == nullptr) {
+    return;
   }
+
+  event_buffer_.Read([&](const SensorEventView& events) {
+    FillMotionSampleBatch(
+        events.size(),
+        [&](size_t i) { return events[i].sensor_event.timestamp; },
+        [&](size_t i) {
+          const ExtendedSensorEvent& event = events[i];
+          return MotionSample{
+              .timestamp = event.sensor_event.timestamp,
+              .x = event.sensor_event.u.vec3.x,
+              .y = event.sensor_event.u.vec3.y,
+              .z = event.sensor_event.u.vec3.z,
+              .arrival_timestamp = event.event_arrival_time_ns,
+          };
+        },
+        intervals, batch);
+  });
 }
 
 int32_t GoogSensorMotion::GetSensorHandle() {
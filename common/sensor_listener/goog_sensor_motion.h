@@ -17,6 +17,7 @@
 #ifndef VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_MOTION_H_
 #define VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_MOTION_H_
 
+#include "goog_motion_sample_batch.h"
 #include "goog_sensor_wrapper.h"
 
 namespace android {
@@ -94,10 +95,13 @@ class GoogSensorMotion : public GoogSensorWrapper {
   //     should be >= 2500us as system can only support up to 400Hz frequency.
   //     If sampling_period_us < 2500us, a nullptr will be returned.
   //   event_queue_size: size of event queue to hold incoming sensor events.
+  //   event_source: if not null, events come from event_source instead of
+  //     the sensor service.
   static sp<GoogSensorMotion> Create(
       MotionSensorType motion_sensor_type,
       int64_t sampling_period_us = kDefaultSamplingPeriodUs,
-      size_t event_queue_size = kDefaultEventQueueSize);
+      size_t event_queue_size = kDefaultEventQueueSize,
+      std::unique_ptr<SensorEventSource> event_source = nullptr);
 
   // Destructor.
   // Destroy and free the resources of a GoogSensorMotion.
@@ -152,6 +156,14 @@ class GoogSensorMotion : public GoogSensorWrapper {
       std::vector<float>* motion_vector_z,
       std::vector<int64_t>* event_arrival_timestamps) const;
 
+  // Query sensor events of many intervals at once, e.g. all row groups of a
+  // rolling shutter readout, into batch. batch is cleared first and should be
+  // reused across queries so that steady-state queries don't allocate. See
+  // MotionSampleBatch for the output layout.
+  void QuerySensorEventsForIntervals(
+      const std::vector<MotionSampleInterval>& intervals,
+      MotionSampleBatch* batch) const;
+
   const char* GetSensorName() const {
     return GetSensorName(motion_sensor_type_);
   }
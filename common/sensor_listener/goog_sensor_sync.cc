@@ -24,7 +24,6 @@
 
 #include <algorithm>
 #include <cmath>
-#include <deque>
 
 #include "utils/Errors.h"
 #include "utils/Log.h"
@@ -56,13 +55,17 @@ GoogSensorSync::~GoogSensorSync() {
   }
 }
 
-sp<GoogSensorSync> GoogSensorSync::Create(uint8_t cam_id,
-                                          size_t event_queue_size) {
+sp<GoogSensorSync> GoogSensorSync::Create(
+    uint8_t cam_id, size_t event_queue_size,
+    std::unique_ptr<SensorEventSource> event_source) {
   sp<GoogSensorSync> sensor_sync_ptr =
       new GoogSensorSync(cam_id, event_queue_size);
   if (sensor_sync_ptr == nullptr) {
     ALOGE("%s %d failed to create GoogSensorSync.", __func__, __LINE__);
   } else {
+    if (event_source != nullptr) {
+      sensor_sync_ptr->SetEventSource(std::move(event_source));
+    }
     status_t result = sensor_sync_ptr->Enable();
     if (result != 0) {
       ALOGE("%s %d failed to enable GoogSensorSync.", __func__, __LINE__);
@@ -110,19 +113,23 @@ void GoogSensorSync::GetLatestNSamples(
   if (num_sample < 0) {
     return;
   }
-  std::lock_guard<std::mutex> el(event_buffer_lock_);
-  int start_index =
-      std::max(0, static_cast<int>(event_buffer_.size()) - num_sample);
-  auto event = event_buffer_.begin();
-  std::advance(event, start_index);
-  for (; event != event_buffer_.end(); ++event) {
-    latest_n_vsync_timestamps->push_back(event->sensor_event.timestamp);
-    latest_n_arrival_timestamps->push_back(event->event_arrival_time_ns);
-    int64_t frame_id, boottime_timestamp;
-    ExtractFrameIdAndBoottimeTimestamp(*event, &frame_id, &boottime_timestamp);
-    latest_n_frame_ids->push_back(frame_id);
-    latest_n_boottime_timestamps->push_back(boottime_timestamp);
-  }
+  event_buffer_.Read([&](const SensorEventView& events) {
+    latest_n_vsync_timestamps->clear();
+    latest_n_frame_ids->clear();
+    latest_n_boottime_timestamps->clear();
+    latest_n_arrival_timestamps->clear();
+    size_t start_index =
+        events.size() - std::min<size_t>(events.size(), num_sample);
+    for (size_t i = start_index; i < events.size(); i++) {
+      const ExtendedSensorEvent& event = events[i];
+      latest_n_vsync_timestamps->push_back(event.sensor_event.timestamp);
+      latest_n_arrival_timestamps->push_back(event.event_arrival_time_ns);
+      int64_t frame_id, boottime_timestamp;
+      ExtractFrameIdAndBoottimeTimestamp(event, &frame_id, &boottime_timestamp);
+      latest_n_frame_ids->push_back(frame_id);
+      latest_n_boottime_timestamps->push_back(boottime_timestamp);
+    }
+  });
 }
 
 int32_t GoogSensorSync::GetSensorHandle() {
@@ -176,16 +183,22 @@ int64_t GoogSensorSync::SyncTimestamp(int64_t timestamp) {
     return timestamp;
   }
 
-  std::lock_guard<std::mutex> el(event_buffer_lock_);
   int64_t min_delta = kMaxTimeDriftNs;
   int64_t nearest_sync = timestamp;
-  for (auto event : event_buffer_) {
-    if (llabs(event.sensor_event.timestamp - timestamp) < min_delta) {
-      min_delta = llabs(event.sensor_event.timestamp - timestamp);
-      nearest_sync = event.sensor_event.timestamp;
+  event_buffer_.Read([&](const SensorEventView& events) {
+    min_delta = kMaxTimeDriftNs;
+    nearest_sync = timestamp;
+    size_t index = events.FindNearest(timestamp);
+    if (index < events.size()) {
+      int64_t delta = llabs(events[index].sensor_event.timestamp - timestamp);
+      if (delta < min_delta) {
+        min_delta = delta;
+        nearest_sync = events[index].sensor_event.timestamp;
+      }
     }
-  }
+  });
 
+  std::lock_guard<std::mutex> l(stats_lock_);
   sync_cnt_++;
   if (min_delta == kMaxTimeDriftNs) {
     struct timespec res;
@@ -214,16 +227,16 @@ std::optional<ExtendedSensorEvent> GoogSensorSync::FindNearestEvent(
     ALOGE("%s %d sensor_sync sensor is not enabled", __func__, __LINE__);
     return std::nullopt;
   }
-  std::lock_guard<std::mutex> el(event_buffer_lock_);
-  int64_t min_delta = kMaxTimeDriftNs;
   std::optional<ExtendedSensorEvent> nearest_event;
-  for (auto event : event_buffer_) {
-    int64_t delta = llabs(event.sensor_event.timestamp - timestamp);
-    if (delta < min_delta) {
-      min_delta = delta;
-      nearest_event = event;
+  event_buffer_.Read([&](const SensorEventView& events) {
+    nearest_event = std::nullopt;
+    size_t index = events.FindNearest(timestamp);
+    if (index < events.size() &&
+        llabs(events[index].sensor_event.timestamp - timestamp) <
+            kMaxTimeDriftNs) {
+      nearest_event = events[index];
     }
-  }
+  });
   return nearest_event;
 }
 
@@ -233,16 +246,27 @@ int64_t GoogSensorSync::MatchTimestamp(int64_t timestamp, int64_t frame_id) {
     return timestamp;
   }
 
-  std::lock_guard<std::mutex> el(event_buffer_lock_);
-  for (auto event : event_buffer_) {
-    int64_t event_frame_id, event_timestamp;
-    ExtractFrameIdAndBoottimeTimestamp(event, &event_frame_id, &event_timestamp);
-    if (frame_id == event_frame_id && timestamp == event_timestamp) {
-      match_cnt_++;
-      return event.sensor_event.timestamp;
+  // Vsync events are in timestamp order, not in boottime timestamp order, so
+  // they are matched linearly.
+  std::optional<int64_t> matched_timestamp;
+  event_buffer_.Read([&](const SensorEventView& events) {
+    matched_timestamp = std::nullopt;
+    for (size_t i = 0; i < events.size(); i++) {
+      int64_t event_frame_id, event_timestamp;
+      ExtractFrameIdAndBoottimeTimestamp(events[i], &event_frame_id,
+                                         &event_timestamp);
+      if (frame_id == event_frame_id && timestamp == event_timestamp) {
+        matched_timestamp = events[i].sensor_event.timestamp;
+        return;
+      }
     }
-  }
+  });
+
+  std::lock_guard<std::mutex> l(stats_lock_);
   match_cnt_++;
+  if (matched_timestamp.has_value()) {
+    return matched_timestamp.value();
+  }
   match_failure_cnt_++;
   if (match_failure_cnt_ >= kFailureThreshold) {
     ALOGW("%s %d Camera %d: out of %d camera timestamps, %d failed to match",
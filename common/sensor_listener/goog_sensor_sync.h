@@ -17,6 +17,8 @@
 #ifndef VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_SYNC_H_
 #define VENDOR_GOOGLE_CAMERA_SENSOR_LISTENER_GOOG_SENSOR_SYNC_H_
 
+#include <optional>
+
 #include "goog_sensor_wrapper.h"
 
 namespace android {
@@ -36,8 +38,11 @@ class GoogSensorSync : public GoogSensorWrapper {
   // Input:
   //   cam_id: physical camera id associated with Vsync sensor.
   //   event_queue_size: size of event queue to hold incoming Vsync events.
+  //   event_source: if not null, events come from event_source instead of
+  //     the sensor service.
   static sp<GoogSensorSync> Create(
-      uint8_t cam_id, size_t event_queue_size = kDefaultEventQueueSize);
+      uint8_t cam_id, size_t event_queue_size = kDefaultEventQueueSize,
+      std::unique_ptr<SensorEventSource> event_source = nullptr);
 
   // Destructor.
   // Destroy and free the resources of a GoogSensorSync.
@@ -145,15 +150,18 @@ class GoogSensorSync : public GoogSensorWrapper {
   // Threshold in logging failed SyncTimestamp.
   static constexpr int32_t kFailureThreshold = 100;
 
+  // Lock protecting the counters below.
+  std::mutex stats_lock_;
+
   // Counter for number of SyncTimeStamp() called.
-  int32_t sync_cnt_ = 0;
+  int32_t sync_cnt_ GUARDED_BY(stats_lock_) = 0;
 
   // Out of all SyncTimeStamp(), number of timestamps that failed to sync.
-  int32_t sync_failure_cnt_ = 0;
+  int32_t sync_failure_cnt_ GUARDED_BY(stats_lock_) = 0;
 
-  int32_t match_cnt_ = 0;
+  int32_t match_cnt_ GUARDED_BY(stats_lock_) = 0;
 
-  int32_t match_failure_cnt_ = 0;
+  int32_t match_failure_cnt_ GUARDED_BY(stats_lock_) = 0;
 
   // The id of the camera linked to this vsync signal.
   uint8_t cam_id_;
@@ -64,15 +64,21 @@ class EventQueueCallback : public IEventQueueCallback {
 
 GoogSensorWrapper::GoogSensorWrapper(size_t event_buffer_size,
                                      int64_t sensor_sampling_period_us)
-    : event_queue_(nullptr),
-      event_buffer_size_limit_(event_buffer_size),
+    : event_buffer_(event_buffer_size),
+      event_queue_(nullptr),
       sensor_sampling_period_us_(sensor_sampling_period_us),
       handle_(-1),
       enabled_(false) {
   ALOGV("%s %d", __func__, __LINE__);
 }
 
-GoogSensorWrapper::~GoogSensorWrapper() { ALOGV("%s %d", __func__, __LINE__); }
+GoogSensorWrapper::~GoogSensorWrapper() {
+  ALOGV("%s %d", __func__, __LINE__);
+  std::lock_guard<std::mutex> l(event_source_lock_);
+  if (event_source_ != nullptr) {
+    event_source_->Stop();
+  }
+}
 
 status_t GoogSensorWrapper::SetEventProcessor(
     std::function<void(const ExtendedSensorEvent& event)> event_processor) {
@@ -81,7 +87,26 @@ status_t GoogSensorWrapper::SetEventProcessor(
   return OK;
 }
 
+status_t GoogSensorWrapper::SetEventSource(
+    std::unique_ptr<SensorEventSource> event_source) {
+  std::lock_guard<std::mutex> l(event_source_lock_);
+  if (enabled_) {
+    ALOGE("%s %d cannot set event source of an enabled sensor", __func__,
+          __LINE__);
+    return INVALID_OPERATION;
+  }
+  event_source_ = std::move(event_source);
+  return OK;
+}
+
 status_t GoogSensorWrapper::Enable() {
+  {
+    std::lock_guard<std::mutex> l(event_source_lock_);
+    if (event_source_ != nullptr) {
+      return EnableEventSourceLocked();
+    }
+  }
+
   status_t res = OK;
   std::lock_guard<std::mutex> l(event_queue_lock_);
 
@@ -111,6 +136,16 @@ status_t GoogSensorWrapper::Enable() {
 }
 
 status_t GoogSensorWrapper::Disable() {
+  {
+    std::lock_guard<std::mutex> l(event_source_lock_);
+    if (event_source_ != nullptr) {
+      // Stop waits for the callbacks, which take event_queue_lock_.
+      event_source_->Stop();
+      enabled_ = false;
+      return OK;
+    }
+  }
+
   std::lock_guard<std::mutex> l(event_queue_lock_);
 
   if (enabled_) {
@@ -132,6 +167,26 @@ status_t GoogSensorWrapper::Disable() {
   return OK;
 }
 
+status_t GoogSensorWrapper::EnableEventSourceLocked() {
+  if (enabled_) {
+    return OK;
+  }
+  {
+    std::lock_guard<std::mutex> l(event_queue_lock_);
+    handle_ = event_source_->GetSensorHandle();
+  }
+  status_t res = event_source_->Start(
+      sensor_sampling_period_us_, [this](const Event& e) { EventCallback(e); });
+  if (res != OK) {
+    ALOGE("%s %d starting event source failed: %d(%s)", __func__, __LINE__,
+          res, strerror(-res));
+    return res;
+  }
+
+  enabled_ = true;
+  return OK;
+}
+
 status_t GoogSensorWrapper::InitializeEventQueueLocked() {
   ALOGV("%s %d", __func__, __LINE__);
 
@@ -173,13 +228,10 @@ int GoogSensorWrapper::EventCallback(const Event& e) {
   event.sensor_event = e;
   if (event.sensor_event.sensorHandle == handle_ &&
       event.sensor_event.sensorType != SensorType::ADDITIONAL_INFO) {
-    {
-      std::lock_guard<std::mutex> l(event_buffer_lock_);
-      if (event_buffer_.size() >= event_buffer_size_limit_) {
-        event_buffer_.pop_front();
-      }
-      event.event_arrival_time_ns = elapsedRealtimeNano();
-      event_buffer_.push_back(event);
+    event.event_arrival_time_ns = elapsedRealtimeNano();
+    if (!event_buffer_.Push(event)) {
+      ALOGV("%s %d dropped out-of-order event with timestamp %" PRId64,
+            __func__, __LINE__, event.sensor_event.timestamp);
     }
 
     std::lock_guard<std::mutex> el(event_processor_lock_);
@@ -21,23 +21,18 @@
 #include <android/frameworks/sensorservice/1.0/ISensorManager.h>
 #include <android/frameworks/sensorservice/1.0/types.h>
 
-#include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
 
+#include "goog_sensor_event_buffer.h"
+#include "goog_sensor_event_source.h"
 #include "utils/Errors.h"
 #include "utils/RefBase.h"
 
 namespace android {
 namespace camera_sensor_listener {
 
-struct ExtendedSensorEvent {
-  // Actual sensor event data.
-  ::android::hardware::sensors::V1_0::Event sensor_event;
-  // Event arrival time, i.e., time of callback being triggered.
-  int64_t event_arrival_time_ns;
-};
-
 class GoogSensorWrapper : public virtual RefBase {
  public:
   virtual ~GoogSensorWrapper();
@@ -50,6 +45,13 @@ class GoogSensorWrapper : public virtual RefBase {
   status_t SetEventProcessor(
       std::function<void(const ExtendedSensorEvent& event)> event_processor);
 
+  // Set an event source to use in place of the sensor service, e.g. a
+  // SyntheticSensorEventSource or ReplaySensorEventSource where no sensor
+  // service is available. Its events go through the same path as the sensor
+  // service events. It should be called before GoogleSensorWrapper::Enable,
+  // otherwise it won't take effect.
+  status_t SetEventSource(std::unique_ptr<SensorEventSource> event_source);
+
   // Enables the sensor. When object is created, sensor is disabled by default.
   // Returns 0 on success.
   status_t Enable();
@@ -72,11 +74,9 @@ class GoogSensorWrapper : public virtual RefBase {
   // Virtual function to get different sensor handler, e.g., gyro handler.
   virtual int32_t GetSensorHandle() = 0;
 
-  // Buffer of the most recent events. Oldest in the front.
-  std::deque<ExtendedSensorEvent> event_buffer_ GUARDED_BY(event_buffer_lock_);
-
-  // Lock protecting event_buffer_.
-  mutable std::mutex event_buffer_lock_;
+  // Buffer of the most recent events. Only written by EventCallback, and
+  // read without blocking it.
+  SensorEventBuffer event_buffer_;
 
  private:
   // Event callback function.
@@ -84,6 +84,10 @@ class GoogSensorWrapper : public virtual RefBase {
   // user-defined callback function event_processor_.
   int EventCallback(const ::android::hardware::sensors::V1_0::Event& e);
 
+  // Start delivering events from event_source_.
+  status_t EnableEventSourceLocked()
+      EXCLUSIVE_LOCKS_REQUIRED(event_source_lock_);
+
   // Initialize sensor handler and set event_queue_.
   status_t InitializeEventQueueLocked()
       EXCLUSIVE_LOCKS_REQUIRED(event_queue_lock_);
@@ -96,14 +100,19 @@ class GoogSensorWrapper : public virtual RefBase {
   std::function<void(const ExtendedSensorEvent& event)> event_processor_
       GUARDED_BY(event_processor_lock_);
 
+  // Event source used in place of the sensor service if not null.
+  std::unique_ptr<SensorEventSource> event_source_
+      GUARDED_BY(event_source_lock_);
+
   // Lock protecting event_queue_.
   mutable std::mutex event_queue_lock_;
 
   // Lock protecting event_processor_.
   mutable std::mutex event_processor_lock_;
 
-  // Size limit for the event buffer.
-  size_t event_buffer_size_limit_;
+  // Lock protecting event_source_. Not held by EventCallback, so that
+  // stopping the source can wait for its callbacks.
+  mutable std::mutex event_source_lock_;
 
   // Sampling period to read sensor events.
   int64_t sensor_sampling_period_us_;
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+#include "goog_direct_channel_reader.h"
+
+namespace android {
+namespace camera_sensor_listener {
+namespace {
+
+static constexpr int64_t kGyroPeriodNs = 2500000;
+
+// Simulates a sensor writing events to a direct channel buffer.
+class DirectChannelWriter {
+ public:
+  explicit DirectChannelWriter(size_t buffer_length)
+      : buffer_(buffer_length) {
+    memset(buffer_.data(), 0, buffer_.size() * sizeof(sensors_event_t));
+  }
+
+  const sensors_event_t* buffer() const {
+    return buffer_.data();
+  }
+
+  // Write the next event. Its data is derived from its counter so readers can
+  // detect torn events.
+  void WriteEvent() {
+    counter_++;
+    sensors_event_t& slot = buffer_[(counter_ - 1) % buffer_.size()];
+    slot.version = sizeof(sensors_event_t);
+    slot.timestamp = counter_ * kGyroPeriodNs;
+    for (int i = 0; i < 3; i++) {
+      slot.data[i] = static_cast<float>(counter_);
+    }
+    __atomic_store_n(&slot.reserved0, static_cast<int32_t>(counter_),
+                     __ATOMIC_RELEASE);
+  }
+
+ private:
+  std::vector<sensors_event_t> buffer_;
+  uint32_t counter_ = 0;
+};
+
+void ExpectEventsFromCounter(const DirectChannelReader& reader,
+                             uint32_t first_counter) {
+  for (size_t i = 0; i < reader.size(); i++) {
+    uint32_t counter = first_counter + i;
+    EXPECT_EQ(static_cast<uint32_t>(reader.event(i).reserved0), counter);
+    EXPECT_EQ(reader.event(i).timestamp, counter * kGyroPeriodNs);
+    EXPECT_EQ(reader.event(i).data[2], static_cast<float>(counter));
+  }
+}
+
+}  // namespace
+
+TEST(DirectChannelReaderTest, ReadNewEvents) {
+  static constexpr size_t kBufferLength = 8;
+  DirectChannelWriter writer(kBufferLength);
+  DirectChannelReader reader(writer.buffer(), kBufferLength);
+  EXPECT_EQ(reader.Update(/*arrival_time=*/1), 0u);
+
+  for (int i = 0; i < 3; i++) {
+    writer.WriteEvent();
+  }
+  EXPECT_EQ(reader.Update(/*arrival_time=*/2), 3u);
+  EXPECT_EQ(reader.Update(/*arrival_time=*/3), 0u);
+  ASSERT_EQ(reader.size(), 3u);
+  ExpectEventsFromCounter(reader, 1);
+  EXPECT_EQ(reader.arrival_time(0), 2);
+
+  // Only the new events are read, across the end of the buffer.
+  for (int i = 0; i < 7; i++) {
+    writer.WriteEvent();
+  }
+  EXPECT_EQ(reader.Update(/*arrival_time=*/4), 7u);
+  ASSERT_EQ(reader.size(), kBufferLength);
+  ExpectEventsFromCounter(reader, 3);
+  EXPECT_EQ(reader.arrival_time(0), 2);
+  EXPECT_EQ(reader.arrival_time(kBufferLength - 1), 4);
+
+  EXPECT_EQ(reader.stats().num_events, 10u);
+  EXPECT_EQ(reader.stats().num_lost_events, 0u);
+  EXPECT_EQ(reader.stats().num_torn_reads, 0u);
+}
+
+TEST(DirectChannelReaderTest, ResyncAfterBeingLapped) {
+  static constexpr size_t kBufferLength = 8;
+  DirectChannelWriter writer(kBufferLength);
+  DirectChannelReader reader(writer.buffer(), kBufferLength);
+  writer.WriteEvent();
+  EXPECT_EQ(reader.Update(/*arrival_time=*/1), 1u);
+
+  // Events 2 to 5 are overwritten before they are read.
+  for (int i = 0; i < 12; i++) {
+    writer.WriteEvent();
+  }
+  EXPECT_EQ(reader.Update(/*arrival_time=*/2), kBufferLength);
+  ASSERT_EQ(reader.size(), kBufferLength);
+  ExpectEventsFromCounter(reader, 6);
+  EXPECT_EQ(reader.stats().num_lost_events, 4u);
+
+  writer.WriteEvent();
+  EXPECT_EQ(reader.Update(/*arrival_time=*/3), 1u);
+  ExpectEventsFromCounter(reader, 7);
+}
+
+// A writer writes events as fast as possible while the reader follows it.
+// Every event read must be intact and in order.
+TEST(DirectChannelReaderTest, ConcurrentWriter) {
+  static constexpr size_t kBufferLength = 64;
+  static constexpr int kNumEvents = 200000;
+  DirectChannelWriter writer(kBufferLength);
+  DirectChannelReader reader(writer.buffer(), kBufferLength);
+
+  std::atomic<bool> writer_done = false;
+  std::thread writer_thread([&] {
+    for (int i = 0; i < kNumEvents; i++) {
+      writer.WriteEvent();
+    }
+    writer_done = true;
+  });
+
+  uint32_t last_counter = 0;
+  bool done = false;
+  while (!done) {
+    done = writer_done;
+    size_t num_new_events = reader.Update(/*arrival_time=*/0);
+    num_new_events = std::min(num_new_events, reader.size());
+    for (size_t i = reader.size() - num_new_events; i < reader.size(); i++) {
+      const sensors_event_t& event = reader.event(i);
+      uint32_t counter = static_cast<uint32_t>(event.reserved0);
+      ASSERT_GT(counter, last_counter);
+      ASSERT_EQ(event.timestamp, counter * kGyroPeriodNs);
+      ASSERT_EQ(event.data[0], static_cast<float>(counter));
+      last_counter = counter;
+    }
+  }
+  writer_thread.join();
+
+  const DirectChannelReader::Stats& stats = reader.stats();
+  EXPECT_EQ(last_counter, static_cast<uint32_t>(kNumEvents));
+  EXPECT_LE(stats.num_events + stats.num_lost_events + stats.num_torn_reads,
+            static_cast<uint64_t>(kNumEvents));
+  ALOGI("%s: %llu events read, %llu lost, %llu torn, %llu resyncs", __func__,
+        static_cast<unsigned long long>(stats.num_events),
+        static_cast<unsigned long long>(stats.num_lost_events),
+        static_cast<unsigned long long>(stats.num_torn_reads),
+        static_cast<unsigned long long>(stats.num_resyncs));
+}
+
+// Compare reading a few new events per query with copying and scanning the
+// whole buffer per query.
+TEST(DirectChannelReaderTest, UpdateBenchmark) {
+  static constexpr size_t kBufferLength = 4000;
+  static constexpr int kNumQueries = 2000;
+  static constexpr int kEventsPerQuery = 8;
+  DirectChannelWriter writer(kBufferLength);
+  DirectChannelReader reader(writer.buffer(), kBufferLength);
+  for (size_t i = 0; i < kBufferLength; i++) {
+    writer.WriteEvent();
+  }
+  reader.Update(/*arrival_time=*/0);
+
+  int64_t update_ns = 0;
+  int64_t copy_ns = 0;
+  int64_t num_found = 0;
+  for (int query = 0; query < kNumQueries; query++) {
+    for (int i = 0; i < kEventsPerQuery; i++) {
+      writer.WriteEvent();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(reader.Update(/*arrival_time=*/query), kEventsPerQuery);
+    auto end = std::chrono::steady_clock::now();
+    update_ns +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count();
+
+    start = std::chrono::steady_clock::now();
+    std::vector<sensors_event_t> events(writer.buffer(),
+                                        writer.buffer() + kBufferLength);
+    int64_t earliest_timestamp = INT64_MAX;
+    for (const sensors_event_t& event : events) {
+      earliest_timestamp = std::min(earliest_timestamp, event.timestamp);
+    }
+    num_found += earliest_timestamp > 0;
+    end = std::chrono::steady_clock::now();
+    copy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                   .count();
+  }
+
+  EXPECT_EQ(num_found, kNumQueries);
+  EXPECT_EQ(reader.stats().num_resyncs, 1u);
+  ALOGI("%s: %zu events buffered, %d new per query: update %lld ns, "
+        "copy and scan %lld ns per query",
+        __func__, kBufferLength, kEventsPerQuery,
+        static_cast<long long>(update_ns / kNumQueries),
+        static_cast<long long>(copy_ns / kNumQueries));
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+#include "goog_motion_sample_batch.h"
+
+namespace android {
+namespace camera_sensor_listener {
+namespace {
+
+// 400 Hz gyro events rotating around the z axis at a constant rate.
+static constexpr int64_t kGyroPeriodNs = 2500000;
+static constexpr float kAngularVelocity = 0.5f;
+
+std::vector<MotionSample> CreateGyroSamples(size_t num_samples) {
+  std::vector<MotionSample> samples;
+  for (size_t i = 0; i < num_samples; i++) {
+    int64_t timestamp = (i + 1) * kGyroPeriodNs;
+    samples.push_back({.timestamp = timestamp,
+                       .x = 0.0f,
+                       .y = 0.0f,
+                       .z = kAngularVelocity,
+                       .arrival_timestamp = timestamp + 1000});
+  }
+  return samples;
+}
+
+void FillBatch(const std::vector<MotionSample>& samples,
+               const std::vector<MotionSampleInterval>& intervals,
+               MotionSampleBatch* batch) {
+  FillMotionSampleBatch(
+      samples.size(), [&](size_t i) { return samples[i].timestamp; },
+      [&](size_t i) { return samples[i]; }, intervals, batch);
+}
+
+}  // namespace
+
+TEST(MotionSampleBatchTest, FillIntervals) {
+  std::vector<MotionSample> samples = CreateGyroSamples(/*num_samples=*/10);
+  MotionSampleBatch batch;
+  batch.integrate_rotations = true;
+
+  // Intervals are (start_time, end_time], and may overlap or be empty.
+  std::vector<MotionSampleInterval> intervals = {
+      {.start_time = 0, .end_time = 2 * kGyroPeriodNs},
+      {.start_time = kGyroPeriodNs, .end_time = 4 * kGyroPeriodNs},
+      {.start_time = 20 * kGyroPeriodNs, .end_time = 30 * kGyroPeriodNs},
+  };
+  FillBatch(samples, intervals, &batch);
+
+  EXPECT_EQ(batch.sample_offsets, (std::vector<uint32_t>{0, 2, 5, 5}));
+  EXPECT_EQ(batch.timestamps,
+            (std::vector<int64_t>{1 * kGyroPeriodNs, 2 * kGyroPeriodNs,
+                                  2 * kGyroPeriodNs, 3 * kGyroPeriodNs,
+                                  4 * kGyroPeriodNs}));
+  EXPECT_EQ(batch.x.size(), batch.timestamps.size());
+  EXPECT_EQ(batch.y.size(), batch.timestamps.size());
+  EXPECT_EQ(batch.z.size(), batch.timestamps.size());
+  EXPECT_EQ(batch.arrival_timestamps[0], kGyroPeriodNs + 1000);
+  ASSERT_EQ(batch.rotations.size(), intervals.size());
+
+  // The first sample covers nothing before it, so the first interval only
+  // rotates from the first to the second sample.
+  float angle = kAngularVelocity * kGyroPeriodNs * 1e-9f;
+  EXPECT_NEAR(batch.rotations[0].w, std::cos(angle / 2), 1e-6);
+  EXPECT_NEAR(batch.rotations[0].z, std::sin(angle / 2), 1e-6);
+  angle = kAngularVelocity * 3 * kGyroPeriodNs * 1e-9f;
+  EXPECT_NEAR(batch.rotations[1].w, std::cos(angle / 2), 1e-6);
+  EXPECT_NEAR(batch.rotations[1].z, std::sin(angle / 2), 1e-6);
+  EXPECT_NEAR(batch.rotations[1].x, 0.0f, 1e-6);
+  EXPECT_FLOAT_EQ(batch.rotations[2].w, 1.0f);
+
+  // An interval ending between samples is covered by the next sample.
+  intervals = {{.start_time = 2 * kGyroPeriodNs + kGyroPeriodNs / 2,
+                .end_time = 3 * kGyroPeriodNs + kGyroPeriodNs / 2}};
+  FillBatch(samples, intervals, &batch);
+  EXPECT_EQ(batch.sample_offsets, (std::vector<uint32_t>{0, 1}));
+  angle = kAngularVelocity * kGyroPeriodNs * 1e-9f;
+  ASSERT_EQ(batch.rotations.size(), 1u);
+  EXPECT_NEAR(batch.rotations[0].z, std::sin(angle / 2), 1e-6);
+
+  batch.integrate_rotations = false;
+  FillBatch(samples, intervals, &batch);
+  EXPECT_TRUE(batch.rotations.empty());
+}
+
+// Query the gyro events of 32 row groups of a rolling shutter readout per
+// frame, and compare with one query per row group into separate vectors.
+TEST(MotionSampleBatchTest, RollingShutterBenchmark) {
+  static constexpr size_t kNumSamples = 4000;
+  static constexpr size_t kNumFrames = 1000;
+  static constexpr size_t kNumRowGroups = 32;
+  static constexpr int64_t kFramePeriodNs = 33333333;
+  static constexpr int64_t kReadoutTimeNs = 10000000;
+  static constexpr int64_t kExposureTimeNs = 8000000;
+  std::vector<MotionSample> samples = CreateGyroSamples(kNumSamples);
+
+  auto get_intervals = [&](size_t frame,
+                           std::vector<MotionSampleInterval>* intervals) {
+    intervals->clear();
+    int64_t frame_start = kGyroPeriodNs * 10 + frame * kFramePeriodNs / 4;
+    for (size_t row = 0; row < kNumRowGroups; row++) {
+      int64_t start =
+          frame_start + kReadoutTimeNs * static_cast<int64_t>(row) /
+                            static_cast<int64_t>(kNumRowGroups);
+      intervals->push_back(
+          {.start_time = start, .end_time = start + kExposureTimeNs});
+    }
+  };
+
+  std::vector<MotionSampleInterval> intervals;
+  intervals.reserve(kNumRowGroups);
+  MotionSampleBatch batch;
+  batch.integrate_rotations = true;
+  get_intervals(0, &intervals);
+  FillBatch(samples, intervals, &batch);
+  const int64_t* timestamps_data = batch.timestamps.data();
+
+  size_t num_batch_samples = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t frame = 0; frame < kNumFrames; frame++) {
+    get_intervals(frame, &intervals);
+    FillBatch(samples, intervals, &batch);
+    num_batch_samples += batch.timestamps.size();
+  }
+  int64_t batch_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  // Every frame queries the same number of samples, so the batch is never
+  // reallocated.
+  EXPECT_EQ(batch.timestamps.data(), timestamps_data);
+
+  // Per-interval queries with a linear scan, as GetLatestNSensorEvents and
+  // QuerySensorEventsBetweenTimestamps did.
+  size_t num_scanned_samples = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t frame = 0; frame < kNumFrames; frame++) {
+    get_intervals(frame, &intervals);
+    for (const MotionSampleInterval& interval : intervals) {
+      std::vector<int64_t> timestamps;
+      std::vector<float> x, y, z;
+      std::vector<int64_t> arrival_timestamps;
+      for (const MotionSample& sample : samples) {
+        if (sample.timestamp <= interval.start_time ||
+            sample.timestamp > interval.end_time) {
+          continue;
+        }
+        timestamps.push_back(sample.timestamp);
+        x.push_back(sample.x);
+        y.push_back(sample.y);
+        z.push_back(sample.z);
+        arrival_timestamps.push_back(sample.arrival_timestamp);
+      }
+      num_scanned_samples += timestamps.size();
+    }
+  }
+  int64_t scan_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+  EXPECT_EQ(num_batch_samples, num_scanned_samples);
+  ALOGI("%s: %zu row groups per frame, batch %lld ns, per-interval scan %lld "
+        "ns per frame",
+        __func__, kNumRowGroups, static_cast<long long>(batch_ns / kNumFrames),
+        static_cast<long long>(scan_ns / kNumFrames));
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
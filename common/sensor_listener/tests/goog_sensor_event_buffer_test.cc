@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+#include "goog_sensor_event_buffer.h"
+
+namespace android {
+namespace camera_sensor_listener {
+namespace {
+
+ExtendedSensorEvent CreateEvent(int64_t timestamp) {
+  ExtendedSensorEvent event = {};
+  event.sensor_event.timestamp = timestamp;
+  // Every field of the event is derived from the timestamp so readers can
+  // detect torn events.
+  event.sensor_event.u.vec3.x = static_cast<float>(timestamp);
+  event.event_arrival_time_ns = timestamp + 1;
+  return event;
+}
+
+std::vector<int64_t> GetTimestamps(const SensorEventBuffer& buffer) {
+  std::vector<int64_t> timestamps;
+  buffer.Read([&](const SensorEventView& events) {
+    timestamps.clear();
+    for (size_t i = 0; i < events.size(); i++) {
+      timestamps.push_back(events[i].sensor_event.timestamp);
+    }
+  });
+  return timestamps;
+}
+
+}  // namespace
+
+TEST(SensorEventBufferTest, PushAndWrapAround) {
+  SensorEventBuffer buffer(/*capacity=*/4);
+  EXPECT_TRUE(GetTimestamps(buffer).empty());
+
+  for (int64_t timestamp = 10; timestamp <= 30; timestamp += 10) {
+    EXPECT_TRUE(buffer.Push(CreateEvent(timestamp)));
+  }
+  EXPECT_EQ(GetTimestamps(buffer), (std::vector<int64_t>{10, 20, 30}));
+
+  // The oldest events are evicted when the buffer is full.
+  for (int64_t timestamp = 40; timestamp <= 60; timestamp += 10) {
+    EXPECT_TRUE(buffer.Push(CreateEvent(timestamp)));
+  }
+  EXPECT_EQ(GetTimestamps(buffer), (std::vector<int64_t>{30, 40, 50, 60}));
+  buffer.Read([](const SensorEventView& events) {
+    EXPECT_EQ(events.older().size(), 2u);
+    EXPECT_EQ(events.newer().size(), 2u);
+    EXPECT_EQ(events.older()[0].sensor_event.timestamp, 30);
+    EXPECT_EQ(events.newer()[0].sensor_event.timestamp, 50);
+  });
+
+  // Out-of-order events are dropped, and equal timestamps are kept.
+  EXPECT_FALSE(buffer.Push(CreateEvent(55)));
+  EXPECT_TRUE(buffer.Push(CreateEvent(60)));
+  EXPECT_EQ(GetTimestamps(buffer), (std::vector<int64_t>{40, 50, 60, 60}));
+}
+
+TEST(SensorEventBufferTest, TimestampQueries) {
+  SensorEventBuffer buffer(/*capacity=*/8);
+  buffer.Read([](const SensorEventView& events) {
+    EXPECT_EQ(events.LowerBound(0), 0u);
+    EXPECT_EQ(events.FindNearest(0), 0u);
+  });
+
+  // Wrap around so the queries span both halves of the ring.
+  for (int64_t timestamp = 0; timestamp <= 110; timestamp += 10) {
+    ASSERT_TRUE(buffer.Push(CreateEvent(timestamp)));
+  }
+
+  buffer.Read([](const SensorEventView& events) {
+    ASSERT_EQ(events.size(), 8u);
+    EXPECT_EQ(events[0].sensor_event.timestamp, 40);
+
+    EXPECT_EQ(events.LowerBound(0), 0u);
+    EXPECT_EQ(events.LowerBound(70), 3u);
+    EXPECT_EQ(events.LowerBound(71), 4u);
+    EXPECT_EQ(events.LowerBound(200), 8u);
+    EXPECT_EQ(events.UpperBound(70), 4u);
+    EXPECT_EQ(events.UpperBound(110), 8u);
+
+    EXPECT_EQ(events.FindNearest(0), 0u);
+    EXPECT_EQ(events.FindNearest(74), 3u);
+    EXPECT_EQ(events.FindNearest(76), 4u);
+    // The earlier event wins a tie.
+    EXPECT_EQ(events.FindNearest(75), 3u);
+    EXPECT_EQ(events.FindNearest(500), 7u);
+  });
+}
+
+// A writer pushes events at a high rate while readers query them. Readers must
+// always see a consistent, ordered snapshot.
+TEST(SensorEventBufferTest, ConcurrentReadersSeeConsistentEvents) {
+  static constexpr size_t kCapacity = 64;
+  static constexpr int64_t kNumEvents = 200000;
+  SensorEventBuffer buffer(kCapacity);
+
+  std::atomic<bool> writer_done = false;
+  std::thread writer([&] {
+    for (int64_t timestamp = 1; timestamp <= kNumEvents; timestamp++) {
+      buffer.Push(CreateEvent(timestamp));
+    }
+    writer_done = true;
+  });
+
+  std::vector<std::thread> readers;
+  for (int reader = 0; reader < 2; reader++) {
+    readers.emplace_back([&] {
+      while (!writer_done) {
+        std::vector<ExtendedSensorEvent> copied;
+        buffer.Read([&](const SensorEventView& events) {
+          size_t begin = events.size() / 2;
+          copied.assign(events.older().begin(), events.older().end());
+          copied.insert(copied.end(), events.newer().begin(),
+                        events.newer().end());
+          copied.erase(copied.begin(), copied.begin() + begin);
+        });
+
+        for (size_t i = 0; i < copied.size(); i++) {
+          const ExtendedSensorEvent& event = copied[i];
+          ASSERT_EQ(event.sensor_event.u.vec3.x,
+                    static_cast<float>(event.sensor_event.timestamp));
+          ASSERT_EQ(event.event_arrival_time_ns,
+                    event.sensor_event.timestamp + 1);
+          if (i > 0) {
+            ASSERT_EQ(event.sensor_event.timestamp,
+                      copied[i - 1].sensor_event.timestamp + 1);
+          }
+        }
+      }
+    });
+  }
+
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(GetTimestamps(buffer).back(), kNumEvents);
+}
+
+// Measure per-frame gyro lookups in a buffer holding 10 seconds of 400 Hz
+// gyro events.
+TEST(SensorEventBufferTest, QueryBenchmark) {
+  static constexpr size_t kCapacity = 4000;
+  static constexpr int64_t kGyroPeriodNs = 2500000;
+  static constexpr int64_t kFramePeriodNs = 33333333;
+  static constexpr int kNumQueries = 100000;
+  SensorEventBuffer buffer(kCapacity);
+  for (size_t i = 0; i < kCapacity * 3 / 2; i++) {
+    ASSERT_TRUE(buffer.Push(CreateEvent(i * kGyroPeriodNs)));
+  }
+
+  int64_t last_timestamp = (kCapacity * 3 / 2 - 1) * kGyroPeriodNs;
+  size_t num_events = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kNumQueries; i++) {
+    // Query the events of a frame near the newest events.
+    int64_t end_time = last_timestamp - (i % 100) * kGyroPeriodNs;
+    size_t num_frame_events = 0;
+    buffer.Read([&](const SensorEventView& events) {
+      num_frame_events = events.UpperBound(end_time) -
+                         events.UpperBound(end_time - kFramePeriodNs);
+    });
+    num_events += num_frame_events;
+  }
+  auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+  EXPECT_EQ(num_events, kNumQueries * (kFramePeriodNs / kGyroPeriodNs + 1));
+  ALOGI("%s: %d queries of %zu events, %lld ns per query", __func__,
+        kNumQueries, kCapacity,
+        static_cast<long long>(elapsed_ns / kNumQueries));
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
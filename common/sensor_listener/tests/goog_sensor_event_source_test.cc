@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+#include "goog_sensor_event_source.h"
+#include "goog_sensor_motion.h"
+#include "utils/RefBase.h"
+#include "utils/SystemClock.h"
+
+namespace android {
+namespace camera_sensor_listener {
+namespace {
+
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::SensorType;
+
+static constexpr int64_t kGyroPeriodNs = 2500000;
+
+// Collects the events delivered by a source.
+class EventCollector {
+ public:
+  SensorEventSource::EventCallback GetCallback() {
+    return [this](const Event& event) {
+      std::lock_guard<std::mutex> l(lock_);
+      events_.push_back(event);
+    };
+  }
+
+  std::vector<Event> GetEvents() {
+    std::lock_guard<std::mutex> l(lock_);
+    return events_;
+  }
+
+ private:
+  std::mutex lock_;
+  std::vector<Event> events_;
+};
+
+void WaitUntilDone(const SensorEventSource& source) {
+  while (!source.IsDone()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+SyntheticSensorEventSource::Config GetGyroConfig() {
+  SyntheticSensorEventSource::Config config;
+  config.sensor_type = SensorType::GYROSCOPE;
+  config.sensor_handle = 7;
+  config.rate_hz = 1e9 / kGyroPeriodNs;
+  config.fill_payload = [](uint64_t index, Event* event) {
+    event->u.vec3.z = static_cast<float>(index);
+  };
+  return config;
+}
+
+}  // namespace
+
+TEST(SensorEventSourceTest, SyntheticRateAndDrift) {
+  static constexpr uint64_t kNumEvents = 1000;
+  static constexpr double kDriftPpm = 100;
+  SyntheticSensorEventSource::Config config = GetGyroConfig();
+  config.realtime = false;
+  config.max_num_events = kNumEvents;
+  config.drift_ppm = kDriftPpm;
+  config.start_time_ns = 1000;
+  SyntheticSensorEventSource source(config);
+
+  EventCollector collector;
+  ASSERT_EQ(source.Start(/*sampling_period_us=*/0, collector.GetCallback()),
+            OK);
+  WaitUntilDone(source);
+  source.Stop();
+
+  std::vector<Event> events = collector.GetEvents();
+  ASSERT_EQ(events.size(), kNumEvents);
+  EXPECT_EQ(source.GetNumDeliveredEvents(), kNumEvents);
+  EXPECT_EQ(events[0].timestamp, 1000);
+  EXPECT_EQ(events[0].sensorHandle, 7);
+  EXPECT_EQ(events[0].sensorType, SensorType::GYROSCOPE);
+  double expected_period_ns = kGyroPeriodNs * (1 + kDriftPpm * 1e-6);
+  EXPECT_NEAR(events.back().timestamp - events[0].timestamp,
+              (kNumEvents - 1) * expected_period_ns, 1);
+  EXPECT_FLOAT_EQ(events.back().u.vec3.z, kNumEvents - 1);
+}
+
+TEST(SensorEventSourceTest, SyntheticJitter) {
+  static constexpr uint64_t kNumEvents = 1000;
+  static constexpr int64_t kJitterNs = 200000;
+  SyntheticSensorEventSource::Config config = GetGyroConfig();
+  config.realtime = false;
+  config.max_num_events = kNumEvents;
+  config.jitter_ns = kJitterNs;
+  config.start_time_ns = kJitterNs;
+  SyntheticSensorEventSource source(config);
+
+  // Jitter is seeded, so restarting the source repeats the same events.
+  std::vector<Event> runs[2];
+  for (std::vector<Event>& run : runs) {
+    EventCollector collector;
+    ASSERT_EQ(source.Start(/*sampling_period_us=*/0, collector.GetCallback()),
+              OK);
+    WaitUntilDone(source);
+    source.Stop();
+    run = collector.GetEvents();
+    ASSERT_EQ(run.size(), kNumEvents);
+  }
+
+  bool jittered = false;
+  for (uint64_t i = 0; i < kNumEvents; i++) {
+    int64_t offset = runs[0][i].timestamp - kJitterNs - i * kGyroPeriodNs;
+    EXPECT_LE(std::abs(offset), kJitterNs);
+    EXPECT_EQ(runs[0][i].timestamp, runs[1][i].timestamp);
+    jittered |= offset != 0;
+  }
+  EXPECT_TRUE(jittered);
+}
+
+TEST(SensorEventSourceTest, SyntheticClampsJitter) {
+  static constexpr uint64_t kNumEvents = 1000;
+  SyntheticSensorEventSource::Config config = GetGyroConfig();
+  config.realtime = false;
+  config.max_num_events = kNumEvents;
+  // Jitter larger than the period would reorder the events if not clamped.
+  config.jitter_ns = 2 * kGyroPeriodNs;
+  config.start_time_ns = kGyroPeriodNs;
+  SyntheticSensorEventSource source(config);
+
+  EventCollector collector;
+  ASSERT_EQ(source.Start(/*sampling_period_us=*/0, collector.GetCallback()),
+            OK);
+  WaitUntilDone(source);
+  source.Stop();
+
+  std::vector<Event> events = collector.GetEvents();
+  ASSERT_EQ(events.size(), kNumEvents);
+  for (uint64_t i = 1; i < kNumEvents; i++) {
+    EXPECT_GT(events[i].timestamp, events[i - 1].timestamp) << "event " << i;
+  }
+}
+
+TEST(SensorEventSourceTest, SyntheticUsesSamplingPeriod) {
+  SyntheticSensorEventSource::Config config = GetGyroConfig();
+  config.rate_hz = 0;
+  config.realtime = false;
+  config.max_num_events = 2;
+  SyntheticSensorEventSource source(config);
+
+  EventCollector collector;
+  ASSERT_EQ(source.Start(/*sampling_period_us=*/5000, collector.GetCallback()),
+            OK);
+  EXPECT_EQ(source.Start(/*sampling_period_us=*/5000, collector.GetCallback()),
+            INVALID_OPERATION);
+  WaitUntilDone(source);
+  source.Stop();
+
+  std::vector<Event> events = collector.GetEvents();
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[1].timestamp - events[0].timestamp, 5000000);
+}
+
+TEST(SensorEventSourceTest, Replay) {
+  // Same format as the logs of GoogGyroTest: timestamp, x, y, z and arrival
+  // time.
+  std::stringstream log;
+  log << "1000000 0.1 0.2 0.3 1500000\n"
+      << "3500000 0.4 0.5 0.6 4000000\n"
+      << "\n"
+      << "6000000 0.7 0.8 0.9 6500000\n";
+  ReplaySensorEventSource::Config config;
+  config.sensor_handle = 3;
+  config.realtime = false;
+  config.rebase_timestamps = false;
+  std::unique_ptr<ReplaySensorEventSource> source =
+      ReplaySensorEventSource::Create(config, log);
+  ASSERT_NE(source, nullptr);
+  EXPECT_EQ(source->GetNumRecordedEvents(), 3u);
+
+  EventCollector collector;
+  ASSERT_EQ(source->Start(/*sampling_period_us=*/0, collector.GetCallback()),
+            OK);
+  WaitUntilDone(*source);
+  source->Stop();
+
+  std::vector<Event> events = collector.GetEvents();
+  ASSERT_EQ(events.size(), 3u);
+  EXPECT_EQ(events[1].timestamp, 3500000);
+  EXPECT_EQ(events[1].sensorHandle, 3);
+  EXPECT_FLOAT_EQ(events[1].u.vec3.x, 0.4f);
+  EXPECT_FLOAT_EQ(events[2].u.vec3.z, 0.9f);
+
+  // Rebased timestamps keep the recorded spacing.
+  config.rebase_timestamps = true;
+  log.clear();
+  log.seekg(0);
+  source = ReplaySensorEventSource::Create(config, log);
+  ASSERT_NE(source, nullptr);
+  EventCollector rebased_collector;
+  int64_t start_time = elapsedRealtimeNano();
+  ASSERT_EQ(
+      source->Start(/*sampling_period_us=*/0, rebased_collector.GetCallback()),
+      OK);
+  WaitUntilDone(*source);
+  source->Stop();
+  events = rebased_collector.GetEvents();
+  ASSERT_EQ(events.size(), 3u);
+  EXPECT_GE(events[0].timestamp, start_time);
+  EXPECT_EQ(events[2].timestamp - events[0].timestamp, 5000000);
+}
+
+TEST(SensorEventSourceTest, ReplayRejectsBadLogs) {
+  ReplaySensorEventSource::Config config;
+  std::stringstream empty_log;
+  EXPECT_EQ(ReplaySensorEventSource::Create(config, empty_log), nullptr);
+
+  std::stringstream short_log("1000 0.1 0.2\n");
+  EXPECT_EQ(ReplaySensorEventSource::Create(config, short_log), nullptr);
+
+  std::stringstream out_of_order_log("2000 0 0 0\n1000 0 0 0\n");
+  EXPECT_EQ(ReplaySensorEventSource::Create(config, out_of_order_log),
+            nullptr);
+
+  EXPECT_EQ(ReplaySensorEventSource::Create(config, "/nonexistent/log.txt"),
+            nullptr);
+}
+
+// A 400 Hz synthetic gyro feeds GoogSensorMotion in real time.
+TEST(SensorEventSourceTest, MotionSensorLatency) {
+  static constexpr int kDurationMs = 500;
+  sp<GoogSensorMotion> gyro = GoogSensorMotion::Create(
+      MotionSensorType::GYROSCOPE, /*sampling_period_us=*/2500,
+      /*event_queue_size=*/400,
+      std::make_unique<SyntheticSensorEventSource>(GetGyroConfig()));
+  ASSERT_NE(gyro, nullptr);
+  ASSERT_TRUE(gyro->GetSensorEnablingStatus());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(kDurationMs));
+  ASSERT_EQ(gyro->Disable(), OK);
+
+  std::vector<int64_t> timestamps;
+  std::vector<float> x, y, z;
+  std::vector<int64_t> arrival_timestamps;
+  gyro->GetLatestNSensorEvents(/*num_sample=*/400, &timestamps, &x, &y, &z,
+                               &arrival_timestamps);
+  ASSERT_GT(timestamps.size(), 1u);
+  std::vector<int64_t> latencies;
+  for (size_t i = 0; i < timestamps.size(); i++) {
+    if (i > 0) {
+      EXPECT_EQ(timestamps[i] - timestamps[i - 1], kGyroPeriodNs);
+      EXPECT_FLOAT_EQ(z[i] - z[i - 1], 1.0f);
+    }
+    latencies.push_back(arrival_timestamps[i] - timestamps[i]);
+    EXPECT_GE(latencies.back(), 0);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  ALOGI("%s: %zu events, latency median %lld ns, max %lld ns", __func__,
+        latencies.size(),
+        static_cast<long long>(latencies[latencies.size() / 2]),
+        static_cast<long long>(latencies.back()));
+}
+
+// Deliver events to GoogSensorMotion as fast as possible while a reader
+// queries them, as a camera would per frame.
+TEST(SensorEventSourceTest, MotionSensorThroughputBenchmark) {
+  static constexpr uint64_t kNumEvents = 200000;
+  SyntheticSensorEventSource::Config config = GetGyroConfig();
+  config.realtime = false;
+  config.max_num_events = kNumEvents;
+  config.start_time_ns = kGyroPeriodNs;
+  auto source = std::make_unique<SyntheticSensorEventSource>(config);
+  const SyntheticSensorEventSource* source_ptr = source.get();
+
+  auto start = std::chrono::steady_clock::now();
+  sp<GoogSensorMotion> gyro = GoogSensorMotion::Create(
+      MotionSensorType::GYROSCOPE, /*sampling_period_us=*/2500,
+      /*event_queue_size=*/400, std::move(source));
+  ASSERT_NE(gyro, nullptr);
+
+  uint64_t num_queries = 0;
+  std::vector<int64_t> timestamps;
+  std::vector<float> x, y, z;
+  std::vector<int64_t> arrival_timestamps;
+  while (!source_ptr->IsDone()) {
+    gyro->GetLatestNSensorEvents(/*num_sample=*/20, &timestamps, &x, &y, &z,
+                                 &arrival_timestamps);
+    for (size_t i = 1; i < timestamps.size(); i++) {
+      ASSERT_LT(timestamps[i - 1], timestamps[i]);
+    }
+    num_queries++;
+  }
+  int64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  ASSERT_EQ(gyro->Disable(), OK);
+
+  gyro->GetLatestNSensorEvents(/*num_sample=*/1, &timestamps, &x, &y, &z,
+                               &arrival_timestamps);
+  ASSERT_EQ(timestamps.size(), 1u);
+  EXPECT_EQ(timestamps[0], static_cast<int64_t>(kNumEvents) * kGyroPeriodNs);
+  ALOGI("%s: %llu events in %lld us (%.0f events/s) with %llu queries",
+        __func__, static_cast<unsigned long long>(kNumEvents),
+        static_cast<long long>(elapsed_ns / 1000),
+        kNumEvents * 1e9 / elapsed_ns,
+        static_cast<unsigned long long>(num_queries));
+}
+
+}  // namespace camera_sensor_listener
+}  // namespace android
@@ -29,11 +29,12 @@ namespace android {
 std::unique_ptr<CameraDeviceHwl> EmulatedCameraDeviceHwlImpl::Create(
     uint32_t camera_id, std::unique_ptr<HalCameraMetadata> static_meta,
     PhysicalDeviceMapPtr physical_devices,
-    std::shared_ptr<EmulatedTorchState> torch_state) {
+    std::shared_ptr<EmulatedTorchState> torch_state,
+    std::shared_ptr<StreamCombinationCache> stream_combination_cache) {
   auto device = std::unique_ptr<EmulatedCameraDeviceHwlImpl>(
-      new EmulatedCameraDeviceHwlImpl(camera_id, std::move(static_meta),
-                                      std::move(physical_devices),
-                                      torch_state));
+      new EmulatedCameraDeviceHwlImpl(
+          camera_id, std::move(static_meta), std::move(physical_devices),
+          torch_state, std::move(stream_combination_cache)));
 
   if (device == nullptr) {
     ALOGE("%s: Creating EmulatedCameraDeviceHwlImpl failed.", __FUNCTION__);
@@ -56,11 +57,17 @@ std::unique_ptr<CameraDeviceHwl> EmulatedCameraDeviceHwlImpl::Create(
 EmulatedCameraDeviceHwlImpl::EmulatedCameraDeviceHwlImpl(
     uint32_t camera_id, std::unique_ptr<HalCameraMetadata> static_meta,
     PhysicalDeviceMapPtr physical_devices,
-    std::shared_ptr<EmulatedTorchState> torch_state)
+    std::shared_ptr<EmulatedTorchState> torch_state,
+    std::shared_ptr<StreamCombinationCache> stream_combination_cache)
     : camera_id_(camera_id),
       static_metadata_(std::move(static_meta)),
       physical_device_map_(std::move(physical_devices)),
-      torch_state_(torch_state) {}
+      torch_state_(torch_state),
+      stream_combination_cache_(std::move(stream_combination_cache)) {
+  if (stream_combination_cache_ == nullptr) {
+    stream_combination_cache_ = std::make_shared<StreamCombinationCache>();
+  }
+}
 
 uint32_t EmulatedCameraDeviceHwlImpl::GetCameraId() const {
   return camera_id_;
@@ -282,11 +289,22 @@ status_t EmulatedCameraDeviceHwlImpl::CreateCameraDeviceSessionHwl(
 bool EmulatedCameraDeviceHwlImpl::IsStreamCombinationSupported(
     const StreamConfiguration& stream_config,
     const bool /*check_settings*/) const {
-  return EmulatedSensor::IsStreamCombinationSupported(
-      camera_id_, stream_config, *stream_configuration_map_,
-      *stream_configuration_map_max_resolution_,
-      physical_stream_configuration_map_,
-      physical_stream_configuration_map_max_resolution_, sensor_chars_);
+  std::string key = StreamCombinationCache::GetKey(camera_id_, stream_config);
+  bool is_supported = false;
+  if (stream_combination_cache_->Get(key, &is_supported)) {
+    return is_supported;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stream_configuration_map_lock_);
+    is_supported = EmulatedSensor::IsStreamCombinationSupported(
+        camera_id_, stream_config, *stream_configuration_map_,
+        *stream_configuration_map_max_resolution_,
+        physical_stream_configuration_map_,
+        physical_stream_configuration_map_max_resolution_, sensor_chars_);
+  }
+  stream_combination_cache_->Put(key, is_supported);
+  return is_supported;
 }
 
 int32_t EmulatedCameraDeviceHwlImpl::GetDefaultTorchStrengthLevel() const {
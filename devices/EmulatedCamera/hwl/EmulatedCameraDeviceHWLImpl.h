@@ -26,6 +26,7 @@
 #include "EmulatedSensor.h"
 #include "EmulatedTorchState.h"
 #include "utils/HWLUtils.h"
+#include "utils/StreamCombinationCache.h"
 #include "utils/StreamConfigurationMap.h"
 
 namespace android {
@@ -45,7 +46,9 @@ class EmulatedCameraDeviceHwlImpl : public CameraDeviceHwl {
   static std::unique_ptr<CameraDeviceHwl> Create(
       uint32_t camera_id, std::unique_ptr<HalCameraMetadata> static_meta,
       PhysicalDeviceMapPtr physical_devices,
-      std::shared_ptr<EmulatedTorchState> torch_state);
+      std::shared_ptr<EmulatedTorchState> torch_state,
+      std::shared_ptr<StreamCombinationCache> stream_combination_cache =
+          nullptr);
 
   virtual ~EmulatedCameraDeviceHwlImpl() = default;
 
@@ -92,7 +95,9 @@ class EmulatedCameraDeviceHwlImpl : public CameraDeviceHwl {
   EmulatedCameraDeviceHwlImpl(uint32_t camera_id,
                               std::unique_ptr<HalCameraMetadata> static_meta,
                               PhysicalDeviceMapPtr physical_devices,
-                              std::shared_ptr<EmulatedTorchState> torch_state);
+                              std::shared_ptr<EmulatedTorchState> torch_state,
+                              std::shared_ptr<StreamCombinationCache>
+                                  stream_combination_cache);
 
   status_t Initialize();
 
@@ -109,6 +114,10 @@ class EmulatedCameraDeviceHwlImpl : public CameraDeviceHwl {
   PhysicalStreamConfigurationMap physical_stream_configuration_map_max_resolution_;
   PhysicalDeviceMapPtr physical_device_map_;
   std::shared_ptr<EmulatedTorchState> torch_state_;
+  // Stream combination results, shared with the provider.
+  std::shared_ptr<StreamCombinationCache> stream_combination_cache_;
+  // StreamConfigurationMap lookups are not thread-safe.
+  mutable std::mutex stream_configuration_map_lock_;
   LogicalCharacteristics sensor_chars_;
   int32_t default_torch_strength_level_ = 0;
   int32_t maximum_torch_strength_level_ = 0;
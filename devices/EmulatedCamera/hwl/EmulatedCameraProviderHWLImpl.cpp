@@ -283,47 +283,66 @@ status_t EmulatedCameraProviderHwlImpl::IsConcurrentStreamCombinationSupported(
     bool* is_supported) {
   *is_supported = false;
 
-  // Go through the given camera ids, get their sensor characteristics, stream
-  // config maps and call EmulatedSensor::IsStreamCombinationSupported()
+  // Go through the given camera ids and check their stream configurations
+  // against the precomputed indexes, unless the result is cached.
   for (auto& config : configs) {
-    // TODO: Consider caching sensor characteristics and StreamConfigurationMap
-    if (camera_id_map_.find(config.camera_id) == camera_id_map_.end()) {
+    auto index = stream_configuration_indexes_.find(config.camera_id);
+    if (index == stream_configuration_indexes_.end()) {
       ALOGE("%s: Camera id %u does not exist", __FUNCTION__, config.camera_id);
       return BAD_VALUE;
     }
 
-    auto stream_configuration_map = std::make_unique<StreamConfigurationMap>(
-        *(static_metadata_[config.camera_id]));
-    auto stream_configuration_map_max_resolution =
-        std::make_unique<StreamConfigurationMap>(
-            *(static_metadata_[config.camera_id]), /*maxResolution*/ true);
+    std::string key = StreamCombinationCache::GetKey(
+        config.camera_id, config.stream_configuration);
+    bool is_config_supported = false;
+    if (!stream_combination_cache_->Get(key, &is_config_supported)) {
+      std::lock_guard<std::mutex> lock(stream_configuration_index_lock_);
+      const StreamConfigurationIndex& camera_index = index->second;
+      is_config_supported = EmulatedSensor::IsStreamCombinationSupported(
+          config.camera_id, config.stream_configuration, *camera_index.map,
+          *camera_index.max_resolution_map, camera_index.physical_map,
+          camera_index.physical_map_max_resolution, camera_index.sensor_chars);
+      stream_combination_cache_->Put(key, is_config_supported);
+    }
+
+    if (!is_config_supported) {
+      return OK;
+    }
+  }
 
-    LogicalCharacteristics sensor_chars;
-    status_t ret =
-        GetSensorCharacteristics((static_metadata_[config.camera_id]).get(),
-                                 &sensor_chars[config.camera_id]);
+  *is_supported = true;
+  return OK;
+}
+
+status_t EmulatedCameraProviderHwlImpl::InitializeStreamConfigurationIndexes() {
+  for (const auto& [camera_id, physical_cameras] : camera_id_map_) {
+    StreamConfigurationIndex index;
+    index.map =
+        std::make_unique<StreamConfigurationMap>(*static_metadata_[camera_id]);
+    index.max_resolution_map = std::make_unique<StreamConfigurationMap>(
+        *static_metadata_[camera_id], /*maxResolution*/ true);
+    status_t ret = GetSensorCharacteristics(static_metadata_[camera_id].get(),
+                                            &index.sensor_chars[camera_id]);
     if (ret != OK) {
       ALOGE("%s: Unable to extract sensor chars for camera id %u", __FUNCTION__,
-            config.camera_id);
+            camera_id);
       return UNKNOWN_ERROR;
     }
 
-    PhysicalStreamConfigurationMap physical_stream_configuration_map;
-    PhysicalStreamConfigurationMap physical_stream_configuration_map_max_resolution;
-    auto const& physicalCameraInfo = camera_id_map_[config.camera_id];
-    for (size_t i = 0; i < physicalCameraInfo.size(); i++) {
-      uint32_t physical_camera_id = physicalCameraInfo[i].second;
-      physical_stream_configuration_map.emplace(
-          physical_camera_id, std::make_unique<StreamConfigurationMap>(
-                                  *(static_metadata_[physical_camera_id])));
-
-      physical_stream_configuration_map_max_resolution.emplace(
+    for (const auto& physical_camera : physical_cameras) {
+      uint32_t physical_camera_id = physical_camera.second;
+      const HalCameraMetadata& physical_metadata =
+          *static_metadata_[physical_camera_id];
+      index.physical_map.emplace(
           physical_camera_id,
-          std::make_unique<StreamConfigurationMap>(
-              *(static_metadata_[physical_camera_id]), /*maxResolution*/ true));
+          std::make_unique<StreamConfigurationMap>(physical_metadata));
+      index.physical_map_max_resolution.emplace(
+          physical_camera_id,
+          std::make_unique<StreamConfigurationMap>(physical_metadata,
+                                                   /*maxResolution*/ true));
 
-      ret = GetSensorCharacteristics(static_metadata_[physical_camera_id].get(),
-                                     &sensor_chars[physical_camera_id]);
+      ret = GetSensorCharacteristics(&physical_metadata,
+                                     &index.sensor_chars[physical_camera_id]);
       if (ret != OK) {
         ALOGE("%s: Unable to extract camera %d sensor characteristics %s (%d)",
               __FUNCTION__, physical_camera_id, strerror(-ret), ret);
@@ -331,16 +350,9 @@ status_t EmulatedCameraProviderHwlImpl::IsConcurrentStreamCombinationSupported(
       }
     }
 
-    if (!EmulatedSensor::IsStreamCombinationSupported(
-            config.camera_id, config.stream_configuration,
-            *stream_configuration_map, *stream_configuration_map_max_resolution,
-            physical_stream_configuration_map,
-            physical_stream_configuration_map_max_resolution, sensor_chars)) {
-      return OK;
-    }
+    stream_configuration_indexes_.emplace(camera_id, std::move(index));
   }
 
-  *is_supported = true;
   return OK;
 }
 
@@ -824,7 +836,7 @@ status_t EmulatedCameraProviderHwlImpl::Initialize() {
     logical_id++;
   }
 
-  return OK;
+  return InitializeStreamConfigurationIndexes();
 }
 
 status_t EmulatedCameraProviderHwlImpl::SetCallback(
@@ -935,7 +947,8 @@ status_t EmulatedCameraProviderHwlImpl::CreateCameraDeviceHwl(
           HalCameraMetadata::Clone(static_metadata_[physical_device.second].get())));
   }
   *camera_device_hwl = EmulatedCameraDeviceHwlImpl::Create(
-      camera_id, std::move(meta), std::move(physical_devices), torch_state);
+      camera_id, std::move(meta), std::move(physical_devices), torch_state,
+      stream_combination_cache_);
   if (*camera_device_hwl == nullptr) {
     ALOGE("%s: Cannot create EmulatedCameraDeviceHWlImpl.", __FUNCTION__);
     return BAD_VALUE;
@@ -23,6 +23,10 @@
 #include <json/reader.h>
 #include <future>
 
+#include "EmulatedSensor.h"
+#include "utils/StreamCombinationCache.h"
+#include "utils/StreamConfigurationMap.h"
+
 namespace android {
 
 using google_camera_hal::CameraBufferAllocatorHwl;
@@ -83,10 +87,30 @@ class EmulatedCameraProviderHwlImpl : public CameraProviderHwl {
   status_t WaitForQemuSfFakeCameraPropertyAvailable();
   bool SupportsMandatoryConcurrentStreams(uint32_t camera_id);
 
+  // Stream configuration maps and sensor characteristics of a logical camera
+  // and its physical cameras, built once from the static metadata.
+  struct StreamConfigurationIndex {
+    std::unique_ptr<StreamConfigurationMap> map;
+    std::unique_ptr<StreamConfigurationMap> max_resolution_map;
+    PhysicalStreamConfigurationMap physical_map;
+    PhysicalStreamConfigurationMap physical_map_max_resolution;
+    LogicalCharacteristics sensor_chars;
+  };
+
+  status_t InitializeStreamConfigurationIndexes();
+
   std::vector<std::unique_ptr<HalCameraMetadata>> static_metadata_;
   // Logical to physical camera Id mapping. Empty value vector in case
   // of regular non-logical device.
   std::unordered_map<uint32_t, std::vector<std::pair<CameraDeviceStatus, uint32_t>>> camera_id_map_;
+  // Map from a logical camera id to its stream configuration index.
+  std::unordered_map<uint32_t, StreamConfigurationIndex>
+      stream_configuration_indexes_;
+  // StreamConfigurationMap lookups are not thread-safe.
+  std::mutex stream_configuration_index_lock_;
+  // Stream combination results shared with the camera devices.
+  std::shared_ptr<StreamCombinationCache> stream_combination_cache_ =
+      std::make_shared<StreamCombinationCache>();
   HwlTorchModeStatusChangeFunc torch_cb_;
   HwlPhysicalCameraDeviceStatusChangeFunc physical_camera_status_cb_;
 
@@ -22,6 +22,7 @@
 #include <inttypes.h>
 #include <log/log.h>
 #include <utils/HWLUtils.h>
+#include <utils/Trace.h>
 
 #include "EmulatedRequestProcessor.h"
 
@@ -29,6 +30,22 @@ namespace android {
 
 using google_camera_hal::HwlPipelineResult;
 
+namespace {
+
+// Return the modes in the range of EmulatedRequestState::AllowedModes.
+template <typename T>
+EmulatedRequestState::AllowedModes GetAllowedModes(const std::set<T>& modes) {
+  EmulatedRequestState::AllowedModes allowed_modes;
+  for (const auto& mode : modes) {
+    if ((mode >= 0) && (static_cast<size_t>(mode) < allowed_modes.size())) {
+      allowed_modes.set(mode);
+    }
+  }
+  return allowed_modes;
+}
+
+}  // namespace
+
 status_t EmulatedRequestState::Update3AMeteringRegion(
     uint32_t tag, const HalCameraMetadata& settings, int32_t* region /*out*/) {
   if ((region == nullptr) || ((tag != ANDROID_CONTROL_AE_REGIONS) &&
@@ -582,22 +599,17 @@ status_t EmulatedRequestState::ProcessAE() {
   return OK;
 }
 
-status_t EmulatedRequestState::InitializeSensorSettings(
-    std::unique_ptr<HalCameraMetadata> request_settings,
-    uint32_t override_frame_number,
-    EmulatedSensor::SensorSettings* sensor_settings /*out*/) {
+status_t EmulatedRequestState::ValidateRequestSettings(
+    ValidatedSettings* validated /*out*/) {
   auto& info = *device_info_;
-  if ((sensor_settings == nullptr) || (request_settings.get() == nullptr)) {
+  if (validated == nullptr) {
     return BAD_VALUE;
   }
 
-  std::lock_guard<std::mutex> lock(request_state_mutex_);
-  request_settings_ = std::move(request_settings);
   camera_metadata_ro_entry_t entry;
   auto ret = request_settings_->Get(ANDROID_CONTROL_MODE, &entry);
   if ((ret == OK) && (entry.count == 1)) {
-    if (info.available_control_modes_.find(entry.data.u8[0]) !=
-        info.available_control_modes_.end()) {
+    if (allowed_control_modes_.test(entry.data.u8[0])) {
       info.control_mode_ = entry.data.u8[0];
     } else {
       ALOGE("%s: Unsupported control mode!", __FUNCTION__);
@@ -607,8 +619,7 @@ status_t EmulatedRequestState::InitializeSensorSettings(
 
   ret = request_settings_->Get(ANDROID_SENSOR_PIXEL_MODE, &entry);
   if ((ret == OK) && (entry.count == 1)) {
-    if (info.available_sensor_pixel_modes_.find(entry.data.u8[0]) !=
-        info.available_sensor_pixel_modes_.end()) {
+    if (allowed_sensor_pixel_modes_.test(entry.data.u8[0])) {
       info.sensor_pixel_mode_ = entry.data.u8[0];
     } else {
       ALOGE("%s: Unsupported control sensor pixel  mode!", __FUNCTION__);
@@ -620,8 +631,7 @@ status_t EmulatedRequestState::InitializeSensorSettings(
   if ((ret == OK) && (entry.count == 1)) {
     // Disabled scene is not expected to be among the available scene list
     if ((entry.data.u8[0] == ANDROID_CONTROL_SCENE_MODE_DISABLED) ||
-        (info.available_scenes_.find(entry.data.u8[0]) !=
-         info.available_scenes_.end())) {
+        allowed_scenes_.test(entry.data.u8[0])) {
       info.scene_mode_ = entry.data.u8[0];
     } else {
       ALOGE("%s: Unsupported scene mode!", __FUNCTION__);
@@ -665,16 +675,10 @@ status_t EmulatedRequestState::InitializeSensorSettings(
     info.settings_override_ = entry.data.i32[0];
   }
 
-  // Store settings override frame number
-  if (override_frame_number != 0) {
-    settings_overriding_frame_number_ = override_frame_number;
-  }
-
   // Check rotate_and_crop setting
   ret = request_settings_->Get(ANDROID_SCALER_ROTATE_AND_CROP, &entry);
   if ((ret == OK) && (entry.count == 1)) {
-    if (info.available_rotate_crop_modes_.find(entry.data.u8[0]) !=
-        info.available_rotate_crop_modes_.end()) {
+    if (allowed_rotate_crop_modes_.test(entry.data.u8[0])) {
       info.rotate_and_crop_ = entry.data.u8[0];
     } else {
       ALOGE("%s: Unsupported rotate and crop mode: %u", __FUNCTION__, entry.data.u8[0]);
@@ -683,12 +687,11 @@ status_t EmulatedRequestState::InitializeSensorSettings(
   }
 
   // Check video stabilization parameter
-  uint8_t vstab_mode = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
+  validated->vstab_mode = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
   ret = request_settings_->Get(ANDROID_CONTROL_VIDEO_STABILIZATION_MODE, &entry);
   if ((ret == OK) && (entry.count == 1)) {
-    if (info.available_vstab_modes_.find(entry.data.u8[0]) !=
-        info.available_vstab_modes_.end()) {
-      vstab_mode = entry.data.u8[0];
+    if (allowed_vstab_modes_.test(entry.data.u8[0])) {
+      validated->vstab_mode = entry.data.u8[0];
     } else {
       ALOGE("%s: Unsupported video stabilization mode: %u! Video stabilization will be disabled!",
             __FUNCTION__, entry.data.u8[0]);
@@ -702,7 +705,7 @@ status_t EmulatedRequestState::InitializeSensorSettings(
     if (info.autoframing_ == ANDROID_CONTROL_AUTOFRAMING_ON) {
       // Set zoom_ratio to be a hard-coded value to test autoframing.
       info.zoom_ratio_ = 1.7f;
-      vstab_mode = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
+      validated->vstab_mode = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
     }
   }
 
@@ -722,12 +725,11 @@ status_t EmulatedRequestState::InitializeSensorSettings(
   }
 
   // Check video stabilization parameter
-  uint8_t edge_mode = ANDROID_EDGE_MODE_OFF;
+  validated->edge_mode = ANDROID_EDGE_MODE_OFF;
   ret = request_settings_->Get(ANDROID_EDGE_MODE, &entry);
   if ((ret == OK) && (entry.count == 1)) {
-    if (info.available_edge_modes_.find(entry.data.u8[0]) !=
-        info.available_edge_modes_.end()) {
-      edge_mode = entry.data.u8[0];
+    if (allowed_edge_modes_.test(entry.data.u8[0])) {
+      validated->edge_mode = entry.data.u8[0];
     } else {
       ALOGE("%s: Unsupported edge mode: %u", __FUNCTION__, entry.data.u8[0]);
       return BAD_VALUE;
@@ -735,29 +737,30 @@ status_t EmulatedRequestState::InitializeSensorSettings(
   }
 
   // Check test pattern parameter
-  uint8_t test_pattern_mode = ANDROID_SENSOR_TEST_PATTERN_MODE_OFF;
+  validated->test_pattern_mode = ANDROID_SENSOR_TEST_PATTERN_MODE_OFF;
   ret = request_settings_->Get(ANDROID_SENSOR_TEST_PATTERN_MODE, &entry);
   if ((ret == OK) && (entry.count == 1)) {
-    if (info.available_test_pattern_modes_.find(entry.data.u8[0]) !=
-        info.available_test_pattern_modes_.end()) {
-      test_pattern_mode = entry.data.u8[0];
+    if (allowed_test_pattern_modes_.test(entry.data.u8[0])) {
+      validated->test_pattern_mode = entry.data.u8[0];
     } else {
       ALOGE("%s: Unsupported test pattern mode: %u", __FUNCTION__,
             entry.data.u8[0]);
       return BAD_VALUE;
     }
   }
-  uint32_t test_pattern_data[4] = {0, 0, 0, 0};
-  if (test_pattern_mode == ANDROID_SENSOR_TEST_PATTERN_MODE_SOLID_COLOR) {
+  memset(validated->test_pattern_data, 0, sizeof(validated->test_pattern_data));
+  if (validated->test_pattern_mode ==
+      ANDROID_SENSOR_TEST_PATTERN_MODE_SOLID_COLOR) {
     ret = request_settings_->Get(ANDROID_SENSOR_TEST_PATTERN_DATA, &entry);
     if ((ret == OK) && (entry.count == 4)) {
       // 'Convert' from i32 to u32 here
-      memcpy(test_pattern_data, entry.data.i32, sizeof(test_pattern_data));
+      memcpy(validated->test_pattern_data, entry.data.i32,
+             sizeof(validated->test_pattern_data));
     }
   }
   // BLACK is just SOLID_COLOR with all-zero data
-  if (test_pattern_mode == ANDROID_SENSOR_TEST_PATTERN_MODE_BLACK) {
-    test_pattern_mode = ANDROID_SENSOR_TEST_PATTERN_MODE_SOLID_COLOR;
+  if (validated->test_pattern_mode == ANDROID_SENSOR_TEST_PATTERN_MODE_BLACK) {
+    validated->test_pattern_mode = ANDROID_SENSOR_TEST_PATTERN_MODE_SOLID_COLOR;
   }
 
   // 3A modes are active in case the scene is disabled or set to face priority
@@ -767,8 +770,7 @@ status_t EmulatedRequestState::InitializeSensorSettings(
       (info.control_mode_ != ANDROID_CONTROL_MODE_USE_SCENE_MODE)) {
     ret = request_settings_->Get(ANDROID_CONTROL_AE_MODE, &entry);
     if ((ret == OK) && (entry.count == 1)) {
-      if (info.available_ae_modes_.find(entry.data.u8[0]) !=
-          info.available_ae_modes_.end()) {
+      if (allowed_ae_modes_.test(entry.data.u8[0])) {
         info.ae_mode_ = entry.data.u8[0];
       } else {
         ALOGE("%s: Unsupported AE mode! Using last valid mode!", __FUNCTION__);
@@ -777,8 +779,7 @@ status_t EmulatedRequestState::InitializeSensorSettings(
 
     ret = request_settings_->Get(ANDROID_CONTROL_AWB_MODE, &entry);
     if ((ret == OK) && (entry.count == 1)) {
-      if (info.available_awb_modes_.find(entry.data.u8[0]) !=
-          info.available_awb_modes_.end()) {
+      if (allowed_awb_modes_.test(entry.data.u8[0])) {
         info.awb_mode_ = entry.data.u8[0];
       } else {
         ALOGE("%s: Unsupported AWB mode! Using last valid mode!", __FUNCTION__);
@@ -787,8 +788,7 @@ status_t EmulatedRequestState::InitializeSensorSettings(
 
     ret = request_settings_->Get(ANDROID_CONTROL_AF_MODE, &entry);
     if ((ret == OK) && (entry.count == 1)) {
-      if (info.available_af_modes_.find(entry.data.u8[0]) !=
-          info.available_af_modes_.end()) {
+      if (allowed_af_modes_.test(entry.data.u8[0])) {
         af_mode_changed_ = info.af_mode_ != entry.data.u8[0];
         info.af_mode_ = entry.data.u8[0];
       } else {
@@ -810,7 +810,85 @@ status_t EmulatedRequestState::InitializeSensorSettings(
     }
   }
 
-  ret = ProcessAE();
+  ret = request_settings_->Get(ANDROID_STATISTICS_LENS_SHADING_MAP_MODE, &entry);
+  if ((ret == OK) && (entry.count == 1)) {
+    if (allowed_lens_shading_map_modes_.test(entry.data.u8[0])) {
+      validated->lens_shading_map_mode = entry.data.u8[0];
+    } else {
+      ALOGE("%s: Unsupported lens shading map mode!", __FUNCTION__);
+    }
+  }
+
+  return OK;
+}
+
+bool EmulatedRequestState::IsLastValidatedSettings(
+    const HalCameraMetadata& settings) const {
+  // Repeating requests are cloned from the same settings, so unchanged
+  // settings are byte-identical.
+  size_t size = settings.GetCameraMetadataSize();
+  return (size == validated_settings_buffer_.size()) &&
+         (memcmp(settings.GetRawCameraMetadata(),
+                 validated_settings_buffer_.data(), size) == 0);
+}
+
+void EmulatedRequestState::UpdateSettingsStats(nsecs_t processing_time,
+                                               bool validated) {
+  settings_stats_.processing_time += processing_time;
+  settings_stats_.frame_count++;
+  if (validated) {
+    settings_stats_.validated_frame_count++;
+  }
+
+  if (settings_stats_.frame_count == kSettingsStatsFrameCount) {
+    ALOGV("%s: Camera %u: %.2f us per frame, %zu of %zu frames validated",
+          __FUNCTION__, camera_id_,
+          ns2us(settings_stats_.processing_time) /
+              static_cast<double>(settings_stats_.frame_count),
+          settings_stats_.validated_frame_count, settings_stats_.frame_count);
+    settings_stats_ = {};
+  }
+}
+
+status_t EmulatedRequestState::InitializeSensorSettings(
+    std::unique_ptr<HalCameraMetadata> request_settings,
+    uint32_t override_frame_number,
+    EmulatedSensor::SensorSettings* sensor_settings /*out*/) {
+  ATRACE_CALL();
+  auto& info = *device_info_;
+  if ((sensor_settings == nullptr) || (request_settings.get() == nullptr)) {
+    return BAD_VALUE;
+  }
+
+  std::lock_guard<std::mutex> lock(request_state_mutex_);
+  nsecs_t start_time = systemTime(SYSTEM_TIME_MONOTONIC);
+  request_settings_ = std::move(request_settings);
+
+  // The enumerated settings only need to be validated again when the request
+  // settings change. Validation is idempotent, so the device info still
+  // reflects the validated settings.
+  bool validate = !IsLastValidatedSettings(*request_settings_);
+  if (validate) {
+    validated_settings_buffer_.clear();
+    auto ret = ValidateRequestSettings(&validated_settings_);
+    if (ret != OK) {
+      return ret;
+    }
+
+    auto raw_settings = reinterpret_cast<const uint8_t*>(
+        request_settings_->GetRawCameraMetadata());
+    size_t size = request_settings_->GetCameraMetadataSize();
+    validated_settings_buffer_.assign(raw_settings, raw_settings + size);
+  } else {
+    af_mode_changed_ = false;
+  }
+
+  // Store settings override frame number
+  if (override_frame_number != 0) {
+    settings_overriding_frame_number_ = override_frame_number;
+  }
+
+  auto ret = ProcessAE();
   if (ret != OK) {
     return ret;
   }
@@ -825,25 +903,6 @@ status_t EmulatedRequestState::InitializeSensorSettings(
     return ret;
   }
 
-  ret = request_settings_->Get(ANDROID_STATISTICS_LENS_SHADING_MAP_MODE, &entry);
-  if ((ret == OK) && (entry.count == 1)) {
-    if (info.available_lens_shading_map_modes_.find(entry.data.u8[0]) !=
-        info.available_lens_shading_map_modes_.end()) {
-      sensor_settings->lens_shading_map_mode = entry.data.u8[0];
-    } else {
-      ALOGE("%s: Unsupported lens shading map mode!", __FUNCTION__);
-    }
-  }
-
-  ret = info.static_metadata_->Get(ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE, &entry);
-  if ((ret == OK) && (entry.count == 1)) {
-    if (entry.data.u8[0] == ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME) {
-      info.timestamp_source_ = ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME;
-    } else if (entry.data.u8[0] != ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_UNKNOWN) {
-      ALOGE("%s: Unsupported timestamp source", __FUNCTION__);
-    }
-  }
-
   sensor_settings->exposure_time = info.sensor_exposure_time_;
   sensor_settings->frame_duration = info.sensor_frame_duration_;
   sensor_settings->gain = info.sensor_sensitivity_;
@@ -854,15 +913,21 @@ status_t EmulatedRequestState::InitializeSensorSettings(
   sensor_settings->report_rotate_and_crop = info.report_rotate_and_crop_;
   sensor_settings->rotate_and_crop = info.rotate_and_crop_;
   sensor_settings->report_video_stab = !info.available_vstab_modes_.empty();
-  sensor_settings->video_stab = vstab_mode;
+  sensor_settings->video_stab = validated_settings_.vstab_mode;
   sensor_settings->report_edge_mode = info.report_edge_mode_;
-  sensor_settings->edge_mode = edge_mode;
+  sensor_settings->edge_mode = validated_settings_.edge_mode;
   sensor_settings->sensor_pixel_mode = info.sensor_pixel_mode_;
-  sensor_settings->test_pattern_mode = test_pattern_mode;
+  sensor_settings->test_pattern_mode = validated_settings_.test_pattern_mode;
   sensor_settings->timestamp_source = info.timestamp_source_;
-  memcpy(sensor_settings->test_pattern_data, test_pattern_data,
+  sensor_settings->lens_shading_map_mode =
+      validated_settings_.lens_shading_map_mode;
+  memcpy(sensor_settings->test_pattern_data,
+         validated_settings_.test_pattern_data,
          sizeof(sensor_settings->test_pattern_data));
 
+  UpdateSettingsStats(systemTime(SYSTEM_TIME_MONOTONIC) - start_time,
+                      validate);
+
   return OK;
 }
 
@@ -1101,6 +1166,39 @@ status_t EmulatedRequestState::Initialize(
     std::unique_ptr<EmulatedCameraDeviceInfo> deviceInfo) {
   std::lock_guard<std::mutex> lock(request_state_mutex_);
   device_info_ = std::move(deviceInfo);
+  if (device_info_.get() == nullptr) {
+    ALOGE("%s: Device info is nullptr", __FUNCTION__);
+    return BAD_VALUE;
+  }
+
+  auto& info = *device_info_;
+  allowed_control_modes_ = GetAllowedModes(info.available_control_modes_);
+  allowed_sensor_pixel_modes_ =
+      GetAllowedModes(info.available_sensor_pixel_modes_);
+  allowed_scenes_ = GetAllowedModes(info.available_scenes_);
+  allowed_rotate_crop_modes_ =
+      GetAllowedModes(info.available_rotate_crop_modes_);
+  allowed_vstab_modes_ = GetAllowedModes(info.available_vstab_modes_);
+  allowed_edge_modes_ = GetAllowedModes(info.available_edge_modes_);
+  allowed_test_pattern_modes_ =
+      GetAllowedModes(info.available_test_pattern_modes_);
+  allowed_ae_modes_ = GetAllowedModes(info.available_ae_modes_);
+  allowed_awb_modes_ = GetAllowedModes(info.available_awb_modes_);
+  allowed_af_modes_ = GetAllowedModes(info.available_af_modes_);
+  allowed_lens_shading_map_modes_ =
+      GetAllowedModes(info.available_lens_shading_map_modes_);
+  validated_settings_buffer_.clear();
+
+  camera_metadata_ro_entry_t entry;
+  auto ret =
+      info.static_metadata_->Get(ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE, &entry);
+  if ((ret == OK) && (entry.count == 1)) {
+    if (entry.data.u8[0] == ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME) {
+      info.timestamp_source_ = ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME;
+    } else if (entry.data.u8[0] != ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_UNKNOWN) {
+      ALOGE("%s: Unsupported timestamp source", __FUNCTION__);
+    }
+  }
 
   return OK;
 }
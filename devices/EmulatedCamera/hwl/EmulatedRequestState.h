@@ -17,8 +17,10 @@
 #ifndef EMULATOR_CAMERA_HAL_HWL_REQUEST_STATE_H
 #define EMULATOR_CAMERA_HAL_HWL_REQUEST_STATE_H
 
+#include <bitset>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "EmulatedCameraDeviceInfo.h"
 #include "EmulatedSensor.h"
@@ -37,6 +39,9 @@ struct PendingRequest;
 
 class EmulatedRequestState {
  public:
+  // Allowed values of an enumerated request setting, indexed by value.
+  typedef std::bitset<256> AllowedModes;
+
   EmulatedRequestState(uint32_t camera_id) : camera_id_(camera_id) {
   }
   virtual ~EmulatedRequestState() {
@@ -61,6 +66,31 @@ class EmulatedRequestState {
   uint32_t GetPartialResultCount(bool is_partial_result);
 
  private:
+  // Request settings that are only validated when the settings change.
+  struct ValidatedSettings {
+    uint8_t vstab_mode = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
+    uint8_t edge_mode = ANDROID_EDGE_MODE_OFF;
+    uint8_t test_pattern_mode = ANDROID_SENSOR_TEST_PATTERN_MODE_OFF;
+    uint32_t test_pattern_data[4] = {0, 0, 0, 0};
+    uint8_t lens_shading_map_mode =
+        ANDROID_STATISTICS_LENS_SHADING_MAP_MODE_OFF;
+  };
+
+  // Processing time of the request settings, logged every
+  // kSettingsStatsFrameCount frames.
+  struct SettingsStats {
+    nsecs_t processing_time = 0;
+    size_t frame_count = 0;
+    size_t validated_frame_count = 0;
+  };
+  static const size_t kSettingsStatsFrameCount = 300;
+
+  // Validate the enumerated settings in request_settings_ against the
+  // allowed modes and update the device info.
+  status_t ValidateRequestSettings(ValidatedSettings* validated /*out*/);
+  // Return true if settings are identical to the last validated settings.
+  bool IsLastValidatedSettings(const HalCameraMetadata& settings) const;
+  void UpdateSettingsStats(nsecs_t processing_time, bool validated);
   status_t ProcessAE();
   status_t ProcessAF();
   status_t ProcessAWB();
@@ -76,6 +106,24 @@ class EmulatedRequestState {
   // Supported capabilities and features
   std::unique_ptr<EmulatedCameraDeviceInfo> device_info_;
 
+  // Allowed modes compiled from device_info_ in Initialize().
+  AllowedModes allowed_control_modes_;
+  AllowedModes allowed_sensor_pixel_modes_;
+  AllowedModes allowed_scenes_;
+  AllowedModes allowed_rotate_crop_modes_;
+  AllowedModes allowed_vstab_modes_;
+  AllowedModes allowed_edge_modes_;
+  AllowedModes allowed_test_pattern_modes_;
+  AllowedModes allowed_ae_modes_;
+  AllowedModes allowed_awb_modes_;
+  AllowedModes allowed_af_modes_;
+  AllowedModes allowed_lens_shading_map_modes_;
+
+  // Raw copy of the last successfully validated request settings.
+  std::vector<uint8_t> validated_settings_buffer_;
+  ValidatedSettings validated_settings_;
+  SettingsStats settings_stats_;
+
   size_t ae_frame_counter_ = 0;
   const size_t kAEPrecaptureMinFrames = 10;
   // Fake AE related constants
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <utils/Log.h>
 
+#include <algorithm>
 #include <cmath>
 #include <string>
 
@@ -395,11 +396,12 @@ void EmulatedScene::SetReadoutPixel(int x, int y) {
 
 static uint32_t pixel[4] = { 0 };
 const uint32_t* EmulatedScene::GetPixelElectrons() {
-  uint32_t start_pos = 54 + kSceneWidth * current_x_ * 3 + current_y_;
+  uint32_t start_pos =
+      GetReadoutOffsetX(current_x_) + GetReadoutOffsetY(current_y_);
 
-  pixel[EmulatedScene::R] = kScene[start_pos + 2];
-  pixel[EmulatedScene::Gr] = kScene[start_pos + 1];
-  pixel[EmulatedScene::B] = kScene[start_pos];
+  pixel[EmulatedScene::R] = kScene[start_pos + GetChannelOffset(R)];
+  pixel[EmulatedScene::Gr] = kScene[start_pos + GetChannelOffset(Gr)];
+  pixel[EmulatedScene::B] = kScene[start_pos + GetChannelOffset(B)];
 
   return pixel;
 }
@@ -408,6 +410,35 @@ const uint32_t* EmulatedScene::GetPixelElectronsColumn() {
   return GetPixelElectrons();
 }
 
+const uint8_t* EmulatedScene::GetSceneData() {
+  return kScene;
+}
+
+// The scene is read as kSceneHeight rows of kSceneWidth BGR pixels after
+// the BMP header, with x selecting the row. Sensors can be larger than that.
+uint32_t EmulatedScene::GetReadoutOffsetX(int x) {
+  x = std::min(std::max(x, 0), kSceneHeight - 1);
+  return 54 + kSceneWidth * x * 3;
+}
+
+uint32_t EmulatedScene::GetReadoutOffsetY(int y) {
+  return std::min(std::max(y, 0), kSceneWidth * 3 - 3);
+}
+
+int32_t EmulatedScene::GetChannelOffset(ColorChannels channel) {
+  // BGR pixels; Gb is not read out
+  switch (channel) {
+    case R:
+      return 2;
+    case Gr:
+      return 1;
+    case B:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
 // Handshake model constants.
 // Frequencies measured in a nanosecond timebase
 const float EmulatedScene::kHorizShakeFreq1 = 2 * M_PI * 2 / 1e9;   // 2 Hz
@@ -91,10 +91,26 @@ class EmulatedScene {
 
   enum ColorChannels { R = 0, Gr, Gb, B, Y, Cb, Cr, NUM_CHANNELS };
 
+  // Direct sensor readout, for loops that precompute their pixel positions
+  // instead of calling SetReadoutPixel() per pixel. GetPixelElectrons() at
+  // (x, y) returns, for each channel,
+  // GetSceneData()[GetReadoutOffsetX(x) + GetReadoutOffsetY(y) +
+  //                GetChannelOffset(channel)]
+  // or 0 if the channel offset is negative. Positions outside the scene read
+  // its nearest edge.
+  static const uint8_t* GetSceneData();
+  static uint32_t GetReadoutOffsetX(int x);
+  static uint32_t GetReadoutOffsetY(int y);
+  static int32_t GetChannelOffset(ColorChannels channel);
+
   static const int kSceneWidth = 1280;
   static const int kSceneHeight = 720;
 
  private:
+  // Fills the scene with a fixed pattern, see
+  // benchmarks/SensorKernelBenchmark.cpp.
+  friend class EmulatedSensorBenchmark;
+
   void InitiliazeSceneRotation(bool clock_wise);
 
   uint8_t scene_rot0_[kSceneWidth*kSceneHeight];
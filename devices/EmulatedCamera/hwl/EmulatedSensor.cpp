@@ -37,6 +37,7 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <thread>
 
 #include "EmulatedSensor.h"
 #include "utils/ExifUtils.h"
@@ -51,26 +52,6 @@ using google_camera_hal::NotifyMessage;
 
 using android::hardware::graphics::common::V1_2::Dataspace;
 
-// Copied from ColorSpace.java (see Named)
-enum ColorSpaceNamed {
-  SRGB,
-  LINEAR_SRGB,
-  EXTENDED_SRGB,
-  LINEAR_EXTENDED_SRGB,
-  BT709,
-  BT2020,
-  DCI_P3,
-  DISPLAY_P3,
-  NTSC_1953,
-  SMPTE_C,
-  ADOBE_RGB,
-  PRO_PHOTO_RGB,
-  ACES,
-  ACESCG,
-  CIE_XYZ,
-  CIE_LAB
-};
-
 const uint32_t EmulatedSensor::kRegularSceneHandshake = 1; // Scene handshake divider
 const uint32_t EmulatedSensor::kReducedSceneHandshake = 2; // Scene handshake divider
 
@@ -89,6 +70,11 @@ const nsecs_t EmulatedSensor::kDefaultFrameDuration = ms2ns(33);
 // Deadline within we should return the results as soon as possible to
 // avoid skewing the frame cycle due to external delays.
 const nsecs_t EmulatedSensor::kReturnResultThreshod = 3 * kDefaultFrameDuration;
+// Noise seed of the first frame in virtual clock mode
+const unsigned int EmulatedSensor::kVirtualClockNoiseSeed = 1;
+// Start of the virtual clock. Clients treat a zero timestamp as invalid, so
+// the clock doesn't start at zero.
+const nsecs_t EmulatedSensor::kVirtualClockStartTime = s2ns(1);
 
 // Sensor defaults
 const uint8_t EmulatedSensor::kSupportedColorFilterArrangement =
@@ -127,6 +113,11 @@ const uint32_t EmulatedSensor::kMaxLensShadingMapSize[2]{64, 64};
 const int32_t EmulatedSensor::kFixedBitPrecision = 64;  // 6-bit
 // In fixed-point math, saturation point of sensor after gain
 const int32_t EmulatedSensor::kSaturationPoint = kFixedBitPrecision * 255;
+// Quad bayer images are remosaiced in bands of rows, one per thread
+const uint32_t EmulatedSensor::kMaxRemosaicThreads = 4;
+const uint32_t EmulatedSensor::kMinRemosaicRowsPerThread = 512;
+// Fractional precision of the color pipeline matrices
+const int32_t EmulatedSensor::kColorMatrixFractionBits = 16;
 const camera_metadata_rational EmulatedSensor::kNeutralColorPoint[3] = {
     {255, 1}, {255, 1}, {255, 1}};
 const float EmulatedSensor::kGreenSplit = 1.f;  // No divergence
@@ -642,6 +633,8 @@ status_t EmulatedSensor::StartUp(
   }
 
   chars_ = std::move(logical_chars);
+  // The color pipelines of a previous session may use other forward matrices
+  color_pipelines_.clear();
   auto device_chars = chars_->find(logical_camera_id);
   if (device_chars == chars_->end()) {
     ALOGE(
@@ -659,6 +652,16 @@ status_t EmulatedSensor::StartUp(
   }
 
   logical_camera_id_ = logical_camera_id;
+  if (property_get_bool("vendor.qemu.camera_virtual_clock", false) &&
+      !virtual_clock_enabled_) {
+    EnableVirtualClock();
+  }
+  if (virtual_clock_enabled_) {
+    ALOGI("%s: Camera %u runs on a virtual clock", __FUNCTION__,
+          logical_camera_id);
+    virtual_frame_count_ = 0;
+    virtual_clock_start_real_time_ = systemTime(SYSTEM_TIME_MONOTONIC);
+  }
   scene_ = std::make_unique<EmulatedScene>(
       device_chars->second.full_res_width, device_chars->second.full_res_height,
       kElectronsPerLuxSecond, device_chars->second.orientation,
@@ -679,9 +682,33 @@ status_t EmulatedSensor::ShutDown() {
   if (res != OK) {
     ALOGE("Unable to shut down sensor capture thread: %d", res);
   }
+
+  if (virtual_clock_enabled_ && (virtual_frame_count_ > 0)) {
+    nsecs_t real_time =
+        systemTime(SYSTEM_TIME_MONOTONIC) - virtual_clock_start_real_time_;
+    ALOGI("%s: %zu frames in %.3f s of real time, %.1f fps", __FUNCTION__,
+          virtual_frame_count_, real_time / 1e9,
+          virtual_frame_count_ * 1e9 / std::max(real_time, nsecs_t(1)));
+  }
   return res;
 }
 
+void EmulatedSensor::EnableVirtualClock(nsecs_t start_time) {
+  if (isRunning()) {
+    ALOGE("%s: The virtual clock can't be enabled while running",
+          __FUNCTION__);
+    return;
+  }
+  if (start_time <= 0) {
+    ALOGE("%s: Invalid virtual clock start time %" PRId64, __FUNCTION__,
+          start_time);
+    return;
+  }
+
+  virtual_clock_enabled_ = true;
+  virtual_time_ = start_time;
+}
+
 void EmulatedSensor::SetCurrentRequest(
     std::unique_ptr<LogicalCameraSettings> logical_settings,
     std::unique_ptr<HwlPipelineResult> result,
@@ -694,6 +721,9 @@ void EmulatedSensor::SetCurrentRequest(
   current_input_buffers_ = std::move(input_buffers);
   current_output_buffers_ = std::move(output_buffers);
   partial_result_ = std::move(partial_result);
+  if (virtual_clock_enabled_) {
+    request_available_.signal();
+  }
 }
 
 bool EmulatedSensor::WaitForVSyncLocked(nsecs_t reltime) {
@@ -757,6 +787,9 @@ status_t EmulatedSensor::Flush() {
 }
 
 nsecs_t EmulatedSensor::getSystemTimeWithSource(uint32_t timestamp_source) {
+  if (virtual_clock_enabled_) {
+    return virtual_time_;
+  }
   if (timestamp_source == ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME) {
     return systemTime(SYSTEM_TIME_BOOTTIME);
   }
@@ -785,6 +818,12 @@ bool EmulatedSensor::threadLoop() {
   };
   {
     Mutex::Autolock lock(control_mutex_);
+    if (virtual_clock_enabled_ && (current_settings_.get() == nullptr)) {
+      // Idle frames are still paced in real time, so that the sensor doesn't
+      // spin without requests.
+      request_available_.waitRelative(control_mutex_,
+                                      kSupportedFrameDurationRange[0]);
+    }
     std::swap(settings, current_settings_);
     std::swap(next_buffers, current_output_buffers_);
     std::swap(next_input_buffer, current_input_buffers_);
@@ -817,6 +856,9 @@ bool EmulatedSensor::threadLoop() {
    */
   next_capture_time_ = frame_end_real_time;
   next_readout_time_ = frame_end_real_time + exposure_time;
+  if (virtual_clock_enabled_) {
+    rand_seed_ = kVirtualClockNoiseSeed + virtual_frame_count_;
+  }
 
   sensor_binning_factor_info_.clear();
 
@@ -945,10 +987,8 @@ bool EmulatedSensor::threadLoop() {
                                      ? HIGH_QUALITY
                                      : REGULAR;
 
-      if ((*b)->color_space !=
-          ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_UNSPECIFIED) {
-        CalculateRgbRgbMatrix((*b)->color_space, device_chars->second);
-      }
+      const ColorPipeline& color_pipeline = GetColorPipeline(
+          (*b)->camera_id, (*b)->color_space, device_chars->second);
 
       switch ((*b)->format) {
         case PixelFormat::RAW16:
@@ -1034,7 +1074,7 @@ bool EmulatedSensor::threadLoop() {
           if (!reprocess_request) {
             CaptureRGB((*b)->plane.img.img, (*b)->width, (*b)->height,
                        (*b)->plane.img.stride_in_bytes, RGBLayout::RGB,
-                       device_settings->second.gain, (*b)->color_space,
+                       device_settings->second.gain, color_pipeline,
                        device_chars->second);
           } else {
             ALOGE("%s: Reprocess requests with output format %x no supported!",
@@ -1046,7 +1086,7 @@ bool EmulatedSensor::threadLoop() {
           if (!reprocess_request) {
             CaptureRGB((*b)->plane.img.img, (*b)->width, (*b)->height,
                        (*b)->plane.img.stride_in_bytes, RGBLayout::RGBA,
-                       device_settings->second.gain, (*b)->color_space,
+                       device_settings->second.gain, color_pipeline,
                        device_chars->second);
           } else {
             ALOGE("%s: Reprocess requests with output format %x no supported!",
@@ -1089,7 +1129,7 @@ bool EmulatedSensor::threadLoop() {
             auto ret = ProcessYUV420(yuv_input, yuv_output,
                                      device_settings->second.gain, process_type,
                                      device_settings->second.zoom_ratio, rotate,
-                                     (*b)->color_space, device_chars->second);
+                                     color_pipeline, device_chars->second);
             if (ret != 0) {
               (*b)->stream_buffer.status = BufferStatus::kError;
               break;
@@ -1132,7 +1172,7 @@ bool EmulatedSensor::threadLoop() {
           auto ret =
               ProcessYUV420(yuv_input, yuv_output, device_settings->second.gain,
                             process_type, device_settings->second.zoom_ratio,
-                            rotate, (*b)->color_space, device_chars->second);
+                            rotate, color_pipeline, device_chars->second);
           if (ret != 0) {
             (*b)->stream_buffer.status = BufferStatus::kError;
           }
@@ -1165,7 +1205,7 @@ bool EmulatedSensor::threadLoop() {
                                      .planes = (*b)->plane.img_y_crcb};
               ProcessYUV420(yuv_input, yuv_output, device_settings->second.gain,
                             process_type, device_settings->second.zoom_ratio,
-                            rotate, (*b)->color_space, device_chars->second);
+                            rotate, color_pipeline, device_chars->second);
             } else {
               ALOGE(
                   "%s: Reprocess requests with output format %x no supported!",
@@ -1191,6 +1231,18 @@ bool EmulatedSensor::threadLoop() {
     next_input_buffer->clear();
   }
 
+  if (virtual_clock_enabled_) {
+    // The frame ends as soon as it is processed. Idle frames depend on the
+    // timing of the requests, so they don't advance the virtual clock.
+    if (settings.get() != nullptr) {
+      virtual_time_ = frame_end_real_time;
+      virtual_frame_count_++;
+    }
+    ReturnResults(callback, std::move(settings), std::move(next_result),
+                  reprocess_request, std::move(partial_result));
+    return true;
+  }
+
   nsecs_t work_done_real_time = getSystemTimeWithSource(timestamp_source);
   // Returning the results at this point is not entirely correct from timing
   // perspective. Under ideal conditions where 'ReturnResults' completes
@@ -1441,9 +1493,51 @@ void EmulatedSensor::RemosaicQuadBayerBlock(uint16_t* img_in, uint16_t* img_out,
   }
 }
 
+// A 4x4 block of pixels, row by row.
+typedef uint16_t QuadBayerBlock
+    __attribute__((vector_size(16 * sizeof(uint16_t))));
+
+void EmulatedSensor::RemosaicQuadBayerBand(const uint16_t* img_in,
+                                           uint16_t* img_out,
+                                           size_t row_stride, size_t width,
+                                           size_t ystart, size_t yend) {
+  for (size_t y = ystart; y < yend; y += 4) {
+    const uint16_t* in_rows[4];
+    uint16_t* out_rows[4];
+    for (size_t row = 0; row < 4; row++) {
+      in_rows[row] = img_in + (y + row) * row_stride;
+      out_rows[row] = img_out + (y + row) * row_stride;
+    }
+
+    size_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+      uint16_t pixels[16];
+      for (size_t row = 0; row < 4; row++) {
+        memcpy(pixels + row * 4, in_rows[row] + x, 4 * sizeof(uint16_t));
+      }
+      QuadBayerBlock block;
+      memcpy(&block, pixels, sizeof(block));
+      // Same permutation as the index map of RemosaicQuadBayerBlock().
+      block = __builtin_shufflevector(block, block, 0, 8, 4, 12, 2, 10, 9, 14,
+                                      1, 6, 5, 13, 3, 11, 7, 15);
+      memcpy(pixels, &block, sizeof(block));
+      for (size_t row = 0; row < 4; row++) {
+        memcpy(out_rows[row] + x, pixels + row * 4, 4 * sizeof(uint16_t));
+      }
+    }
+
+    // A partial block at the end of the rows.
+    if (x < width) {
+      RemosaicQuadBayerBlock(const_cast<uint16_t*>(img_in), img_out, x, y,
+                             row_stride * 2);
+    }
+  }
+}
+
 status_t EmulatedSensor::RemosaicRAW16Image(uint16_t* img_in, uint16_t* img_out,
                                             size_t row_stride_in_bytes,
                                             const SensorCharacteristics& chars) {
+  ATRACE_CALL();
   if (chars.full_res_width % 2 != 0 || chars.full_res_height % 2 != 0) {
     ALOGE(
         "%s RAW16 Image with quad CFA, height %zu and width %zu, not multiples "
@@ -1451,9 +1545,36 @@ status_t EmulatedSensor::RemosaicRAW16Image(uint16_t* img_in, uint16_t* img_out,
         __FUNCTION__, chars.full_res_height, chars.full_res_width);
     return BAD_VALUE;
   }
-  for (uint32_t i = 0; i < chars.full_res_width; i += 4) {
-    for (uint32_t j = 0; j < chars.full_res_height; j += 4) {
-      RemosaicQuadBayerBlock(img_in, img_out, i, j, row_stride_in_bytes);
+
+  size_t row_stride = row_stride_in_bytes / 2;
+  size_t width = chars.full_res_width;
+  size_t block_rows = chars.full_res_height / 4 * 4;
+  size_t num_threads = std::min<size_t>(
+      {std::max<size_t>(block_rows / kMinRemosaicRowsPerThread, 1),
+       kMaxRemosaicThreads,
+       std::max<size_t>(std::thread::hardware_concurrency(), 1)});
+  size_t band_rows = (block_rows / 4 + num_threads - 1) / num_threads * 4;
+
+  // The threads are started per image instead of being kept around: only RAW
+  // reprocess requests of quad bayer sensors are remosaiced, and starting
+  // three threads (~70us) is well below 1% of remosaicing a 48MP image.
+  std::vector<std::thread> band_threads;
+  for (size_t ystart = band_rows; ystart < block_rows; ystart += band_rows) {
+    band_threads.emplace_back(RemosaicQuadBayerBand, img_in, img_out,
+                              row_stride, width, ystart,
+                              std::min(ystart + band_rows, block_rows));
+  }
+  RemosaicQuadBayerBand(img_in, img_out, row_stride, width, 0,
+                        std::min(band_rows, block_rows));
+  for (auto& thread : band_threads) {
+    thread.join();
+  }
+
+  // A partial row of blocks at the bottom of the image.
+  if (block_rows < chars.full_res_height) {
+    for (size_t x = 0; x < width; x += 4) {
+      RemosaicQuadBayerBlock(img_in, img_out, x, block_rows,
+                             row_stride_in_bytes);
     }
   }
   return OK;
@@ -1498,16 +1619,31 @@ void EmulatedSensor::CaptureRaw(uint8_t* img, size_t row_stride_in_bytes,
   float read_noise_var =
       kReadNoiseVarBeforeGain * noise_var_gain + kReadNoiseVarAfterGain;
 
-  scene_->SetReadoutPixel(0, 0);
   // RGGB
   int bayer_select[4] = {EmulatedScene::R, EmulatedScene::Gr, EmulatedScene::Gb,
                          EmulatedScene::B};
+  const bool quad_bayer =
+      chars.quad_bayer_sensor && !(in_sensor_zoom || binned);
   const float raw_zoom_ratio = in_sensor_zoom ? 2.0f : 1.0f;
   unsigned int image_width =
       in_sensor_zoom || binned ? chars.width : chars.full_res_width;
   unsigned int image_height =
       in_sensor_zoom || binned ? chars.height : chars.full_res_height;
   const float norm_left_top = 0.5f - 0.5f / raw_zoom_ratio;
+
+  // The scene position of each output column only depends on the readout
+  // mode, so it is computed once instead of per pixel.
+  std::vector<uint32_t> column_offsets(image_width);
+  for (unsigned int out_x = 0; out_x < image_width; out_x++) {
+    float norm_x = out_x / (image_width * raw_zoom_ratio);
+    int x = static_cast<int>(chars.full_res_width * (norm_left_top + norm_x));
+    x = std::min(std::max(x, 0), (int)chars.full_res_width - 1);
+    column_offsets[out_x] = EmulatedScene::GetReadoutOffsetX(x);
+  }
+
+  const uint8_t* scene = EmulatedScene::GetSceneData();
+  std::vector<uint32_t> electron_counts(image_width);
+  std::vector<float> noise_samples(image_width);
   for (unsigned int out_y = 0; out_y < image_height; out_y++) {
     int* bayer_row = bayer_select + (out_y & 0x1) * 2;
     uint16_t* px = (uint16_t*)img + out_y * (row_stride_in_bytes / 2);
@@ -1515,19 +1651,39 @@ void EmulatedSensor::CaptureRaw(uint8_t* img, size_t row_stride_in_bytes,
     float norm_y = out_y / (image_height * raw_zoom_ratio);
     int y = static_cast<int>(chars.full_res_height * (norm_left_top + norm_y));
     y = std::min(std::max(y, 0), (int)chars.full_res_height - 1);
+    const uint8_t* scene_row = scene + EmulatedScene::GetReadoutOffsetY(y);
+
+    // The color filter repeats every 2 (bayer) or 4 (quad bayer) columns
+    int32_t channel_offsets[4];
+    uint32_t black_levels[4];
+    for (unsigned int i = 0; i < 4; i++) {
+      int color_idx =
+          quad_bayer ? GetQuadBayerColor(i, out_y) : bayer_row[i & 0x1];
+      channel_offsets[i] = EmulatedScene::GetChannelOffset(
+          static_cast<EmulatedScene::ColorChannels>(color_idx));
+      black_levels[i] = chars.black_level_pattern[color_idx];
+    }
 
     for (unsigned int out_x = 0; out_x < image_width; out_x++) {
-      int color_idx = chars.quad_bayer_sensor && !(in_sensor_zoom || binned)
-                          ? GetQuadBayerColor(out_x, out_y)
-                          : bayer_row[out_x & 0x1];
-      float norm_x = out_x / (image_width * raw_zoom_ratio);
-      int x = static_cast<int>(chars.full_res_width * (norm_left_top + norm_x));
-      x = std::min(std::max(x, 0), (int)chars.full_res_width - 1);
+      int32_t channel_offset = channel_offsets[out_x & 0x3];
+      electron_counts[out_x] =
+          channel_offset < 0
+              ? 0
+              : scene_row[column_offsets[out_x] + channel_offset];
+    }
 
-      uint32_t electron_count;
-      scene_->SetReadoutPixel(x, y);
-      electron_count = scene_->GetPixelElectrons()[color_idx];
+    // Noise samples are drawn in pixel order, so that the sequence of
+    // rand_seed_ stays the same for a given seed.
+    for (unsigned int out_x = 0; out_x < image_width; out_x++) {
+      // TODO: Use more-correct Gaussian instead of uniform noise
+      // Scaled to roughly match gaussian/uniform noise stddev
+      noise_samples[out_x] =
+          rand_r(&rand_seed_) * (2.5 / (1.0 + RAND_MAX)) - 1.25;
+    }
 
+    // No per pixel calls are left, so the compiler can vectorize this loop.
+    for (unsigned int out_x = 0; out_x < image_width; out_x++) {
+      uint32_t electron_count = electron_counts[out_x];
       // TODO: Better pixel saturation curve?
       electron_count = (electron_count < kSaturationElectrons)
                            ? electron_count
@@ -1539,16 +1695,13 @@ void EmulatedSensor::CaptureRaw(uint8_t* img, size_t row_stride_in_bytes,
           (raw_count < chars.max_raw_value) ? raw_count : chars.max_raw_value;
 
       // Calculate noise value
-      // TODO: Use more-correct Gaussian instead of uniform noise
       float photon_noise_var = electron_count * noise_var_gain;
       float noise_stddev = sqrtf_approx(read_noise_var + photon_noise_var);
-      // Scaled to roughly match gaussian/uniform noise stddev
-      float noise_sample = rand_r(&rand_seed_) * (2.5 / (1.0 + RAND_MAX)) - 1.25;
 
-      raw_count += chars.black_level_pattern[color_idx];
-      raw_count += noise_stddev * noise_sample;
+      raw_count += black_levels[out_x & 0x3];
+      raw_count += noise_stddev * noise_samples[out_x];
 
-      *px++ = raw_count;
+      px[out_x] = raw_count;
     }
     // TODO: Handle this better
     // simulatedTime += mRowReadoutTime;
@@ -1558,7 +1711,8 @@ void EmulatedSensor::CaptureRaw(uint8_t* img, size_t row_stride_in_bytes,
 
 void EmulatedSensor::CaptureRGB(uint8_t* img, uint32_t width, uint32_t height,
                                 uint32_t stride, RGBLayout layout,
-                                uint32_t gain, int32_t color_space,
+                                uint32_t gain,
+                                const ColorPipeline& color_pipeline,
                                 const SensorCharacteristics& chars) {
   ATRACE_CALL();
   float total_gain = gain / 100.0 * GetBaseGainFactor(chars.max_raw_value);
@@ -1579,9 +1733,8 @@ void EmulatedSensor::CaptureRGB(uint8_t* img, uint32_t width, uint32_t height,
       g_count = pixel[EmulatedScene::Gr] * scale64x;
       b_count = pixel[EmulatedScene::B] * scale64x;
 
-      if (color_space !=
-          ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_UNSPECIFIED) {
-        RgbToRgb(&r_count, &g_count, &b_count);
+      if (color_pipeline.convert_rgb) {
+        RgbToRgb(color_pipeline, &r_count, &g_count, &b_count);
       }
 
       uint8_t r = r_count < 255 * 64 ? r_count / 64 : 255;
@@ -1618,7 +1771,7 @@ void EmulatedSensor::CaptureRGB(uint8_t* img, uint32_t width, uint32_t height,
 void EmulatedSensor::CaptureYUV420(YCbCrPlanes yuv_layout, uint32_t width,
                                    uint32_t height, uint32_t gain,
                                    float zoom_ratio, bool rotate,
-                                   int32_t color_space,
+                                   const ColorPipeline& color_pipeline,
                                    const SensorCharacteristics& chars) {
   ATRACE_CALL();
   float total_gain = gain / 100.0 * GetBaseGainFactor(chars.max_raw_value);
@@ -1678,9 +1831,8 @@ void EmulatedSensor::CaptureYUV420(YCbCrPlanes yuv_layout, uint32_t width,
       g_count = pixel[EmulatedScene::Gr] * scale64x;
       b_count = pixel[EmulatedScene::B] * scale64x;
 
-      if (color_space !=
-          ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_UNSPECIFIED) {
-        RgbToRgb(&r_count, &g_count, &b_count);
+      if (color_pipeline.convert_rgb) {
+        RgbToRgb(color_pipeline, &r_count, &g_count, &b_count);
       }
 
       r_count = r_count < kSaturationPoint ? r_count : kSaturationPoint;
@@ -1688,9 +1840,9 @@ void EmulatedSensor::CaptureYUV420(YCbCrPlanes yuv_layout, uint32_t width,
       b_count = b_count < kSaturationPoint ? b_count : kSaturationPoint;
 
       // Gamma correction
-      r_count = GammaTable(r_count, color_space);
-      g_count = GammaTable(g_count, color_space);
-      b_count = GammaTable(b_count, color_space);
+      r_count = color_pipeline.gamma_table[r_count];
+      g_count = color_pipeline.gamma_table[g_count];
+      b_count = color_pipeline.gamma_table[b_count];
 
       uint8_t y8 = (rgb_to_y[0] * r_count + rgb_to_y[1] * g_count +
                     rgb_to_y[2] * b_count) /
@@ -1766,7 +1918,7 @@ status_t EmulatedSensor::ProcessYUV420(const YUV420Frame& input,
                                        const YUV420Frame& output, uint32_t gain,
                                        ProcessType process_type,
                                        float zoom_ratio, bool rotate_and_crop,
-                                       int32_t color_space,
+                                       const ColorPipeline& color_pipeline,
                                        const SensorCharacteristics& chars) {
   ATRACE_CALL();
   size_t input_width, input_height;
@@ -1784,7 +1936,7 @@ status_t EmulatedSensor::ProcessYUV420(const YUV420Frame& input,
   switch (process_type) {
     case HIGH_QUALITY:
       CaptureYUV420(output.planes, output.width, output.height, gain,
-                    zoom_ratio, rotate_and_crop, color_space, chars);
+                    zoom_ratio, rotate_and_crop, color_pipeline, chars);
       return OK;
     case REPROCESS:
       input_width = input.width;
@@ -1834,7 +1986,7 @@ status_t EmulatedSensor::ProcessYUV420(const YUV420Frame& input,
           .cbcr_step = 1,
           .bytesPerPixel = bytes_per_pixel};
       CaptureYUV420(input_planes, input_width, input_height, gain, zoom_ratio,
-                    rotate_and_crop, color_space, chars);
+                    rotate_and_crop, color_pipeline, chars);
   }
 
   output_planes = output.planes;
@@ -1954,39 +2106,64 @@ int32_t EmulatedSensor::ApplyHLGGamma(int32_t value, int32_t saturation) {
   return n_value * saturation;
 }
 
-int32_t EmulatedSensor::GammaTable(int32_t value, int32_t color_space) {
+const int32_t* EmulatedSensor::GetGammaTable(int32_t color_space) const {
   switch (color_space) {
     case ColorSpaceNamed::BT709:
-      return gamma_table_smpte170m_[value];
+      return gamma_table_smpte170m_.data();
     case ColorSpaceNamed::BT2020:
-      return gamma_table_hlg_[value];  // Assume HLG
+      return gamma_table_hlg_.data();  // Assume HLG
     case ColorSpaceNamed::DISPLAY_P3:
     case ColorSpaceNamed::SRGB:
     default:
-      return gamma_table_sRGB_[value];
+      return gamma_table_sRGB_.data();
   }
+}
 
-  return 0;
+const ColorPipeline& EmulatedSensor::GetColorPipeline(
+    uint32_t camera_id, int32_t color_space,
+    const SensorCharacteristics& chars) {
+  auto key = std::make_pair(camera_id, color_space);
+  auto it = color_pipelines_.find(key);
+  if (it != color_pipelines_.end()) {
+    return it->second;
+  }
+
+  ColorPipeline color_pipeline;
+  color_pipeline.gamma_table = GetGammaTable(color_space);
+  if (color_space !=
+      ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_UNSPECIFIED) {
+    RgbRgbMatrix matrix = CalculateRgbRgbMatrix(color_space, chars);
+    const float rows[3][3] = {{matrix.rR, matrix.gR, matrix.bR},
+                              {matrix.rG, matrix.gG, matrix.bG},
+                              {matrix.rB, matrix.gB, matrix.bB}};
+    for (size_t i = 0; i < 3; i++) {
+      for (size_t j = 0; j < 3; j++) {
+        color_pipeline.rgb_rgb_matrix[i][j] =
+            llroundf(rows[i][j] * (1 << kColorMatrixFractionBits));
+      }
+    }
+    color_pipeline.convert_rgb = true;
+  }
+
+  return color_pipelines_.emplace(key, color_pipeline).first->second;
 }
 
-void EmulatedSensor::RgbToRgb(uint32_t* r_count, uint32_t* g_count,
+void EmulatedSensor::RgbToRgb(const ColorPipeline& color_pipeline,
+                              uint32_t* r_count, uint32_t* g_count,
                               uint32_t* b_count) {
-  uint32_t r = *r_count;
-  uint32_t g = *g_count;
-  uint32_t b = *b_count;
-  *r_count = (uint32_t)std::max(
-      r * rgb_rgb_matrix_.rR + g * rgb_rgb_matrix_.gR + b * rgb_rgb_matrix_.bR,
-      0.0f);
-  *g_count = (uint32_t)std::max(
-      r * rgb_rgb_matrix_.rG + g * rgb_rgb_matrix_.gG + b * rgb_rgb_matrix_.bG,
-      0.0f);
-  *b_count = (uint32_t)std::max(
-      r * rgb_rgb_matrix_.rB + g * rgb_rgb_matrix_.gB + b * rgb_rgb_matrix_.bB,
-      0.0f);
+  int64_t rgb[3] = {*r_count, *g_count, *b_count};
+  uint32_t* out[3] = {r_count, g_count, b_count};
+  for (size_t i = 0; i < 3; i++) {
+    const int64_t* row = color_pipeline.rgb_rgb_matrix[i];
+    int64_t value = (rgb[0] * row[0] + rgb[1] * row[1] + rgb[2] * row[2]) >>
+                    kColorMatrixFractionBits;
+    *out[i] = std::max<int64_t>(value, 0);
+  }
 }
 
-void EmulatedSensor::CalculateRgbRgbMatrix(int32_t color_space,
-                                           const SensorCharacteristics& chars) {
+RgbRgbMatrix EmulatedSensor::CalculateRgbRgbMatrix(
+    int32_t color_space, const SensorCharacteristics& chars) {
+  RgbRgbMatrix rgb_rgb_matrix;
   const XyzMatrix* xyzMatrix;
   switch (color_space) {
     case ColorSpaceNamed::DISPLAY_P3:
@@ -2004,33 +2181,34 @@ void EmulatedSensor::CalculateRgbRgbMatrix(int32_t color_space,
       break;
   }
 
-  rgb_rgb_matrix_.rR = xyzMatrix->xR * chars.forward_matrix.rX +
-                       xyzMatrix->yR * chars.forward_matrix.rY +
-                       xyzMatrix->zR * chars.forward_matrix.rZ;
-  rgb_rgb_matrix_.gR = xyzMatrix->xR * chars.forward_matrix.gX +
-                       xyzMatrix->yR * chars.forward_matrix.gY +
-                       xyzMatrix->zR * chars.forward_matrix.gZ;
-  rgb_rgb_matrix_.bR = xyzMatrix->xR * chars.forward_matrix.bX +
-                       xyzMatrix->yR * chars.forward_matrix.bY +
-                       xyzMatrix->zR * chars.forward_matrix.bZ;
-  rgb_rgb_matrix_.rG = xyzMatrix->xG * chars.forward_matrix.rX +
-                       xyzMatrix->yG * chars.forward_matrix.rY +
-                       xyzMatrix->zG * chars.forward_matrix.rZ;
-  rgb_rgb_matrix_.gG = xyzMatrix->xG * chars.forward_matrix.gX +
-                       xyzMatrix->yG * chars.forward_matrix.gY +
-                       xyzMatrix->zG * chars.forward_matrix.gZ;
-  rgb_rgb_matrix_.bG = xyzMatrix->xG * chars.forward_matrix.bX +
-                       xyzMatrix->yG * chars.forward_matrix.bY +
-                       xyzMatrix->zG * chars.forward_matrix.bZ;
-  rgb_rgb_matrix_.rB = xyzMatrix->xB * chars.forward_matrix.rX +
-                       xyzMatrix->yB * chars.forward_matrix.rY +
-                       xyzMatrix->zB * chars.forward_matrix.rZ;
-  rgb_rgb_matrix_.gB = xyzMatrix->xB * chars.forward_matrix.gX +
-                       xyzMatrix->yB * chars.forward_matrix.gY +
-                       xyzMatrix->zB * chars.forward_matrix.gZ;
-  rgb_rgb_matrix_.bB = xyzMatrix->xB * chars.forward_matrix.bX +
-                       xyzMatrix->yB * chars.forward_matrix.bY +
-                       xyzMatrix->zB * chars.forward_matrix.bZ;
+  rgb_rgb_matrix.rR = xyzMatrix->xR * chars.forward_matrix.rX +
+                      xyzMatrix->yR * chars.forward_matrix.rY +
+                      xyzMatrix->zR * chars.forward_matrix.rZ;
+  rgb_rgb_matrix.gR = xyzMatrix->xR * chars.forward_matrix.gX +
+                      xyzMatrix->yR * chars.forward_matrix.gY +
+                      xyzMatrix->zR * chars.forward_matrix.gZ;
+  rgb_rgb_matrix.bR = xyzMatrix->xR * chars.forward_matrix.bX +
+                      xyzMatrix->yR * chars.forward_matrix.bY +
+                      xyzMatrix->zR * chars.forward_matrix.bZ;
+  rgb_rgb_matrix.rG = xyzMatrix->xG * chars.forward_matrix.rX +
+                      xyzMatrix->yG * chars.forward_matrix.rY +
+                      xyzMatrix->zG * chars.forward_matrix.rZ;
+  rgb_rgb_matrix.gG = xyzMatrix->xG * chars.forward_matrix.gX +
+                      xyzMatrix->yG * chars.forward_matrix.gY +
+                      xyzMatrix->zG * chars.forward_matrix.gZ;
+  rgb_rgb_matrix.bG = xyzMatrix->xG * chars.forward_matrix.bX +
+                      xyzMatrix->yG * chars.forward_matrix.bY +
+                      xyzMatrix->zG * chars.forward_matrix.bZ;
+  rgb_rgb_matrix.rB = xyzMatrix->xB * chars.forward_matrix.rX +
+                      xyzMatrix->yB * chars.forward_matrix.rY +
+                      xyzMatrix->zB * chars.forward_matrix.rZ;
+  rgb_rgb_matrix.gB = xyzMatrix->xB * chars.forward_matrix.gX +
+                      xyzMatrix->yB * chars.forward_matrix.gY +
+                      xyzMatrix->zB * chars.forward_matrix.gZ;
+  rgb_rgb_matrix.bB = xyzMatrix->xB * chars.forward_matrix.bX +
+                      xyzMatrix->yB * chars.forward_matrix.bY +
+                      xyzMatrix->zB * chars.forward_matrix.bZ;
+  return rgb_rgb_matrix;
 }
 
 }  // namespace android
@@ -141,6 +141,19 @@ struct RgbRgbMatrix {
   float bB;
 };
 
+// Conversion of the processed outputs to a color space, baked once per color
+// space and forward matrix and shared by the frames and streams of a session.
+struct ColorPipeline {
+  // Whether rgb_rgb_matrix is applied, which is not the case for the
+  // unspecified color space.
+  bool convert_rgb = false;
+  // Sensor RGB to color space RGB by row, in fixed point with
+  // EmulatedSensor::kColorMatrixFractionBits of fractional precision.
+  int64_t rgb_rgb_matrix[3][3] = {};
+  // Gamma curve of the color space over [0, kSaturationPoint].
+  const int32_t* gamma_table = nullptr;
+};
+
 typedef std::unordered_map<DynamicRangeProfile,
                            std::unordered_set<DynamicRangeProfile>>
     DynamicRangeProfileMap;
@@ -257,6 +270,19 @@ class EmulatedSensor : private Thread, public virtual RefBase {
                    std::unique_ptr<LogicalCharacteristics> logical_chars);
   status_t ShutDown();
 
+  /*
+   * Virtual clock
+   */
+
+  // Run the sensor on a virtual clock that starts at start_time, which must be
+  // positive. Instead of pacing frames in real time, each frame advances the
+  // virtual clock by its frame duration and the next frame starts as soon as
+  // a new request is available. The noise of each frame is seeded with its
+  // index, so the same requests produce the same output. Must be called before
+  // StartUp(). The virtual clock is also enabled by the
+  // vendor.qemu.camera_virtual_clock property.
+  void EnableVirtualClock(nsecs_t start_time = kVirtualClockStartTime);
+
   /*
    * Physical camera settings control
    */
@@ -310,6 +336,7 @@ class EmulatedSensor : private Thread, public virtual RefBase {
   static const nsecs_t kDefaultExposureTime;
   static const int32_t kDefaultSensitivity;
   static const nsecs_t kDefaultFrameDuration;
+  static const nsecs_t kVirtualClockStartTime;
   static const nsecs_t kReturnResultThreshod;
   static const uint32_t kDefaultBlackLevelPattern[4];
   static const camera_metadata_rational kDefaultColorTransform[9];
@@ -320,6 +347,15 @@ class EmulatedSensor : private Thread, public virtual RefBase {
   static const uint8_t kPipelineDepth;
 
  private:
+  // Runs the pixel kernels below on a fixed scene, see
+  // benchmarks/SensorKernelBenchmark.cpp.
+  friend class EmulatedSensorBenchmark;
+  // Checks the pixel kernels below against reference implementations, see
+  // tests/EmulatedSensorTests.cpp.
+  friend class EmulatedSensorKernelTests;
+
+  static const unsigned int kVirtualClockNoiseSeed;
+
   // Scene stabilization
   static const uint32_t kRegularSceneHandshake;
   static const uint32_t kReducedSceneHandshake;
@@ -354,6 +390,29 @@ class EmulatedSensor : private Thread, public virtual RefBase {
   static const uint32_t kMaxLensShadingMapSize[2];
   static const int32_t kFixedBitPrecision;
   static const int32_t kSaturationPoint;
+  static const uint32_t kMaxRemosaicThreads;
+  static const uint32_t kMinRemosaicRowsPerThread;
+  static const int32_t kColorMatrixFractionBits;
+
+  // Copied from ColorSpace.java (see Named)
+  enum ColorSpaceNamed {
+    SRGB,
+    LINEAR_SRGB,
+    EXTENDED_SRGB,
+    LINEAR_EXTENDED_SRGB,
+    BT709,
+    BT2020,
+    DCI_P3,
+    DISPLAY_P3,
+    NTSC_1953,
+    SMPTE_C,
+    ADOBE_RGB,
+    PRO_PHOTO_RGB,
+    ACES,
+    ACESCG,
+    CIE_XYZ,
+    CIE_LAB
+  };
 
   std::vector<int32_t> gamma_table_sRGB_;
   std::vector<int32_t> gamma_table_smpte170m_;
@@ -369,9 +428,18 @@ class EmulatedSensor : private Thread, public virtual RefBase {
   std::unique_ptr<Buffers> current_output_buffers_;
   std::unique_ptr<Buffers> current_input_buffers_;
   std::unique_ptr<JpegCompressor> jpeg_compressor_;
+  // Signaled when a request is set in virtual clock mode.
+  Condition request_available_;
 
   // End of control parameters
 
+  // Virtual clock state. Only set before the sensor thread starts, or used by
+  // the sensor thread.
+  bool virtual_clock_enabled_ = false;
+  nsecs_t virtual_time_ = 0;
+  size_t virtual_frame_count_ = 0;
+  nsecs_t virtual_clock_start_real_time_ = 0;
+
   unsigned int rand_seed_ = 1;
 
   /**
@@ -396,7 +464,9 @@ class EmulatedSensor : private Thread, public virtual RefBase {
 
   std::unique_ptr<EmulatedScene> scene_;
 
-  RgbRgbMatrix rgb_rgb_matrix_;
+  // Color pipelines of the session by camera id and color space, only used
+  // by the sensor thread.
+  std::map<std::pair<uint32_t, int32_t>, ColorPipeline> color_pipelines_;
 
   static EmulatedScene::ColorChannels GetQuadBayerColor(uint32_t x, uint32_t y);
 
@@ -404,6 +474,12 @@ class EmulatedSensor : private Thread, public virtual RefBase {
                                      int xstart, int ystart,
                                      int row_stride_in_bytes);
 
+  // Remosaic the 4x4 blocks of rows [ystart, yend), which must be a multiple
+  // of 4 rows.
+  static void RemosaicQuadBayerBand(const uint16_t* img_in, uint16_t* img_out,
+                                    size_t row_stride, size_t width,
+                                    size_t ystart, size_t yend);
+
   static status_t RemosaicRAW16Image(uint16_t* img_in, uint16_t* img_out,
                                      size_t row_stride_in_bytes,
                                      const SensorCharacteristics& chars);
@@ -422,15 +498,24 @@ class EmulatedSensor : private Thread, public virtual RefBase {
   enum RGBLayout { RGB, RGBA, ARGB };
   void CaptureRGB(uint8_t* img, uint32_t width, uint32_t height,
                   uint32_t stride, RGBLayout layout, uint32_t gain,
-                  int32_t color_space, const SensorCharacteristics& chars);
+                  const ColorPipeline& color_pipeline,
+                  const SensorCharacteristics& chars);
   void CaptureYUV420(YCbCrPlanes yuv_layout, uint32_t width, uint32_t height,
                      uint32_t gain, float zoom_ratio, bool rotate,
-                     int32_t color_space, const SensorCharacteristics& chars);
+                     const ColorPipeline& color_pipeline,
+                     const SensorCharacteristics& chars);
   void CaptureDepth(uint8_t* img, uint32_t gain, uint32_t width, uint32_t height,
                     uint32_t stride, const SensorCharacteristics& chars);
-  void RgbToRgb(uint32_t* r_count, uint32_t* g_count, uint32_t* b_count);
-  void CalculateRgbRgbMatrix(int32_t color_space,
-                             const SensorCharacteristics& chars);
+  const ColorPipeline& GetColorPipeline(uint32_t camera_id,
+                                        int32_t color_space,
+                                        const SensorCharacteristics& chars);
+  // Converts to the color space of the pipeline. Negative results are clamped
+  // to 0, saturation is left to the caller.
+  static void RgbToRgb(const ColorPipeline& color_pipeline,
+                       uint32_t* r_count, uint32_t* g_count,
+                       uint32_t* b_count);
+  static RgbRgbMatrix CalculateRgbRgbMatrix(int32_t color_space,
+                                            const SensorCharacteristics& chars);
 
   struct YUV420Frame {
     uint32_t width = 0;
@@ -442,14 +527,14 @@ class EmulatedSensor : private Thread, public virtual RefBase {
   status_t ProcessYUV420(const YUV420Frame& input, const YUV420Frame& output,
                          uint32_t gain, ProcessType process_type,
                          float zoom_ratio, bool rotate_and_crop,
-                         int32_t color_space,
+                         const ColorPipeline& color_pipeline,
                          const SensorCharacteristics& chars);
 
   inline int32_t ApplysRGBGamma(int32_t value, int32_t saturation);
   inline int32_t ApplySMPTE170MGamma(int32_t value, int32_t saturation);
   inline int32_t ApplyST2084Gamma(int32_t value, int32_t saturation);
   inline int32_t ApplyHLGGamma(int32_t value, int32_t saturation);
-  inline int32_t GammaTable(int32_t value, int32_t color_space);
+  const int32_t* GetGammaTable(int32_t color_space) const;
 
   bool WaitForVSyncLocked(nsecs_t reltime);
   void CalculateAndAppendNoiseProfile(float gain /*in ISO*/,
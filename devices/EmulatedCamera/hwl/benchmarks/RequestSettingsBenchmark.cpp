@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the per-frame processing time of request settings, including 3A,
+// on the camera configurations bundled with the device (emu_camera_*.json).
+//
+// Repeating requests send the same settings every frame, as a preview does.
+// Changing requests alternate between two zoom ratios, so that the settings
+// are validated every frame.
+
+#define LOG_TAG "RequestSettingsBenchmark"
+#include <benchmark/benchmark.h>
+#include <camera_device_hwl.h>
+#include <camera_provider_hwl.h>
+#include <hal_camera_metadata.h>
+#include <log/log.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EmulatedCameraDeviceInfo.h"
+#include "EmulatedRequestState.h"
+
+extern "C" android::google_camera_hal::CameraProviderHwl*
+CreateCameraProviderHwl();
+
+namespace android {
+namespace {
+
+using google_camera_hal::CameraDeviceHwl;
+using google_camera_hal::CameraProviderHwl;
+using google_camera_hal::HalCameraMetadata;
+
+struct CameraRequestState {
+  uint32_t camera_id = 0;
+  std::unique_ptr<EmulatedRequestState> request_state;
+  // Settings sent by consecutive frames.
+  std::vector<std::unique_ptr<HalCameraMetadata>> settings;
+};
+
+void BM_InitializeSensorSettings(benchmark::State& state,
+                                 CameraRequestState* camera,
+                                 size_t num_settings) {
+  size_t i = 0;
+  for (auto _ : state) {
+    EmulatedSensor::SensorSettings sensor_settings;
+    status_t res = camera->request_state->InitializeSensorSettings(
+        HalCameraMetadata::Clone(camera->settings[i].get()),
+        /*override_frame_number=*/0, &sensor_settings);
+    if (res != OK) {
+      state.SkipWithError("InitializeSensorSettings() failed.");
+      break;
+    }
+    benchmark::DoNotOptimize(sensor_settings);
+    i = (i + 1) % num_settings;
+  }
+}
+
+std::unique_ptr<CameraRequestState> CreateCameraRequestState(
+    CameraProviderHwl* provider, uint32_t camera_id) {
+  std::unique_ptr<CameraDeviceHwl> device;
+  std::unique_ptr<HalCameraMetadata> characteristics;
+  if (provider->CreateCameraDeviceHwl(camera_id, &device) != OK ||
+      device->GetCameraCharacteristics(&characteristics) != OK) {
+    ALOGE("%s: Getting camera %u failed.", __FUNCTION__, camera_id);
+    return nullptr;
+  }
+
+  auto device_info =
+      EmulatedCameraDeviceInfo::Create(std::move(characteristics));
+  if (device_info == nullptr) {
+    return nullptr;
+  }
+
+  auto camera = std::make_unique<CameraRequestState>();
+  camera->camera_id = camera_id;
+  camera->request_state = std::make_unique<EmulatedRequestState>(camera_id);
+  if (camera->request_state->Initialize(std::move(device_info)) != OK) {
+    ALOGE("%s: Initializing camera %u failed.", __FUNCTION__, camera_id);
+    return nullptr;
+  }
+
+  std::unique_ptr<HalCameraMetadata> settings;
+  if (camera->request_state->GetDefaultRequest(
+          google_camera_hal::RequestTemplate::kPreview, &settings) != OK) {
+    ALOGE("%s: Camera %u has no preview template.", __FUNCTION__, camera_id);
+    return nullptr;
+  }
+
+  // The zoom ratio is clamped to the supported range, so it is valid on all
+  // cameras.
+  float zoom_ratio = 2.0f;
+  auto zoomed_settings = HalCameraMetadata::Clone(settings.get());
+  if (zoomed_settings == nullptr ||
+      zoomed_settings->Set(ANDROID_CONTROL_ZOOM_RATIO, &zoom_ratio, 1) != OK) {
+    return nullptr;
+  }
+  camera->settings.push_back(std::move(settings));
+  camera->settings.push_back(std::move(zoomed_settings));
+  return camera;
+}
+
+}  // namespace
+}  // namespace android
+
+int main(int argc, char** argv) {
+  using namespace android;
+
+  benchmark::Initialize(&argc, argv);
+
+  std::unique_ptr<CameraProviderHwl> provider(CreateCameraProviderHwl());
+  if (provider == nullptr) {
+    ALOGE("%s: Creating the camera provider HWL failed.", __FUNCTION__);
+    return 1;
+  }
+
+  std::vector<uint32_t> camera_ids;
+  provider->GetVisibleCameraIds(&camera_ids);
+  std::vector<std::unique_ptr<CameraRequestState>> cameras;
+  for (uint32_t camera_id : camera_ids) {
+    auto camera = CreateCameraRequestState(provider.get(), camera_id);
+    if (camera == nullptr) {
+      return 1;
+    }
+
+    std::string name = "camera" + std::to_string(camera_id);
+    benchmark::RegisterBenchmark(
+        (name + "/InitializeSensorSettings/repeating").c_str(),
+        BM_InitializeSensorSettings, camera.get(), /*num_settings=*/1);
+    benchmark::RegisterBenchmark(
+        (name + "/InitializeSensorSettings/changing").c_str(),
+        BM_InitializeSensorSettings, camera.get(),
+        camera->settings.size());
+    cameras.push_back(std::move(camera));
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the pixel kernels of EmulatedSensor on a fixed scene, from VGA to
+// a 48 MP quad bayer sensor. Besides time per pixel and output bandwidth, each
+// benchmark reports a checksum of its output, with the noise reset to a fixed
+// seed, so that optimized kernels can be checked against the current ones:
+//
+//   sensor_kernel_benchmark --golden_file=sensor_kernel_golden.txt
+//
+// The run fails if a checksum differs from the golden file or is missing from
+// it. --update_golden writes the checksums of the kernels that ran to the
+// golden file instead. sensor_kernel_golden.txt next to this file was recorded
+// on an x86-64 host; float kernels may round differently elsewhere. Lines of
+// the golden file starting with '#' note why checksums were re-recorded and
+// are kept by --update_golden.
+
+#define LOG_TAG "SensorKernelBenchmark"
+#include <benchmark/benchmark.h>
+#include <log/log.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "EmulatedSensor.h"
+
+namespace android {
+
+// Gives the benchmarks access to the kernels of EmulatedSensor.
+class EmulatedSensorBenchmark {
+ public:
+  explicit EmulatedSensorBenchmark(const SensorCharacteristics& chars)
+      : chars_(chars), sensor_(new EmulatedSensor()) {
+    // Noon, so that the scene is lit.
+    static constexpr nsecs_t kSceneTime = s2ns(7) + ms2ns(200);
+    FillScene();
+    sensor_->scene_ = std::make_unique<EmulatedScene>(
+        chars.full_res_width, chars.full_res_height,
+        EmulatedSensor::kElectronsPerLuxSecond, chars.orientation,
+        chars.is_front_facing);
+    sensor_->scene_->SetExposureDuration(
+        EmulatedSensor::kDefaultExposureTime / 1e9);
+    const ColorFilterXYZ& filter = chars.color_filter;
+    sensor_->scene_->SetColorFilterXYZ(
+        filter.rX, filter.rY, filter.rZ, filter.grX, filter.grY, filter.grZ,
+        filter.gbX, filter.gbY, filter.gbZ, filter.bX, filter.bY, filter.bZ);
+    sensor_->scene_->CalculateScene(kSceneTime,
+                                    EmulatedSensor::kRegularSceneHandshake);
+  }
+
+  const SensorCharacteristics& GetCharacteristics() const {
+    return chars_;
+  }
+
+  static int32_t GetSaturationPoint() {
+    return EmulatedSensor::kSaturationPoint;
+  }
+
+  // Reset the noise, so that the next capture is the same as the first one.
+  void ResetNoise() {
+    sensor_->rand_seed_ = EmulatedSensor::kVirtualClockNoiseSeed;
+  }
+
+  void CaptureRaw(uint8_t* img, bool in_sensor_zoom, bool binned) {
+    uint32_t width = in_sensor_zoom || binned ? chars_.width
+                                              : chars_.full_res_width;
+    sensor_->CaptureRaw(img, width * 2, gain_, chars_, in_sensor_zoom,
+                        binned);
+  }
+
+  status_t RemosaicRAW16Image(uint16_t* img_in, uint16_t* img_out) {
+    return EmulatedSensor::RemosaicRAW16Image(
+        img_in, img_out, chars_.full_res_width * 2, chars_);
+  }
+
+  void CaptureRGBA(uint8_t* img, int32_t color_space) {
+    sensor_->CaptureRGB(img, chars_.width, chars_.height, chars_.width * 4,
+                        EmulatedSensor::RGBA, gain_,
+                        GetColorPipeline(color_space), chars_);
+  }
+
+  void CaptureYUV420(uint8_t* img, int32_t color_space) {
+    sensor_->CaptureYUV420(GetNV21Planes(img), chars_.width, chars_.height,
+                           gain_, /*zoom_ratio=*/1.0f, /*rotate=*/false,
+                           GetColorPipeline(color_space), chars_);
+  }
+
+  status_t ProcessYUV420(uint8_t* img) {
+    EmulatedSensor::YUV420Frame output = {
+        .width = static_cast<uint32_t>(chars_.width),
+        .height = static_cast<uint32_t>(chars_.height),
+        .planes = GetNV21Planes(img)};
+    return sensor_->ProcessYUV420(
+        /*input=*/{}, output, gain_, EmulatedSensor::REGULAR,
+        /*zoom_ratio=*/1.0f, /*rotate_and_crop=*/false,
+        GetColorPipeline(
+            ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_UNSPECIFIED),
+        chars_);
+  }
+
+  void CaptureDepth(uint8_t* img) {
+    sensor_->CaptureDepth(img, gain_, chars_.width, chars_.height,
+                          chars_.width * 2, chars_);
+  }
+
+  void RgbToRgb(const uint32_t* rgb_in, uint32_t* rgb_out, size_t num_pixels,
+                int32_t color_space) {
+    const ColorPipeline& color_pipeline = GetColorPipeline(color_space);
+    for (size_t i = 0; i < num_pixels * 3; i += 3) {
+      uint32_t r = rgb_in[i], g = rgb_in[i + 1], b = rgb_in[i + 2];
+      EmulatedSensor::RgbToRgb(color_pipeline, &r, &g, &b);
+      rgb_out[i] = r;
+      rgb_out[i + 1] = g;
+      rgb_out[i + 2] = b;
+    }
+  }
+
+ private:
+  // The scene is only loaded by the emulator and is black otherwise, so a
+  // fixed pattern stands in for it.
+  static void FillScene() {
+    static constexpr size_t kBmpHeaderSize = 54;
+    static constexpr size_t kRowSize = EmulatedScene::kSceneWidth * 3;
+    for (size_t i = 0; i < kRowSize * EmulatedScene::kSceneHeight; i++) {
+      EmulatedScene::kScene[kBmpHeaderSize + i] =
+          static_cast<uint8_t>((i * 13) ^ (i / kRowSize));
+    }
+  }
+
+  // Baked on first use and then reused, as by the sensor thread.
+  const ColorPipeline& GetColorPipeline(int32_t color_space) {
+    return sensor_->GetColorPipeline(/*camera_id=*/0, color_space, chars_);
+  }
+
+  YCbCrPlanes GetNV21Planes(uint8_t* img) {
+    uint8_t* img_cr = img + chars_.width * chars_.height;
+    return {.img_y = img,
+            .img_cb = img_cr + 1,
+            .img_cr = img_cr,
+            .y_stride = static_cast<uint32_t>(chars_.width),
+            .cbcr_stride = static_cast<uint32_t>(chars_.width),
+            .cbcr_step = 2};
+  }
+
+  const SensorCharacteristics chars_;
+  const uint32_t gain_ = EmulatedSensor::kDefaultSensitivity;
+  sp<EmulatedSensor> sensor_;
+};
+
+namespace {
+
+struct SensorConfig {
+  const char* name;
+  size_t width;
+  size_t height;
+  size_t full_res_width;
+  size_t full_res_height;
+  bool quad_bayer_sensor;
+};
+
+const SensorConfig kSensorConfigs[] = {
+    {"VGA", 640, 480, 640, 480, false},
+    {"1080p", 1920, 1080, 1920, 1080, false},
+    {"12MP", 4032, 3024, 4032, 3024, false},
+    {"48MP_quad_bayer", 4032, 3024, 8064, 6048, true},
+};
+
+struct KernelCase {
+  std::string name;
+  EmulatedSensorBenchmark* sensor = nullptr;
+  size_t num_pixels = 0;
+  size_t output_size = 0;
+  // Runs the kernel once, writing output_size bytes to output.
+  std::function<status_t(uint8_t* output)> run;
+  bool has_checksum = false;
+  uint64_t checksum = 0;
+};
+
+// FNV-1a
+uint64_t GetChecksum(const uint8_t* data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+void BM_Kernel(benchmark::State& state, KernelCase* kernel) {
+  std::vector<uint8_t> output(kernel->output_size);
+  if (!kernel->has_checksum) {
+    kernel->sensor->ResetNoise();
+    if (kernel->run(output.data()) != OK) {
+      state.SkipWithError("Running the kernel failed.");
+      return;
+    }
+    kernel->checksum = GetChecksum(output.data(), output.size());
+    kernel->has_checksum = true;
+  }
+
+  for (auto _ : state) {
+    kernel->run(output.data());
+    benchmark::ClobberMemory();
+  }
+
+  char label[32];
+  snprintf(label, sizeof(label), "checksum=%016" PRIx64, kernel->checksum);
+  state.SetLabel(label);
+  state.SetBytesProcessed(state.iterations() * kernel->output_size);
+  state.counters["time_per_pixel"] = benchmark::Counter(
+      kernel->num_pixels, benchmark::Counter::kIsIterationInvariantRate |
+                              benchmark::Counter::kInvert);
+}
+
+SensorCharacteristics GetCharacteristics(const SensorConfig& config) {
+  SensorCharacteristics chars;
+  chars.width = config.width;
+  chars.height = config.height;
+  chars.full_res_width = config.full_res_width;
+  chars.full_res_height = config.full_res_height;
+  chars.quad_bayer_sensor = config.quad_bayer_sensor;
+  chars.max_raw_value = EmulatedSensor::kDefaultMaxRawValue;
+  std::copy(std::begin(EmulatedSensor::kDefaultBlackLevelPattern),
+            std::end(EmulatedSensor::kDefaultBlackLevelPattern),
+            chars.black_level_pattern);
+  return chars;
+}
+
+// Add the kernels for one sensor configuration to kernels.
+void AddKernelCases(const SensorConfig& config,
+                    EmulatedSensorBenchmark* sensor,
+                    std::vector<std::unique_ptr<KernelCase>>* kernels) {
+  const SensorCharacteristics& chars = sensor->GetCharacteristics();
+  size_t num_pixels = chars.width * chars.height;
+  size_t num_full_res_pixels = chars.full_res_width * chars.full_res_height;
+  auto add = [&](const std::string& kernel_name, size_t kernel_pixels,
+                 size_t output_size,
+                 std::function<status_t(uint8_t*)> run) {
+    auto kernel = std::make_unique<KernelCase>();
+    kernel->name = kernel_name + "/" + config.name;
+    kernel->sensor = sensor;
+    kernel->num_pixels = kernel_pixels;
+    kernel->output_size = output_size;
+    kernel->run = std::move(run);
+    kernels->push_back(std::move(kernel));
+  };
+
+  if (config.quad_bayer_sensor) {
+    add("CaptureRaw/binned", num_pixels, num_pixels * 2, [=](uint8_t* img) {
+      sensor->CaptureRaw(img, /*in_sensor_zoom=*/false, /*binned=*/true);
+      return OK;
+    });
+    add("CaptureRaw/in_sensor_zoom", num_pixels, num_pixels * 2,
+        [=](uint8_t* img) {
+          sensor->CaptureRaw(img, /*in_sensor_zoom=*/true, /*binned=*/false);
+          return OK;
+        });
+
+    // The input is a full resolution capture, made once.
+    auto raw_input = std::make_shared<std::vector<uint16_t>>();
+    add("RemosaicRAW16Image", num_full_res_pixels, num_full_res_pixels * 2,
+        [=](uint8_t* img) {
+          if (raw_input->empty()) {
+            raw_input->resize(num_full_res_pixels);
+            sensor->ResetNoise();
+            sensor->CaptureRaw(reinterpret_cast<uint8_t*>(raw_input->data()),
+                               /*in_sensor_zoom=*/false, /*binned=*/false);
+          }
+          return sensor->RemosaicRAW16Image(raw_input->data(),
+                                            reinterpret_cast<uint16_t*>(img));
+        });
+  }
+  add("CaptureRaw/full_res", num_full_res_pixels, num_full_res_pixels * 2,
+      [=](uint8_t* img) {
+        sensor->CaptureRaw(img, /*in_sensor_zoom=*/false, /*binned=*/false);
+        return OK;
+      });
+
+  std::pair<const char*, int32_t> color_spaces[] = {
+      {"unspecified",
+       ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_UNSPECIFIED},
+      {"srgb", ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_SRGB},
+      {"display_p3",
+       ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_DISPLAY_P3},
+      {"bt2020_hlg",
+       ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_BT2020_HLG}};
+  for (auto& entry : color_spaces) {
+    std::string suffix = std::string("/") + entry.first;
+    int32_t color_space = entry.second;
+    add("CaptureYUV420" + suffix, num_pixels, num_pixels * 3 / 2,
+        [=](uint8_t* img) {
+          sensor->CaptureYUV420(img, color_space);
+          return OK;
+        });
+    add("CaptureRGBA" + suffix, num_pixels, num_pixels * 4,
+        [=](uint8_t* img) {
+          sensor->CaptureRGBA(img, color_space);
+          return OK;
+        });
+  }
+
+  add("ProcessYUV420/regular", num_pixels, num_pixels * 3 / 2,
+      [=](uint8_t* img) { return sensor->ProcessYUV420(img); });
+  add("CaptureDepth", num_pixels, num_pixels * 2, [=](uint8_t* img) {
+    sensor->CaptureDepth(img);
+    return OK;
+  });
+
+  // Converts a ramp of linear RGB values. The ramp is made once, by the untimed
+  // run that records the checksum.
+  auto rgb_ramp = std::make_shared<std::vector<uint32_t>>();
+  add("RgbToRgb/display_p3", num_pixels, num_pixels * 3 * sizeof(uint32_t),
+      [=](uint8_t* img) {
+        if (rgb_ramp->empty()) {
+          rgb_ramp->resize(num_pixels * 3);
+          for (size_t i = 0; i < rgb_ramp->size(); i++) {
+            (*rgb_ramp)[i] = i % EmulatedSensorBenchmark::GetSaturationPoint();
+          }
+        }
+        sensor->RgbToRgb(
+            rgb_ramp->data(), reinterpret_cast<uint32_t*>(img), num_pixels,
+            ANDROID_REQUEST_AVAILABLE_COLOR_SPACE_PROFILES_MAP_DISPLAY_P3);
+        return OK;
+      });
+}
+
+bool ReadGoldenFile(const std::string& path,
+                    std::map<std::string, uint64_t>* checksums,
+                    std::vector<std::string>* notes) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (line[0] == '#') {
+      notes->push_back(line);
+      continue;
+    }
+    std::istringstream entry(line);
+    std::string name;
+    std::string checksum;
+    if (entry >> name >> checksum) {
+      (*checksums)[name] = strtoull(checksum.c_str(), nullptr, 16);
+    }
+  }
+  return true;
+}
+
+}  // namespace
+}  // namespace android
+
+int main(int argc, char** argv) {
+  using namespace android;
+
+  benchmark::Initialize(&argc, argv);
+
+  std::string golden_file;
+  bool update_golden = false;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--golden_file=", 14) == 0) {
+      golden_file = argv[i] + 14;
+    } else if (strcmp(argv[i], "--update_golden") == 0) {
+      update_golden = true;
+    } else {
+      fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::vector<std::unique_ptr<EmulatedSensorBenchmark>> sensors;
+  std::vector<std::unique_ptr<KernelCase>> kernels;
+  for (const auto& config : kSensorConfigs) {
+    sensors.push_back(
+        std::make_unique<EmulatedSensorBenchmark>(GetCharacteristics(config)));
+    AddKernelCases(config, sensors.back().get(), &kernels);
+  }
+  for (auto& kernel : kernels) {
+    benchmark::RegisterBenchmark(kernel->name.c_str(), BM_Kernel, kernel.get())
+        ->Unit(benchmark::kMillisecond);
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  if (golden_file.empty()) {
+    return 0;
+  }
+
+  // Checksums of kernels that didn't run are kept when updating.
+  std::map<std::string, uint64_t> golden_checksums;
+  std::vector<std::string> golden_notes;
+  if (!ReadGoldenFile(golden_file, &golden_checksums, &golden_notes) &&
+      !update_golden) {
+    fprintf(stderr, "Cannot read %s\n", golden_file.c_str());
+    return 1;
+  }
+
+  int mismatches = 0;
+  for (auto& kernel : kernels) {
+    if (!kernel->has_checksum) {
+      continue;
+    }
+    if (update_golden) {
+      golden_checksums[kernel->name] = kernel->checksum;
+      continue;
+    }
+    auto golden = golden_checksums.find(kernel->name);
+    if (golden == golden_checksums.end()) {
+      fprintf(stderr, "%s: no golden checksum, run with --update_golden\n",
+              kernel->name.c_str());
+      mismatches++;
+    } else if (golden->second != kernel->checksum) {
+      fprintf(stderr, "%s: checksum %016" PRIx64 " differs from golden %016"
+              PRIx64 "\n", kernel->name.c_str(), kernel->checksum,
+              golden->second);
+      mismatches++;
+    }
+  }
+
+  if (update_golden) {
+    FILE* file = fopen(golden_file.c_str(), "w");
+    if (file == nullptr) {
+      fprintf(stderr, "Cannot write %s\n", golden_file.c_str());
+      return 1;
+    }
+    for (auto& note : golden_notes) {
+      fprintf(file, "%s\n", note.c_str());
+    }
+    for (auto& [name, checksum] : golden_checksums) {
+      fprintf(file, "%s %016" PRIx64 "\n", name.c_str(), checksum);
+    }
+    fclose(file);
+  }
+
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the latency of stream combination queries on the camera
+// configurations bundled with the device (emu_camera_*.json).
+//
+// Warm queries cycle through a few configurations that stay cached. Cold
+// queries cycle through more distinct configurations than the cache holds,
+// so that every query is checked against the stream configuration maps.
+
+#define LOG_TAG "StreamCombinationBenchmark"
+#include <benchmark/benchmark.h>
+#include <camera_device_hwl.h>
+#include <camera_provider_hwl.h>
+#include <hal_camera_metadata.h>
+#include <log/log.h>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "utils/StreamCombinationCache.h"
+
+extern "C" android::google_camera_hal::CameraProviderHwl*
+CreateCameraProviderHwl();
+
+namespace android {
+namespace {
+
+using google_camera_hal::CameraDeviceHwl;
+using google_camera_hal::CameraIdAndStreamConfiguration;
+using google_camera_hal::CameraProviderHwl;
+using google_camera_hal::HalCameraMetadata;
+using google_camera_hal::Stream;
+using google_camera_hal::StreamConfigurationMode;
+using google_camera_hal::StreamType;
+
+// Number of configurations that stay in the cache.
+constexpr size_t kNumWarmConfigs = 8;
+
+struct CameraConfigs {
+  uint32_t camera_id = 0;
+  std::unique_ptr<CameraDeviceHwl> device;
+  std::vector<StreamConfiguration> configs;
+};
+
+std::vector<std::pair<uint32_t, uint32_t>> GetOutputSizes(
+    const HalCameraMetadata& characteristics, int32_t format) {
+  std::set<std::pair<uint32_t, uint32_t>> sizes;
+  camera_metadata_ro_entry entry = {};
+  if (characteristics.Get(ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS,
+                          &entry) != OK) {
+    return {};
+  }
+  for (size_t i = 0; i + 3 < entry.count; i += 4) {
+    if (entry.data.i32[i] == format &&
+        entry.data.i32[i + 3] ==
+            ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT) {
+      sizes.emplace(entry.data.i32[i + 1], entry.data.i32[i + 2]);
+    }
+  }
+  return {sizes.begin(), sizes.end()};
+}
+
+Stream GetStream(int32_t id, android_pixel_format_t format,
+                 const std::pair<uint32_t, uint32_t>& size) {
+  Stream stream;
+  stream.id = id;
+  stream.stream_type = StreamType::kOutput;
+  stream.format = format;
+  stream.width = size.first;
+  stream.height = size.second;
+  stream.data_space = format == HAL_PIXEL_FORMAT_BLOB ? HAL_DATASPACE_V0_JFIF
+                                                      : HAL_DATASPACE_UNKNOWN;
+  return stream;
+}
+
+// Return preview + YUV + JPEG configurations over all supported sizes, the
+// typical queries of an app setting up a session.
+std::vector<StreamConfiguration> GetStreamConfigurations(
+    const HalCameraMetadata& characteristics) {
+  auto priv_sizes = GetOutputSizes(characteristics,
+                                   HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED);
+  auto yuv_sizes =
+      GetOutputSizes(characteristics, HAL_PIXEL_FORMAT_YCBCR_420_888);
+  auto blob_sizes = GetOutputSizes(characteristics, HAL_PIXEL_FORMAT_BLOB);
+
+  std::vector<StreamConfiguration> configs;
+  for (const auto& priv_size : priv_sizes) {
+    for (const auto& yuv_size : yuv_sizes) {
+      for (const auto& blob_size : blob_sizes) {
+        StreamConfiguration config;
+        config.operation_mode = StreamConfigurationMode::kNormal;
+        config.streams.push_back(GetStream(
+            0, HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED, priv_size));
+        config.streams.push_back(
+            GetStream(1, HAL_PIXEL_FORMAT_YCBCR_420_888, yuv_size));
+        config.streams.push_back(
+            GetStream(2, HAL_PIXEL_FORMAT_BLOB, blob_size));
+        configs.push_back(std::move(config));
+      }
+    }
+  }
+  return configs;
+}
+
+void BM_IsStreamCombinationSupported(benchmark::State& state,
+                                     CameraConfigs* camera,
+                                     size_t num_configs) {
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(camera->device->IsStreamCombinationSupported(
+        camera->configs[i], /*check_settings=*/false));
+    i = (i + 1) % num_configs;
+  }
+}
+
+void BM_IsConcurrentStreamCombinationSupported(benchmark::State& state,
+                                               CameraProviderHwl* provider,
+                                               CameraConfigs* camera,
+                                               size_t num_configs) {
+  std::vector<CameraIdAndStreamConfiguration> configs(1);
+  configs[0].camera_id = camera->camera_id;
+  size_t i = 0;
+  for (auto _ : state) {
+    configs[0].stream_configuration.streams = camera->configs[i].streams;
+    configs[0].stream_configuration.operation_mode =
+        camera->configs[i].operation_mode;
+    bool is_supported = false;
+    provider->IsConcurrentStreamCombinationSupported(configs, &is_supported);
+    benchmark::DoNotOptimize(is_supported);
+    i = (i + 1) % num_configs;
+  }
+}
+
+}  // namespace
+}  // namespace android
+
+int main(int argc, char** argv) {
+  using namespace android;
+
+  benchmark::Initialize(&argc, argv);
+
+  std::unique_ptr<CameraProviderHwl> provider(CreateCameraProviderHwl());
+  if (provider == nullptr) {
+    ALOGE("%s: Creating the camera provider HWL failed.", __FUNCTION__);
+    return 1;
+  }
+
+  std::vector<uint32_t> camera_ids;
+  provider->GetVisibleCameraIds(&camera_ids);
+  std::vector<std::unique_ptr<CameraConfigs>> cameras;
+  for (uint32_t camera_id : camera_ids) {
+    auto camera = std::make_unique<CameraConfigs>();
+    camera->camera_id = camera_id;
+    std::unique_ptr<HalCameraMetadata> characteristics;
+    if (provider->CreateCameraDeviceHwl(camera_id, &camera->device) != OK ||
+        camera->device->GetCameraCharacteristics(&characteristics) != OK) {
+      ALOGE("%s: Getting camera %u failed.", __FUNCTION__, camera_id);
+      return 1;
+    }
+    camera->configs = GetStreamConfigurations(*characteristics);
+    if (camera->configs.empty()) {
+      continue;
+    }
+
+    // Cold queries need more distinct configurations than the cache holds.
+    size_t num_cold_configs = camera->configs.size();
+    bool has_cold_configs =
+        num_cold_configs > StreamCombinationCache::kDefaultCapacity;
+    size_t num_warm_configs = std::min(num_cold_configs, kNumWarmConfigs);
+    std::string name = "camera" + std::to_string(camera_id);
+
+    benchmark::RegisterBenchmark(
+        (name + "/IsStreamCombinationSupported/warm").c_str(),
+        BM_IsStreamCombinationSupported, camera.get(), num_warm_configs);
+    benchmark::RegisterBenchmark(
+        (name + "/IsConcurrentStreamCombinationSupported/warm").c_str(),
+        BM_IsConcurrentStreamCombinationSupported, provider.get(),
+        camera.get(), num_warm_configs);
+    if (has_cold_configs) {
+      benchmark::RegisterBenchmark(
+          (name + "/IsStreamCombinationSupported/cold").c_str(),
+          BM_IsStreamCombinationSupported, camera.get(), num_cold_configs);
+      benchmark::RegisterBenchmark(
+          (name + "/IsConcurrentStreamCombinationSupported/cold").c_str(),
+          BM_IsConcurrentStreamCombinationSupported, provider.get(),
+          camera.get(), num_cold_configs);
+    }
+    cameras.push_back(std::move(camera));
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
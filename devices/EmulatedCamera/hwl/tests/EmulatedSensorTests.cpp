@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EmulatedSensorTests"
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "EmulatedSensor.h"
+
+namespace android {
+
+using google_camera_hal::HalCameraMetadata;
+using google_camera_hal::HwlPipelineResult;
+using google_camera_hal::MessageType;
+using google_camera_hal::NotifyMessage;
+
+namespace {
+
+constexpr uint32_t kCameraId = 0;
+constexpr uint32_t kWidth = 320;
+constexpr uint32_t kHeight = 240;
+constexpr uint32_t kNumFrames = 5;
+
+SensorCharacteristics GetCharacteristics() {
+  SensorCharacteristics chars;
+  chars.width = kWidth;
+  chars.height = kHeight;
+  chars.full_res_width = kWidth;
+  chars.full_res_height = kHeight;
+  std::copy(std::begin(EmulatedSensor::kSupportedExposureTimeRange),
+            std::end(EmulatedSensor::kSupportedExposureTimeRange),
+            chars.exposure_time_range);
+  std::copy(std::begin(EmulatedSensor::kSupportedFrameDurationRange),
+            std::end(EmulatedSensor::kSupportedFrameDurationRange),
+            chars.frame_duration_range);
+  std::copy(std::begin(EmulatedSensor::kSupportedSensitivityRange),
+            std::end(EmulatedSensor::kSupportedSensitivityRange),
+            chars.sensitivity_range);
+  chars.max_raw_value = EmulatedSensor::kDefaultMaxRawValue;
+  std::copy(std::begin(EmulatedSensor::kDefaultBlackLevelPattern),
+            std::end(EmulatedSensor::kDefaultBlackLevelPattern),
+            chars.black_level_pattern);
+  chars.max_raw_streams = 1;
+  chars.max_processed_streams = 1;
+  return chars;
+}
+
+// Timestamps and output of a session on the virtual clock.
+struct Capture {
+  std::vector<nsecs_t> shutter_timestamps;
+  std::vector<nsecs_t> result_timestamps;
+  std::vector<std::vector<uint8_t>> raw_outputs;
+  std::vector<std::vector<uint8_t>> yuv_outputs;
+};
+
+// Run kNumFrames requests with a RAW16 and a YUV output on a new sensor with
+// the virtual clock enabled.
+void RunVirtualClockSession(Capture* capture) {
+  std::mutex lock;
+  std::condition_variable result_cv;
+  uint32_t num_results = 0;
+
+  HwlPipelineCallback callback = {
+      .process_pipeline_result =
+          [&](std::unique_ptr<HwlPipelineResult> result) {
+            camera_metadata_ro_entry_t entry;
+            ASSERT_EQ(result->result_metadata->Get(ANDROID_SENSOR_TIMESTAMP,
+                                                   &entry),
+                      OK);
+            std::lock_guard<std::mutex> l(lock);
+            capture->result_timestamps.push_back(entry.data.i64[0]);
+            num_results++;
+            result_cv.notify_one();
+          },
+      .process_pipeline_batch_result = nullptr,
+      .notify =
+          [&](uint32_t /*pipeline_id*/, const NotifyMessage& message) {
+            if (message.type == MessageType::kShutter) {
+              std::lock_guard<std::mutex> l(lock);
+              capture->shutter_timestamps.push_back(
+                  message.message.shutter.timestamp_ns);
+            }
+          },
+  };
+
+  sp<EmulatedSensor> sensor = new EmulatedSensor();
+  sensor->EnableVirtualClock();
+  auto logical_chars = std::make_unique<LogicalCharacteristics>();
+  logical_chars->emplace(kCameraId, GetCharacteristics());
+  ASSERT_EQ(sensor->StartUp(kCameraId, std::move(logical_chars)), OK);
+
+  capture->raw_outputs.assign(kNumFrames,
+                              std::vector<uint8_t>(kWidth * kHeight * 2));
+  capture->yuv_outputs.assign(kNumFrames,
+                              std::vector<uint8_t>(kWidth * kHeight * 3 / 2));
+  for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+    auto raw = std::make_unique<SensorBuffer>();
+    raw->width = kWidth;
+    raw->height = kHeight;
+    raw->frame_number = frame;
+    raw->camera_id = kCameraId;
+    raw->format = PixelFormat::RAW16;
+    raw->callback = callback;
+    raw->plane.img = {.img = capture->raw_outputs[frame].data(),
+                      .stride_in_bytes = kWidth * 2,
+                      .buffer_size = kWidth * kHeight * 2};
+
+    auto yuv = std::make_unique<SensorBuffer>();
+    uint8_t* img_y = capture->yuv_outputs[frame].data();
+    uint8_t* img_cr = img_y + kWidth * kHeight;
+    yuv->width = kWidth;
+    yuv->height = kHeight;
+    yuv->frame_number = frame;
+    yuv->camera_id = kCameraId;
+    yuv->format = PixelFormat::YCRCB_420_SP;
+    yuv->callback = callback;
+    yuv->plane.img_y_crcb = {.img_y = img_y,
+                             .img_cb = img_cr + 1,
+                             .img_cr = img_cr,
+                             .y_stride = kWidth,
+                             .cbcr_stride = kWidth,
+                             .cbcr_step = 2};
+
+    auto output_buffers = std::make_unique<Buffers>();
+    output_buffers->push_back(std::move(raw));
+    output_buffers->push_back(std::move(yuv));
+
+    auto result = std::make_unique<HwlPipelineResult>();
+    result->camera_id = kCameraId;
+    result->frame_number = frame;
+    result->result_metadata = HalCameraMetadata::Create(1, 10);
+
+    EmulatedSensor::SensorSettings settings;
+    settings.exposure_time = EmulatedSensor::kDefaultExposureTime;
+    settings.frame_duration = EmulatedSensor::kDefaultFrameDuration;
+    settings.gain = EmulatedSensor::kDefaultSensitivity;
+    auto logical_settings =
+        std::make_unique<EmulatedSensor::LogicalCameraSettings>();
+    logical_settings->emplace(kCameraId, settings);
+
+    sensor->SetCurrentRequest(std::move(logical_settings), std::move(result),
+                              /*partial_result=*/nullptr,
+                              /*input_buffers=*/nullptr,
+                              std::move(output_buffers));
+
+    // Wait for the result before the next request replaces this one.
+    std::unique_lock<std::mutex> l(lock);
+    ASSERT_TRUE(result_cv.wait_for(l, std::chrono::seconds(5),
+                                   [&] { return num_results > frame; }));
+  }
+
+  EXPECT_EQ(sensor->ShutDown(), OK);
+}
+
+// A RAW16 image of random pixels. RemosaicQuadBayerBlock() reads and writes
+// the partial blocks at the right and bottom edges as whole blocks, so the
+// rows are padded and there are spare rows at the bottom.
+std::vector<uint16_t> CreateRandomRaw16Image(size_t row_stride, size_t height,
+                                             std::mt19937* rng) {
+  std::vector<uint16_t> img(row_stride * (height + 4));
+  for (auto& pixel : img) {
+    pixel = (*rng)() & 0xffff;
+  }
+  return img;
+}
+
+}  // namespace
+
+TEST(EmulatedSensorTests, VirtualClockStartsAtNonzeroTime) {
+  Capture capture;
+  RunVirtualClockSession(&capture);
+  ASSERT_EQ(capture.shutter_timestamps.size(), kNumFrames);
+  ASSERT_EQ(capture.result_timestamps.size(), kNumFrames);
+
+  // Each frame advances the virtual clock by its frame duration.
+  for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+    EXPECT_EQ(capture.shutter_timestamps[frame],
+              EmulatedSensor::kVirtualClockStartTime +
+                  (frame + 1) * EmulatedSensor::kDefaultFrameDuration);
+    EXPECT_EQ(capture.result_timestamps[frame],
+              capture.shutter_timestamps[frame]);
+  }
+}
+
+TEST(EmulatedSensorTests, VirtualClockSessionsAreReproducible) {
+  Capture first;
+  RunVirtualClockSession(&first);
+  Capture second;
+  RunVirtualClockSession(&second);
+
+  EXPECT_EQ(first.shutter_timestamps, second.shutter_timestamps);
+  EXPECT_EQ(first.result_timestamps, second.result_timestamps);
+  for (uint32_t frame = 0; frame < kNumFrames; frame++) {
+    EXPECT_EQ(first.raw_outputs[frame], second.raw_outputs[frame])
+        << "RAW16 output of frame " << frame << " differs";
+    EXPECT_EQ(first.yuv_outputs[frame], second.yuv_outputs[frame])
+        << "YUV output of frame " << frame << " differs";
+  }
+
+  // Each frame has its own noise seed and scene time.
+  EXPECT_NE(first.raw_outputs[0], first.raw_outputs[1]);
+}
+
+// Gives the tests access to the kernels of EmulatedSensor.
+class EmulatedSensorKernelTests : public ::testing::Test {
+ protected:
+  // Rows of an image that is remosaiced by all threads.
+  static size_t GetRemosaicThreadRows() {
+    return EmulatedSensor::kMaxRemosaicThreads *
+           EmulatedSensor::kMinRemosaicRowsPerThread;
+  }
+
+  // Remosaic all blocks of an image one at a time, as
+  // EmulatedSensor::RemosaicRAW16Image() did before it used
+  // RemosaicQuadBayerBand().
+  static void RemosaicByBlock(uint16_t* img_in, uint16_t* img_out,
+                              size_t row_stride, size_t width,
+                              size_t height) {
+    for (size_t x = 0; x < width; x += 4) {
+      for (size_t y = 0; y < height; y += 4) {
+        EmulatedSensor::RemosaicQuadBayerBlock(img_in, img_out, x, y,
+                                               row_stride * 2);
+      }
+    }
+  }
+
+  static void RemosaicQuadBayerBand(const uint16_t* img_in, uint16_t* img_out,
+                                    size_t row_stride, size_t width,
+                                    size_t ystart, size_t yend) {
+    EmulatedSensor::RemosaicQuadBayerBand(img_in, img_out, row_stride, width,
+                                          ystart, yend);
+  }
+
+  static status_t RemosaicRAW16Image(uint16_t* img_in, uint16_t* img_out,
+                                     size_t row_stride, size_t width,
+                                     size_t height) {
+    SensorCharacteristics chars;
+    chars.full_res_width = width;
+    chars.full_res_height = height;
+    chars.quad_bayer_sensor = true;
+    return EmulatedSensor::RemosaicRAW16Image(img_in, img_out, row_stride * 2,
+                                              chars);
+  }
+
+  static std::vector<int32_t> GetWideColorSpaces() {
+    return {EmulatedSensor::DISPLAY_P3, EmulatedSensor::BT2020};
+  }
+
+  // Check the fixed point conversion of a color pipeline against the float
+  // matrix it was baked from, as EmulatedSensor::RgbToRgb() computed it
+  // before it used fixed point.
+  static void ExpectRgbToRgbMatchesFloat(int32_t color_space) {
+    SensorCharacteristics chars = GetCharacteristics();
+    sp<EmulatedSensor> sensor = new EmulatedSensor();
+    const ColorPipeline& color_pipeline =
+        sensor->GetColorPipeline(kCameraId, color_space, chars);
+    ASSERT_TRUE(color_pipeline.convert_rgb);
+    RgbRgbMatrix matrix =
+        EmulatedSensor::CalculateRgbRgbMatrix(color_space, chars);
+
+    const uint32_t max = EmulatedSensor::kSaturationPoint;
+    for (uint32_t i = 0; i <= max; i++) {
+      for (auto [r, g, b] : {std::make_tuple(i, i, i),
+                             std::make_tuple(i, max - i, i / 2)}) {
+        uint32_t expected[3] = {
+            (uint32_t)std::max(r * matrix.rR + g * matrix.gR + b * matrix.bR,
+                               0.0f),
+            (uint32_t)std::max(r * matrix.rG + g * matrix.gG + b * matrix.bG,
+                               0.0f),
+            (uint32_t)std::max(r * matrix.rB + g * matrix.gB + b * matrix.bB,
+                               0.0f)};
+        uint32_t actual[3] = {r, g, b};
+        EmulatedSensor::RgbToRgb(color_pipeline, &actual[0], &actual[1],
+                                 &actual[2]);
+        for (size_t c = 0; c < 3; c++) {
+          ASSERT_LE(std::abs((int64_t)actual[c] - (int64_t)expected[c]), 1)
+              << "color space " << color_space << ", channel " << c
+              << ", input " << r << "," << g << "," << b;
+        }
+      }
+    }
+  }
+};
+
+// Widths and heights that are and aren't multiples of 4.
+constexpr std::pair<size_t, size_t> kRemosaicSizes[] = {
+    {16, 8}, {18, 8}, {16, 10}, {22, 14}, {4, 2}, {2, 4}};
+
+TEST_F(EmulatedSensorKernelTests, RemosaicQuadBayerBandMatchesBlocks) {
+  std::mt19937 rng(1);
+  for (auto [width, height] : kRemosaicSizes) {
+    size_t row_stride = width + 4;
+    std::vector<uint16_t> input = CreateRandomRaw16Image(row_stride, height,
+                                                         &rng);
+    size_t block_rows = height / 4 * 4;
+    std::vector<uint16_t> expected(input.size());
+    RemosaicByBlock(input.data(), expected.data(), row_stride, width,
+                    block_rows);
+    std::vector<uint16_t> output(input.size());
+    RemosaicQuadBayerBand(input.data(), output.data(), row_stride, width,
+                          /*ystart=*/0, block_rows);
+    EXPECT_EQ(output, expected) << width << "x" << height;
+  }
+}
+
+TEST_F(EmulatedSensorKernelTests, RemosaicRAW16ImageMatchesBlocks) {
+  std::mt19937 rng(2);
+  std::vector<std::pair<size_t, size_t>> sizes(std::begin(kRemosaicSizes),
+                                               std::end(kRemosaicSizes));
+  // Tall enough to be split across threads.
+  sizes.push_back({20, GetRemosaicThreadRows()});
+  sizes.push_back({18, GetRemosaicThreadRows() + 2});
+  for (auto [width, height] : sizes) {
+    size_t row_stride = width + 4;
+    std::vector<uint16_t> input = CreateRandomRaw16Image(row_stride, height,
+                                                         &rng);
+    std::vector<uint16_t> expected(input.size());
+    RemosaicByBlock(input.data(), expected.data(), row_stride, width, height);
+    std::vector<uint16_t> output(input.size());
+    ASSERT_EQ(RemosaicRAW16Image(input.data(), output.data(), row_stride,
+                                 width, height),
+              OK);
+    EXPECT_EQ(output, expected) << width << "x" << height;
+  }
+}
+
+TEST_F(EmulatedSensorKernelTests, RgbToRgbMatchesFloatMatrix) {
+  for (int32_t color_space : GetWideColorSpaces()) {
+    ExpectRgbToRgbMatchesFloat(color_space);
+  }
+}
+
+}  // namespace android
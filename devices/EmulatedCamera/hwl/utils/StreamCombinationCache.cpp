@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StreamCombinationCache"
+#include "StreamCombinationCache.h"
+
+#include <log/log.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace android {
+
+using google_camera_hal::Stream;
+
+namespace {
+
+template <typename T>
+void AppendValue(std::string* key, T value) {
+  key->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+std::string GetStreamKey(const Stream& stream) {
+  std::string key;
+  AppendValue(&key, stream.stream_type);
+  AppendValue(&key, stream.format);
+  AppendValue(&key, stream.width);
+  AppendValue(&key, stream.height);
+  AppendValue(&key, stream.data_space);
+  AppendValue(&key, stream.rotation);
+  AppendValue(&key, stream.is_physical_camera_stream);
+  AppendValue(&key, stream.is_physical_camera_stream
+                        ? stream.physical_camera_id
+                        : uint32_t(0));
+  AppendValue(&key, stream.group_id != -1);
+  AppendValue(&key, stream.intended_for_max_resolution_mode);
+  AppendValue(&key, stream.intended_for_default_resolution_mode);
+  AppendValue(&key, stream.dynamic_profile);
+  AppendValue(&key, stream.use_case);
+  return key;
+}
+
+}  // namespace
+
+StreamCombinationCache::StreamCombinationCache(size_t capacity)
+    : capacity_(std::max(capacity, size_t(1))) {
+}
+
+std::string StreamCombinationCache::GetKey(uint32_t camera_id,
+                                           const StreamConfiguration& config) {
+  // The result doesn't depend on the order of the streams.
+  std::vector<std::string> stream_keys;
+  stream_keys.reserve(config.streams.size());
+  for (const auto& stream : config.streams) {
+    stream_keys.push_back(GetStreamKey(stream));
+  }
+  std::sort(stream_keys.begin(), stream_keys.end());
+
+  std::string key;
+  AppendValue(&key, camera_id);
+  AppendValue(&key, config.operation_mode);
+  for (const auto& stream_key : stream_keys) {
+    AppendValue(&key, static_cast<uint32_t>(stream_key.size()));
+    key += stream_key;
+  }
+  return key;
+}
+
+bool StreamCombinationCache::Get(const std::string& key, bool* is_supported) {
+  if (is_supported == nullptr) {
+    ALOGE("%s: is_supported is nullptr", __FUNCTION__);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  auto entry = entry_map_.find(key);
+  if (entry == entry_map_.end()) {
+    miss_count_++;
+    return false;
+  }
+
+  entries_.splice(entries_.begin(), entries_, entry->second);
+  *is_supported = entry->second->second;
+  hit_count_++;
+  return true;
+}
+
+void StreamCombinationCache::Put(const std::string& key, bool is_supported) {
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  auto entry = entry_map_.find(key);
+  if (entry != entry_map_.end()) {
+    entry->second->second = is_supported;
+    entries_.splice(entries_.begin(), entries_, entry->second);
+    return;
+  }
+
+  if (entries_.size() >= capacity_) {
+    entry_map_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  entries_.emplace_front(key, is_supported);
+  entry_map_.emplace(key, entries_.begin());
+}
+
+void StreamCombinationCache::Clear() {
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  entries_.clear();
+  entry_map_.clear();
+  hit_count_ = 0;
+  miss_count_ = 0;
+}
+
+size_t StreamCombinationCache::GetHitCount() const {
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  return hit_count_;
+}
+
+size_t StreamCombinationCache::GetMissCount() const {
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  return miss_count_;
+}
+
+}  // namespace android
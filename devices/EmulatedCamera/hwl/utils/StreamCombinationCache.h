@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EMULATOR_CAMERA_HAL_HWL_STREAM_COMBINATION_CACHE_H_
+#define EMULATOR_CAMERA_HAL_HWL_STREAM_COMBINATION_CACHE_H_
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "hal_types.h"
+
+namespace android {
+
+using google_camera_hal::StreamConfiguration;
+
+// StreamCombinationCache remembers the results of stream combination queries
+// in a least-recently-used cache. Configurations are canonicalized first so
+// that the same streams in a different order, or with different stream ids
+// and usages, share one entry. The results only depend on the static
+// metadata of a camera, so the cache can be shared by the provider and all
+// devices.
+// StreamCombinationCache is thread-safe.
+class StreamCombinationCache {
+ public:
+  static constexpr size_t kDefaultCapacity = 128;
+
+  explicit StreamCombinationCache(size_t capacity = kDefaultCapacity);
+
+  // Return the canonical key of a stream configuration of camera_id. Only the
+  // fields checked by EmulatedSensor::IsStreamCombinationSupported() are
+  // part of the key.
+  static std::string GetKey(uint32_t camera_id,
+                            const StreamConfiguration& config);
+
+  // Return true and the cached result in is_supported if key is cached.
+  bool Get(const std::string& key, bool* is_supported);
+
+  void Put(const std::string& key, bool is_supported);
+
+  void Clear();
+
+  size_t GetHitCount() const;
+  size_t GetMissCount() const;
+
+ private:
+  typedef std::list<std::pair<std::string, bool>> EntryList;
+
+  const size_t capacity_;
+
+  mutable std::mutex cache_lock_;
+
+  // Cached results, most recently used first. Protected by cache_lock_.
+  EntryList entries_;
+
+  // Map from a key to its entry in entries_. Protected by cache_lock_.
+  std::unordered_map<std::string, EntryList::iterator> entry_map_;
+
+  // Protected by cache_lock_.
+  size_t hit_count_ = 0;
+  size_t miss_count_ = 0;
+};
+
+}  // namespace android
+
+#endif  // EMULATOR_CAMERA_HAL_HWL_STREAM_COMBINATION_CACHE_H_